@@ -3,6 +3,11 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdalign.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * @file yapb.h
@@ -13,6 +18,10 @@
  *   - Data:   Each element = 1 byte type + value (network byte order)
  *   - For BLOB: type + 2 byte length + raw bytes
  *   - For NESTED_PKT: type + nested packet (with its own 4 byte header)
+ *   - For NESTED_REF: type + 4 byte offset, from the start of the enclosing
+ *     packet, of an earlier NESTED_PKT element with the same contents
+ *   - For TIMESTAMP_DELTA: type + zigzag LEB128 varint (1-10 bytes), the
+ *     difference to the first TIMESTAMP element of the same packet
  *
  * Error handling:
  *   YAPB uses sticky errors (like errno/OpenGL). Once an error occurs, all
@@ -61,7 +70,7 @@
  * @brief Element type tags stored in the wire format.
  *
  * Each element in a packet is prefixed with a one-byte type tag.
- * Tags 0x06-0x0D are reserved for future types.
+ * Tags 0x08-0x0C are reserved for future types.
  */
 typedef enum {
     YAPB_INT8   = 0x00, /**< Signed 8-bit integer (1 byte value). */
@@ -70,7 +79,10 @@ typedef enum {
     YAPB_INT64  = 0x03, /**< Signed 64-bit integer (8 byte value, network order). */
     YAPB_FLOAT  = 0x04, /**< IEEE 754 single-precision float (4 bytes, network order). */
     YAPB_DOUBLE = 0x05, /**< IEEE 754 double-precision float (8 bytes, network order). */
-    // 0x06-0x0D reserved for future types
+    YAPB_TIMESTAMP  = 0x06, /**< Nanoseconds since the epoch (8 bytes, network order). */
+    YAPB_TIMESTAMP_DELTA = 0x07, /**< Timestamp as a varint delta to the packet's first TIMESTAMP; pops as YAPB_TIMESTAMP. */
+    // 0x08-0x0C reserved for future types
+    YAPB_NESTED_REF = 0x0D, /**< Back-reference to an earlier nested packet (4 byte offset); pops as YAPB_NESTED_PKT. */
     YAPB_BLOB       = 0x0E, /**< Raw byte blob (2 byte length + N bytes). */
     YAPB_NESTED_PKT = 0x0F, /**< Nested packet (complete packet with its own header). */
 } YAPB_Type_t;
@@ -95,6 +107,9 @@ typedef enum {
  * has been consumed.
  */
 typedef enum {
+    YAPB_ERR_OUT_OF_RANGE     = -10, /**< A value cannot be represented in the wire format. */
+    YAPB_ERR_NOT_FOUND        = -9, /**< No entry matches the requested key. */
+    YAPB_ERR_IO               = -8, /**< A file or system call failed (see errno). */
     YAPB_ERR_NO_MORE_ELEMENTS = -7, /**< No more elements to pop. */
     YAPB_ERR_INVALID_PACKET   = -6, /**< Packet data is malformed. */
     YAPB_ERR_TYPE_MISMATCH    = -5, /**< Next element type doesn't match the pop call. */
@@ -106,9 +121,29 @@ typedef enum {
     YAPB_STS_COMPLETE         = 1,  /**< Success, last element consumed. */
 } YAPB_Result_t;
 
+/**
+ * @ingroup types
+ * @brief Handle layout revision; see YAPB_abi_version().
+ *
+ * Revision 2 uses a 24-byte packet handle (32 bytes for YAPB_Element_t),
+ * so arrays of cursors take half the cache they did. Define
+ * YAPB_COMPAT_HANDLES (CMake option of the same name) to build with the
+ * revision 1 layout of 0.1.x, for code that hard-codes its sizes. The
+ * library and every program using it must agree.
+ */
+#ifdef YAPB_COMPAT_HANDLES
+#define YAPB_ABI_VERSION 1
+#else
+#define YAPB_ABI_VERSION 2
+#endif
+
 /** @ingroup types
  *  @brief Size of the opaque YAPB_Packet_t storage in bytes. */
+#ifdef YAPB_COMPAT_HANDLES
 #define YAPB_PACKET_SIZE 48
+#else
+#define YAPB_PACKET_SIZE 24
+#endif
 
 /**
  * @ingroup types
@@ -117,7 +152,11 @@ typedef enum {
  * Internals are hidden; use YAPB_initialize() or YAPB_load() to set up.
  */
 typedef struct YAPB_Packet {
+#ifdef YAPB_COMPAT_HANDLES
     alignas(max_align_t) unsigned char _opaque[YAPB_PACKET_SIZE];
+#else
+    alignas(void *) unsigned char _opaque[YAPB_PACKET_SIZE];
+#endif
 } YAPB_Packet_t;
 
 /**
@@ -132,7 +171,7 @@ typedef struct YAPB_Element {
         int8_t   i8;     /**< Valid when type == YAPB_INT8. */
         int16_t  i16;    /**< Valid when type == YAPB_INT16. */
         int32_t  i32;    /**< Valid when type == YAPB_INT32. */
-        int64_t  i64;    /**< Valid when type == YAPB_INT64. */
+        int64_t  i64;    /**< Valid when type == YAPB_INT64 or YAPB_TIMESTAMP (nanoseconds). */
         float    f;      /**< Valid when type == YAPB_FLOAT. */
         double   d;      /**< Valid when type == YAPB_DOUBLE. */
         struct { const uint8_t *data; uint16_t len; } blob; /**< Valid when type == YAPB_BLOB. Pointer into packet buffer. */
@@ -257,6 +296,51 @@ YAPB_Result_t YAPB_push_blob(YAPB_Packet_t *pkt, const uint8_t *data, uint16_t l
  */
 YAPB_Result_t YAPB_push_nested(YAPB_Packet_t *pkt, const YAPB_Packet_t *nested);
 
+/**
+ * @ingroup push
+ * @brief Push a timestamp in nanoseconds since the epoch.
+ *
+ * Always written in full (TIMESTAMP, 8 bytes), so the packet's shape does
+ * not depend on the value. The packet's first timestamp is the base for
+ * YAPB_push_timestamp_delta().
+ *
+ * @param pkt Packet in write mode.
+ * @param ns  Nanoseconds since the epoch.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_push_timestamp(YAPB_Packet_t *pkt, const int64_t *ns);
+
+/**
+ * @ingroup push
+ * @brief Push a timestamp as a delta to the packet's first timestamp.
+ *
+ * Written as TIMESTAMP_DELTA, a zigzag varint of the difference to the
+ * packet's first TIMESTAMP: at most 4 bytes within 134 ms of it and 5
+ * within 17 s, instead of 8, but up to 10 for distant times. A packet
+ * without a timestamp yet gets this one in full, as its base. The tag
+ * depends only on the order of the calls, so packets built the same way
+ * share a shape; it differs from the shape with YAPB_push_timestamp(), and
+ * fixed plans (yapb_plan.h) cannot hold deltas.
+ *
+ * @param pkt Packet in write mode.
+ * @param ns  Nanoseconds since the epoch.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_push_timestamp_delta(YAPB_Packet_t *pkt, const int64_t *ns);
+
+/**
+ * @ingroup push
+ * @brief Push a timestamp given as a struct timespec (see
+ *        YAPB_push_timestamp()).
+ * @param pkt Packet in write mode.
+ * @param ts  Time since the epoch, with tv_nsec in [0, 1e9); representable
+ *            from the year 1677 to 2262.
+ * @return YAPB_OK on success, YAPB_ERR_OUT_OF_RANGE if @p ts is out of
+ *         that range or not normalized (nothing is pushed and the packet
+ *         stays usable), other error code otherwise.
+ */
+YAPB_Result_t YAPB_push_timespec(YAPB_Packet_t *pkt, const struct timespec *ts);
+
 /** @ingroup push
  *  @brief Push an unsigned 8-bit integer. */
 static inline YAPB_Result_t YAPB_push_u8(YAPB_Packet_t *pkt, const uint8_t *val) {
@@ -284,7 +368,8 @@ static inline YAPB_Result_t YAPB_push_u64(YAPB_Packet_t *pkt, const uint64_t *va
  *
  * Reads the type tag, then dispatches to the appropriate typed pop function.
  * The result is returned in a tagged union. This is useful for generic
- * iteration over packet contents.
+ * iteration over packet contents. A NESTED_REF element is returned as
+ * YAPB_NESTED_PKT with the packet it refers to.
  *
  * @param pkt Packet in read mode.
  * @param out Output: tagged union with type and value.
@@ -365,7 +450,8 @@ YAPB_Result_t YAPB_pop_blob(YAPB_Packet_t *pkt, const uint8_t **data, uint16_t *
  * @brief Pop a nested packet.
  *
  * The output packet is set up in read mode, pointing into the parent's
- * data buffer. The parent buffer must remain valid.
+ * data buffer. The parent buffer must remain valid. A NESTED_REF element
+ * pops as the earlier nested packet it refers to, without a copy.
  *
  * @param pkt Packet in read mode.
  * @param out Output: nested packet ready for reading (unchanged on error).
@@ -373,6 +459,25 @@ YAPB_Result_t YAPB_pop_blob(YAPB_Packet_t *pkt, const uint8_t **data, uint16_t *
  */
 YAPB_Result_t YAPB_pop_nested(YAPB_Packet_t *pkt, YAPB_Packet_t *out);
 
+/**
+ * @ingroup pop
+ * @brief Pop a timestamp (TIMESTAMP or TIMESTAMP_DELTA) in nanoseconds.
+ * @param pkt Packet in read mode.
+ * @param out Output value (unchanged on error).
+ * @return YAPB_OK, YAPB_STS_COMPLETE, or error code; a delta without an
+ *         earlier TIMESTAMP in the packet is YAPB_ERR_INVALID_PACKET.
+ */
+YAPB_Result_t YAPB_pop_timestamp(YAPB_Packet_t *pkt, int64_t *out);
+
+/**
+ * @ingroup pop
+ * @brief Pop a timestamp as a struct timespec (tv_nsec in [0, 1e9)).
+ * @param pkt Packet in read mode.
+ * @param out Output value (unchanged on error).
+ * @return As YAPB_pop_timestamp().
+ */
+YAPB_Result_t YAPB_pop_timespec(YAPB_Packet_t *pkt, struct timespec *out);
+
 /** @ingroup pop
  *  @brief Pop an unsigned 8-bit integer. */
 static inline YAPB_Result_t YAPB_pop_u8(YAPB_Packet_t *pkt, uint8_t *out) {
@@ -394,6 +499,21 @@ static inline YAPB_Result_t YAPB_pop_u64(YAPB_Packet_t *pkt, uint64_t *out) {
     return YAPB_pop_i64(pkt, (int64_t *)out);
 }
 
+/**
+ * @ingroup query
+ * @brief Get the handle layout revision the library was built with.
+ *
+ * Compare against YAPB_ABI_VERSION at startup to catch a program built
+ * with a different YAPB_COMPAT_HANDLES setting than the library:
+ *
+ * @code
+ *   if (YAPB_abi_version() != YAPB_ABI_VERSION) abort();
+ * @endcode
+ *
+ * @return The library's YAPB_ABI_VERSION.
+ */
+unsigned YAPB_abi_version(void);
+
 /**
  * @ingroup query
  * @brief Get the sticky error state of a packet.
@@ -454,3 +574,7 @@ const uint8_t *YAPB_get_buffer(const YAPB_Packet_t *pkt, size_t *out_len);
  * @return true if the buffer contains a complete packet, false otherwise.
  */
 bool YAPB_check_complete(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
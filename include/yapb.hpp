@@ -0,0 +1,1027 @@
+#pragma once
+#include "yapb.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * @file yapb.hpp
+ * @brief C++20 coroutine reader and writer for packet streams.
+ *
+ * Header-only layer over the C API for services that use coroutines. A
+ * stream_reader frames packets from a non-blocking file descriptor and
+ * hands them out without copying: each YAPB_Packet_t is loaded straight
+ * from the reader's receive buffer. next_batch() returns every packet that
+ * one read made complete, so a busy stream costs one resumption per read
+ * instead of one per packet. A stream_writer sends packets with one
+ * sendmsg()/writev() per batch, straight from the packet buffers.
+ *
+ * Coroutines suspend on an executor when the descriptor is not ready. The
+ * executor interface is small, so an application event loop can provide
+ * one; epoll_executor is a ready-made single-threaded one.
+ *
+ * @code
+ *   yapb::task<void> session(yapb::executor &ex, int fd) {
+ *       std::vector<uint8_t> rx(1 << 20);
+ *       yapb::stream_reader in(ex, fd, rx);
+ *       yapb::stream_writer out(ex, fd);
+ *       YAPB_Packet_t batch[64];
+ *       size_t n;
+ *       while (co_await in.next_batch(batch, n) == YAPB_OK) {
+ *           for (size_t i = 0; i < n; i++) handle(batch[i]);
+ *           co_await out.send(reply);
+ *       }
+ *   }
+ *
+ *   yapb::epoll_executor ex;
+ *   ex.spawn(session(ex, fd));   // one coroutine per connection
+ *   ex.run();
+ * @endcode
+ *
+ * packet_view is a forward range over the elements of a packet. Its
+ * elements are views into the packet bytes: blobs as spans or string
+ * views, and nested packets as packet_views of their own. Iterating copies
+ * no handles and no values.
+ *
+ * @code
+ *   for (yapb::element e : yapb::packet_view(pkt)) {
+ *       if (e.type() == YAPB_BLOB) use(e.str());
+ *   }
+ *   auto n = std::ranges::count_if(yapb::packet_view(pkt), &yapb::element::is_integer);
+ * @endcode
+ *
+ * lazy_packet gives typed, named access to messages with a known layout,
+ * decoding only the fields a handler reads.
+ *
+ * Errors are returned as YAPB_Result_t, as in the C API. Exceptions thrown
+ * inside a task are rethrown to the coroutine that awaits it.
+ */
+
+/** @defgroup cpp C++ Interface
+ *  Element ranges and awaitable packet streams for C++20.
+ */
+
+namespace yapb {
+
+/* ======== Element ranges ======== */
+
+namespace detail {
+
+inline uint16_t load_be16(const uint8_t *p) noexcept {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+inline uint32_t load_be32(const uint8_t *p) noexcept {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline uint64_t load_be64(const uint8_t *p) noexcept {
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+// Value sizes of fixed-size tags (a NESTED_REF's is its offset); 0 for
+// reserved tags
+inline constexpr uint8_t fixed_sizes[YAPB_BLOB] = { 1, 2, 4, 8, 4, 8, 8, 0, 0, 0, 0, 0, 0, 4 };
+
+// Size of the element at p (tag included), 0 if malformed or past end
+inline size_t element_span(const uint8_t *p, const uint8_t *end) noexcept {
+    if (p >= end) return 0;
+    size_t avail = (size_t)(end - p) - 1;
+    size_t len;
+    if (p[0] == YAPB_TIMESTAMP_DELTA) {
+        // LEB128 varint of at most 10 bytes
+        for (len = 1; len <= avail && len <= 10; len++) {
+            if ((p[len] & 0x80) == 0) return (len == 10 && p[len] > 1) ? 0 : len + 1;
+        }
+        return 0;
+    } else if (p[0] < YAPB_BLOB) {
+        len = fixed_sizes[p[0]];
+        if (len == 0) return 0;
+    } else if (p[0] == YAPB_BLOB) {
+        if (avail < 2) return 0;
+        len = 2 + (size_t)load_be16(p + 1);
+    } else if (p[0] == YAPB_NESTED_PKT) {
+        if (avail < YAPB_HEADER_SIZE) return 0;
+        len = load_be32(p + 1);
+        if (len < YAPB_HEADER_SIZE) return 0;
+    } else {
+        return 0;
+    }
+    return len <= avail ? len + 1 : 0;
+}
+
+// Nested packet the NESTED_REF element at p points back at, in the packet
+// starting at pkt; empty unless it is a nested packet ending before p
+inline std::span<const uint8_t> ref_target(const uint8_t *pkt, const uint8_t *p) noexcept {
+    size_t t = load_be32(p + 1);
+    if (pkt == nullptr || t < YAPB_HEADER_SIZE || t >= (size_t)(p - pkt) || pkt[t] != YAPB_NESTED_PKT) return {};
+    size_t span = element_span(pkt + t, p);
+    if (span == 0) return {};
+    return { pkt + t + 1, span - 1 };
+}
+
+// Nanoseconds of the well-formed TIMESTAMP or TIMESTAMP_DELTA element at p,
+// in the packet starting at pkt; a delta is relative to the packet's first
+// TIMESTAMP
+inline std::optional<int64_t> timestamp_at(const uint8_t *pkt, const uint8_t *p) noexcept {
+    if (p[0] == YAPB_TIMESTAMP) return (int64_t)load_be64(p + 1);
+    if (p[0] != YAPB_TIMESTAMP_DELTA) return std::nullopt;
+    for (const uint8_t *q = pkt + YAPB_HEADER_SIZE; q < p;) {
+        if (q[0] == YAPB_TIMESTAMP) {
+            uint64_t zz = 0;
+            for (unsigned i = 0, shift = 0;; i++, shift += 7) {
+                zz |= (uint64_t)(p[1 + i] & 0x7F) << shift;
+                if ((p[1 + i] & 0x80) == 0) break;
+            }
+            uint64_t d = (zz >> 1) ^ (0 - (zz & 1));
+            return (int64_t)(load_be64(q + 1) + d);
+        }
+        size_t span = element_span(q, p);
+        if (span == 0) return std::nullopt;
+        q += span;
+    }
+    return std::nullopt;
+}
+
+template <typename T> struct tag_of;
+template <> struct tag_of<int8_t>   { static constexpr YAPB_Type_t value = YAPB_INT8; };
+template <> struct tag_of<uint8_t>  { static constexpr YAPB_Type_t value = YAPB_INT8; };
+template <> struct tag_of<int16_t>  { static constexpr YAPB_Type_t value = YAPB_INT16; };
+template <> struct tag_of<uint16_t> { static constexpr YAPB_Type_t value = YAPB_INT16; };
+template <> struct tag_of<int32_t>  { static constexpr YAPB_Type_t value = YAPB_INT32; };
+template <> struct tag_of<uint32_t> { static constexpr YAPB_Type_t value = YAPB_INT32; };
+template <> struct tag_of<int64_t>  { static constexpr YAPB_Type_t value = YAPB_INT64; };
+template <> struct tag_of<uint64_t> { static constexpr YAPB_Type_t value = YAPB_INT64; };
+template <> struct tag_of<float>    { static constexpr YAPB_Type_t value = YAPB_FLOAT; };
+template <> struct tag_of<double>   { static constexpr YAPB_Type_t value = YAPB_DOUBLE; };
+
+} // namespace detail
+
+class element;
+
+/**
+ * @ingroup cpp
+ * @brief Forward range over the elements of a packet, without copies.
+ *
+ * Covers the whole packet from its first element, whatever a YAPB_Packet_t
+ * it was made from has already popped. Iteration stops at the first
+ * malformed element; check() tells whether the packet is well formed. The
+ * packet bytes must outlive the view and its elements.
+ */
+class packet_view : public std::ranges::view_interface<packet_view> {
+public:
+    class iterator;
+
+    /** @brief Empty view. */
+    packet_view() noexcept = default;
+
+    /** @brief View of raw packet bytes (header included). An invalid header
+     *  gives an empty view for which check() fails. */
+    explicit packet_view(std::span<const uint8_t> bytes) noexcept {
+        if (bytes.size() >= YAPB_HEADER_SIZE) {
+            size_t len = detail::load_be32(bytes.data());
+            if (len >= YAPB_HEADER_SIZE && len <= bytes.size()) {
+                data_ = bytes.data();
+                len_ = len;
+                return;
+            }
+        }
+        bad_ = true;
+    }
+
+    /** @brief View of a packet loaded for reading, or finalized. */
+    explicit packet_view(const YAPB_Packet_t &pkt) noexcept {
+        size_t len;
+        const uint8_t *data = YAPB_get_buffer(&pkt, &len);
+        if (data != nullptr) {
+            *this = packet_view(std::span<const uint8_t>(data, len));
+        } else {
+            bad_ = true;
+        }
+    }
+
+    iterator begin() const noexcept;
+    iterator end() const noexcept;
+
+    /** @brief The packet bytes, header included. */
+    std::span<const uint8_t> bytes() const noexcept { return { data_, len_ }; }
+
+    /** @brief Elements of a NESTED_PKT element of this packet, or of the
+     *  nested packet a NESTED_REF element of it refers to (empty for other
+     *  types and invalid references). */
+    packet_view nested(const element &e) const noexcept;
+
+    /** @brief Nanoseconds of a TIMESTAMP or TIMESTAMP_DELTA element of this
+     *  packet (nullopt for other types, or a delta without a base). */
+    std::optional<int64_t> timestamp(const element &e) const noexcept;
+
+    /**
+     * @brief Walk the packet and check that every element is well formed.
+     * @return YAPB_OK, or YAPB_ERR_INVALID_PACKET. Nested packets are
+     *         checked when they are visited.
+     */
+    YAPB_Result_t check() const noexcept {
+        if (bad_) return YAPB_ERR_INVALID_PACKET;
+        const uint8_t *p = data_ + YAPB_HEADER_SIZE, *end = data_ + len_;
+        while (p < end) {
+            size_t span = detail::element_span(p, end);
+            if (span == 0) return YAPB_ERR_INVALID_PACKET;
+            if (p[0] == YAPB_NESTED_REF && detail::ref_target(data_, p).empty()) return YAPB_ERR_INVALID_PACKET;
+            p += span;
+        }
+        return YAPB_OK;
+    }
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t len_ = 0;
+    bool bad_ = false;
+};
+
+/**
+ * @ingroup cpp
+ * @brief View of one element: its tag and the bytes after it.
+ */
+class element {
+public:
+    element() noexcept = default;
+    element(const uint8_t *p, size_t span) noexcept : p_(p), span_(span) {}
+
+    YAPB_Type_t type() const noexcept { return (YAPB_Type_t)p_[0]; }
+    bool is_integer() const noexcept { return p_[0] <= YAPB_INT64; }
+    bool is_real() const noexcept { return p_[0] == YAPB_FLOAT || p_[0] == YAPB_DOUBLE; }
+
+    /** @brief Value of an INT8..INT64 element, sign-extended. */
+    int64_t as_int() const noexcept {
+        switch (p_[0]) {
+            case YAPB_INT8:  return (int8_t)p_[1];
+            case YAPB_INT16: return (int16_t)detail::load_be16(p_ + 1);
+            case YAPB_INT32: return (int32_t)detail::load_be32(p_ + 1);
+            default:         return (int64_t)detail::load_be64(p_ + 1);
+        }
+    }
+
+    /** @brief Value of a FLOAT or DOUBLE element. */
+    double as_real() const noexcept {
+        if (p_[0] == YAPB_FLOAT) {
+            uint32_t b = detail::load_be32(p_ + 1);
+            float f;
+            std::memcpy(&f, &b, sizeof(f));
+            return f;
+        }
+        uint64_t b = detail::load_be64(p_ + 1);
+        double d;
+        std::memcpy(&d, &b, sizeof(d));
+        return d;
+    }
+
+    /** @brief Typed value if the element has exactly T's wire type, as the
+     *  matching YAPB_pop_*() would return it. */
+    template <typename T>
+    std::optional<T> get() const noexcept {
+        if (p_[0] != detail::tag_of<T>::value) return std::nullopt;
+        if constexpr (std::is_floating_point_v<T>) {
+            return (T)as_real();
+        } else {
+            return (T)as_int();
+        }
+    }
+
+    /** @brief Bytes of a BLOB element (empty for other types). */
+    std::span<const uint8_t> blob() const noexcept {
+        if (p_[0] != YAPB_BLOB) return {};
+        return { p_ + 3, span_ - 3 };
+    }
+
+    /** @brief Bytes of a BLOB element as characters. */
+    std::string_view str() const noexcept {
+        auto b = blob();
+        return { (const char *)b.data(), b.size() };
+    }
+
+    /** @brief Elements of a NESTED_PKT element (empty for other types;
+     *  see packet_view::nested() for NESTED_REF elements). */
+    packet_view nested() const noexcept {
+        if (p_[0] != YAPB_NESTED_PKT) return {};
+        return packet_view(std::span<const uint8_t>(p_ + 1, span_ - 1));
+    }
+
+    /** @brief The element's bytes on the wire, tag included. */
+    std::span<const uint8_t> bytes() const noexcept { return { p_, span_ }; }
+
+private:
+    const uint8_t *p_ = nullptr;
+    size_t span_ = 0;
+};
+
+/**
+ * @ingroup cpp
+ * @brief Forward iterator over packet_view elements.
+ *
+ * Holds the current position, the end, and the current element's size, so
+ * dereferencing is free and incrementing is one pointer advance plus the
+ * size lookup of the next tag.
+ */
+class packet_view::iterator {
+public:
+    using iterator_concept = std::forward_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+    using value_type = element;
+    using difference_type = std::ptrdiff_t;
+    using reference = element;
+
+    iterator() noexcept = default;
+    iterator(const uint8_t *p, const uint8_t *end) noexcept : p_(p), end_(end) { settle(); }
+
+    element operator*() const noexcept { return { p_, span_ }; }
+
+    iterator &operator++() noexcept {
+        p_ += span_;
+        settle();
+        return *this;
+    }
+    iterator operator++(int) noexcept {
+        iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    bool operator==(const iterator &o) const noexcept { return p_ == o.p_; }
+
+private:
+    // A malformed element ends the iteration
+    void settle() noexcept {
+        span_ = detail::element_span(p_, end_);
+        if (span_ == 0) p_ = end_;
+    }
+
+    const uint8_t *p_ = nullptr;
+    const uint8_t *end_ = nullptr;
+    size_t span_ = 0;
+};
+
+inline packet_view packet_view::nested(const element &e) const noexcept {
+    if (e.type() != YAPB_NESTED_REF) return e.nested();
+    auto target = detail::ref_target(data_, e.bytes().data());
+    return target.empty() ? packet_view{} : packet_view(target);
+}
+
+inline std::optional<int64_t> packet_view::timestamp(const element &e) const noexcept {
+    if (data_ == nullptr) return std::nullopt;
+    return detail::timestamp_at(data_, e.bytes().data());
+}
+
+inline packet_view::iterator packet_view::begin() const noexcept {
+    if (data_ == nullptr) return {};
+    return { data_ + YAPB_HEADER_SIZE, data_ + len_ };
+}
+
+inline packet_view::iterator packet_view::end() const noexcept {
+    if (data_ == nullptr) return {};
+    return { data_ + len_, data_ + len_ };
+}
+
+/**
+ * @ingroup cpp
+ * @brief Packet with typed fields that are located and decoded on access.
+ *
+ * @p Fields are the expected element types in order: int8_t..uint64_t,
+ * float and double (exact wire type, as for the YAPB_pop_*() calls),
+ * std::string_view or std::span<const uint8_t> for blobs, packet_view for
+ * nested packets, or element for any type. Nothing is decoded up front.
+ * Reading field I walks only to I, from the furthest field located so far,
+ * and records the offset of every element it passes. A handler that reads
+ * a few fields near the front does a fraction of the work of a full
+ * decode, and reading a field again is a single lookup.
+ *
+ * The offset index is a mutable cache, so a lazy_packet must not be read
+ * from several threads at once. The packet bytes must outlive it.
+ *
+ * @code
+ *   struct order : yapb::lazy_packet<int64_t, std::string_view, double, int32_t> {
+ *       using lazy_packet::lazy_packet;
+ *       std::optional<int64_t> id() const { return get<0>(); }
+ *       std::optional<double> price() const { return get<2>(); }
+ *   };
+ *   order o(pkt);
+ *   if (auto p = o.price()) ...
+ * @endcode
+ */
+template <typename... Fields>
+class lazy_packet {
+public:
+    /** @brief Number of declared fields. */
+    static constexpr size_t field_count = sizeof...(Fields);
+
+    /** @brief Type of field @p I. */
+    template <size_t I>
+    using field_type = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+    lazy_packet() noexcept = default;
+    explicit lazy_packet(packet_view view) noexcept : view_(view) {}
+    explicit lazy_packet(const YAPB_Packet_t &pkt) noexcept : view_(pkt) {}
+
+    /**
+     * @brief Decode field @p I.
+     * @param out Output value (unchanged on error).
+     * @return YAPB_OK, YAPB_ERR_NO_MORE_ELEMENTS if the packet has fewer
+     *         elements (an older sender), YAPB_ERR_TYPE_MISMATCH if the
+     *         element has another type, YAPB_ERR_INVALID_PACKET if the
+     *         packet is malformed before it.
+     */
+    template <size_t I>
+    YAPB_Result_t get(field_type<I> &out) const noexcept {
+        static_assert(I < field_count, "field index out of range");
+        element e;
+        YAPB_Result_t r = locate(I, e);
+        if (r != YAPB_OK) return r;
+        return decode(e, out);
+    }
+
+    /** @brief Decode field @p I, or nullopt if it is missing or has another
+     *  type. */
+    template <size_t I>
+    std::optional<field_type<I>> get() const noexcept {
+        field_type<I> out{};
+        if (get<I>(out) != YAPB_OK) return std::nullopt;
+        return out;
+    }
+
+    /** @brief Number of fields whose offsets are known so far. */
+    size_t indexed() const noexcept { return known_; }
+
+    /** @brief The underlying packet. */
+    const packet_view &view() const noexcept { return view_; }
+
+private:
+    YAPB_Result_t locate(size_t i, element &out) const noexcept {
+        auto bytes = view_.bytes();
+        if (bytes.empty()) return YAPB_ERR_INVALID_PACKET;
+        const uint8_t *base = bytes.data(), *end = base + bytes.size();
+        // offs_[k] is the start of field k for k <= known_
+        while (known_ <= i) {
+            const uint8_t *p = base + offs_[known_];
+            if (p == end) return YAPB_ERR_NO_MORE_ELEMENTS;
+            size_t span = detail::element_span(p, end);
+            if (span == 0) return YAPB_ERR_INVALID_PACKET;
+            offs_[known_ + 1] = offs_[known_] + (uint32_t)span;
+            known_++;
+        }
+        const uint8_t *p = base + offs_[i];
+        out = element(p, offs_[i + 1] - offs_[i]);
+        return YAPB_OK;
+    }
+
+    template <typename T>
+    YAPB_Result_t decode(const element &e, T &out) const noexcept {
+        if constexpr (std::is_same_v<T, element>) {
+            out = e;
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            if (e.type() != YAPB_BLOB) return YAPB_ERR_TYPE_MISMATCH;
+            out = e.str();
+        } else if constexpr (std::is_same_v<T, std::span<const uint8_t>>) {
+            if (e.type() != YAPB_BLOB) return YAPB_ERR_TYPE_MISMATCH;
+            out = e.blob();
+        } else if constexpr (std::is_same_v<T, packet_view>) {
+            if (e.type() != YAPB_NESTED_PKT && e.type() != YAPB_NESTED_REF) return YAPB_ERR_TYPE_MISMATCH;
+            packet_view nested = view_.nested(e);
+            if (nested.bytes().empty()) return YAPB_ERR_INVALID_PACKET;
+            out = nested;
+        } else {
+            std::optional<T> v = e.get<T>();
+            if (!v) return YAPB_ERR_TYPE_MISMATCH;
+            out = *v;
+        }
+        return YAPB_OK;
+    }
+
+    packet_view view_;
+    mutable std::array<uint32_t, field_count + 1> offs_{YAPB_HEADER_SIZE};
+    mutable size_t known_ = 0;
+};
+
+/* ======== Coroutines ======== */
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct promise_base {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            return h.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct promise : promise_base {
+    std::optional<T> value;
+    task<T> get_return_object() noexcept;
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct promise<void> : promise_base {
+    task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+// Fire-and-forget frame that owns a task and frees itself when it ends
+struct detached {
+    struct promise_type {
+        detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+/**
+ * @ingroup cpp
+ * @brief Lazily started coroutine returning @p T.
+ *
+ * The task runs when it is awaited, and resumes its awaiter when it
+ * finishes (symmetric transfer, so chains of tasks do not grow the stack).
+ */
+template <typename T>
+class [[nodiscard]] task {
+public:
+    using promise_type = detail::promise<T>;
+    using handle = std::coroutine_handle<promise_type>;
+
+    explicit task(handle h) noexcept : h_(h) {}
+    task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+    task &operator=(task &&o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct awaiter {
+            handle h;
+            bool await_ready() noexcept { return !h || h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept {
+                h.promise().continuation = cont;
+                return h;
+            }
+            T await_resume() { return h.promise().result(); }
+        };
+        return awaiter{h_};
+    }
+
+private:
+    handle h_;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> promise<T>::get_return_object() noexcept {
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept {
+    return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+inline detached run_detached(task<void> t) {
+    co_await std::move(t);
+}
+
+} // namespace detail
+
+/**
+ * @ingroup cpp
+ * @brief Readiness a coroutine waits for.
+ */
+enum class io_event : uint32_t {
+    readable = EPOLLIN,
+    writable = EPOLLOUT,
+};
+
+/**
+ * @ingroup cpp
+ * @brief Where coroutines wait for descriptors.
+ *
+ * Implementations resume each handle exactly once, after the descriptor
+ * became ready or failed (the retried system call reports the error).
+ * Streams of one executor must be used from the thread that runs it.
+ */
+class executor {
+public:
+    virtual ~executor() = default;
+
+    /** @brief Resume @p h when @p fd is ready for @p ev. */
+    virtual void wait_io(int fd, io_event ev, std::coroutine_handle<> h) = 0;
+
+    /** @brief Resume @p h on the next turn of the loop. */
+    virtual void post(std::coroutine_handle<> h) = 0;
+
+    /** @brief Start a task that nobody awaits; it runs until its first wait. */
+    void spawn(task<void> t) { detail::run_detached(std::move(t)); }
+
+    /** @brief Awaitable that suspends until @p fd is ready for @p ev. */
+    auto ready(int fd, io_event ev) noexcept {
+        struct awaiter {
+            executor &ex;
+            int fd;
+            io_event ev;
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { ex.wait_io(fd, ev, h); }
+            void await_resume() noexcept {}
+        };
+        return awaiter{*this, fd, ev};
+    }
+
+    /** @brief Awaitable that lets other ready coroutines run first. */
+    auto yield() noexcept {
+        struct awaiter {
+            executor &ex;
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { ex.post(h); }
+            void await_resume() noexcept {}
+        };
+        return awaiter{*this};
+    }
+};
+
+/**
+ * @ingroup cpp
+ * @brief Single-threaded executor on epoll.
+ *
+ * Each descriptor is registered once, one-shot, with the union of the
+ * directions waited for. Descriptors epoll cannot watch (regular files)
+ * are treated as always ready.
+ */
+class epoll_executor final : public executor {
+public:
+    epoll_executor() : epfd_(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~epoll_executor() override {
+        if (epfd_ >= 0) ::close(epfd_);
+    }
+    epoll_executor(const epoll_executor &) = delete;
+    epoll_executor &operator=(const epoll_executor &) = delete;
+
+    /** @brief Whether the epoll instance was created. */
+    bool valid() const noexcept { return epfd_ >= 0; }
+
+    void wait_io(int fd, io_event ev, std::coroutine_handle<> h) override {
+        waiters &w = fds_[fd];
+        (ev == io_event::readable ? w.rd : w.wr) = h;
+        pending_++;
+        arm(fd, w);
+    }
+
+    void post(std::coroutine_handle<> h) override { ready_.push_back(h); }
+
+    /** @brief Run until no coroutine is waiting or stop() is called. */
+    void run() {
+        stop_ = false;
+        while (!stop_ && (pending_ > 0 || !ready_.empty())) {
+            run_once(-1);
+        }
+    }
+
+    /**
+     * @brief Run @p t to completion and return its result.
+     *
+     * Other coroutines run as well. The task must not wait on anything
+     * outside this executor.
+     */
+    template <typename T>
+    T run(task<T> t) {
+        bool done = false;
+        if constexpr (std::is_void_v<T>) {
+            spawn(complete(std::move(t), done));
+            finish(done);
+        } else {
+            std::optional<T> out;
+            spawn(complete(std::move(t), out, done));
+            finish(done);
+            return std::move(*out);
+        }
+    }
+
+    /** @brief Run ready coroutines, then wait up to @p timeout_ms for I/O. */
+    void run_once(int timeout_ms) {
+        drain();
+        if (pending_ == 0) return;
+        epoll_event evs[64];
+        int n = epoll_wait(epfd_, evs, 64, ready_.empty() ? timeout_ms : 0);
+        for (int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            auto it = fds_.find(fd);
+            if (it == fds_.end()) continue;
+            waiters &w = it->second;
+            uint32_t e = evs[i].events;
+            if (w.rd && (e & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))) {
+                ready_.push_back(std::exchange(w.rd, {}));
+                pending_--;
+            }
+            if (w.wr && (e & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                ready_.push_back(std::exchange(w.wr, {}));
+                pending_--;
+            }
+            // One-shot: re-enable whatever is still waited for
+            if (w.rd || w.wr) arm(fd, w);
+        }
+        drain();
+    }
+
+    /** @brief Make run() return after the current turn. */
+    void stop() noexcept { stop_ = true; }
+
+private:
+    struct waiters {
+        std::coroutine_handle<> rd, wr;
+    };
+
+    template <typename T>
+    static task<void> complete(task<T> t, std::optional<T> &out, bool &done) {
+        out.emplace(co_await std::move(t));
+        done = true;
+    }
+
+    static task<void> complete(task<void> t, bool &done) {
+        co_await std::move(t);
+        done = true;
+    }
+
+    void finish(const bool &done) {
+        while (!done && (pending_ > 0 || !ready_.empty())) {
+            run_once(-1);
+        }
+        if (!done) {
+            // Nothing left that could resume the task
+            std::terminate();
+        }
+    }
+
+    void arm(int fd, waiters &w) {
+        epoll_event ev{};
+        ev.events = EPOLLONESHOT | (w.rd ? EPOLLIN | EPOLLRDHUP : 0u) | (w.wr ? EPOLLOUT : 0u);
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == 0) return;
+        if (errno == ENOENT && epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == 0) return;
+        // Not pollable (EPERM for regular files) or closed: let the retry report it
+        for (std::coroutine_handle<> *h : {&w.rd, &w.wr}) {
+            if (*h) {
+                ready_.push_back(std::exchange(*h, {}));
+                pending_--;
+            }
+        }
+    }
+
+    void drain() {
+        // Resumed coroutines may post more; those run on the next turn
+        batch_.swap(ready_);
+        for (auto h : batch_) h.resume();
+        batch_.clear();
+    }
+
+    int epfd_;
+    bool stop_ = false;
+    size_t pending_ = 0;
+    std::unordered_map<int, waiters> fds_;
+    std::vector<std::coroutine_handle<>> ready_, batch_;
+};
+
+/**
+ * @ingroup cpp
+ * @brief Frames packets from a non-blocking descriptor.
+ *
+ * Packets are loaded in read mode straight from the receive buffer. They
+ * stay valid until the next call to next_packet() or next_batch(), which
+ * may move buffered bytes. Copy a packet's bytes out to keep it longer.
+ * The buffer bounds the largest packet that can be received.
+ */
+class stream_reader {
+public:
+    /**
+     * @param ex     Executor to wait on.
+     * @param fd     Non-blocking descriptor (socket, pipe, ...).
+     * @param buffer Receive buffer, owned by the caller.
+     */
+    stream_reader(executor &ex, int fd, std::span<uint8_t> buffer) noexcept
+        : ex_(ex), fd_(fd), buf_(buffer) {}
+
+    /**
+     * @brief Wait for the next packet.
+     * @param out Output: packet loaded for reading.
+     * @return YAPB_OK, YAPB_ERR_NO_MORE_ELEMENTS at a clean end of stream,
+     *         YAPB_ERR_INVALID_PACKET for a malformed or truncated packet,
+     *         YAPB_ERR_BUFFER_TOO_SMALL for a packet larger than the
+     *         buffer, YAPB_ERR_IO on read errors.
+     */
+    task<YAPB_Result_t> next_packet(YAPB_Packet_t &out) {
+        size_t n;
+        co_return co_await next_batch(std::span<YAPB_Packet_t>(&out, 1), n);
+    }
+
+    /**
+     * @brief Wait until at least one packet is complete, then take all
+     *        complete packets (up to @p out.size()).
+     * @param out   Output: packets loaded for reading.
+     * @param count Output: number of packets, 0 on error.
+     * @return As next_packet(). Errors are reported once the packets
+     *         received before them have been returned.
+     */
+    task<YAPB_Result_t> next_batch(std::span<YAPB_Packet_t> out, size_t &count) {
+        count = 0;
+        if (out.empty()) co_return YAPB_ERR_BUFFER_TOO_SMALL;
+        for (;;) {
+            YAPB_Result_t r = YAPB_OK;
+            size_t n = 0;
+            while (n < out.size()) {
+                size_t len = 0;
+                r = frame(len);
+                if (r != YAPB_OK || len == 0) break;
+                r = YAPB_load(&out[n], buf_.data() + begin_, len);
+                if (r != YAPB_OK) break;
+                begin_ += len;
+                n++;
+            }
+            if (n > 0) {
+                count = n;
+                co_return YAPB_OK;
+            }
+            if (r != YAPB_OK) co_return r;
+            if (eof_) {
+                co_return end_ > begin_ ? YAPB_ERR_INVALID_PACKET : YAPB_ERR_NO_MORE_ELEMENTS;
+            }
+
+            // Nothing complete: make room and read as much as is available
+            if (begin_ > 0) {
+                std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+                end_ -= begin_;
+                begin_ = 0;
+            }
+            ssize_t got = ::read(fd_, buf_.data() + end_, buf_.size() - end_);
+            if (got > 0) {
+                end_ += (size_t)got;
+            } else if (got == 0) {
+                eof_ = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                co_await ex_.ready(fd_, io_event::readable);
+            } else if (errno != EINTR) {
+                co_return YAPB_ERR_IO;
+            }
+        }
+    }
+
+private:
+    // Length of the complete packet at begin_, or 0 if more bytes are needed
+    YAPB_Result_t frame(size_t &len) const {
+        size_t avail = end_ - begin_;
+        len = 0;
+        if (avail < YAPB_HEADER_SIZE) return YAPB_OK;
+        const uint8_t *p = buf_.data() + begin_;
+        size_t need = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+        if (need < YAPB_HEADER_SIZE) return YAPB_ERR_INVALID_PACKET;
+        if (need > buf_.size()) return YAPB_ERR_BUFFER_TOO_SMALL;
+        if (avail >= need) len = need;
+        return YAPB_OK;
+    }
+
+    executor &ex_;
+    int fd_;
+    std::span<uint8_t> buf_;
+    size_t begin_ = 0;      // first unconsumed byte
+    size_t end_ = 0;        // end of received bytes
+    bool eof_ = false;
+};
+
+/**
+ * @ingroup cpp
+ * @brief Sends finalized packets on a non-blocking descriptor.
+ *
+ * Packets are gathered into one system call per batch straight from their
+ * buffers, which must stay valid until the send completes. On sockets,
+ * MSG_NOSIGNAL turns a closed peer into YAPB_ERR_IO instead of SIGPIPE.
+ * One send at a time per writer.
+ */
+class stream_writer {
+public:
+    stream_writer(executor &ex, int fd) noexcept : ex_(ex), fd_(fd) {}
+
+    /**
+     * @brief Send one packet.
+     * @return YAPB_OK once all bytes are written, the packet's sticky error,
+     *         YAPB_ERR_INVALID_MODE if it is not finalized, YAPB_ERR_IO on
+     *         write errors.
+     */
+    task<YAPB_Result_t> send(const YAPB_Packet_t &pkt) {
+        co_return co_await send_batch(std::span<const YAPB_Packet_t>(&pkt, 1));
+    }
+
+    /**
+     * @brief Send packets back to back with gathered writes.
+     * @return As send(); nothing is written if any packet is invalid.
+     */
+    task<YAPB_Result_t> send_batch(std::span<const YAPB_Packet_t> pkts) {
+        iov_.clear();
+        for (const YAPB_Packet_t &pkt : pkts) {
+            if (YAPB_get_error(&pkt) < 0) co_return YAPB_get_error(&pkt);
+            size_t len;
+            const uint8_t *data = YAPB_get_buffer(&pkt, &len);
+            if (data == NULL) co_return YAPB_ERR_INVALID_MODE;
+            iov_.push_back({const_cast<uint8_t *>(data), len});
+        }
+        size_t i = 0;
+        while (i < iov_.size()) {
+            int cnt = (int)std::min<size_t>(iov_.size() - i, IOV_MAX);
+            ssize_t put = gather(&iov_[i], cnt);
+            if (put < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    co_await ex_.ready(fd_, io_event::writable);
+                    continue;
+                }
+                if (errno == EINTR) continue;
+                co_return YAPB_ERR_IO;
+            }
+            // Skip what was written; a partial packet resumes mid-buffer
+            size_t left = (size_t)put;
+            while (i < iov_.size() && left >= iov_[i].iov_len) {
+                left -= iov_[i++].iov_len;
+            }
+            if (left > 0) {
+                iov_[i].iov_base = (uint8_t *)iov_[i].iov_base + left;
+                iov_[i].iov_len -= left;
+            }
+        }
+        co_return YAPB_OK;
+    }
+
+private:
+    ssize_t gather(iovec *iov, int cnt) {
+        if (socket_) {
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = (size_t)cnt;
+            ssize_t put = ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+            if (put >= 0 || errno != ENOTSOCK) return put;
+            socket_ = false;
+        }
+        return ::writev(fd_, iov, cnt);
+    }
+
+    executor &ex_;
+    int fd_;
+    bool socket_ = true;    // cleared on the first ENOTSOCK
+    std::vector<iovec> iov_;
+};
+
+} // namespace yapb
+
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<yapb::packet_view> = true;
@@ -0,0 +1,449 @@
+#pragma once
+#include "yapb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_batch.h
+ * @brief Batch writer and reader for back-to-back packets in one buffer.
+ *
+ * A batch hands out consecutive regions of a single caller-provided buffer.
+ * Each region is set up with YAPB_initialize() semantics, so packets are
+ * built in place and the next one starts right after the previous packet
+ * was finalized. The committed range can be sent with a single write().
+ *
+ * @code
+ *   uint8_t sendbuf[4096];
+ *   YAPB_Batch_t batch;
+ *   YAPB_batch_init(&batch, sendbuf, sizeof(sendbuf));
+ *
+ *   YAPB_Packet_t pkt;
+ *   YAPB_batch_begin(&batch, &pkt);
+ *   YAPB_push_i32(&pkt, &temp);
+ *   YAPB_batch_commit(&batch, &pkt);  // finalizes and appends
+ *
+ *   size_t len;
+ *   const uint8_t *data = YAPB_batch_get_buffer(&batch, &len);
+ *   write(fd, data, len);
+ *   YAPB_batch_reset(&batch);
+ * @endcode
+ *
+ * A batch reader walks such a buffer (a received batch, a mapped log) and
+ * loads one packet after another, optionally prefetching ahead of it:
+ *
+ * @code
+ *   YAPB_BatchReader_t rd;
+ *   YAPB_batch_reader_init(&rd, data, len, YAPB_BATCH_PREFETCH_DEFAULT);
+ *   YAPB_Packet_t pkt;
+ *   while (YAPB_batch_reader_next(&rd, &pkt) == YAPB_OK) {
+ *       handle(&pkt);
+ *   }
+ * @endcode
+ */
+
+/** @defgroup batch Batch Writer
+ *  Build several packets back to back in one buffer.
+ */
+
+/** @ingroup batch
+ *  @brief Size of the opaque YAPB_Batch_t storage in bytes. */
+#define YAPB_BATCH_SIZE 48
+
+/**
+ * @ingroup batch
+ * @brief Opaque batch writer handle, stack-allocatable.
+ *
+ * Internals are hidden; use YAPB_batch_init() to set up.
+ */
+typedef struct YAPB_Batch {
+    alignas(max_align_t) unsigned char _opaque[YAPB_BATCH_SIZE];
+} YAPB_Batch_t;
+
+/**
+ * @ingroup batch
+ * @brief Initialize a batch writer over a caller-provided buffer.
+ *
+ * @param batch  Batch to initialize.
+ * @param buffer Buffer that will hold all packets of the batch.
+ * @param size   Size of the buffer (must be >= YAPB_HEADER_SIZE).
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_init(YAPB_Batch_t *batch, uint8_t *buffer, size_t size);
+
+/**
+ * @ingroup batch
+ * @brief Start the next packet directly after the last committed one.
+ *
+ * Initializes @p pkt in write mode over the unused tail of the batch buffer.
+ * Only one packet may be open at a time.
+ *
+ * @param batch Batch writer.
+ * @param pkt   Packet to initialize for writing.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_MODE if a packet is already
+ *         open, YAPB_ERR_BUFFER_TOO_SMALL if the batch is full.
+ */
+YAPB_Result_t YAPB_batch_begin(YAPB_Batch_t *batch, YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup batch
+ * @brief Commit the open packet to the batch.
+ *
+ * Finalizes @p pkt if that has not been done yet and appends it to the
+ * committed range. If the packet carries a sticky error (e.g. it ran out of
+ * space), it is discarded and the error is returned; the batch itself stays
+ * usable, so the caller can flush and retry.
+ *
+ * @param batch Batch writer.
+ * @param pkt   Packet returned by YAPB_batch_begin().
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_commit(YAPB_Batch_t *batch, YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup batch
+ * @brief Discard the open packet, if any.
+ * @param batch Batch writer.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_abort(YAPB_Batch_t *batch);
+
+/**
+ * @ingroup batch
+ * @brief Copy a packet that was built elsewhere into the batch.
+ *
+ * @param batch Batch writer (no packet may be open).
+ * @param pkt   Finalized write packet or loaded read packet.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_append(YAPB_Batch_t *batch, const YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup batch
+ * @brief Get the committed range of the batch.
+ *
+ * The returned range holds all committed packets back to back and can be
+ * passed to a single write()/send(). An open packet is not included.
+ *
+ * @param batch   Batch writer.
+ * @param out_len Output: number of committed bytes. May be NULL.
+ * @return Pointer to the start of the batch buffer, or NULL if batch is NULL.
+ */
+const uint8_t *YAPB_batch_get_buffer(const YAPB_Batch_t *batch, size_t *out_len);
+
+/**
+ * @ingroup batch
+ * @brief Get the number of committed packets.
+ * @param batch     Batch writer.
+ * @param out_count Output: number of packets.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_get_count(const YAPB_Batch_t *batch, size_t *out_count);
+
+/**
+ * @ingroup batch
+ * @brief Drop all committed packets and start over at the buffer start.
+ * @param batch Batch writer.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_reset(YAPB_Batch_t *batch);
+
+/** @defgroup batchread Batch Reader
+ *  Walk back-to-back packets with software prefetching.
+ *
+ *  Each packet's header gives the position of the next one, so a plain walk
+ *  over memory that is not in cache waits on every header in turn. A batch
+ *  reader can instead keep a window of bytes ahead of the packet it hands
+ *  out prefetched, headers and bodies alike. The window is plain bytes, so
+ *  it does not have to read the headers in it and runs a full distance
+ *  ahead: each call prefetches the lines that entered the window since the
+ *  last one.
+ *
+ *  The distance is in 64-byte cache lines. With data streaming from memory
+ *  in order, the hardware prefetcher keeps up on its own and the extra
+ *  prefetch instructions measured slower, so the default is 0, which
+ *  disables the window. Try a distance of a few packets' worth of lines for
+ *  cold or remote-node memory, and compare with `yapb-bench replay` on the
+ *  target host.
+ */
+
+/** @ingroup batchread
+ *  @brief Default prefetch distance in cache lines: none (see above). */
+#define YAPB_BATCH_PREFETCH_DEFAULT 0
+
+/** @ingroup batchread
+ *  @brief Size of the opaque YAPB_BatchReader_t storage in bytes. */
+#define YAPB_BATCH_READER_SIZE 64
+
+/**
+ * @ingroup batchread
+ * @brief Opaque batch reader handle, stack-allocatable.
+ */
+typedef struct YAPB_BatchReader {
+    alignas(max_align_t) unsigned char _opaque[YAPB_BATCH_READER_SIZE];
+} YAPB_BatchReader_t;
+
+/**
+ * @ingroup batchread
+ * @brief Start reading back-to-back packets.
+ * @param reader   Reader to initialize.
+ * @param data     Packets; must stay valid while the reader is used.
+ * @param len      Size of @p data in bytes.
+ * @param distance Cache lines to prefetch ahead, 0 for none.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_reader_init(YAPB_BatchReader_t *reader, const uint8_t *data, size_t len,
+                                     unsigned distance);
+
+/**
+ * @ingroup batchread
+ * @brief Load the next packet for reading.
+ *
+ * The packet points into the reader's data; nothing is copied.
+ *
+ * @param reader Reader.
+ * @param out    Output: packet in read mode.
+ * @return YAPB_OK on success, YAPB_ERR_NO_MORE_ELEMENTS at the end of the
+ *         data, YAPB_ERR_INVALID_PACKET if a header is invalid or the last
+ *         packet is truncated (sticky), other error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_reader_next(YAPB_BatchReader_t *reader, YAPB_Packet_t *out);
+
+/**
+ * @ingroup batchread
+ * @brief Get the position of the reader.
+ * @param reader    Reader.
+ * @param out_off   Output: offset of the next packet. May be NULL.
+ * @param out_count Output: packets returned so far. May be NULL.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_batch_reader_tell(const YAPB_BatchReader_t *reader, size_t *out_off, size_t *out_count);
+
+/**
+ * @ingroup batchread
+ * @brief Per-packet callback for YAPB_batch_for_each().
+ * @param ctx User context.
+ * @param pkt Packet in read mode; the callback may pop from it.
+ * @return YAPB_OK to continue, a negative code to stop the walk.
+ */
+typedef YAPB_Result_t (*YAPB_PacketFn_t)(void *ctx, YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup batchread
+ * @brief Call @p fn for every packet of a buffer, with prefetching.
+ *
+ * Equivalent to a YAPB_batch_reader_next() loop, with the reader kept in
+ * registers.
+ *
+ * @param data     Packets.
+ * @param len      Size of @p data in bytes.
+ * @param distance Cache lines to prefetch ahead, 0 for none.
+ * @param fn       Callback.
+ * @param ctx      User context for @p fn. May be NULL.
+ * @return YAPB_OK after the last packet, the callback's code if it stopped
+ *         the walk, YAPB_ERR_INVALID_PACKET for bad framing, other error
+ *         code otherwise.
+ */
+YAPB_Result_t YAPB_batch_for_each(const uint8_t *data, size_t len, unsigned distance,
+                                  YAPB_PacketFn_t fn, void *ctx);
+
+/** @defgroup coalesce Coalescing Writer
+ *  Batch outbound packets and flush on size, count or a latency deadline.
+ *
+ *  A coalescer wraps a batch writer and a flush callback. Packets are built
+ *  in place (YAPB_coalesce_begin() / YAPB_coalesce_commit()) or copied in
+ *  (YAPB_coalesce_append()). The batch is flushed as soon as one of the
+ *  configured thresholds is reached:
+ *
+ *   - @c max_bytes:    committed bytes reach the threshold
+ *   - @c max_packets:  committed packets reach the threshold
+ *   - @c max_delay_us: the oldest pending packet waited this long
+ *
+ *  Time is passed in by the caller as microseconds. Use the same clock
+ *  everywhere; YAPB_coalesce_now_us() reads CLOCK_MONOTONIC so the value
+ *  from YAPB_coalesce_get_deadline() can arm a timerfd with
+ *  TFD_TIMER_ABSTIME, or the caller may simply call YAPB_coalesce_poll()
+ *  from its event loop.
+ *
+ *  Packets built in place cannot grow past the end of the buffer. Keep
+ *  @c max_bytes at least one maximum packet size below the buffer size so a
+ *  flush always happens before the space runs out.
+ */
+
+/**
+ * @ingroup coalesce
+ * @brief Reason a coalescer batch was flushed.
+ */
+typedef enum {
+    YAPB_FLUSH_SIZE     = 0, /**< max_bytes reached. */
+    YAPB_FLUSH_COUNT    = 1, /**< max_packets reached. */
+    YAPB_FLUSH_DEADLINE = 2, /**< max_delay_us expired for the oldest packet. */
+    YAPB_FLUSH_FULL     = 3, /**< Next packet did not fit into the remaining buffer. */
+    YAPB_FLUSH_EXPLICIT = 4, /**< YAPB_coalesce_flush() called by the user. */
+    YAPB_FLUSH_REASON_COUNT  /**< Number of flush reasons. */
+} YAPB_FlushReason_t;
+
+/** @ingroup coalesce
+ *  @brief Number of power-of-two buckets in the batch size histogram. */
+#define YAPB_COALESCE_HIST_BUCKETS 8
+
+/**
+ * @ingroup coalesce
+ * @brief Flush thresholds. A zero value disables that threshold.
+ */
+typedef struct YAPB_CoalesceConfig {
+    size_t max_bytes;      /**< Flush once this many bytes are pending. */
+    size_t max_packets;    /**< Flush once this many packets are pending. */
+    uint64_t max_delay_us; /**< Flush once the oldest packet waited this long. */
+} YAPB_CoalesceConfig_t;
+
+/**
+ * @ingroup coalesce
+ * @brief Flush statistics collected by a coalescer.
+ */
+typedef struct YAPB_CoalesceStats {
+    uint64_t flushes[YAPB_FLUSH_REASON_COUNT]; /**< Flush count per YAPB_FlushReason_t. */
+    uint64_t packets;            /**< Total packets flushed. */
+    uint64_t bytes;              /**< Total bytes flushed. */
+    uint64_t max_batch_packets;  /**< Largest batch seen, in packets. */
+    uint64_t max_batch_bytes;    /**< Largest batch seen, in bytes. */
+    /** Batch size histogram: bucket i counts batches of 2^i .. 2^(i+1)-1
+     *  packets, the last bucket collects everything larger. */
+    uint64_t batch_hist[YAPB_COALESCE_HIST_BUCKETS];
+} YAPB_CoalesceStats_t;
+
+/**
+ * @ingroup coalesce
+ * @brief Flush callback, e.g. a wrapper around write() or send().
+ *
+ * @param ctx   User context passed to YAPB_coalesce_init().
+ * @param data  Back-to-back packets to transmit.
+ * @param len   Number of bytes in @p data.
+ * @param count Number of packets in @p data.
+ * @return YAPB_OK if the data was consumed. On error the batch is kept and
+ *         the error is returned to the caller of the triggering function.
+ */
+typedef YAPB_Result_t (*YAPB_FlushFn_t)(void *ctx, const uint8_t *data, size_t len, size_t count);
+
+/** @ingroup coalesce
+ *  @brief Size of the opaque YAPB_Coalescer_t storage in bytes. */
+#define YAPB_COALESCER_SIZE 256
+
+/**
+ * @ingroup coalesce
+ * @brief Opaque coalescing writer handle, stack-allocatable.
+ */
+typedef struct YAPB_Coalescer {
+    alignas(max_align_t) unsigned char _opaque[YAPB_COALESCER_SIZE];
+} YAPB_Coalescer_t;
+
+/**
+ * @ingroup coalesce
+ * @brief Initialize a coalescing writer.
+ *
+ * @param c      Coalescer to initialize.
+ * @param buffer Batch buffer.
+ * @param size   Size of the batch buffer.
+ * @param cfg    Flush thresholds (copied).
+ * @param flush  Flush callback.
+ * @param ctx    User context for @p flush. May be NULL.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_init(YAPB_Coalescer_t *c, uint8_t *buffer, size_t size,
+                                 const YAPB_CoalesceConfig_t *cfg, YAPB_FlushFn_t flush, void *ctx);
+
+/**
+ * @ingroup coalesce
+ * @brief Start building the next packet in place.
+ *
+ * If the remaining buffer is too small for even an empty packet, the
+ * pending batch is flushed first (reason YAPB_FLUSH_FULL).
+ *
+ * @param c      Coalescer.
+ * @param pkt    Packet to initialize for writing.
+ * @param now_us Current time in microseconds.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_begin(YAPB_Coalescer_t *c, YAPB_Packet_t *pkt, uint64_t now_us);
+
+/**
+ * @ingroup coalesce
+ * @brief Commit the packet started with YAPB_coalesce_begin().
+ *
+ * Finalizes the packet if needed, then flushes if a threshold is reached.
+ *
+ * @param c      Coalescer.
+ * @param pkt    Packet returned by YAPB_coalesce_begin().
+ * @param now_us Current time in microseconds.
+ * @return YAPB_OK on success, error code from the batch or flush otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_commit(YAPB_Coalescer_t *c, YAPB_Packet_t *pkt, uint64_t now_us);
+
+/**
+ * @ingroup coalesce
+ * @brief Copy a finalized packet into the pending batch.
+ *
+ * Flushes first (reason YAPB_FLUSH_FULL) if the packet does not fit.
+ *
+ * @param c      Coalescer.
+ * @param pkt    Finalized write packet or loaded read packet.
+ * @param now_us Current time in microseconds.
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if the packet is
+ *         larger than the whole batch buffer, other error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_append(YAPB_Coalescer_t *c, const YAPB_Packet_t *pkt, uint64_t now_us);
+
+/**
+ * @ingroup coalesce
+ * @brief Flush the pending batch if its deadline has passed.
+ *
+ * While a packet is being built in place the flush is deferred to the
+ * next YAPB_coalesce_commit().
+ *
+ * @param c      Coalescer.
+ * @param now_us Current time in microseconds.
+ * @return YAPB_OK on success (including nothing to do), error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_poll(YAPB_Coalescer_t *c, uint64_t now_us);
+
+/**
+ * @ingroup coalesce
+ * @brief Flush the pending batch now.
+ * @param c Coalescer.
+ * @return YAPB_OK on success (including empty batch), YAPB_ERR_INVALID_MODE
+ *         while a packet from YAPB_coalesce_begin() is not committed yet,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_flush(YAPB_Coalescer_t *c);
+
+/**
+ * @ingroup coalesce
+ * @brief Get the time at which the pending batch must be flushed.
+ *
+ * @param c      Coalescer.
+ * @param out_us Output: absolute deadline in microseconds, or UINT64_MAX if
+ *               nothing is pending or no delay threshold is configured.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_get_deadline(const YAPB_Coalescer_t *c, uint64_t *out_us);
+
+/**
+ * @ingroup coalesce
+ * @brief Get a copy of the flush statistics.
+ * @param c   Coalescer.
+ * @param out Output: statistics.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_coalesce_get_stats(const YAPB_Coalescer_t *c, YAPB_CoalesceStats_t *out);
+
+/**
+ * @ingroup coalesce
+ * @brief Read CLOCK_MONOTONIC in microseconds.
+ * @return Current monotonic time in microseconds.
+ */
+uint64_t YAPB_coalesce_now_us(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,203 @@
+#pragma once
+#include "yapb.h"
+#include "yapb_shared.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_bus.h
+ * @brief In-process publish/subscribe bus for shared YAPB packets.
+ *
+ * Publishers hand finalized packets in shared buffers (see yapb_shared.h) to
+ * a numeric topic. Every active subscriber of that topic whose optional
+ * filter matches gets its own reference to the same buffer, pushed into a
+ * per-subscriber bounded lock-free queue. Subscribers drain their queue in
+ * batches and read the packets in place with YAPB_shared_load().
+ *
+ * Any number of threads may publish concurrently, without locks. Each
+ * subscriber queue has a single consumer. Subscribe and unsubscribe are
+ * serialized among themselves; an unsubscribe unlinks the subscriber and
+ * waits for the publishes already walking past it, after which its storage
+ * may be reused for a new subscription or freed.
+ *
+ * @code
+ *   YAPB_Bus_t bus;
+ *   YAPB_bus_init(&bus);
+ *
+ *   static YAPB_BusSlot_t slots[1024];
+ *   YAPB_Subscriber_t sub;
+ *   YAPB_bus_subscribe(&bus, &sub, TOPIC_TELEMETRY, slots, 1024, NULL);
+ *
+ *   // publisher thread
+ *   YAPB_bus_publish(&bus, TOPIC_TELEMETRY, sh, NULL);
+ *   YAPB_shared_release(sh);   // publisher drops its own reference
+ *
+ *   // subscriber thread
+ *   YAPB_Shared_t *batch[32];
+ *   size_t n;
+ *   YAPB_sub_poll(&sub, batch, 32, &n);
+ *   for (size_t i = 0; i < n; i++) {
+ *       YAPB_Packet_t pkt;
+ *       YAPB_shared_load(&pkt, batch[i]);
+ *       handle(&pkt);
+ *       YAPB_shared_release(batch[i]);
+ *   }
+ * @endcode
+ */
+
+/** @defgroup bus Publish/Subscribe Bus
+ *  Zero-copy packet delivery between modules of one process.
+ */
+
+/**
+ * @ingroup bus
+ * @brief Field filter evaluated on the raw packet buffer.
+ *
+ * Matches packets whose element number @c index (0-based, top level) has
+ * integer type @c type and equals @c value. Only YAPB_INT8 .. YAPB_INT64
+ * are supported; other types never match.
+ */
+typedef struct YAPB_Filter {
+    uint16_t index;    /**< Element position in the packet. */
+    YAPB_Type_t type;  /**< Expected integer type tag. */
+    int64_t value;     /**< Value to compare against (sign-extended). */
+} YAPB_Filter_t;
+
+/** @ingroup bus
+ *  @brief Size of the opaque YAPB_Bus_t storage in bytes. */
+#define YAPB_BUS_SIZE 32
+
+/** @ingroup bus
+ *  @brief Size of the opaque YAPB_Subscriber_t storage in bytes. */
+#define YAPB_SUBSCRIBER_SIZE 256
+
+/** @ingroup bus
+ *  @brief Size of one opaque queue slot in bytes. */
+#define YAPB_BUS_SLOT_SIZE 16
+
+/**
+ * @ingroup bus
+ * @brief Opaque bus handle, stack-allocatable.
+ */
+typedef struct YAPB_Bus {
+    alignas(max_align_t) unsigned char _opaque[YAPB_BUS_SIZE];
+} YAPB_Bus_t;
+
+/**
+ * @ingroup bus
+ * @brief Opaque subscriber handle, stack-allocatable.
+ *
+ * Cache-line aligned so publishers and the consumer do not share lines.
+ */
+typedef struct YAPB_Subscriber {
+    alignas(64) unsigned char _opaque[YAPB_SUBSCRIBER_SIZE];
+} YAPB_Subscriber_t;
+
+/**
+ * @ingroup bus
+ * @brief Opaque subscriber queue slot. The caller provides the array.
+ */
+typedef struct YAPB_BusSlot {
+    alignas(max_align_t) unsigned char _opaque[YAPB_BUS_SLOT_SIZE];
+} YAPB_BusSlot_t;
+
+/**
+ * @ingroup bus
+ * @brief Check whether a raw packet matches a filter.
+ *
+ * Walks the type tags up to the filtered element without decoding anything
+ * else. Malformed packets never match.
+ *
+ * @param data   Raw packet data (including header).
+ * @param len    Size of the data buffer.
+ * @param filter Filter to evaluate.
+ * @return true if the packet matches.
+ */
+bool YAPB_filter_match(const uint8_t *data, size_t len, const YAPB_Filter_t *filter);
+
+/**
+ * @ingroup bus
+ * @brief Initialize an empty bus.
+ * @param bus Bus to initialize.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_bus_init(YAPB_Bus_t *bus);
+
+/**
+ * @ingroup bus
+ * @brief Register a subscriber for a topic.
+ *
+ * @param bus    Bus.
+ * @param sub    Subscriber storage; must stay valid until YAPB_bus_unsubscribe().
+ * @param topic  Topic to receive.
+ * @param slots  Queue storage for the subscriber.
+ * @param nslots Number of slots (a power of two, >= 2).
+ * @param filter Optional filter (copied). May be NULL to receive everything.
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if @p nslots is not
+ *         a power of two >= 2, YAPB_ERR_INVALID_MODE if @p sub is already
+ *         subscribed to @p bus, other error code otherwise.
+ */
+YAPB_Result_t YAPB_bus_subscribe(YAPB_Bus_t *bus, YAPB_Subscriber_t *sub, uint32_t topic,
+                                 YAPB_BusSlot_t *slots, size_t nslots, const YAPB_Filter_t *filter);
+
+/**
+ * @ingroup bus
+ * @brief Stop delivering to a subscriber and unlink it from its bus.
+ *
+ * Waits until no publish can still reach the subscriber, so it must not be
+ * called while publishing on the same thread. Packets already queued stay
+ * queued; drain them with YAPB_sub_poll() and release them. The storage may
+ * then be subscribed again or freed.
+ *
+ * @param sub Subscriber.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_MODE if @p sub is not
+ *         subscribed, other error code otherwise.
+ */
+YAPB_Result_t YAPB_bus_unsubscribe(YAPB_Subscriber_t *sub);
+
+/**
+ * @ingroup bus
+ * @brief Deliver a finalized packet to all matching subscribers.
+ *
+ * Each receiving subscriber gets its own reference. The caller keeps its
+ * reference and releases it when done. Subscribers with a full queue skip
+ * the packet and count it as dropped.
+ *
+ * @param bus           Bus.
+ * @param topic         Topic to publish on.
+ * @param sh            Shared buffer holding a finalized packet.
+ * @param out_delivered Output: number of subscribers that got the packet. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if @p sh does not hold
+ *         a valid packet, other error code otherwise.
+ */
+YAPB_Result_t YAPB_bus_publish(YAPB_Bus_t *bus, uint32_t topic, YAPB_Shared_t *sh, size_t *out_delivered);
+
+/**
+ * @ingroup bus
+ * @brief Take up to @p max queued packets from a subscriber queue.
+ *
+ * Must only be called from the subscriber's consumer thread. The caller owns
+ * one reference to each returned buffer.
+ *
+ * @param sub   Subscriber.
+ * @param out   Output array of buffers.
+ * @param max   Capacity of @p out.
+ * @param out_n Output: number of buffers stored in @p out.
+ * @return YAPB_OK on success (also when the queue is empty), error code otherwise.
+ */
+YAPB_Result_t YAPB_sub_poll(YAPB_Subscriber_t *sub, YAPB_Shared_t **out, size_t max, size_t *out_n);
+
+/**
+ * @ingroup bus
+ * @brief Get the number of packets dropped because the queue was full.
+ * @param sub         Subscriber.
+ * @param out_dropped Output: dropped packet count.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_sub_get_dropped(const YAPB_Subscriber_t *sub, uint64_t *out_dropped);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+#include "yapb_sort.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_compact.h
+ * @brief Log compaction: keep only the latest packet per key.
+ *
+ * Compaction rewrites a packet log (see yapb_log.h) so that it holds only
+ * the last packet for each key. It streams the log through the external
+ * sort (yapb_sort.h), which is stable, so the packets of each key end up
+ * together and in log order. A single pass then writes the last packet of
+ * each group. Memory use is bounded by the sort budget, whatever the log
+ * size.
+ *
+ * A packet whose element at the tombstone path is the integer
+ * @c tombstone_value deletes its key: when it is the last packet of a key,
+ * nothing is written for that key. When compacting only part of a history
+ * (e.g. older log files), set @c keep_tombstones so that the deletions still
+ * hide packets in the rest of it.
+ *
+ * The output is sorted by key. Packets without the key are all kept, after
+ * the keyed ones. The output is written to a temporary file and renamed
+ * into place, so the input and output may be the same file. In that case,
+ * complete packets appended to the file while it is compacted are copied
+ * to the end of the output, uncompacted, just before the rename. An append
+ * that lands between that copy and the rename is lost, and a writer that
+ * keeps the file open goes on writing to the replaced file. Writers must
+ * therefore open the file for each append or be paused for the
+ * compaction. Readers can keep going.
+ *
+ * A sealed segment file (yapb_segment.h) is compacted by its packet data,
+ * and the output is written through a segment writer with the keys and
+ * Bloom filter size of the input's footer, so it is a sealed segment whose
+ * summaries cover only the kept packets.
+ *
+ * @code
+ *   YAPB_KeyPath_t key;
+ *   YAPB_keypath_parse("0", &key);
+ *   YAPB_CompactConfig_t cfg = { .sort = { .mem_budget = 256u << 20 },
+ *                                .tombstone = { 1, { 1 } }, .tombstone_value = OP_DELETE };
+ *   YAPB_Compaction_t job;
+ *   YAPB_compact_start(&job, "state.yapb", "state.yapb", &key, &cfg);
+ *   // ... keep serving reads; appends reopen the file each time ...
+ *   YAPB_compact_wait(&job, &stats);
+ * @endcode
+ */
+
+/** @defgroup compact Log Compaction
+ *  Drop superseded packets from keyed logs.
+ */
+
+/** @ingroup compact
+ *  @brief Size of the opaque YAPB_Compaction_t storage in bytes. */
+#define YAPB_COMPACTION_SIZE 256
+
+/**
+ * @ingroup compact
+ * @brief Compaction configuration. Zeroed fields take their defaults.
+ */
+typedef struct YAPB_CompactConfig {
+    YAPB_SortConfig_t sort;     /**< Memory budget, threads and temporary directory. */
+    YAPB_KeyPath_t tombstone;   /**< Tombstone marker element (depth 0: no tombstones). */
+    int64_t tombstone_value;    /**< Marker value that deletes a key. */
+    bool keep_tombstones;       /**< Write a key's final tombstone instead of dropping it. */
+} YAPB_CompactConfig_t;
+
+/**
+ * @ingroup compact
+ * @brief Compaction statistics.
+ */
+typedef struct YAPB_CompactStats {
+    uint64_t packets_in;    /**< Packets read. */
+    uint64_t packets_out;   /**< Packets written. */
+    uint64_t bytes_in;      /**< Size of the input. */
+    uint64_t bytes_out;     /**< Size of the output. */
+    uint64_t deleted;       /**< Keys whose last packet was a tombstone. */
+    uint64_t carried;       /**< Bytes appended during an in-place compaction and copied over. */
+} YAPB_CompactStats_t;
+
+/**
+ * @ingroup compact
+ * @brief Opaque background compaction, stack-allocatable.
+ */
+typedef struct YAPB_Compaction {
+    alignas(max_align_t) unsigned char _opaque[YAPB_COMPACTION_SIZE];
+} YAPB_Compaction_t;
+
+/**
+ * @ingroup compact
+ * @brief Compact a log file.
+ * @param in_path   Input log.
+ * @param out_path  Output log (replaced when complete; may equal @p in_path).
+ * @param key       Key path.
+ * @param cfg       Configuration. May be NULL for defaults.
+ * @param out_stats Output: statistics. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the input is not a
+ *         valid log, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_compact_file(const char *in_path, const char *out_path, const YAPB_KeyPath_t *key,
+                                const YAPB_CompactConfig_t *cfg, YAPB_CompactStats_t *out_stats);
+
+/**
+ * @ingroup compact
+ * @brief Run YAPB_compact_file() on a background thread.
+ *
+ * The paths, key and configuration are copied (the tmp_dir string is not
+ * and must stay valid until YAPB_compact_wait()).
+ *
+ * @param job      Compaction to start.
+ * @param in_path  Input log.
+ * @param out_path Output log.
+ * @param key      Key path.
+ * @param cfg      Configuration. May be NULL for defaults.
+ * @return YAPB_OK if the thread started, YAPB_ERR_IO otherwise.
+ */
+YAPB_Result_t YAPB_compact_start(YAPB_Compaction_t *job, const char *in_path, const char *out_path,
+                                 const YAPB_KeyPath_t *key, const YAPB_CompactConfig_t *cfg);
+
+/**
+ * @ingroup compact
+ * @brief Check whether a background compaction has finished.
+ * @param job Compaction.
+ * @return true once YAPB_compact_wait() would not block.
+ */
+bool YAPB_compact_done(YAPB_Compaction_t *job);
+
+/**
+ * @ingroup compact
+ * @brief Wait for a background compaction and release its thread.
+ * @param job       Compaction.
+ * @param out_stats Output: statistics. May be NULL.
+ * @return The result of YAPB_compact_file().
+ */
+YAPB_Result_t YAPB_compact_wait(YAPB_Compaction_t *job, YAPB_CompactStats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
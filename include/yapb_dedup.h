@@ -0,0 +1,102 @@
+#pragma once
+#include "yapb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_dedup.h
+ * @brief Write repeated nested packets once, as back-references.
+ *
+ * Packets that carry the same nested packet many times (a device
+ * descriptor repeated with every sample of a batch) copy it in full with
+ * each YAPB_push_nested(). YAPB_push_nested_dedup() remembers the nested
+ * packets already written to a packet in a small hash table. When the same
+ * bytes come again, it writes a 5-byte YAPB_NESTED_REF element holding the
+ * offset of the first copy instead.
+ *
+ * Readers need nothing new: YAPB_pop_nested() and YAPB_pop_next() return
+ * the referenced packet in place, pointing at the first copy.
+ *
+ * @code
+ *   YAPB_Dedup_t dd;
+ *   YAPB_dedup_init(&dd);
+ *   YAPB_initialize(&batch, buf, sizeof(buf));
+ *   for (size_t i = 0; i < n; i++) {
+ *       YAPB_push_nested_dedup(&batch, &dd, &descriptor[i]);  // mostly repeats
+ *       YAPB_push_double(&batch, &value[i]);
+ *   }
+ *   YAPB_finalize(&batch, &len);
+ * @endcode
+ *
+ * References are relative to the packet they are in, so every packet is
+ * still self-contained: a reader can take it alone, and a nested packet
+ * holding references can be copied into another one. A hit is confirmed
+ * with memcmp() against the first copy, so a hash collision never yields
+ * a wrong reference, and entries left from an earlier packet in the same
+ * buffer only cost a miss.
+ */
+
+/** @defgroup dedup Nested Deduplication
+ *  Replace repeated nested packets with references to the first copy.
+ */
+
+/** @ingroup dedup
+ *  @brief Number of hash table slots; a colliding packet replaces the entry. */
+#define YAPB_DEDUP_SLOTS 256
+
+/** @ingroup dedup
+ *  @brief Size of the opaque YAPB_Dedup_t storage in bytes. */
+#define YAPB_DEDUP_SIZE 2080
+
+/**
+ * @ingroup dedup
+ * @brief Opaque deduplication table, stack-allocatable.
+ */
+typedef struct YAPB_Dedup {
+    alignas(max_align_t) unsigned char _opaque[YAPB_DEDUP_SIZE];
+} YAPB_Dedup_t;
+
+/**
+ * @ingroup dedup
+ * @brief Initialize an empty table.
+ *
+ * A table follows the buffer of the packet it is used with and empties
+ * itself when given a packet over another buffer. Call again to start
+ * over explicitly, e.g. when reusing a buffer.
+ *
+ * @param dd Table to initialize.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_dedup_init(YAPB_Dedup_t *dd);
+
+/**
+ * @ingroup dedup
+ * @brief Push a nested packet, or a reference to an identical one already
+ *        pushed with this table.
+ *
+ * Empty nested packets are always copied, as a reference would not be
+ * smaller.
+ *
+ * @param pkt    Packet in write mode.
+ * @param dd     Table of the nested packets pushed to @p pkt so far.
+ * @param nested Finalized or loaded packet to push.
+ * @return YAPB_OK on success, error code otherwise (sticky on @p pkt, as
+ *         for YAPB_push_nested()).
+ */
+YAPB_Result_t YAPB_push_nested_dedup(YAPB_Packet_t *pkt, YAPB_Dedup_t *dd, const YAPB_Packet_t *nested);
+
+/**
+ * @ingroup dedup
+ * @brief Counters since YAPB_dedup_init().
+ * @param dd        Table.
+ * @param out_refs  Output: references written. May be NULL.
+ * @param out_saved Output: bytes saved over plain copies. May be NULL.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_dedup_get_stats(const YAPB_Dedup_t *dd, uint64_t *out_refs, uint64_t *out_saved);
+
+#ifdef __cplusplus
+}
+#endif
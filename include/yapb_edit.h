@@ -0,0 +1,134 @@
+#pragma once
+#include "yapb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_edit.h
+ * @brief Edit sessions: insert, delete and replace elements of a packet.
+ *
+ * Changing an element in the middle of a packet otherwise means popping
+ * everything and pushing it again, along with every nested packet whose
+ * length changes. An edit session records operations against element
+ * positions of an existing packet, at any nesting depth, without touching
+ * it. YAPB_edit_apply() then writes the edited packet in one pass. Runs of
+ * untouched elements are copied with memcpy(), untouched nested packets
+ * are copied whole, and the length headers of the nested packets on the
+ * way to an edit are rewritten. References (YAPB_NESTED_REF) and timestamp
+ * deltas in those packets would no longer line up, so they are written out
+ * as copies and full timestamps.
+ *
+ * Positions are key paths (see yapb_log.h) and always refer to the
+ * original packet, whatever was recorded before. New elements are taken
+ * from a packet built with the usual push functions.
+ *
+ * @code
+ *   YAPB_Edit_t ed;
+ *   YAPB_edit_begin(&ed, &pkt);
+ *
+ *   YAPB_KeyPath_t at;
+ *   YAPB_keypath_parse("3.1", &at);            // element 1 of nested element 3
+ *   YAPB_edit_replace(&ed, &at, &new_elems);   // finalized packet of new elements
+ *   YAPB_keypath_parse("0", &at);
+ *   YAPB_edit_delete(&ed, &at);
+ *
+ *   size_t len;
+ *   YAPB_edit_apply(&ed, out, sizeof(out), &len);
+ * @endcode
+ *
+ * Nothing is copied until YAPB_edit_apply(), so the original packet and
+ * the packets passed as new elements must stay valid until then.
+ */
+
+/** @defgroup edit Edit Sessions
+ *  Rewrite elements of a packet without re-encoding it.
+ */
+
+/** @ingroup edit
+ *  @brief Maximum number of operations per session. */
+#define YAPB_EDIT_MAX_OPS 32
+
+/** @ingroup edit
+ *  @brief Size of the opaque YAPB_Edit_t storage in bytes. */
+#define YAPB_EDIT_SIZE 1344
+
+/**
+ * @ingroup edit
+ * @brief Opaque edit session, stack-allocatable.
+ */
+typedef struct YAPB_Edit {
+    alignas(max_align_t) unsigned char _opaque[YAPB_EDIT_SIZE];
+} YAPB_Edit_t;
+
+/**
+ * @ingroup edit
+ * @brief Start an edit session over a packet.
+ * @param ed  Session to initialize.
+ * @param pkt Packet loaded for reading, or finalized.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_MODE if @p pkt is an
+ *         unfinished write packet, other error code otherwise.
+ */
+YAPB_Result_t YAPB_edit_begin(YAPB_Edit_t *ed, const YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup edit
+ * @brief Insert elements before the element at a path.
+ *
+ * A last index equal to the element count appends to that packet. Several
+ * inserts at the same position keep the order they were recorded in.
+ *
+ * @param ed    Session.
+ * @param at    Position in the original packet.
+ * @param elems Finalized or loaded packet whose elements are inserted.
+ * @return YAPB_OK on success, YAPB_ERR_NOT_FOUND if the position does not
+ *         exist, YAPB_ERR_TYPE_MISMATCH if the path descends into an element
+ *         that is not a nested packet, YAPB_ERR_INVALID_MODE if it lies
+ *         inside an element deleted or replaced in this session,
+ *         YAPB_ERR_BUFFER_TOO_SMALL if the session holds YAPB_EDIT_MAX_OPS
+ *         operations, YAPB_ERR_INVALID_PACKET if a packet is malformed.
+ */
+YAPB_Result_t YAPB_edit_insert(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at, const YAPB_Packet_t *elems);
+
+/**
+ * @ingroup edit
+ * @brief Delete the element at a path (with its contents if nested).
+ * @param ed Session.
+ * @param at Position in the original packet.
+ * @return As YAPB_edit_insert(); YAPB_ERR_INVALID_MODE also if the element
+ *         is already deleted or replaced, or contains recorded edits.
+ */
+YAPB_Result_t YAPB_edit_delete(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at);
+
+/**
+ * @ingroup edit
+ * @brief Replace the element at a path with the elements of a packet.
+ * @param ed    Session.
+ * @param at    Position in the original packet.
+ * @param elems Finalized or loaded packet, usually holding one element.
+ * @return As YAPB_edit_delete().
+ */
+YAPB_Result_t YAPB_edit_replace(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at, const YAPB_Packet_t *elems);
+
+/**
+ * @ingroup edit
+ * @brief Write the edited packet.
+ *
+ * The session is unchanged and can be applied again.
+ *
+ * @param ed      Session.
+ * @param out     Output buffer; must not overlap the original packet.
+ * @param size    Size of @p out.
+ * @param out_len Output: length of the edited packet, or the size needed
+ *                if @p out is too small.
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if @p out is too
+ *         small or the result would exceed the 32-bit packet length,
+ *         YAPB_ERR_INVALID_PACKET if the original packet is malformed,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_edit_apply(const YAPB_Edit_t *ed, uint8_t *out, size_t size, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+#include "yapb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_index.h
+ * @brief Secondary key index over packet log files.
+ *
+ * An index file maps the key at a key path (see yapb_log.h) to the offsets
+ * of the packets that carry it. It is a sorted array of 16-byte entries
+ * (key prefix, log offset) that lookups binary-search in place through a
+ * memory mapping. Entries whose prefix matches are confirmed against the
+ * packet in the log, so blob keys longer than 8 bytes work too.
+ *
+ * Packets appended to the log later are added by YAPB_index_update() as
+ * sorted tail runs, at most eight, that lookups binary-search one by one.
+ * Each update merges its entries with the newest runs no larger than them.
+ * Once the tail grows past a fraction of the sorted part, the update merges
+ * everything into a new sorted part. A last packet that is still being
+ * written is left for the next update.
+ *
+ * @code
+ *   YAPB_KeyPath_t path;
+ *   YAPB_keypath_parse("0", &path);
+ *   YAPB_IndexConfig_t cfg = { .threads = 4 };
+ *   YAPB_index_build("capture.yapb", "capture.idx", &path, &cfg);
+ *
+ *   YAPB_Index_t idx;
+ *   YAPB_index_open(&idx, "capture.yapb", "capture.idx");
+ *   YAPB_Key_t key;
+ *   YAPB_key_from_int(user_id, &key);
+ *   YAPB_Packet_t pkt;
+ *   if (YAPB_index_lookup(&idx, &key, &pkt) == YAPB_OK) {
+ *       // pkt reads straight from the mapped log
+ *   }
+ *   YAPB_index_close(&idx);
+ * @endcode
+ *
+ * Packets without the key are not indexed. Index files store integers in
+ * network byte order and can be moved between machines with their log.
+ */
+
+/** @defgroup index Log Index
+ *  Point lookups into packet logs by key.
+ */
+
+/** @ingroup index
+ *  @brief Size of the opaque YAPB_Index_t storage in bytes. */
+#define YAPB_INDEX_SIZE 256
+
+/**
+ * @ingroup index
+ * @brief Opaque open index, stack-allocatable.
+ */
+typedef struct YAPB_Index {
+    alignas(max_align_t) unsigned char _opaque[YAPB_INDEX_SIZE];
+} YAPB_Index_t;
+
+/**
+ * @ingroup index
+ * @brief Index build configuration. Zeroed fields take their defaults.
+ */
+typedef struct YAPB_IndexConfig {
+    unsigned threads;       /**< Key extraction threads (default 1). */
+    bool numa;              /**< Spread the threads over NUMA nodes, pinned, as the
+                                 sort does (default off). */
+} YAPB_IndexConfig_t;
+
+/**
+ * @ingroup index
+ * @brief Build an index for a log file.
+ *
+ * Worker threads extract and sort the keys of consecutive slices of the
+ * log, and the sorted slices are merged into the index file. The file is
+ * written next to @p index_path and renamed into place when complete.
+ * Needs 16 bytes of memory per packet. A partly written last packet is
+ * left for YAPB_index_update().
+ *
+ * @param log_path   Packet log.
+ * @param index_path Index file to create or replace.
+ * @param key        Key path.
+ * @param cfg        Configuration. May be NULL for defaults.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the log is not
+ *         valid, YAPB_ERR_IO on file errors, other error code otherwise.
+ */
+YAPB_Result_t YAPB_index_build(const char *log_path, const char *index_path,
+                               const YAPB_KeyPath_t *key, const YAPB_IndexConfig_t *cfg);
+
+/**
+ * @ingroup index
+ * @brief Index packets appended to the log since the last build or update.
+ *
+ * Does nothing when the log has not grown. A partly written last packet
+ * is not indexed yet; the next update picks it up once it is complete.
+ *
+ * @param log_path   Packet log.
+ * @param index_path Existing index of that log.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the index does not
+ *         belong to the log (e.g. the log shrank) or new data is malformed,
+ *         YAPB_ERR_IO on file errors, other error code otherwise.
+ */
+YAPB_Result_t YAPB_index_update(const char *log_path, const char *index_path);
+
+/**
+ * @ingroup index
+ * @brief Map an index and its log for lookups.
+ *
+ * Packets appended to the log after the index was last updated are not
+ * visible.
+ *
+ * @param idx        Index handle to initialize.
+ * @param log_path   Packet log.
+ * @param index_path Index of that log.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the index file is
+ *         not valid or does not match the log, YAPB_ERR_IO on file errors,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_index_open(YAPB_Index_t *idx, const char *log_path, const char *index_path);
+
+/**
+ * @ingroup index
+ * @brief Unmap an index opened with YAPB_index_open().
+ * @param idx Index.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_index_close(YAPB_Index_t *idx);
+
+/**
+ * @ingroup index
+ * @brief Get the number of indexed packets.
+ * @param idx       Index.
+ * @param out_count Output: entries in the sorted part plus the tail.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_index_get_count(const YAPB_Index_t *idx, uint64_t *out_count);
+
+/**
+ * @ingroup index
+ * @brief Find the first packet (lowest log offset) with a key.
+ *
+ * @param idx     Index.
+ * @param key     Key to look up (e.g. from YAPB_key_from_int()).
+ * @param out_pkt Output: packet loaded for reading, pointing into the
+ *                mapped log; valid until YAPB_index_close().
+ * @return YAPB_OK if found, YAPB_ERR_NOT_FOUND if no packet has the key,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_index_lookup(const YAPB_Index_t *idx, const YAPB_Key_t *key, YAPB_Packet_t *out_pkt);
+
+/**
+ * @ingroup index
+ * @brief Find the log offsets of all packets with a key, ascending.
+ *
+ * @param idx      Index.
+ * @param key      Key to look up.
+ * @param out_offs Output array of log offsets. May be NULL if @p max is 0.
+ * @param max      Capacity of @p out_offs.
+ * @param out_n    Output: number of matches (may exceed @p max; only the
+ *                 first @p max offsets are stored).
+ * @return YAPB_OK if at least one packet matches, YAPB_ERR_NOT_FOUND
+ *         otherwise, other error code on failure.
+ */
+YAPB_Result_t YAPB_index_find(const YAPB_Index_t *idx, const YAPB_Key_t *key,
+                              uint64_t *out_offs, size_t max, size_t *out_n);
+
+/**
+ * @ingroup index
+ * @brief Load the log packet at an offset returned by YAPB_index_find().
+ * @param idx     Index.
+ * @param off     Log offset.
+ * @param out_pkt Output: packet loaded for reading from the mapped log.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if @p off is not a
+ *         packet start inside the log, other error code otherwise.
+ */
+YAPB_Result_t YAPB_index_load(const YAPB_Index_t *idx, uint64_t off, YAPB_Packet_t *out_pkt);
+
+#ifdef __cplusplus
+}
+#endif
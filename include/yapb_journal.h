@@ -0,0 +1,155 @@
+#pragma once
+#include "yapb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_journal.h
+ * @brief Durable packet log with group commit.
+ *
+ * A journal appends packets to a log file (see yapb_log.h) and reports a
+ * packet as written only after it has reached stable storage. Any number of
+ * threads may submit packets. Submitted packets are copied into a staging
+ * buffer, and a background flusher thread writes everything staged with one
+ * write() and one fdatasync(). All submitters of that batch are then
+ * released together. Packets arriving while a sync is in progress go into
+ * the next batch, so the number of syncs per packet falls as concurrency
+ * rises.
+ *
+ * @code
+ *   YAPB_JournalConfig_t cfg = { .buffer_bytes = 1u << 20, .max_delay_us = 200 };
+ *   YAPB_Journal_t j;
+ *   YAPB_journal_open(&j, "audit.yapb", &cfg);
+ *
+ *   // any thread
+ *   if (YAPB_journal_append(&j, &pkt, NULL) == YAPB_OK) {
+ *       // pkt is durable
+ *   }
+ *
+ *   YAPB_journal_close(&j);
+ * @endcode
+ *
+ * A failed write or sync is sticky: the packets of that batch and all later
+ * calls report YAPB_ERR_IO, since the state of the file is then unknown.
+ */
+
+/** @defgroup journal Journal
+ *  Durable packet logging with batched syncs.
+ */
+
+/** @ingroup journal
+ *  @brief Size of the opaque YAPB_Journal_t storage in bytes. */
+#define YAPB_JOURNAL_SIZE 384
+
+/**
+ * @ingroup journal
+ * @brief Journal configuration. Zero values take their defaults.
+ */
+typedef struct YAPB_JournalConfig {
+    size_t buffer_bytes;    /**< Staging buffer size, the largest batch (default 1 MiB). */
+    uint64_t max_delay_us;  /**< Extra time the flusher waits for more packets after the
+                                 first one of a batch (default 0: sync right away). */
+} YAPB_JournalConfig_t;
+
+/**
+ * @ingroup journal
+ * @brief Journal statistics.
+ */
+typedef struct YAPB_JournalStats {
+    uint64_t packets;           /**< Packets made durable. */
+    uint64_t bytes;             /**< Bytes made durable. */
+    uint64_t syncs;             /**< Batches written (one fdatasync() each). */
+    uint64_t max_batch_packets; /**< Largest batch, in packets. */
+} YAPB_JournalStats_t;
+
+/**
+ * @ingroup journal
+ * @brief Opaque journal handle, stack-allocatable.
+ *
+ * Must not be moved or copied while open (it holds a mutex and is shared
+ * with the flusher thread).
+ */
+typedef struct YAPB_Journal {
+    alignas(max_align_t) unsigned char _opaque[YAPB_JOURNAL_SIZE];
+} YAPB_Journal_t;
+
+/**
+ * @ingroup journal
+ * @brief Open a journal on a log file and start its flusher thread.
+ *
+ * The file is created if needed; packets are appended after any existing
+ * contents. Allocates two staging buffers of @c buffer_bytes each.
+ *
+ * @param j    Journal to initialize.
+ * @param path Log file.
+ * @param cfg  Configuration (NULL for defaults).
+ * @return YAPB_OK on success, YAPB_ERR_IO on file or thread errors, other
+ *         error code otherwise.
+ */
+YAPB_Result_t YAPB_journal_open(YAPB_Journal_t *j, const char *path, const YAPB_JournalConfig_t *cfg);
+
+/**
+ * @ingroup journal
+ * @brief Stage a packet without waiting for it to become durable.
+ *
+ * Blocks only while the staging buffer is full.
+ *
+ * @param j          Journal.
+ * @param pkt        Finalized packet (write mode after YAPB_finalize(), or read mode).
+ * @param out_ticket Output: ticket for YAPB_journal_wait().
+ * @param out_off    Output: file offset of the packet. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if the packet is
+ *         larger than the staging buffer, YAPB_ERR_IO after a failed sync,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_journal_submit(YAPB_Journal_t *j, const YAPB_Packet_t *pkt,
+                                  uint64_t *out_ticket, uint64_t *out_off);
+
+/**
+ * @ingroup journal
+ * @brief Wait until a submitted packet is durable.
+ * @param j      Journal.
+ * @param ticket Ticket from YAPB_journal_submit().
+ * @return YAPB_OK once the packet is on stable storage, YAPB_ERR_IO if its
+ *         batch (or an earlier one) could not be written.
+ */
+YAPB_Result_t YAPB_journal_wait(YAPB_Journal_t *j, uint64_t ticket);
+
+/**
+ * @ingroup journal
+ * @brief Append a packet and wait until it is durable.
+ *
+ * Same as YAPB_journal_submit() followed by YAPB_journal_wait().
+ *
+ * @param j       Journal.
+ * @param pkt     Finalized packet.
+ * @param out_off Output: file offset of the packet. May be NULL.
+ * @return YAPB_OK once the packet is on stable storage, error code otherwise.
+ */
+YAPB_Result_t YAPB_journal_append(YAPB_Journal_t *j, const YAPB_Packet_t *pkt, uint64_t *out_off);
+
+/**
+ * @ingroup journal
+ * @brief Get the journal statistics.
+ * @param j   Journal.
+ * @param out Output: statistics.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_journal_get_stats(YAPB_Journal_t *j, YAPB_JournalStats_t *out);
+
+/**
+ * @ingroup journal
+ * @brief Make all staged packets durable, stop the flusher and close the file.
+ *
+ * No other call may be in progress or follow, except YAPB_journal_open().
+ *
+ * @param j Journal.
+ * @return YAPB_OK on success, YAPB_ERR_IO if any batch failed.
+ */
+YAPB_Result_t YAPB_journal_close(YAPB_Journal_t *j);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,267 @@
+#pragma once
+#include "yapb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_log.h
+ * @brief Packet log files and key extraction.
+ *
+ * A packet log is a file of finalized packets stored back to back, as
+ * produced by the batch writer (see yapb_batch.h). Each packet's header
+ * gives its length, so the next packet starts right after it.
+ *
+ * A key path selects one element of a packet, descending through nested
+ * packets, to use as a sort or lookup key. Numeric keys compare by value;
+ * blob keys compare bytewise. Every key has a 64-bit order-preserving
+ * prefix, so most comparisons are a single integer compare.
+ *
+ * @code
+ *   YAPB_LogMap_t map;
+ *   YAPB_log_map(&map, "capture.yapb", YAPB_MAP_SEQUENTIAL);
+ *   size_t len, off = 0;
+ *   const uint8_t *data = YAPB_log_get_data(&map, &len);
+ *
+ *   YAPB_KeyPath_t path;
+ *   YAPB_keypath_parse("2.0", &path);   // element 0 of nested element 2
+ *
+ *   const uint8_t *rec;
+ *   size_t rec_len;
+ *   while (YAPB_log_next(data, len, &off, &rec, &rec_len) == YAPB_OK) {
+ *       YAPB_Key_t key;
+ *       YAPB_key_extract(rec, rec_len, &path, &key);
+ *   }
+ *   YAPB_log_unmap(&map);
+ * @endcode
+ */
+
+/** @defgroup log Packet Logs
+ *  Read files of concatenated packets and extract keys from them.
+ */
+
+/** @ingroup log
+ *  @brief Maximum nesting depth of a key path. */
+#define YAPB_KEY_MAX_DEPTH 8
+
+/** @ingroup log
+ *  @brief Size of the opaque YAPB_LogMap_t storage in bytes. */
+#define YAPB_LOG_MAP_SIZE 32
+
+/** @ingroup log
+ *  @brief YAPB_log_map() flag: fault in the whole file at map time
+ *  (MAP_POPULATE), so scans take no page faults. */
+#define YAPB_MAP_POPULATE   0x01u
+
+/** @ingroup log
+ *  @brief YAPB_log_map() flag: the file is read front to back
+ *  (MADV_SEQUENTIAL: larger readahead, pages dropped behind the reader). */
+#define YAPB_MAP_SEQUENTIAL 0x02u
+
+/** @ingroup log
+ *  @brief YAPB_log_map() flag: the file is read at random offsets
+ *  (MADV_RANDOM: no readahead). */
+#define YAPB_MAP_RANDOM     0x04u
+
+/** @ingroup log
+ *  @brief YAPB_log_map() flag: start reading the whole file in the
+ *  background (MADV_WILLNEED). */
+#define YAPB_MAP_WILLNEED   0x08u
+
+/** @ingroup log
+ *  @brief YAPB_log_map() flag: ask for transparent huge pages
+ *  (MADV_HUGEPAGE). Only honored by kernels and file systems that support
+ *  huge pages for file mappings; ignored otherwise. */
+#define YAPB_MAP_HUGEPAGE   0x10u
+
+/**
+ * @ingroup log
+ * @brief Location of a key element.
+ *
+ * @c index[0] is the element position in the packet. Each further level is
+ * the element position inside the nested packet selected by the previous
+ * level.
+ */
+typedef struct YAPB_KeyPath {
+    uint16_t depth;                        /**< Number of levels (1..YAPB_KEY_MAX_DEPTH). */
+    uint16_t index[YAPB_KEY_MAX_DEPTH];    /**< Element position per level. */
+} YAPB_KeyPath_t;
+
+/**
+ * @ingroup log
+ * @brief Kind of an extracted key, in sort order.
+ */
+typedef enum {
+    YAPB_KEY_INT  = 0,   /**< INT8..INT64, compared as int64. */
+    YAPB_KEY_REAL = 1,   /**< FLOAT or DOUBLE, compared as double. */
+    YAPB_KEY_BLOB = 2,   /**< BLOB, compared bytewise (shorter first on ties). */
+    YAPB_KEY_NONE = 3,   /**< Path does not exist in the packet; sorts last. */
+} YAPB_KeyKind_t;
+
+/**
+ * @ingroup log
+ * @brief Key extracted from a packet.
+ */
+typedef struct YAPB_Key {
+    uint64_t prefix;        /**< Order-preserving 64-bit image of the key. */
+    const uint8_t *data;    /**< Blob keys: pointer into the packet. */
+    uint16_t len;           /**< Blob keys: length in bytes. */
+    uint8_t kind;           /**< YAPB_KeyKind_t. */
+} YAPB_Key_t;
+
+/**
+ * @ingroup log
+ * @brief Opaque read-only file mapping, stack-allocatable.
+ */
+typedef struct YAPB_LogMap {
+    alignas(max_align_t) unsigned char _opaque[YAPB_LOG_MAP_SIZE];
+} YAPB_LogMap_t;
+
+/**
+ * @ingroup log
+ * @brief Map a file read-only.
+ *
+ * Empty files map to a NULL data pointer with length 0. The access hints
+ * in @p flags are advisory: a hint the kernel rejects does not fail the
+ * call.
+ *
+ * @param map   Mapping to initialize.
+ * @param path  File to map.
+ * @param flags 0 or a combination of YAPB_MAP_* flags. SEQUENTIAL and
+ *              RANDOM are mutually exclusive.
+ * @return YAPB_OK on success, YAPB_ERR_IO if the file cannot be opened or
+ *         mapped, YAPB_ERR_INVALID_MODE for unknown or conflicting flags,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_log_map(YAPB_LogMap_t *map, const char *path, unsigned flags);
+
+/**
+ * @ingroup log
+ * @brief Get the mapped bytes.
+ * @param map     Mapping.
+ * @param out_len Output: file size. May be NULL.
+ * @return Pointer to the file contents (NULL for empty files).
+ */
+const uint8_t *YAPB_log_get_data(const YAPB_LogMap_t *map, size_t *out_len);
+
+/**
+ * @ingroup log
+ * @brief Start reading part of a mapped file in the background.
+ *
+ * For sequential replay, call this every few megabytes for the window
+ * ahead of the reader; it issues MADV_WILLNEED for the pages covering
+ * [off, off + len), clamped to the file.
+ *
+ * @param map Mapping.
+ * @param off Offset of the window.
+ * @param len Window length.
+ * @return YAPB_OK on success (including empty windows), error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_log_prefetch(const YAPB_LogMap_t *map, size_t off, size_t len);
+
+/**
+ * @ingroup log
+ * @brief Unmap a file mapped with YAPB_log_map().
+ * @param map Mapping.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_log_unmap(YAPB_LogMap_t *map);
+
+/**
+ * @ingroup log
+ * @brief Step to the next packet of a log.
+ *
+ * @param data    Log contents.
+ * @param len     Log size in bytes.
+ * @param off     In/out: offset of the next packet, advanced past it.
+ * @param out_pkt Output: start of the packet (header included).
+ * @param out_len Output: packet length from its header.
+ * @return YAPB_OK on success, YAPB_ERR_NO_MORE_ELEMENTS at the end of the
+ *         log, YAPB_ERR_INVALID_PACKET if the header is invalid or the packet
+ *         is truncated, other error code otherwise.
+ */
+YAPB_Result_t YAPB_log_next(const uint8_t *data, size_t len, size_t *off,
+                            const uint8_t **out_pkt, size_t *out_len);
+
+/**
+ * @ingroup log
+ * @brief Parse a key path written as dot-separated indices, e.g. "2.0".
+ * @param spec Path text.
+ * @param out  Output: parsed path.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the text is not a
+ *         valid path, other error code otherwise.
+ */
+YAPB_Result_t YAPB_keypath_parse(const char *spec, YAPB_KeyPath_t *out);
+
+/**
+ * @ingroup log
+ * @brief Extract the key selected by a path from a raw packet.
+ *
+ * Packets that end before the path, or whose intermediate elements are
+ * not nested packets, yield a YAPB_KEY_NONE key. Timestamps (either
+ * encoding) yield integer keys in nanoseconds, so segment zone maps and
+ * indexes over them answer time-range queries.
+ *
+ * @param pkt  Packet data (header included).
+ * @param len  Packet length.
+ * @param path Key path.
+ * @param out  Output: key. Blob keys point into @p pkt.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the packet is
+ *         malformed along the path, other error code otherwise.
+ */
+YAPB_Result_t YAPB_key_extract(const uint8_t *pkt, size_t len, const YAPB_KeyPath_t *path, YAPB_Key_t *out);
+
+/**
+ * @ingroup log
+ * @brief Make an integer key, e.g. to look up packets by an INT64 id.
+ * @param value Key value.
+ * @param out   Output: key.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_key_from_int(int64_t value, YAPB_Key_t *out);
+
+/**
+ * @ingroup log
+ * @brief Make a real key.
+ * @param value Key value.
+ * @param out   Output: key.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_key_from_real(double value, YAPB_Key_t *out);
+
+/**
+ * @ingroup log
+ * @brief Make a blob key. The key points to @p data; it is not copied.
+ * @param data Key bytes.
+ * @param len  Key length.
+ * @param out  Output: key.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_key_from_blob(const uint8_t *data, uint16_t len, YAPB_Key_t *out);
+
+/**
+ * @ingroup log
+ * @brief Compare two keys.
+ * @param a First key.
+ * @param b Second key.
+ * @return Negative, zero or positive as @p a sorts before, with or after @p b.
+ */
+int YAPB_key_compare(const YAPB_Key_t *a, const YAPB_Key_t *b);
+
+/**
+ * @ingroup log
+ * @brief Hash a key. Equal keys (YAPB_key_compare() == 0) hash equally.
+ *
+ * The hash is part of the segment and table file formats and does not
+ * change between versions or machines.
+ *
+ * @param key Key.
+ * @return 64-bit hash.
+ */
+uint64_t YAPB_key_hash(const YAPB_Key_t *key);
+
+#ifdef __cplusplus
+}
+#endif
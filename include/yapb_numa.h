@@ -0,0 +1,153 @@
+#pragma once
+#include "yapb_shared.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_numa.h
+ * @brief NUMA node discovery, thread pinning and per-node buffer pools.
+ *
+ * On multi-socket hosts a packet buffer filled on one node and decoded on
+ * another pays remote memory latency for every access. A node pool set
+ * keeps one shared-buffer pool per node, with memory placed on that node.
+ * Allocation serves the calling thread from its own node's pool and falls
+ * back to the other nodes only when it is empty. Buffers return to the pool
+ * they came from, whichever thread releases them.
+ *
+ * Pin I/O threads and the workers that decode their packets to the same
+ * node so that their buffers stay node-local:
+ *
+ * @code
+ *   // on each worker thread
+ *   YAPB_numa_pin_thread(node);
+ *
+ *   YAPB_NodePools_t np;
+ *   YAPB_nodepools_init(&np, 256 << 20, 2048, YAPB_POOL_MEM_PREFAULT);
+ *   YAPB_Shared_t *sh;
+ *   YAPB_nodepools_alloc(&np, &sh);   // from the caller's node
+ *   ...
+ *   YAPB_nodepools_destroy(&np);
+ * @endcode
+ *
+ * Topology comes from /sys/devices/system/node and placement uses the
+ * mbind() system call, so libnuma is not needed. On hosts without NUMA
+ * information everything behaves as a single node 0.
+ */
+
+/** @defgroup numa NUMA
+ *  Node-local buffer pools and thread placement.
+ */
+
+/** @ingroup numa
+ *  @brief Maximum number of nodes handled; further nodes are ignored. */
+#define YAPB_NUMA_MAX_NODES 8
+
+/** @ingroup numa
+ *  @brief Size of the opaque YAPB_NodePools_t storage in bytes. */
+#define YAPB_NODE_POOLS_SIZE 768
+
+/**
+ * @ingroup numa
+ * @brief Opaque per-node pool set, stack-allocatable.
+ *
+ * Must not move in memory while buffers are allocated from it.
+ */
+typedef struct YAPB_NodePools {
+    alignas(max_align_t) unsigned char _opaque[YAPB_NODE_POOLS_SIZE];
+} YAPB_NodePools_t;
+
+/**
+ * @ingroup numa
+ * @brief Get the number of online nodes (at least 1).
+ * @return Node count, at most YAPB_NUMA_MAX_NODES.
+ */
+unsigned YAPB_numa_node_count(void);
+
+/**
+ * @ingroup numa
+ * @brief Get the id of the i-th online node.
+ * @param i Position, below YAPB_numa_node_count().
+ * @return Node id as used by the kernel, or -1 if @p i is out of range.
+ */
+int YAPB_numa_node_id(unsigned i);
+
+/**
+ * @ingroup numa
+ * @brief Get the node of the CPU the calling thread runs on.
+ * @return Node id, 0 if unknown.
+ */
+int YAPB_numa_current_node(void);
+
+/**
+ * @ingroup numa
+ * @brief Restrict the calling thread to the CPUs of a node.
+ * @param node Node id.
+ * @return YAPB_OK on success (a no-op without NUMA information for node
+ *         0), YAPB_ERR_NOT_FOUND if the node is unknown, YAPB_ERR_IO if
+ *         the affinity cannot be set.
+ */
+YAPB_Result_t YAPB_numa_pin_thread(int node);
+
+/**
+ * @ingroup numa
+ * @brief Prefer a node for the pages of a memory range.
+ *
+ * Applies to pages faulted in afterwards, so call it before first touch.
+ * The policy is a preference: allocation falls back to other nodes when
+ * the node runs out of memory.
+ *
+ * @param mem  Page-aligned start of the range.
+ * @param size Size of the range.
+ * @param node Node id.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_MODE for node ids the
+ *         kernel interface cannot express, YAPB_ERR_IO if the policy cannot
+ *         be set.
+ */
+YAPB_Result_t YAPB_numa_bind(void *mem, size_t size, int node);
+
+/**
+ * @ingroup numa
+ * @brief Create one pool per online node, each backed by memory on its node.
+ * @param np             Pool set to initialize.
+ * @param bytes_per_node Memory per node pool.
+ * @param buf_size       Usable size of each buffer (see YAPB_pool_init()).
+ * @param mem_flags      YAPB_POOL_MEM_HUGETLB, _THP and/or _PREFAULT; the
+ *                       node is chosen per pool.
+ * @return YAPB_OK on success, YAPB_ERR_IO if memory cannot be mapped,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_nodepools_init(YAPB_NodePools_t *np, size_t bytes_per_node, size_t buf_size,
+                                  unsigned mem_flags);
+
+/**
+ * @ingroup numa
+ * @brief Take a buffer, from the calling thread's node if it has one free.
+ * @param np  Pool set.
+ * @param out Output: the buffer, released with YAPB_shared_release().
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if every pool is
+ *         exhausted, other error code otherwise.
+ */
+YAPB_Result_t YAPB_nodepools_alloc(YAPB_NodePools_t *np, YAPB_Shared_t **out);
+
+/**
+ * @ingroup numa
+ * @brief Get the pool of a node, for YAPB_shared_ref() and statistics.
+ * @param np   Pool set.
+ * @param node Node id.
+ * @return The node's pool, or NULL if the node has none.
+ */
+YAPB_Pool_t *YAPB_nodepools_get_pool(YAPB_NodePools_t *np, int node);
+
+/**
+ * @ingroup numa
+ * @brief Unmap all pool memory. No buffer may be in use.
+ * @param np Pool set.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_nodepools_destroy(YAPB_NodePools_t *np);
+
+#ifdef __cplusplus
+}
+#endif
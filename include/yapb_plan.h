@@ -0,0 +1,334 @@
+#pragma once
+#include "yapb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_plan.h
+ * @brief Shape fingerprints and pre-built decode plans.
+ *
+ * Many packets share a handful of fixed layouts (the same sequence of type
+ * tags). A shape fingerprint identifies a layout from its tags alone. A
+ * decode plan records the value offsets of a layout made only of fixed-size
+ * elements, so a matching packet is decoded with one length check and one
+ * tag comparison per field instead of a full pop per element.
+ *
+ * A registry maps fingerprints to plans. Packets whose shape is not
+ * registered take the generic pop path, so results never depend on the
+ * registry content:
+ *
+ * @code
+ *   const YAPB_Plan_t *plan;
+ *   if (YAPB_registry_lookup(&reg, &pkt, &plan) == YAPB_OK) {
+ *       switch (YAPB_plan_get_id(plan)) {
+ *           case SHAPE_POSITION: {
+ *               void *outs[] = { &pos.x, &pos.y, &pos.z };
+ *               YAPB_plan_decode(plan, &pkt, outs);
+ *               break;
+ *           }
+ *       }
+ *   } else {
+ *       decode_generic(&pkt);
+ *   }
+ * @endcode
+ */
+
+/** @defgroup plan Decode Plans
+ *  Fingerprint packet layouts and decode known ones in a single pass.
+ */
+
+/** @ingroup plan
+ *  @brief Maximum number of elements in a decode plan. */
+#define YAPB_PLAN_MAX_FIELDS 32
+
+/** @ingroup plan
+ *  @brief Size of the opaque YAPB_Plan_t storage in bytes. */
+#define YAPB_PLAN_SIZE 128
+
+/** @ingroup plan
+ *  @brief Size of the opaque YAPB_Registry_t storage in bytes. */
+#define YAPB_REGISTRY_SIZE 32
+
+/**
+ * @ingroup plan
+ * @brief Opaque decode plan, stack-allocatable.
+ */
+typedef struct YAPB_Plan {
+    alignas(max_align_t) unsigned char _opaque[YAPB_PLAN_SIZE];
+} YAPB_Plan_t;
+
+/**
+ * @ingroup plan
+ * @brief Opaque plan registry handle, stack-allocatable.
+ */
+typedef struct YAPB_Registry {
+    alignas(max_align_t) unsigned char _opaque[YAPB_REGISTRY_SIZE];
+} YAPB_Registry_t;
+
+/**
+ * @ingroup plan
+ * @brief Compute the shape fingerprint of a type tag sequence.
+ *
+ * Packets with the same tag sequence always have the same fingerprint.
+ *
+ * @param tags   Type tags in element order.
+ * @param count  Number of tags.
+ * @param out_fp Output: 64-bit fingerprint.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_shape_of_tags(const YAPB_Type_t *tags, uint16_t count, uint64_t *out_fp);
+
+/**
+ * @ingroup plan
+ * @brief Compute the shape fingerprint of a packet.
+ *
+ * Walks the type tags from the header without advancing the read position.
+ * Nested packets contribute a single YAPB_NESTED_PKT tag.
+ *
+ * @param pkt       Packet in read mode.
+ * @param out_fp    Output: 64-bit fingerprint.
+ * @param out_count Output: number of elements. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if malformed, other
+ *         error code otherwise.
+ */
+YAPB_Result_t YAPB_get_shape(const YAPB_Packet_t *pkt, uint64_t *out_fp, uint16_t *out_count);
+
+/**
+ * @ingroup plan
+ * @brief Build a decode plan for a layout of fixed-size elements.
+ *
+ * @param plan  Plan to build.
+ * @param id    User identifier returned by YAPB_plan_get_id() for dispatch.
+ * @param tags  Type tags in element order (INT8..INT64, FLOAT, DOUBLE,
+ *              TIMESTAMP only).
+ * @param count Number of tags (at most YAPB_PLAN_MAX_FIELDS).
+ * @return YAPB_OK on success, YAPB_ERR_TYPE_MISMATCH if a tag is not a
+ *         fixed-size type, YAPB_ERR_BUFFER_TOO_SMALL if there are too many
+ *         fields, other error code otherwise.
+ */
+YAPB_Result_t YAPB_plan_build(YAPB_Plan_t *plan, uint32_t id, const YAPB_Type_t *tags, uint16_t count);
+
+/**
+ * @ingroup plan
+ * @brief Build a decode plan from the layout of a sample packet.
+ * @param plan Plan to build.
+ * @param id   User identifier for dispatch.
+ * @param pkt  Sample packet in read mode.
+ * @return YAPB_OK on success, error code as for YAPB_plan_build() otherwise.
+ */
+YAPB_Result_t YAPB_plan_from_packet(YAPB_Plan_t *plan, uint32_t id, const YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup plan
+ * @brief Get the user identifier of a plan.
+ * @param plan Plan.
+ * @return Identifier passed when the plan was built (0 if plan is NULL).
+ */
+uint32_t YAPB_plan_get_id(const YAPB_Plan_t *plan);
+
+/**
+ * @ingroup plan
+ * @brief Get the shape fingerprint a plan decodes.
+ * @param plan Plan.
+ * @return Fingerprint (0 if plan is NULL).
+ */
+uint64_t YAPB_plan_get_shape(const YAPB_Plan_t *plan);
+
+/**
+ * @ingroup plan
+ * @brief Decode every field of a packet with a plan.
+ *
+ * Checks the packet length once and the type tag of every field, then
+ * writes each value to the matching output pointer. Output types are the
+ * same as for the typed pop functions (int8_t*, int16_t*, ..., double*).
+ * A NULL output skips that field. On error no output is modified and the
+ * packet can still be decoded with the generic pop functions.
+ *
+ * The packet's read position is not changed.
+ *
+ * @param plan Plan.
+ * @param pkt  Packet in read mode.
+ * @param outs Array of YAPB_plan_get_count() output pointers.
+ * @return YAPB_OK on success, YAPB_ERR_TYPE_MISMATCH if the packet does not
+ *         have the plan's layout, other error code otherwise.
+ */
+YAPB_Result_t YAPB_plan_decode(const YAPB_Plan_t *plan, const YAPB_Packet_t *pkt, void *const outs[]);
+
+/**
+ * @ingroup plan
+ * @brief Get the number of fields of a plan.
+ * @param plan Plan.
+ * @return Field count (0 if plan is NULL).
+ */
+uint16_t YAPB_plan_get_count(const YAPB_Plan_t *plan);
+
+/**
+ * @ingroup plan
+ * @brief Initialize a registry over caller-provided plan storage.
+ * @param reg    Registry to initialize.
+ * @param slots  Storage for the registered plans.
+ * @param nslots Number of slots (a power of two).
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_registry_init(YAPB_Registry_t *reg, YAPB_Plan_t *slots, size_t nslots);
+
+/**
+ * @ingroup plan
+ * @brief Register a plan (copied) under its shape fingerprint.
+ * @param reg  Registry.
+ * @param plan Plan to add; replaces a plan with the same fingerprint.
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if the registry is
+ *         full, other error code otherwise.
+ */
+YAPB_Result_t YAPB_registry_add(YAPB_Registry_t *reg, const YAPB_Plan_t *plan);
+
+/**
+ * @ingroup plan
+ * @brief Find the plan registered for a shape fingerprint.
+ * @param reg      Registry.
+ * @param shape    Fingerprint.
+ * @param out_plan Output: registered plan (unchanged if not found).
+ * @return YAPB_OK if found, YAPB_ERR_TYPE_MISMATCH if no plan is registered,
+ *         other error code otherwise.
+ */
+YAPB_Result_t YAPB_registry_find(const YAPB_Registry_t *reg, uint64_t shape, const YAPB_Plan_t **out_plan);
+
+/**
+ * @ingroup plan
+ * @brief Fingerprint a packet and find its plan.
+ * @param reg      Registry.
+ * @param pkt      Packet in read mode.
+ * @param out_plan Output: plan for the packet's layout (unchanged if not found).
+ * @return YAPB_OK if found, YAPB_ERR_TYPE_MISMATCH if the layout is not
+ *         registered, other error code otherwise.
+ */
+YAPB_Result_t YAPB_registry_lookup(const YAPB_Registry_t *reg, const YAPB_Packet_t *pkt, const YAPB_Plan_t **out_plan);
+
+/** @defgroup reader Reader Plans
+ *  Decode packets from older or newer writers without per-field errors.
+ *
+ *  A reader describes the layout it expects. Writers on other versions may
+ *  send fewer fields (older) or extra/different trailing fields (newer).
+ *  The generic way to read such packets is to pop field by field and keep
+ *  defaults when a pop fails. A reader plan resolves the difference between
+ *  the expected layout and one observed writer layout once, caches it, and
+ *  then fills the present fields of every packet with that layout in one
+ *  pass. Fields the writer does not provide keep their default values.
+ *
+ *  @code
+ *    static const YAPB_Type_t expected[] = { YAPB_INT32, YAPB_INT32, YAPB_INT16 };
+ *    YAPB_ReaderPlan_t cache[4];
+ *    YAPB_Reader_t rd;
+ *    YAPB_reader_init(&rd, expected, 3, cache, 4);
+ *
+ *    int32_t id = 0, value = 0;
+ *    int16_t flags = 42;   // default for writers without this field
+ *    void *outs[] = { &id, &value, &flags };
+ *    YAPB_reader_decode(&rd, &pkt, outs, NULL);
+ *  @endcode
+ */
+
+/**
+ * @ingroup reader
+ * @brief Output type for YAPB_BLOB fields decoded by a reader or edit.
+ */
+typedef struct YAPB_Blob {
+    const uint8_t *data; /**< Pointer into the packet buffer. */
+    uint16_t len;        /**< Blob length in bytes. */
+} YAPB_Blob_t;
+
+/** @ingroup reader
+ *  @brief Size of the opaque YAPB_ReaderPlan_t storage in bytes. */
+#define YAPB_READER_PLAN_SIZE 96
+
+/** @ingroup reader
+ *  @brief Size of the opaque YAPB_Reader_t storage in bytes. */
+#define YAPB_READER_SIZE 96
+
+/**
+ * @ingroup reader
+ * @brief Opaque resolved plan for one writer layout. The caller provides
+ *        the cache array.
+ */
+typedef struct YAPB_ReaderPlan {
+    alignas(max_align_t) unsigned char _opaque[YAPB_READER_PLAN_SIZE];
+} YAPB_ReaderPlan_t;
+
+/**
+ * @ingroup reader
+ * @brief Opaque reader handle, stack-allocatable.
+ */
+typedef struct YAPB_Reader {
+    alignas(max_align_t) unsigned char _opaque[YAPB_READER_SIZE];
+} YAPB_Reader_t;
+
+/**
+ * @ingroup reader
+ * @brief Initialize a reader for an expected layout.
+ *
+ * @param rd       Reader to initialize.
+ * @param expected Expected type tags in element order (copied).
+ * @param count    Number of expected fields (at most YAPB_PLAN_MAX_FIELDS).
+ * @param cache    Storage for resolved writer layouts.
+ * @param ncache   Number of cache entries (>= 1). When full, the oldest
+ *                 entry is replaced.
+ * @return YAPB_OK on success, YAPB_ERR_TYPE_MISMATCH if an expected tag is
+ *         not a known type, other error code otherwise.
+ */
+YAPB_Result_t YAPB_reader_init(YAPB_Reader_t *rd, const YAPB_Type_t *expected, uint16_t count,
+                               YAPB_ReaderPlan_t *cache, size_t ncache);
+
+/**
+ * @ingroup reader
+ * @brief Resolve and cache the plan for a known writer layout up front.
+ *
+ * Only needed to warm the cache; YAPB_reader_decode() resolves unknown
+ * layouts on first sight.
+ *
+ * @param rd    Reader.
+ * @param tags  Writer's type tags in element order.
+ * @param count Number of writer tags.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_reader_resolve(YAPB_Reader_t *rd, const YAPB_Type_t *tags, uint16_t count);
+
+/**
+ * @ingroup reader
+ * @brief Decode the fields a packet provides, keeping defaults for the rest.
+ *
+ * Fills the leading fields whose type matches the expected layout, stopping
+ * at the first missing or mismatching field, exactly like a sequence of
+ * typed pops that keep their defaults on error. Output types match the
+ * typed pop functions; YAPB_BLOB fields take a YAPB_Blob_t* and
+ * YAPB_NESTED_PKT fields a YAPB_Packet_t* (loaded for reading). A NULL
+ * output skips that field.
+ *
+ * A cached plan is verified against the packet with a length check and one
+ * tag compare per field; only unseen layouts take a full walk. The packet's
+ * read position is not changed.
+ *
+ * @param rd          Reader.
+ * @param pkt         Packet in read mode.
+ * @param outs        Array of output pointers, one per expected field.
+ * @param out_present Output: number of fields filled. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the packet is
+ *         malformed (no output modified), other error code otherwise.
+ */
+YAPB_Result_t YAPB_reader_decode(YAPB_Reader_t *rd, const YAPB_Packet_t *pkt, void *const outs[],
+                                 uint16_t *out_present);
+
+/**
+ * @ingroup reader
+ * @brief Get cache statistics of a reader.
+ * @param rd         Reader.
+ * @param out_hits   Output: packets decoded with a cached plan. May be NULL.
+ * @param out_misses Output: packets that needed a new plan. May be NULL.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_reader_get_stats(const YAPB_Reader_t *rd, uint64_t *out_hits, uint64_t *out_misses);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,284 @@
+#pragma once
+#include "yapb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_segment.h
+ * @brief Segmented packet logs with per-segment Bloom filters and zone maps.
+ *
+ * A segment writer appends packets to numbered segment files in a
+ * directory (seg-00000001.yapb, ...) and starts a new file when a size or
+ * packet limit is reached. When a segment is sealed, the writer appends a
+ * footer with a summary of each configured key (see yapb_log.h):
+ *
+ * - a Bloom filter over the key values, for equality queries;
+ * - the minimum and maximum key (a zone map), for range queries.
+ *
+ * A query then opens only the segments whose summaries say they may hold
+ * a match. The footer is itself a packet, so a segment remains a valid
+ * packet log. Its last element gives the footer length, so readers find it
+ * from the end of the file.
+ *
+ * @code
+ *   static const YAPB_SegmentKey_t keys[] = {
+ *       { .path = { 1, { 0 } }, .flags = YAPB_SEG_BLOOM | YAPB_SEG_ZONE },  // device id
+ *       { .path = { 1, { 1 } }, .flags = YAPB_SEG_ZONE },                   // timestamp
+ *   };
+ *   YAPB_SegmentConfig_t cfg = { .max_bytes = 64u << 20, .keys = keys, .nkeys = 2 };
+ *   YAPB_SegmentWriter_t w;
+ *   YAPB_segw_open(&w, "capture.d", &cfg);
+ *   YAPB_segw_append(&w, &pkt);
+ *   YAPB_segw_close(&w);
+ *
+ *   YAPB_SegmentFilter_t q = { .path = keys[0].path, .op = YAPB_SEG_EQ };
+ *   YAPB_key_from_int(device, &q.lo);
+ *   YAPB_segment_scan("capture.d", &q, on_packet, ctx, &stats);
+ * @endcode
+ */
+
+/** @defgroup segment Segments
+ *  Segmented packet logs that skip segments which cannot match a query.
+ */
+
+/** @ingroup segment
+ *  @brief Maximum number of summarized keys per segment. */
+#define YAPB_SEG_MAX_KEYS 8
+
+/** @ingroup segment
+ *  @brief Keep a Bloom filter of a key's values. */
+#define YAPB_SEG_BLOOM 0x01
+
+/** @ingroup segment
+ *  @brief Keep the minimum and maximum of a key. */
+#define YAPB_SEG_ZONE  0x02
+
+/** @ingroup segment
+ *  @brief Size of the opaque YAPB_SegmentWriter_t storage in bytes. */
+#define YAPB_SEGMENT_WRITER_SIZE 128
+
+/** @ingroup segment
+ *  @brief Size of the opaque YAPB_Segment_t storage in bytes. */
+#define YAPB_SEGMENT_SIZE 128
+
+/**
+ * @ingroup segment
+ * @brief A key to summarize in segment footers.
+ */
+typedef struct YAPB_SegmentKey {
+    YAPB_KeyPath_t path;    /**< Key location in each packet. */
+    uint8_t flags;          /**< YAPB_SEG_BLOOM and/or YAPB_SEG_ZONE. */
+} YAPB_SegmentKey_t;
+
+/**
+ * @ingroup segment
+ * @brief Segment writer configuration. Zeroed limits take their defaults.
+ */
+typedef struct YAPB_SegmentConfig {
+    uint64_t max_bytes;             /**< Seal a segment at this data size (default 64 MiB). */
+    uint32_t max_packets;           /**< Seal a segment at this packet count (default: no limit). */
+    uint32_t bloom_bytes;           /**< Bloom filter size per key (default 8 KiB, max 65535). */
+    const YAPB_SegmentKey_t *keys;  /**< Keys to summarize (copied). */
+    uint16_t nkeys;                 /**< Number of keys (at most YAPB_SEG_MAX_KEYS). */
+    bool sync;                      /**< fdatasync() each segment when it is sealed. */
+} YAPB_SegmentConfig_t;
+
+/**
+ * @ingroup segment
+ * @brief Query operators.
+ */
+typedef enum {
+    YAPB_SEG_EQ    = 0,   /**< Key equals @c lo. */
+    YAPB_SEG_RANGE = 1,   /**< @c lo <= key <= @c hi. */
+} YAPB_SegmentOp_t;
+
+/**
+ * @ingroup segment
+ * @brief Query on one key.
+ */
+typedef struct YAPB_SegmentFilter {
+    YAPB_KeyPath_t path;    /**< Key to test. */
+    uint8_t op;             /**< YAPB_SegmentOp_t. */
+    YAPB_Key_t lo;          /**< Value (EQ) or lower bound (RANGE). */
+    YAPB_Key_t hi;          /**< Upper bound (RANGE only). */
+} YAPB_SegmentFilter_t;
+
+/**
+ * @ingroup segment
+ * @brief Statistics of a segment scan.
+ */
+typedef struct YAPB_SegmentScanStats {
+    uint32_t segments;      /**< Segment files considered. */
+    uint32_t skipped;       /**< Segments skipped by their footer. */
+    uint64_t scanned;       /**< Packets examined in the other segments. */
+    uint64_t matched;       /**< Packets passed to the callback. */
+} YAPB_SegmentScanStats_t;
+
+/**
+ * @ingroup segment
+ * @brief Callback for matching packets. Return false to stop the scan.
+ */
+typedef bool (*YAPB_SegmentFn_t)(void *ctx, YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup segment
+ * @brief Opaque segment writer handle, stack-allocatable.
+ */
+typedef struct YAPB_SegmentWriter {
+    alignas(max_align_t) unsigned char _opaque[YAPB_SEGMENT_WRITER_SIZE];
+} YAPB_SegmentWriter_t;
+
+/**
+ * @ingroup segment
+ * @brief Opaque open segment, stack-allocatable.
+ */
+typedef struct YAPB_Segment {
+    alignas(max_align_t) unsigned char _opaque[YAPB_SEGMENT_SIZE];
+} YAPB_Segment_t;
+
+/**
+ * @ingroup segment
+ * @brief Open a segment writer on a directory.
+ *
+ * New segments are numbered after the highest existing one. The directory
+ * must exist. Allocates the Bloom filters and a write buffer.
+ *
+ * @param w   Writer to initialize.
+ * @param dir Directory for the segment files; must stay valid while the
+ *            writer is open.
+ * @param cfg Configuration.
+ * @return YAPB_OK on success, YAPB_ERR_IO if the directory cannot be read,
+ *         YAPB_ERR_BUFFER_TOO_SMALL for invalid limits, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_segw_open(YAPB_SegmentWriter_t *w, const char *dir, const YAPB_SegmentConfig_t *cfg);
+
+/**
+ * @ingroup segment
+ * @brief Append a finalized packet, sealing the segment if it is full.
+ * @param w   Writer.
+ * @param pkt Finalized packet (write mode after YAPB_finalize(), or read mode).
+ * @return YAPB_OK on success, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_segw_append(YAPB_SegmentWriter_t *w, const YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup segment
+ * @brief Seal the current segment now (no-op if it is empty).
+ * @param w Writer.
+ * @return YAPB_OK on success, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_segw_roll(YAPB_SegmentWriter_t *w);
+
+/**
+ * @ingroup segment
+ * @brief Seal the current segment and free the writer's buffers.
+ * @param w Writer.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_segw_close(YAPB_SegmentWriter_t *w);
+
+/**
+ * @ingroup segment
+ * @brief Map a segment file and read its footer.
+ *
+ * Segments without a valid footer (e.g. still being written) open with no
+ * summaries; they can never be skipped.
+ *
+ * @param seg  Segment to initialize.
+ * @param path Segment file.
+ * @return YAPB_OK on success, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_segment_open(YAPB_Segment_t *seg, const char *path);
+
+/**
+ * @ingroup segment
+ * @brief Get the packet data of a segment (without the footer).
+ * @param seg     Segment.
+ * @param out_len Output: data length. May be NULL.
+ * @return Pointer to the first packet (NULL for empty segments).
+ */
+const uint8_t *YAPB_segment_get_data(const YAPB_Segment_t *seg, size_t *out_len);
+
+/**
+ * @ingroup segment
+ * @brief Check whether a segment has a valid footer.
+ * @param seg Segment.
+ * @return true for a sealed segment, false for plain packet data.
+ */
+bool YAPB_segment_is_sealed(const YAPB_Segment_t *seg);
+
+/**
+ * @ingroup segment
+ * @brief Recover the key configuration a sealed segment was written with.
+ *
+ * A writer opened with the result writes footers that summarize the same
+ * keys with the same Bloom filter size. The limits are left zeroed.
+ *
+ * @param seg  Segment.
+ * @param cfg  Output: configuration, whose @c keys point into @p keys.
+ * @param keys Output: key storage.
+ * @return YAPB_OK on success, YAPB_ERR_NOT_FOUND for an unsealed segment,
+ *         YAPB_ERR_INVALID_PACKET for a malformed key summary.
+ */
+YAPB_Result_t YAPB_segment_get_config(const YAPB_Segment_t *seg, YAPB_SegmentConfig_t *cfg,
+                                      YAPB_SegmentKey_t keys[YAPB_SEG_MAX_KEYS]);
+
+/**
+ * @ingroup segment
+ * @brief Check whether a segment may hold packets matching a filter.
+ *
+ * A false result is definite. A true result may be a false positive (Bloom
+ * filter) or mean that the segment has no summary for the filter's key.
+ *
+ * @param seg    Segment.
+ * @param filter Query.
+ * @return false if no packet of the segment can match.
+ */
+bool YAPB_segment_may_match(const YAPB_Segment_t *seg, const YAPB_SegmentFilter_t *filter);
+
+/**
+ * @ingroup segment
+ * @brief Unmap a segment.
+ * @param seg Segment.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_segment_close(YAPB_Segment_t *seg);
+
+/**
+ * @ingroup segment
+ * @brief Check whether a packet matches a filter exactly.
+ * @param pkt    Packet data (header included).
+ * @param len    Packet length.
+ * @param filter Query.
+ * @return true if the packet's key satisfies the filter.
+ */
+bool YAPB_segment_filter_packet(const uint8_t *pkt, size_t len, const YAPB_SegmentFilter_t *filter);
+
+/**
+ * @ingroup segment
+ * @brief Run a query over all segments of a directory, in segment order.
+ *
+ * Segments whose footer rules out a match are not read. In the others,
+ * each packet is checked exactly and matches are passed to @p fn. An
+ * unsealed segment is read up to its last complete packet.
+ *
+ * @param dir       Segment directory.
+ * @param filter    Query.
+ * @param fn        Callback for matching packets.
+ * @param ctx       Callback context.
+ * @param out_stats Output: scan statistics. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_segment_scan(const char *dir, const YAPB_SegmentFilter_t *filter,
+                                YAPB_SegmentFn_t fn, void *ctx, YAPB_SegmentScanStats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,234 @@
+#pragma once
+#include "yapb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_shared.h
+ * @brief Refcounted packet buffers carved from a fixed-size pool.
+ *
+ * YAPB_Packet_t only borrows memory. When one encoded packet must be handed
+ * to many consumers (possibly on different threads), a shared buffer lets
+ * every consumer hold a reference instead of a copy. The buffer returns to
+ * its pool when the last reference is released.
+ *
+ * The pool is carved from caller-provided memory, so no allocation happens
+ * at runtime. Allocation, retain and release are lock-free and may be called
+ * from any thread. YAPB_pool_mem_alloc() provides backing memory on huge
+ * pages and/or faulted in up front, for pools that see high packet rates.
+ *
+ * @code
+ *   static uint8_t mem[1 << 20];
+ *   YAPB_Pool_t pool;
+ *   YAPB_pool_init(&pool, mem, sizeof(mem), 2048);
+ *
+ *   YAPB_Shared_t *sh;
+ *   YAPB_shared_alloc(&pool, &sh);
+ *   YAPB_Packet_t pkt;
+ *   YAPB_shared_initialize(&pkt, sh);
+ *   YAPB_push_i32(&pkt, &temp);
+ *   YAPB_finalize(&pkt, NULL);
+ *
+ *   for (each subscriber) {
+ *       YAPB_shared_retain(sh);
+ *       enqueue(subscriber, sh);   // subscriber calls YAPB_shared_release()
+ *   }
+ *   YAPB_shared_release(sh);
+ * @endcode
+ *
+ * Slices (blobs, nested packets) point into the shared buffer. To keep a
+ * slice alive after the packet handle is gone, take a reference on its
+ * owner with YAPB_shared_ref().
+ */
+
+/** @defgroup shared Shared Buffers
+ *  Pool-backed, reference-counted packet buffers for zero-copy fan-out.
+ */
+
+/** @ingroup shared
+ *  @brief Size of the opaque YAPB_Pool_t storage in bytes. */
+#define YAPB_POOL_SIZE 64
+
+/** @ingroup shared
+ *  @brief Alignment and header size of each pool slot in bytes. */
+#define YAPB_SHARED_ALIGN 64
+
+/** @ingroup shared
+ *  @brief YAPB_pool_mem_alloc() flag: back the memory with explicit huge
+ *  pages (MAP_HUGETLB). Falls back to YAPB_POOL_MEM_THP when no huge pages
+ *  are reserved. */
+#define YAPB_POOL_MEM_HUGETLB  0x01u
+
+/** @ingroup shared
+ *  @brief YAPB_pool_mem_alloc() flag: align the memory to the huge page size
+ *  and ask for transparent huge pages (MADV_HUGEPAGE). */
+#define YAPB_POOL_MEM_THP      0x02u
+
+/** @ingroup shared
+ *  @brief YAPB_pool_mem_alloc() flag: fault in every page before returning,
+ *  so the first packets take no page faults. */
+#define YAPB_POOL_MEM_PREFAULT 0x04u
+
+/** @ingroup shared
+ *  @brief YAPB_pool_mem_alloc() flag: prefer NUMA node @p n (0..254) for
+ *  the pages. Dropped from the returned flags if the kernel refuses the
+ *  placement. See yapb_numa.h. */
+#define YAPB_POOL_MEM_NODE(n)  ((((unsigned)(n)) + 1u) << 8)
+
+/**
+ * @ingroup shared
+ * @brief Opaque buffer pool handle, stack-allocatable.
+ *
+ * Internals are hidden; use YAPB_pool_init() to set up. The pool must not
+ * move in memory while buffers are allocated from it.
+ */
+typedef struct YAPB_Pool {
+    alignas(max_align_t) unsigned char _opaque[YAPB_POOL_SIZE];
+} YAPB_Pool_t;
+
+/**
+ * @ingroup shared
+ * @brief Reference-counted buffer from a YAPB_Pool_t. Only used by pointer.
+ */
+typedef struct YAPB_Shared YAPB_Shared_t;
+
+/**
+ * @ingroup shared
+ * @brief Initialize a pool of equally sized buffers over caller memory.
+ *
+ * Each slot takes YAPB_SHARED_ALIGN bytes of bookkeeping plus @p buf_size
+ * rounded up to YAPB_SHARED_ALIGN.
+ *
+ * @param pool     Pool to initialize.
+ * @param mem      Backing memory; must stay valid for the pool's lifetime.
+ * @param mem_size Size of the backing memory.
+ * @param buf_size Usable size of each buffer (must be >= YAPB_HEADER_SIZE).
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if not even one
+ *         buffer fits, other error code otherwise.
+ */
+YAPB_Result_t YAPB_pool_init(YAPB_Pool_t *pool, void *mem, size_t mem_size, size_t buf_size);
+
+/**
+ * @ingroup shared
+ * @brief Map anonymous memory to back a pool.
+ *
+ * The size is rounded up to the page size, or to the huge page size when
+ * huge pages are requested. Pass the returned size to YAPB_pool_init() and
+ * YAPB_pool_mem_free().
+ *
+ * @param size      Minimum size in bytes.
+ * @param flags     0 or a combination of YAPB_POOL_MEM_* flags.
+ * @param out_mem   Output: the memory, zero-filled.
+ * @param out_size  Output: size of the mapping.
+ * @param out_flags Output: flags in effect after fallbacks (e.g. THP in
+ *                  place of HUGETLB). May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_IO if the memory cannot be mapped,
+ *         YAPB_ERR_INVALID_MODE for unknown flags, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_pool_mem_alloc(size_t size, unsigned flags, void **out_mem,
+                                  size_t *out_size, unsigned *out_flags);
+
+/**
+ * @ingroup shared
+ * @brief Unmap memory from YAPB_pool_mem_alloc().
+ * @param mem  Memory.
+ * @param size Size returned by YAPB_pool_mem_alloc().
+ * @return YAPB_OK on success, YAPB_ERR_IO on failure, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_pool_mem_free(void *mem, size_t size);
+
+/**
+ * @ingroup shared
+ * @brief Get the number of buffers in the pool and how many are free.
+ * @param pool      Pool.
+ * @param out_total Output: total number of buffers. May be NULL.
+ * @param out_free  Output: buffers currently free (a snapshot). May be NULL.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_pool_get_count(const YAPB_Pool_t *pool, size_t *out_total, size_t *out_free);
+
+/**
+ * @ingroup shared
+ * @brief Take a buffer from the pool with a reference count of one.
+ * @param pool Pool.
+ * @param out  Output: the buffer (unchanged on error).
+ * @return YAPB_OK on success, YAPB_ERR_BUFFER_TOO_SMALL if the pool is
+ *         exhausted, other error code otherwise.
+ */
+YAPB_Result_t YAPB_shared_alloc(YAPB_Pool_t *pool, YAPB_Shared_t **out);
+
+/**
+ * @ingroup shared
+ * @brief Add a reference to a buffer.
+ * @param sh Buffer holding at least one reference.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_shared_retain(YAPB_Shared_t *sh);
+
+/**
+ * @ingroup shared
+ * @brief Drop a reference; the buffer returns to its pool at zero.
+ * @param sh Buffer.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_shared_release(YAPB_Shared_t *sh);
+
+/**
+ * @ingroup shared
+ * @brief Get the data area of a buffer.
+ * @param sh           Buffer.
+ * @param out_capacity Output: usable size in bytes. May be NULL.
+ * @return Pointer to the data area, or NULL if sh is NULL.
+ */
+uint8_t *YAPB_shared_data(YAPB_Shared_t *sh, size_t *out_capacity);
+
+/**
+ * @ingroup shared
+ * @brief Initialize a packet for writing into a shared buffer.
+ *
+ * Same as YAPB_initialize() over the whole data area. Do not hand the
+ * buffer to other threads before YAPB_finalize().
+ *
+ * @param pkt Packet structure to initialize.
+ * @param sh  Buffer to write into.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_shared_initialize(YAPB_Packet_t *pkt, YAPB_Shared_t *sh);
+
+/**
+ * @ingroup shared
+ * @brief Load the packet stored in a shared buffer for reading.
+ *
+ * Same as YAPB_load() over the data area. The packet stays valid as long
+ * as the caller holds a reference on @p sh.
+ *
+ * @param pkt Packet structure to initialize.
+ * @param sh  Buffer holding a finalized packet.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_shared_load(YAPB_Packet_t *pkt, const YAPB_Shared_t *sh);
+
+/**
+ * @ingroup shared
+ * @brief Take a reference on the buffer that contains @p ptr.
+ *
+ * Use this to keep a blob or nested packet alive after the packet it was
+ * popped from is gone, e.g. with the pointer from YAPB_pop_blob() or
+ * YAPB_get_buffer() on a nested packet. Release it with
+ * YAPB_shared_release() on @p out.
+ *
+ * @param pool Pool the buffer came from.
+ * @param ptr  Any pointer into the data area of an allocated buffer.
+ * @param out  Output: owning buffer, now with one more reference.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_MODE if @p ptr is not inside
+ *         an allocated buffer of @p pool, other error code otherwise.
+ */
+YAPB_Result_t YAPB_shared_ref(YAPB_Pool_t *pool, const void *ptr, YAPB_Shared_t **out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+#pragma once
+#include "yapb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_snapshot.h
+ * @brief Incremental snapshots of large packet trees.
+ *
+ * A snapshot file stores an object graph as subtrees, one packet each
+ * (usually built from nested packets), identified by 64-bit ids. Each
+ * subtree carries a CRC-32C checksum. An index sorted by id closes the file.
+ *
+ * An incremental snapshot names a base snapshot. Subtrees that did not
+ * change since the base are reused: the new index entry points at the
+ * bytes in the base file (or in the file the base itself pointed to), so
+ * nothing is re-encoded or copied. Checkpoint cost is proportional to the
+ * changed subtrees. A snapshot can depend on at most
+ * YAPB_SNAP_MAX_FILES - 1 other files. Past that, reused subtrees are
+ * copied byte for byte, which cuts the chain.
+ *
+ * Readers map the snapshot and the files it depends on. A subtree is
+ * located through the index and verified only when it is requested.
+ *
+ * @code
+ *   YAPB_SnapWriter_t w;
+ *   YAPB_snap_begin(&w, "ckpt-0002.snap", "ckpt-0001.snap");
+ *   for (each object) {
+ *       if (object->dirty) YAPB_snap_put(&w, object->id, &encoded);
+ *       else               YAPB_snap_reuse(&w, object->id);
+ *   }
+ *   YAPB_snap_commit(&w, NULL);
+ *
+ *   YAPB_Snapshot_t s;
+ *   YAPB_snap_open(&s, "ckpt-0002.snap");
+ *   YAPB_Packet_t pkt;
+ *   YAPB_snap_get(&s, id, &pkt);   // reads from the mapping
+ *   YAPB_snap_close(&s);
+ * @endcode
+ *
+ * Base file paths are stored as given (relative paths resolve against the
+ * reader's working directory). A base file must not be deleted while
+ * snapshots that depend on it are kept.
+ */
+
+/** @defgroup snapshot Snapshots
+ *  Checkpoints of packet trees that reuse unchanged subtrees.
+ */
+
+/** @ingroup snapshot
+ *  @brief Maximum number of files a snapshot reads from, itself included. */
+#define YAPB_SNAP_MAX_FILES 8
+
+/** @ingroup snapshot
+ *  @brief Size of the opaque YAPB_SnapWriter_t storage in bytes. */
+#define YAPB_SNAP_WRITER_SIZE 256
+
+/** @ingroup snapshot
+ *  @brief Size of the opaque YAPB_Snapshot_t storage in bytes. */
+#define YAPB_SNAPSHOT_SIZE 384
+
+/**
+ * @ingroup snapshot
+ * @brief Snapshot writer statistics.
+ */
+typedef struct YAPB_SnapStats {
+    uint64_t subtrees;      /**< Subtrees in the snapshot. */
+    uint64_t written;       /**< Subtrees written by YAPB_snap_put(). */
+    uint64_t reused;        /**< Subtrees referenced in other files. */
+    uint64_t copied;        /**< Reused subtrees copied to cut the file chain. */
+    uint64_t bytes;         /**< Size of the snapshot file. */
+} YAPB_SnapStats_t;
+
+/**
+ * @ingroup snapshot
+ * @brief Opaque snapshot writer, stack-allocatable.
+ */
+typedef struct YAPB_SnapWriter {
+    alignas(max_align_t) unsigned char _opaque[YAPB_SNAP_WRITER_SIZE];
+} YAPB_SnapWriter_t;
+
+/**
+ * @ingroup snapshot
+ * @brief Opaque open snapshot, stack-allocatable.
+ */
+typedef struct YAPB_Snapshot {
+    alignas(max_align_t) unsigned char _opaque[YAPB_SNAPSHOT_SIZE];
+} YAPB_Snapshot_t;
+
+/**
+ * @ingroup snapshot
+ * @brief Start writing a snapshot.
+ *
+ * The file is written next to @p path and renamed into place by
+ * YAPB_snap_commit().
+ *
+ * @param w         Writer to initialize.
+ * @param path      Snapshot file to create; must not be a file the base
+ *                  snapshot reads from.
+ * @param base_path Previous snapshot for YAPB_snap_reuse(), or NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the base is not a
+ *         valid snapshot, YAPB_ERR_INVALID_MODE if @p path is one of the
+ *         base's files, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_snap_begin(YAPB_SnapWriter_t *w, const char *path, const char *base_path);
+
+/**
+ * @ingroup snapshot
+ * @brief Write a subtree.
+ * @param w   Writer.
+ * @param id  Subtree id (unique within the snapshot).
+ * @param pkt Finalized packet (write mode after YAPB_finalize(), or read mode).
+ * @return YAPB_OK on success, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_snap_put(YAPB_SnapWriter_t *w, uint64_t id, const YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup snapshot
+ * @brief Take a subtree unchanged from the base snapshot.
+ * @param w  Writer.
+ * @param id Subtree id.
+ * @return YAPB_OK on success, YAPB_ERR_NOT_FOUND if the base has no such
+ *         subtree (or there is no base), other error code otherwise.
+ */
+YAPB_Result_t YAPB_snap_reuse(YAPB_SnapWriter_t *w, uint64_t id);
+
+/**
+ * @ingroup snapshot
+ * @brief Write the index, sync the file and rename it into place.
+ *
+ * The writer is closed in all cases.
+ *
+ * @param w         Writer.
+ * @param out_stats Output: statistics. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_MODE if an id was used
+ *         twice, YAPB_ERR_IO on file errors, other error code otherwise.
+ */
+YAPB_Result_t YAPB_snap_commit(YAPB_SnapWriter_t *w, YAPB_SnapStats_t *out_stats);
+
+/**
+ * @ingroup snapshot
+ * @brief Discard a snapshot being written and close the writer.
+ * @param w Writer.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_snap_abort(YAPB_SnapWriter_t *w);
+
+/**
+ * @ingroup snapshot
+ * @brief Map a snapshot and the files it depends on.
+ * @param s    Snapshot to initialize.
+ * @param path Snapshot file.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the file or its
+ *         index is corrupt, YAPB_ERR_IO on file errors, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_snap_open(YAPB_Snapshot_t *s, const char *path);
+
+/**
+ * @ingroup snapshot
+ * @brief Get the number of subtrees.
+ * @param s         Snapshot.
+ * @param out_count Output: subtree count.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_snap_get_count(const YAPB_Snapshot_t *s, uint64_t *out_count);
+
+/**
+ * @ingroup snapshot
+ * @brief Get the id of the i-th subtree in id order.
+ * @param s      Snapshot.
+ * @param i      Position, below the count.
+ * @param out_id Output: subtree id.
+ * @return YAPB_OK on success, YAPB_ERR_NOT_FOUND if @p i is out of range.
+ */
+YAPB_Result_t YAPB_snap_get_id(const YAPB_Snapshot_t *s, uint64_t i, uint64_t *out_id);
+
+/**
+ * @ingroup snapshot
+ * @brief Load a subtree after verifying its checksum.
+ * @param s       Snapshot.
+ * @param id      Subtree id.
+ * @param out_pkt Output: packet loaded for reading from the mapping; valid
+ *                until YAPB_snap_close().
+ * @return YAPB_OK on success, YAPB_ERR_NOT_FOUND if there is no such
+ *         subtree, YAPB_ERR_INVALID_PACKET if it is corrupt, other error
+ *         code otherwise.
+ */
+YAPB_Result_t YAPB_snap_get(const YAPB_Snapshot_t *s, uint64_t id, YAPB_Packet_t *out_pkt);
+
+/**
+ * @ingroup snapshot
+ * @brief Unmap a snapshot and its base files.
+ * @param s Snapshot.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_snap_close(YAPB_Snapshot_t *s);
+
+#ifdef __cplusplus
+}
+#endif
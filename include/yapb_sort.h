@@ -0,0 +1,88 @@
+#pragma once
+#include "yapb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_sort.h
+ * @brief External merge sort of packet log files by key.
+ *
+ * Sorts a log of concatenated packets (see yapb_log.h) by the key at a key
+ * path, with memory use bounded by a budget independent of the file size:
+ *
+ * 1. Run generation: worker threads take consecutive slices of the
+ *    memory-mapped input, sort a compact array of 16-byte entries
+ *    (64-bit key prefix plus record number) and write each slice as a
+ *    sorted run. Full key comparisons only happen when two blob keys
+ *    share their 8-byte prefix. A run is its slice reordered, so all runs
+ *    share one temporary file, each at its slice's offset.
+ * 2. Merge: the run file is memory-mapped and up to `merge_fanin` runs at
+ *    a time are merged with a k-way heap. With more runs than that, extra
+ *    passes merge groups into a second temporary file until one pass can
+ *    write the output. At most three files are open at any run count.
+ *
+ * The sort is stable: packets with equal keys keep their input order.
+ * Packets without the key sort last. Unlike the rest of the library, this
+ * module allocates heap memory (within the budget) and starts threads.
+ *
+ * @code
+ *   YAPB_KeyPath_t key;
+ *   YAPB_keypath_parse("0", &key);
+ *   YAPB_SortConfig_t cfg = { .mem_budget = 256u << 20, .threads = 4 };
+ *   YAPB_sort_file("capture.yapb", "sorted.yapb", &key, &cfg, NULL);
+ * @endcode
+ */
+
+/** @defgroup sort External Sort
+ *  Sort packet logs larger than memory.
+ */
+
+/**
+ * @ingroup sort
+ * @brief Sort configuration. Zeroed fields take their defaults.
+ */
+typedef struct YAPB_SortConfig {
+    size_t mem_budget;      /**< Heap bytes for key arrays and write buffers (default 64 MiB). */
+    unsigned threads;       /**< Run generation threads (default 1). */
+    const char *tmp_dir;    /**< Directory for run files (default: the output's directory). */
+    unsigned merge_fanin;   /**< Runs merged per heap (default 128, minimum 2). */
+    bool numa;              /**< Spread run generation threads over NUMA nodes, pinned,
+                                 with node-local buffers (default off). */
+    uint64_t in_len;        /**< Sort only the first in_len bytes of the input, which must
+                                 end on a packet boundary (default: the whole file). */
+} YAPB_SortConfig_t;
+
+/**
+ * @ingroup sort
+ * @brief Sort statistics.
+ */
+typedef struct YAPB_SortStats {
+    uint64_t records;       /**< Packets sorted. */
+    uint64_t bytes;         /**< Bytes written to the output. */
+    uint32_t runs;          /**< Sorted runs generated (1 means no merge pass). */
+    uint32_t passes;        /**< Merge passes over the data (0 for a single run). */
+} YAPB_SortStats_t;
+
+/**
+ * @ingroup sort
+ * @brief Sort a packet log file by key into a new file.
+ *
+ * @param in_path   Input log.
+ * @param out_path  Output log (created or truncated; must differ from input).
+ * @param key       Key path.
+ * @param cfg       Configuration. May be NULL for defaults.
+ * @param out_stats Output: statistics. May be NULL.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the input is not a
+ *         valid log or is shorter than @c in_len, YAPB_ERR_INVALID_MODE if the output is the input file,
+ *         YAPB_ERR_IO on file errors, YAPB_ERR_BUFFER_TOO_SMALL if the
+ *         budget cannot hold the per-thread buffers, other error code
+ *         otherwise.
+ */
+YAPB_Result_t YAPB_sort_file(const char *in_path, const char *out_path, const YAPB_KeyPath_t *key,
+                             const YAPB_SortConfig_t *cfg, YAPB_SortStats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,166 @@
+#pragma once
+#include "yapb_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file yapb_table.h
+ * @brief Persistent memory-mapped hash table of packets by key.
+ *
+ * A table file maps the key at a key path (see yapb_log.h) to the latest
+ * packet stored with that key. The file holds a header, an open-addressing
+ * slot array (linear probing, 16 bytes per slot) and an append-only data
+ * region with the packets themselves. The whole file is memory-mapped, so
+ * opening an existing table costs one mmap() regardless of its size, and
+ * lookups return packets that read straight from the mapping.
+ *
+ * A put appends the packet to the data region, advances the published end
+ * of the data, and only then points the slot at the packet, with a single
+ * 8-byte store. A crash at any point leaves either the old or the new
+ * packet visible for the key, never a torn one. Stores to a shared mapping
+ * survive a process crash without further work; with @c sync set, each step
+ * is also flushed with msync() before the next, which covers power loss.
+ *
+ * When the slots pass 3/4 load or the data region is full, the table is
+ * rebuilt into a new file with only the live packets, which is renamed over
+ * the old one.
+ *
+ * @code
+ *   YAPB_KeyPath_t key;
+ *   YAPB_keypath_parse("0", &key);
+ *   YAPB_Table_t t;
+ *   YAPB_table_open(&t, "state.tbl", &key, NULL);
+ *   YAPB_table_put(&t, &pkt);
+ *
+ *   YAPB_Key_t k;
+ *   YAPB_key_from_int(user_id, &k);
+ *   YAPB_Packet_t latest;
+ *   if (YAPB_table_get(&t, &k, &latest) == YAPB_OK) {
+ *       // latest reads from the mapping
+ *   }
+ *   YAPB_table_close(&t);
+ * @endcode
+ *
+ * A table has one writer; it is not thread-safe. Packets returned by
+ * YAPB_table_get() stay valid until the next put or remove (which may remap
+ * the file) or YAPB_table_close().
+ */
+
+/** @defgroup table Packet Table
+ *  Persistent key to latest packet map.
+ */
+
+/** @ingroup table
+ *  @brief Size of the opaque YAPB_Table_t storage in bytes. */
+#define YAPB_TABLE_SIZE 96
+
+/**
+ * @ingroup table
+ * @brief Table configuration. Zero values take their defaults.
+ */
+typedef struct YAPB_TableConfig {
+    uint64_t slots;         /**< Initial slot count, rounded up to a power of two (default 1024). */
+    uint64_t data_bytes;    /**< Initial data region size (default 1 MiB). */
+    bool sync;              /**< msync() each step of a put, for power-loss safety. */
+    bool read_only;         /**< Open an existing table for lookups only. */
+} YAPB_TableConfig_t;
+
+/**
+ * @ingroup table
+ * @brief Table statistics.
+ */
+typedef struct YAPB_TableStats {
+    uint64_t count;         /**< Keys in the table. */
+    uint64_t slots;         /**< Slot array size. */
+    uint64_t data_used;     /**< Data region bytes in use, including superseded packets. */
+    uint64_t data_live;     /**< Bytes of the latest packets. */
+    uint64_t data_bytes;    /**< Data region size. */
+} YAPB_TableStats_t;
+
+/**
+ * @ingroup table
+ * @brief Opaque open table, stack-allocatable.
+ */
+typedef struct YAPB_Table {
+    alignas(max_align_t) unsigned char _opaque[YAPB_TABLE_SIZE];
+} YAPB_Table_t;
+
+/**
+ * @ingroup table
+ * @brief Open a table file, creating it if it does not exist.
+ *
+ * After a crash the counters in the header are recomputed from the slots.
+ *
+ * @param t    Table to initialize.
+ * @param path Table file.
+ * @param key  Key path; must match the one the table was created with.
+ * @param cfg  Configuration. May be NULL for defaults.
+ * @return YAPB_OK on success, YAPB_ERR_INVALID_PACKET if the file is not a
+ *         table or has another key path, YAPB_ERR_IO on file errors, other
+ *         error code otherwise.
+ */
+YAPB_Result_t YAPB_table_open(YAPB_Table_t *t, const char *path, const YAPB_KeyPath_t *key,
+                              const YAPB_TableConfig_t *cfg);
+
+/**
+ * @ingroup table
+ * @brief Store a packet as the latest one for its key.
+ * @param t   Table.
+ * @param pkt Finalized packet (write mode after YAPB_finalize(), or read mode).
+ * @return YAPB_OK on success, YAPB_ERR_TYPE_MISMATCH if the packet has no
+ *         key, YAPB_ERR_INVALID_MODE for read-only tables, YAPB_ERR_IO on
+ *         file errors, other error code otherwise.
+ */
+YAPB_Result_t YAPB_table_put(YAPB_Table_t *t, const YAPB_Packet_t *pkt);
+
+/**
+ * @ingroup table
+ * @brief Look up the latest packet for a key.
+ * @param t       Table.
+ * @param key     Key (e.g. from YAPB_key_from_int()).
+ * @param out_pkt Output: packet loaded for reading from the mapping.
+ * @return YAPB_OK if found, YAPB_ERR_NOT_FOUND otherwise, other error code
+ *         on failure.
+ */
+YAPB_Result_t YAPB_table_get(const YAPB_Table_t *t, const YAPB_Key_t *key, YAPB_Packet_t *out_pkt);
+
+/**
+ * @ingroup table
+ * @brief Remove a key.
+ * @param t   Table.
+ * @param key Key.
+ * @return YAPB_OK if removed, YAPB_ERR_NOT_FOUND if absent, other error
+ *         code otherwise.
+ */
+YAPB_Result_t YAPB_table_remove(YAPB_Table_t *t, const YAPB_Key_t *key);
+
+/**
+ * @ingroup table
+ * @brief Get the table statistics.
+ * @param t   Table.
+ * @param out Output: statistics.
+ * @return YAPB_OK on success, error code otherwise.
+ */
+YAPB_Result_t YAPB_table_get_stats(const YAPB_Table_t *t, YAPB_TableStats_t *out);
+
+/**
+ * @ingroup table
+ * @brief Flush the whole mapping to stable storage.
+ * @param t Table.
+ * @return YAPB_OK on success, YAPB_ERR_IO otherwise.
+ */
+YAPB_Result_t YAPB_table_sync(YAPB_Table_t *t);
+
+/**
+ * @ingroup table
+ * @brief Flush, mark the table cleanly closed and unmap it.
+ * @param t Table.
+ * @return YAPB_OK on success, YAPB_ERR_IO otherwise.
+ */
+YAPB_Result_t YAPB_table_close(YAPB_Table_t *t);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,63 +1,20 @@
 #include "yapb.h"
+#include "yapb_internal.h"
 #include <string.h>
-#include <arpa/inet.h>
 
-typedef struct {
-    uint8_t *buffer;      // buffer for writing / raw data for reading
-    size_t buffer_size;   // total buffer size
-    size_t pos;           // current read/write position (starts after header)
-    int mode;             // YAPB_MODE_WRITE or YAPB_MODE_READ
-    YAPB_Result_t error;  // sticky error state, checked by get_error()
-    bool finalized;       // true after YAPB_finalize(), prevents further pushes
-} _YAPB_Packet_t;
-
-_Static_assert(sizeof(_YAPB_Packet_t) <= YAPB_PACKET_SIZE,
-    "YAPB_PACKET_SIZE too small for _YAPB_Packet_t");
-
-#define P(x) ((_YAPB_Packet_t *)(x))
-#define CP(x) ((const _YAPB_Packet_t *)(x))
-
-// Helper to write uint16 in network byte order
-static inline void write_u16(uint8_t *dst, uint16_t val) {
-    uint16_t net = htons(val);
-    memcpy(dst, &net, 2);
-}
-
-// Helper to write uint32 in network byte order
-static inline void write_u32(uint8_t *dst, uint32_t val) {
-    uint32_t net = htonl(val);
-    memcpy(dst, &net, 4);
-}
-
-// Helper to write uint64 in network byte order
-static inline void write_u64(uint8_t *dst, uint64_t val) {
-    uint32_t high = htonl((uint32_t)(val >> 32));
-    uint32_t low = htonl((uint32_t)(val & 0xFFFFFFFF));
-    memcpy(dst, &high, 4);
-    memcpy(dst + 4, &low, 4);
-}
-
-// Helper to read uint16 from network byte order
-static inline uint16_t read_u16(const uint8_t *src) {
-    uint16_t net;
-    memcpy(&net, src, 2);
-    return ntohs(net);
-}
-
-// Helper to read uint32 from network byte order
-static inline uint32_t read_u32(const uint8_t *src) {
-    uint32_t net;
-    memcpy(&net, src, 4);
-    return ntohl(net);
-}
-
-// Helper to read uint64 from network byte order
-static inline uint64_t read_u64(const uint8_t *src) {
-    uint32_t high, low;
-    memcpy(&high, src, 4);
-    memcpy(&low, src + 4, 4);
-    return ((uint64_t)ntohl(high) << 32) | ntohl(low);
-}
+const _YAPB_TagDesc_t _yapb_tag_desc[256] = {
+    [YAPB_INT8]       = { 1, 1, 0, 0 },
+    [YAPB_INT16]      = { 1, 2, 0, 0 },
+    [YAPB_INT32]      = { 1, 4, 0, 0 },
+    [YAPB_INT64]      = { 1, 8, 0, 0 },
+    [YAPB_FLOAT]      = { 1, 4, 0, 0 },
+    [YAPB_DOUBLE]     = { 1, 8, 0, 0 },
+    [YAPB_TIMESTAMP]  = { 1, 8, 0, 0 },
+    [YAPB_TIMESTAMP_DELTA] = { 1, 0, 0, 1 },
+    [YAPB_NESTED_REF] = { 1, 4, 0, 0 },
+    [YAPB_BLOB]       = { 1, 2, 2, 0 },
+    [YAPB_NESTED_PKT] = { 1, 0, 4, 0 },
+};
 
 // Helper to check if at end of packet (for returning COMPLETE vs OK)
 static inline YAPB_Result_t check_complete(_YAPB_Packet_t *p) {
@@ -123,9 +80,11 @@ YAPB_Result_t YAPB_initialize(YAPB_Packet_t *pkt, uint8_t *buffer, size_t size)
     }
     _YAPB_Packet_t *p = P(pkt);
 
+    // Packet lengths are 32-bit on the wire; a larger buffer can't be filled
     p->buffer = buffer;
-    p->buffer_size = size;
+    p->buffer_size = size > UINT32_MAX ? UINT32_MAX : (uint32_t)size;
     p->pos = YAPB_HEADER_SIZE;
+    p->ts_base = 0;
     p->mode = YAPB_MODE_WRITE;
     p->error = YAPB_OK;
     p->finalized = false;
@@ -171,6 +130,7 @@ YAPB_Result_t YAPB_load(YAPB_Packet_t *pkt, const uint8_t *data, size_t size) {
     p->buffer = (uint8_t *)data;
     p->buffer_size = pkt_len;
     p->pos = YAPB_HEADER_SIZE;
+    p->ts_base = 0;
     p->mode = YAPB_MODE_READ;
     p->error = YAPB_OK;
     p->finalized = false;
@@ -264,7 +224,7 @@ YAPB_Result_t YAPB_push_blob(YAPB_Packet_t *pkt, const uint8_t *data, uint16_t l
         p->error = YAPB_ERR_INVALID_MODE;
         return p->error;
     }
-    if (p->pos + 1 + 2 + len > p->buffer_size) {
+    if ((size_t)p->pos + 1 + 2 + len > p->buffer_size) {
         p->error = YAPB_ERR_BUFFER_TOO_SMALL;
         return p->error;
     }
@@ -294,7 +254,7 @@ YAPB_Result_t YAPB_push_nested(YAPB_Packet_t *pkt, const YAPB_Packet_t *nested)
         return p->error;
     }
 
-    if (p->pos + 1 + nested_len > p->buffer_size) {
+    if ((size_t)p->pos + 1 + nested_len > p->buffer_size) {
         p->error = YAPB_ERR_BUFFER_TOO_SMALL;
         return p->error;
     }
@@ -305,6 +265,59 @@ YAPB_Result_t YAPB_push_nested(YAPB_Packet_t *pkt, const YAPB_Packet_t *nested)
     return YAPB_OK;
 }
 
+YAPB_Result_t YAPB_push_timestamp(YAPB_Packet_t *pkt, const int64_t *ns) {
+    _YAPB_Packet_t *p = P(pkt);
+    YAPB_Result_t r = _push_validate(p, ns, 1 + 8);
+    if (r != YAPB_OK) return r;
+
+    if (p->ts_base == 0) {
+        p->ts_base = p->pos;
+    }
+    p->buffer[p->pos++] = YAPB_TIMESTAMP;
+    write_u64(p->buffer + p->pos, (uint64_t)*ns);
+    p->pos += 8;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_push_timestamp_delta(YAPB_Packet_t *pkt, const int64_t *ns) {
+    if (pkt == NULL || ns == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Packet_t *p = P(pkt);
+    // The first timestamp is the base and goes in full
+    if (p->mode != YAPB_MODE_WRITE || p->ts_base == 0) {
+        return YAPB_push_timestamp(pkt, ns);
+    }
+    uint64_t zz = ts_delta_encode(*ns, (int64_t)read_u64(p->buffer + p->ts_base + 1));
+    size_t len = varint_size(zz);
+    YAPB_Result_t r = _push_validate(p, ns, 1 + len);
+    if (r != YAPB_OK) return r;
+
+    p->buffer[p->pos++] = YAPB_TIMESTAMP_DELTA;
+    p->pos += write_varint(p->buffer + p->pos, zz);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_push_timespec(YAPB_Packet_t *pkt, const struct timespec *ts) {
+    if (pkt == NULL || ts == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Packet_t *p = P(pkt);
+    if (p->error < 0) {
+        return p->error;
+    }
+    // Nanoseconds in an int64_t: about 292 years either side of the epoch
+    const int64_t max_sec = INT64_MAX / 1000000000;
+    int64_t sec = (int64_t)ts->tv_sec;
+    // A bad value leaves the packet usable
+    if (ts->tv_nsec < 0 || ts->tv_nsec >= 1000000000 || sec > max_sec || sec < -max_sec ||
+        (sec == max_sec && ts->tv_nsec > INT64_MAX % 1000000000)) {
+        return YAPB_ERR_OUT_OF_RANGE;
+    }
+    int64_t ns = sec * 1000000000 + ts->tv_nsec;
+    return YAPB_push_timestamp(pkt, &ns);
+}
+
 // ============ Pop functions ============
 
 YAPB_Result_t YAPB_pop_i8(YAPB_Packet_t *pkt, int8_t *out) {
@@ -366,7 +379,7 @@ YAPB_Result_t YAPB_pop_blob(YAPB_Packet_t *pkt, const uint8_t **data, uint16_t *
     if (len == NULL) return YAPB_ERR_NULL_PTR;
     _YAPB_Packet_t *p = P(pkt);
 
-    if (p->pos + 3 > p->buffer_size) {
+    if ((size_t)p->pos + 3 > p->buffer_size) {
         p->error = YAPB_ERR_INVALID_PACKET;
         return p->error;
     }
@@ -380,13 +393,31 @@ YAPB_Result_t YAPB_pop_blob(YAPB_Packet_t *pkt, const uint8_t **data, uint16_t *
     return check_complete(p);
 }
 
+// A NESTED_REF pops as the earlier nested packet it points back at
+static YAPB_Result_t _pop_ref(_YAPB_Packet_t *p, YAPB_Packet_t *out) {
+    YAPB_Result_t r = _pop_validate(p, out, YAPB_NESTED_REF, 4);
+    if (r != YAPB_OK) return r;
+
+    size_t at = nested_at(p->buffer, p->pos - 1, p->buffer_size);
+    if (at == 0) {
+        p->error = YAPB_ERR_INVALID_PACKET;
+        return p->error;
+    }
+    YAPB_load(out, p->buffer + at, read_u32(p->buffer + at));
+    p->pos += 4;
+    return check_complete(p);
+}
+
 YAPB_Result_t YAPB_pop_nested(YAPB_Packet_t *pkt, YAPB_Packet_t *out) {
     _YAPB_Packet_t *p = P(pkt);
 
-    if (p->pos + YAPB_HEADER_SIZE + 1 > p->buffer_size) {
+    if ((size_t)p->pos + YAPB_HEADER_SIZE + 1 > p->buffer_size) {
         p->error = YAPB_ERR_INVALID_PACKET;
         return p->error;
     }
+    if (p->buffer[p->pos] == YAPB_NESTED_REF) {
+        return _pop_ref(p, out);
+    }
     uint32_t nested_len = read_u32(p->buffer + p->pos + 1);
 
     YAPB_Result_t r = _pop_validate(p, out, YAPB_NESTED_PKT, nested_len);
@@ -402,6 +433,73 @@ YAPB_Result_t YAPB_pop_nested(YAPB_Packet_t *pkt, YAPB_Packet_t *out) {
     return check_complete(p);
 }
 
+// Decode the TIMESTAMP or TIMESTAMP_DELTA element at p->pos, noting the
+// first TIMESTAMP as the base for later deltas. The base is searched for if
+// it was skipped without being read. Returns the element size, or 0 if it
+// is malformed.
+static size_t _read_timestamp(_YAPB_Packet_t *p, int64_t *out) {
+    size_t span = elem_span(p->buffer, p->pos, p->buffer_size);
+    if (span == 0) {
+        return 0;
+    }
+    if (p->ts_base == 0) {
+        p->ts_base = (p->buffer[p->pos] == YAPB_TIMESTAMP) ? p->pos : ts_base_find(p->buffer, p->pos);
+    }
+    return decode_timestamp(p->buffer, p->pos, p->ts_base, out) ? span : 0;
+}
+
+YAPB_Result_t YAPB_pop_timestamp(YAPB_Packet_t *pkt, int64_t *out) {
+    if (pkt == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Packet_t *p = P(pkt);
+    if (p->error < 0) {
+        return p->error;
+    }
+    if (p->mode != YAPB_MODE_READ) {
+        p->error = YAPB_ERR_INVALID_MODE;
+        return p->error;
+    }
+    if (p->pos >= p->buffer_size) {
+        p->error = YAPB_ERR_NO_MORE_ELEMENTS;
+        return p->error;
+    }
+    uint8_t tag = p->buffer[p->pos];
+    if (tag != YAPB_TIMESTAMP && tag != YAPB_TIMESTAMP_DELTA) {
+        p->error = YAPB_ERR_TYPE_MISMATCH;
+        return p->error;
+    }
+
+    int64_t ns;
+    size_t span = _read_timestamp(p, &ns);
+    if (span == 0) {
+        p->error = YAPB_ERR_INVALID_PACKET;
+        return p->error;
+    }
+    *out = ns;
+    p->pos += span;
+    return check_complete(p);
+}
+
+YAPB_Result_t YAPB_pop_timespec(YAPB_Packet_t *pkt, struct timespec *out) {
+    if (out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    int64_t ns;
+    YAPB_Result_t r = YAPB_pop_timestamp(pkt, &ns);
+    if (r < 0) return r;
+    // Floor division, so times before the epoch keep tv_nsec non-negative
+    int64_t sec = ns / 1000000000;
+    int64_t nsec = ns % 1000000000;
+    if (nsec < 0) {
+        sec--;
+        nsec += 1000000000;
+    }
+    out->tv_sec = (time_t)sec;
+    out->tv_nsec = (long)nsec;
+    return r;
+}
+
 YAPB_Result_t YAPB_get_elem_count(const YAPB_Packet_t *pkt, uint16_t *out_count) {
     if (pkt == NULL || out_count == NULL) {
         return YAPB_ERR_NULL_PTR;
@@ -412,52 +510,20 @@ YAPB_Result_t YAPB_get_elem_count(const YAPB_Packet_t *pkt, uint16_t *out_count)
     }
 
     uint16_t count = 0;
-    size_t scan_pos = YAPB_HEADER_SIZE;
-    size_t data_end = p->buffer_size;
-
-    while (scan_pos < data_end) {
-        YAPB_Type_t type = (YAPB_Type_t)p->buffer[scan_pos++];
-
-        size_t skip;
-        switch (type) {
-            case YAPB_INT8:
-                skip = 1;
-                break;
-            case YAPB_INT16:
-                skip = 2;
-                break;
-            case YAPB_INT32:
-                skip = 4;
-                break;
-            case YAPB_INT64:
-                skip = 8;
-                break;
-            case YAPB_FLOAT:
-                skip = 4;
-                break;
-            case YAPB_DOUBLE:
-                skip = 8;
-                break;
-            case YAPB_BLOB:
-                if (scan_pos + 2 > data_end) {
-                    return YAPB_ERR_INVALID_PACKET;
-                }
-                skip = 2 + read_u16(p->buffer + scan_pos);
-                break;
-            case YAPB_NESTED_PKT:
-                if (scan_pos + YAPB_HEADER_SIZE > data_end) {
-                    return YAPB_ERR_INVALID_PACKET;
-                }
-                skip = read_u32(p->buffer + scan_pos);
-                break;
-            default:
-                return YAPB_ERR_INVALID_PACKET;
-        }
+    const uint8_t *b = p->buffer + YAPB_HEADER_SIZE;
+    const uint8_t *end = p->buffer + p->buffer_size;
 
-        if (scan_pos + skip > data_end) {
+    while (b < end) {
+        size_t avail = (size_t)(end - b) - 1;
+        _YAPB_TagDesc_t d = _yapb_tag_desc[b[0]];
+        if (!d.valid || avail < d.len_width) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        size_t len = d.varint ? varint_len(b + 1, avail) : d.size + tag_len_field(d, b);
+        if (len > avail || (d.varint && len == 0)) {
             return YAPB_ERR_INVALID_PACKET;
         }
-        scan_pos += skip;
+        b += 1 + len;
         count++;
     }
 
@@ -465,6 +531,9 @@ YAPB_Result_t YAPB_get_elem_count(const YAPB_Packet_t *pkt, uint16_t *out_count)
     return YAPB_OK;
 }
 
+// Decodes in place rather than through the typed pops: one switch on the
+// tag and one bounds check per element. The switch (not _yapb_tag_desc) is
+// kept here because the value has to be dispatched on its type anyway.
 YAPB_Result_t YAPB_pop_next(YAPB_Packet_t *pkt, YAPB_Element_t *out) {
     if (pkt == NULL || out == NULL) {
         return YAPB_ERR_NULL_PTR;
@@ -482,22 +551,77 @@ YAPB_Result_t YAPB_pop_next(YAPB_Packet_t *pkt, YAPB_Element_t *out) {
         return p->error;
     }
 
-    YAPB_Type_t type = (YAPB_Type_t)p->buffer[p->pos];
-    out->type = type;
-
-    switch (type) {
-        case YAPB_INT8:    return YAPB_pop_i8(pkt, &out->val.i8);
-        case YAPB_INT16:   return YAPB_pop_i16(pkt, &out->val.i16);
-        case YAPB_INT32:   return YAPB_pop_i32(pkt, &out->val.i32);
-        case YAPB_INT64:   return YAPB_pop_i64(pkt, &out->val.i64);
-        case YAPB_FLOAT:   return YAPB_pop_float(pkt, &out->val.f);
-        case YAPB_DOUBLE:  return YAPB_pop_double(pkt, &out->val.d);
-        case YAPB_BLOB:    return YAPB_pop_blob(pkt, &out->val.blob.data, &out->val.blob.len);
-        case YAPB_NESTED_PKT: return YAPB_pop_nested(pkt, &out->val.nested);
+    const uint8_t *b = p->buffer + p->pos;
+    size_t avail = p->buffer_size - p->pos - 1;
+    size_t len;
+    out->type = (YAPB_Type_t)b[0];
+    switch ((YAPB_Type_t)b[0]) {
+        case YAPB_INT8:
+            if ((len = 1) > avail) goto invalid;
+            out->val.i8 = (int8_t)b[1];
+            break;
+        case YAPB_INT16:
+            if ((len = 2) > avail) goto invalid;
+            out->val.i16 = (int16_t)read_u16(b + 1);
+            break;
+        case YAPB_INT32:
+        case YAPB_FLOAT: {
+            if ((len = 4) > avail) goto invalid;
+            uint32_t bits = read_u32(b + 1);
+            memcpy(&out->val, &bits, 4);
+            break;
+        }
+        case YAPB_INT64:
+        case YAPB_DOUBLE: {
+            if ((len = 8) > avail) goto invalid;
+            uint64_t bits = read_u64(b + 1);
+            memcpy(&out->val, &bits, 8);
+            break;
+        }
+        case YAPB_BLOB:
+            if (avail < 2 || (len = 2 + (size_t)read_u16(b + 1)) > avail) goto invalid;
+            out->val.blob.data = b + 3;
+            out->val.blob.len = (uint16_t)(len - 2);
+            break;
+        case YAPB_NESTED_PKT: {
+            if (avail < YAPB_HEADER_SIZE || (len = read_u32(b + 1)) > avail) goto invalid;
+            YAPB_Result_t r = YAPB_load(&out->val.nested, b + 1, len);
+            if (r != YAPB_OK) {
+                p->error = r;
+                return p->error;
+            }
+            break;
+        }
+        case YAPB_TIMESTAMP:
+        case YAPB_TIMESTAMP_DELTA: {
+            size_t span = _read_timestamp(p, &out->val.i64);
+            if (span == 0) goto invalid;
+            len = span - 1;
+            out->type = YAPB_TIMESTAMP;
+            break;
+        }
+        case YAPB_NESTED_REF: {
+            size_t at = nested_at(p->buffer, p->pos, p->buffer_size);
+            if (at == 0) goto invalid;
+            len = 4;
+            out->type = YAPB_NESTED_PKT;
+            YAPB_load(&out->val.nested, p->buffer + at, read_u32(p->buffer + at));
+            break;
+        }
         default:
-            p->error = YAPB_ERR_INVALID_PACKET;
-            return p->error;
+            goto invalid;
     }
+
+    p->pos += 1 + len;
+    return check_complete(p);
+
+invalid:
+    p->error = YAPB_ERR_INVALID_PACKET;
+    return p->error;
+}
+
+unsigned YAPB_abi_version(void) {
+    return YAPB_ABI_VERSION;
 }
 
 YAPB_Result_t YAPB_get_error(const YAPB_Packet_t *pkt) {
@@ -543,6 +667,9 @@ const char *YAPB_Result_str(YAPB_Result_t result) {
         case YAPB_ERR_TYPE_MISMATCH:    return "Type mismatch";
         case YAPB_ERR_NO_MORE_ELEMENTS: return "No more elements";
         case YAPB_ERR_INVALID_PACKET:   return "Invalid packet";
+        case YAPB_ERR_IO:               return "I/O error";
+        case YAPB_ERR_NOT_FOUND:        return "Not found";
+        case YAPB_ERR_OUT_OF_RANGE:     return "Out of range";
         default:                        return "Unknown";
     }
 }
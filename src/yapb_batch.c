@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 200809L
+#include "yapb_batch.h"
+#include "yapb_internal.h"
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    uint8_t *buffer;      // start of the batch buffer
+    size_t buffer_size;   // total buffer size
+    size_t used;          // bytes taken by committed packets
+    size_t count;         // number of committed packets
+    bool open;            // true while a packet handed out by begin() is pending
+} _YAPB_Batch_t;
+
+_Static_assert(sizeof(_YAPB_Batch_t) <= YAPB_BATCH_SIZE,
+    "YAPB_BATCH_SIZE too small for _YAPB_Batch_t");
+
+#define B(x) ((_YAPB_Batch_t *)(x))
+#define CB(x) ((const _YAPB_Batch_t *)(x))
+
+YAPB_Result_t YAPB_batch_init(YAPB_Batch_t *batch, uint8_t *buffer, size_t size) {
+    if (batch == NULL || buffer == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (size < YAPB_HEADER_SIZE) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    _YAPB_Batch_t *b = B(batch);
+
+    b->buffer = buffer;
+    b->buffer_size = size;
+    b->used = 0;
+    b->count = 0;
+    b->open = false;
+
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_begin(YAPB_Batch_t *batch, YAPB_Packet_t *pkt) {
+    if (batch == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Batch_t *b = B(batch);
+    if (b->open) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    YAPB_Result_t r = YAPB_initialize(pkt, b->buffer + b->used, b->buffer_size - b->used);
+    if (r != YAPB_OK) return r;
+
+    b->open = true;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_commit(YAPB_Batch_t *batch, YAPB_Packet_t *pkt) {
+    if (batch == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Batch_t *b = B(batch);
+    if (!b->open) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    // A packet that hit an error is dropped; the region is handed out again
+    // by the next begin().
+    YAPB_Result_t r = YAPB_get_error(pkt);
+    if (r < 0) {
+        b->open = false;
+        return r;
+    }
+
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (data == NULL) {
+        r = YAPB_finalize(pkt, &len);
+        if (r != YAPB_OK) {
+            b->open = false;
+            return r;
+        }
+        data = YAPB_get_buffer(pkt, &len);
+    }
+
+    // The packet must be the one handed out by begin(), not a foreign one
+    if (data != b->buffer + b->used || len > b->buffer_size - b->used) {
+        b->open = false;
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    b->used += len;
+    b->count++;
+    b->open = false;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_abort(YAPB_Batch_t *batch) {
+    if (batch == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    B(batch)->open = false;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_append(YAPB_Batch_t *batch, const YAPB_Packet_t *pkt) {
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (batch == NULL || data == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Batch_t *b = B(batch);
+    if (b->open) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    if (len > b->buffer_size - b->used) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+
+    memmove(b->buffer + b->used, data, len);
+    b->used += len;
+    b->count++;
+    return YAPB_OK;
+}
+
+const uint8_t *YAPB_batch_get_buffer(const YAPB_Batch_t *batch, size_t *out_len) {
+    if (batch == NULL) {
+        return NULL;
+    }
+    const _YAPB_Batch_t *b = CB(batch);
+    if (out_len != NULL) {
+        *out_len = b->used;
+    }
+    return b->buffer;
+}
+
+YAPB_Result_t YAPB_batch_get_count(const YAPB_Batch_t *batch, size_t *out_count) {
+    if (batch == NULL || out_count == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    *out_count = CB(batch)->count;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_reset(YAPB_Batch_t *batch) {
+    if (batch == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Batch_t *b = B(batch);
+    b->used = 0;
+    b->count = 0;
+    b->open = false;
+    return YAPB_OK;
+}
+
+// ============ Batch reader ============
+
+#define CACHE_LINE 64
+
+typedef struct {
+    const uint8_t *data;  // back-to-back packets
+    size_t len;           // size of data
+    size_t off;           // next packet handed out
+    size_t ahead;         // end of the prefetched window
+    size_t count;         // packets handed out
+    size_t window;        // bytes kept prefetched ahead of off
+    YAPB_Result_t error;  // sticky framing error
+} _YAPB_BatchReader_t;
+
+_Static_assert(sizeof(_YAPB_BatchReader_t) <= YAPB_BATCH_READER_SIZE,
+    "YAPB_BATCH_READER_SIZE too small for _YAPB_BatchReader_t");
+
+#define BR(x) ((_YAPB_BatchReader_t *)(x))
+#define CBR(x) ((const _YAPB_BatchReader_t *)(x))
+
+static inline void prefetch_lines(const uint8_t *p, size_t n) {
+#if defined(__GNUC__)
+    uintptr_t line = (uintptr_t)p & ~(uintptr_t)(CACHE_LINE - 1);
+    for (uintptr_t end = (uintptr_t)p + n; line < end; line += CACHE_LINE) {
+        __builtin_prefetch((const void *)line, 0, 3);
+    }
+#else
+    (void)p;
+    (void)n;
+#endif
+}
+
+// Prefetch the lines of [off, off + window) not covered by an earlier
+// call. The window is plain bytes, so it runs ahead without reading the
+// headers in it, and covers packet bodies as well as headers. Each line
+// is requested about once.
+static inline void reader_prefetch(_YAPB_BatchReader_t *r) {
+    size_t end = (r->len - r->off > r->window) ? r->off + r->window : r->len;
+    if (end > r->ahead) {
+        size_t from = (r->ahead > r->off) ? r->ahead : r->off;
+        prefetch_lines(r->data + from, end - from);
+        r->ahead = end;
+    }
+}
+
+static inline YAPB_Result_t reader_next(_YAPB_BatchReader_t *r, YAPB_Packet_t *out) {
+    if (r->error < 0) {
+        return r->error;
+    }
+    if (r->window > 0) {
+        reader_prefetch(r);
+    }
+    size_t rest = r->len - r->off;
+    if (rest == 0) {
+        return YAPB_ERR_NO_MORE_ELEMENTS;
+    }
+    uint32_t n = rest >= YAPB_HEADER_SIZE ? read_u32(r->data + r->off) : 0;
+    if (n < YAPB_HEADER_SIZE || n > rest) {
+        r->error = YAPB_ERR_INVALID_PACKET;
+        return r->error;
+    }
+    YAPB_Result_t res = YAPB_load(out, r->data + r->off, n);
+    if (res != YAPB_OK) {
+        return res;
+    }
+    r->off += n;
+    r->count++;
+    return YAPB_OK;
+}
+
+static void reader_init(_YAPB_BatchReader_t *r, const uint8_t *data, size_t len, unsigned distance) {
+    r->data = data;
+    r->len = len;
+    r->off = 0;
+    r->ahead = 0;
+    r->count = 0;
+    r->window = (size_t)distance * CACHE_LINE;
+    r->error = YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_reader_init(YAPB_BatchReader_t *reader, const uint8_t *data, size_t len,
+                                     unsigned distance) {
+    if (reader == NULL || (data == NULL && len > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    reader_init(BR(reader), data, len, distance);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_reader_next(YAPB_BatchReader_t *reader, YAPB_Packet_t *out) {
+    if (reader == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    return reader_next(BR(reader), out);
+}
+
+YAPB_Result_t YAPB_batch_reader_tell(const YAPB_BatchReader_t *reader, size_t *out_off, size_t *out_count) {
+    if (reader == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_BatchReader_t *r = CBR(reader);
+    if (out_off != NULL) {
+        *out_off = r->off;
+    }
+    if (out_count != NULL) {
+        *out_count = r->count;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_batch_for_each(const uint8_t *data, size_t len, unsigned distance,
+                                  YAPB_PacketFn_t fn, void *ctx) {
+    if (fn == NULL || (data == NULL && len > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_BatchReader_t r;
+    reader_init(&r, data, len, distance);
+    YAPB_Packet_t pkt;
+    YAPB_Result_t res;
+    while ((res = reader_next(&r, &pkt)) == YAPB_OK) {
+        res = fn(ctx, &pkt);
+        if (res < 0) {
+            return res;
+        }
+    }
+    return (res == YAPB_ERR_NO_MORE_ELEMENTS) ? YAPB_OK : res;
+}
+
+// ============ Coalescing writer ============
+
+typedef struct {
+    YAPB_Batch_t batch;          // pending packets
+    YAPB_CoalesceConfig_t cfg;   // flush thresholds
+    YAPB_FlushFn_t flush;        // output callback
+    void *ctx;                   // user context for flush
+    uint64_t first_us;           // commit time of the oldest pending packet
+    bool building;               // a packet from begin() is not committed yet
+    YAPB_CoalesceStats_t stats;  // flush statistics
+} _YAPB_Coalescer_t;
+
+_Static_assert(sizeof(_YAPB_Coalescer_t) <= YAPB_COALESCER_SIZE,
+    "YAPB_COALESCER_SIZE too small for _YAPB_Coalescer_t");
+
+#define C(x) ((_YAPB_Coalescer_t *)(x))
+#define CC(x) ((const _YAPB_Coalescer_t *)(x))
+
+// Hand the pending batch to the flush callback and account for it
+static YAPB_Result_t _coalesce_flush(_YAPB_Coalescer_t *c, YAPB_FlushReason_t reason) {
+    size_t len, count;
+    const uint8_t *data = YAPB_batch_get_buffer(&c->batch, &len);
+    YAPB_batch_get_count(&c->batch, &count);
+    if (count == 0) {
+        return YAPB_OK;
+    }
+
+    YAPB_Result_t r = c->flush(c->ctx, data, len, count);
+    if (r < 0) return r;
+
+    YAPB_CoalesceStats_t *s = &c->stats;
+    s->flushes[reason]++;
+    s->packets += count;
+    s->bytes += len;
+    if (count > s->max_batch_packets) s->max_batch_packets = count;
+    if (len > s->max_batch_bytes) s->max_batch_bytes = len;
+
+    size_t bucket = 0;
+    while (bucket + 1 < YAPB_COALESCE_HIST_BUCKETS && (count >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    s->batch_hist[bucket]++;
+
+    YAPB_batch_reset(&c->batch);
+    return YAPB_OK;
+}
+
+// Flush if any threshold is reached after a packet was added
+static YAPB_Result_t _coalesce_check(_YAPB_Coalescer_t *c, uint64_t now_us) {
+    size_t len, count;
+    YAPB_batch_get_buffer(&c->batch, &len);
+    YAPB_batch_get_count(&c->batch, &count);
+
+    if (c->cfg.max_bytes != 0 && len >= c->cfg.max_bytes) {
+        return _coalesce_flush(c, YAPB_FLUSH_SIZE);
+    }
+    if (c->cfg.max_packets != 0 && count >= c->cfg.max_packets) {
+        return _coalesce_flush(c, YAPB_FLUSH_COUNT);
+    }
+    return YAPB_coalesce_poll((YAPB_Coalescer_t *)c, now_us);
+}
+
+// Record the arrival time of the first packet in a new batch
+static void _coalesce_mark(_YAPB_Coalescer_t *c, uint64_t now_us) {
+    size_t count;
+    YAPB_batch_get_count(&c->batch, &count);
+    if (count == 1) {
+        c->first_us = now_us;
+    }
+}
+
+YAPB_Result_t YAPB_coalesce_init(YAPB_Coalescer_t *c, uint8_t *buffer, size_t size,
+                                 const YAPB_CoalesceConfig_t *cfg, YAPB_FlushFn_t flush, void *ctx) {
+    if (c == NULL || cfg == NULL || flush == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Coalescer_t *co = C(c);
+
+    YAPB_Result_t r = YAPB_batch_init(&co->batch, buffer, size);
+    if (r != YAPB_OK) return r;
+
+    co->cfg = *cfg;
+    co->flush = flush;
+    co->ctx = ctx;
+    co->first_us = 0;
+    co->building = false;
+    memset(&co->stats, 0, sizeof(co->stats));
+
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_coalesce_begin(YAPB_Coalescer_t *c, YAPB_Packet_t *pkt, uint64_t now_us) {
+    if (c == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Coalescer_t *co = C(c);
+
+    // A deadline that expired while the caller was idle is honoured first
+    YAPB_Result_t r = YAPB_coalesce_poll(c, now_us);
+    if (r < 0) return r;
+
+    r = YAPB_batch_begin(&co->batch, pkt);
+    if (r == YAPB_ERR_BUFFER_TOO_SMALL) {
+        r = _coalesce_flush(co, YAPB_FLUSH_FULL);
+        if (r < 0) return r;
+        r = YAPB_batch_begin(&co->batch, pkt);
+    }
+    if (r == YAPB_OK) {
+        co->building = true;
+    }
+    return r;
+}
+
+YAPB_Result_t YAPB_coalesce_commit(YAPB_Coalescer_t *c, YAPB_Packet_t *pkt, uint64_t now_us) {
+    if (c == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Coalescer_t *co = C(c);
+
+    // The batch closes the region whether or not the commit succeeds
+    YAPB_Result_t r = YAPB_batch_commit(&co->batch, pkt);
+    co->building = false;
+    if (r != YAPB_OK) return r;
+
+    _coalesce_mark(co, now_us);
+    return _coalesce_check(co, now_us);
+}
+
+YAPB_Result_t YAPB_coalesce_append(YAPB_Coalescer_t *c, const YAPB_Packet_t *pkt, uint64_t now_us) {
+    if (c == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Coalescer_t *co = C(c);
+
+    YAPB_Result_t r = YAPB_coalesce_poll(c, now_us);
+    if (r < 0) return r;
+
+    r = YAPB_batch_append(&co->batch, pkt);
+    if (r == YAPB_ERR_BUFFER_TOO_SMALL) {
+        r = _coalesce_flush(co, YAPB_FLUSH_FULL);
+        if (r < 0) return r;
+        r = YAPB_batch_append(&co->batch, pkt);
+    }
+    if (r != YAPB_OK) return r;
+
+    _coalesce_mark(co, now_us);
+    return _coalesce_check(co, now_us);
+}
+
+YAPB_Result_t YAPB_coalesce_poll(YAPB_Coalescer_t *c, uint64_t now_us) {
+    uint64_t deadline;
+    YAPB_Result_t r = YAPB_coalesce_get_deadline(c, &deadline);
+    if (r != YAPB_OK) return r;
+
+    // The batch cannot move while a packet is built in place behind it;
+    // the overdue flush then happens on the next commit.
+    if (now_us >= deadline && !C(c)->building) {
+        return _coalesce_flush(C(c), YAPB_FLUSH_DEADLINE);
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_coalesce_flush(YAPB_Coalescer_t *c) {
+    if (c == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (C(c)->building) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    return _coalesce_flush(C(c), YAPB_FLUSH_EXPLICIT);
+}
+
+YAPB_Result_t YAPB_coalesce_get_deadline(const YAPB_Coalescer_t *c, uint64_t *out_us) {
+    if (c == NULL || out_us == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Coalescer_t *co = CC(c);
+
+    size_t count;
+    YAPB_batch_get_count(&co->batch, &count);
+    if (count == 0 || co->cfg.max_delay_us == 0) {
+        *out_us = UINT64_MAX;
+    } else {
+        *out_us = co->first_us + co->cfg.max_delay_us;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_coalesce_get_stats(const YAPB_Coalescer_t *c, YAPB_CoalesceStats_t *out) {
+    if (c == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    *out = CC(c)->stats;
+    return YAPB_OK;
+}
+
+uint64_t YAPB_coalesce_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
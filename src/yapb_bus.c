@@ -0,0 +1,305 @@
+#include "yapb_bus.h"
+#include "yapb_internal.h"
+#include <sched.h>
+#include <stdatomic.h>
+
+typedef struct {
+    _Atomic size_t seq;         // Vyukov sequence number for this cell
+    YAPB_Shared_t *sh;          // queued buffer (one reference owned by the queue)
+} _YAPB_BusSlot_t;
+
+_Static_assert(sizeof(_YAPB_BusSlot_t) <= YAPB_BUS_SLOT_SIZE,
+    "YAPB_BUS_SLOT_SIZE too small for _YAPB_BusSlot_t");
+
+typedef struct _YAPB_Bus _YAPB_Bus_t;
+
+typedef struct _YAPB_Subscriber {
+    // Written at subscribe/unsubscribe time, read by publishers
+    _Atomic(struct _YAPB_Subscriber *) next;
+    _YAPB_Bus_t *bus;           // bus the subscriber is linked into, NULL once unlinked
+    _YAPB_BusSlot_t *slots;
+    size_t mask;
+    uint32_t topic;
+    bool has_filter;
+    YAPB_Filter_t filter;
+    _Atomic bool active;
+
+    // Producer side, contended by publishers
+    alignas(64) _Atomic size_t tail;
+    _Atomic uint64_t dropped;
+
+    // Consumer side, owned by the subscriber thread
+    alignas(64) size_t head;
+} _YAPB_Subscriber_t;
+
+_Static_assert(sizeof(_YAPB_Subscriber_t) <= YAPB_SUBSCRIBER_SIZE,
+    "YAPB_SUBSCRIBER_SIZE too small for _YAPB_Subscriber_t");
+
+// Publishers walk the list without locks. Subscribe and unsubscribe take
+// the writer lock; an unsubscribe unlinks the subscriber, then waits for
+// every publish that might still see it. A publish counts itself in the
+// reader slot of the current epoch parity; the unsubscribe flips the epoch
+// and waits for the old slot to drain, twice, so no earlier publish remains.
+struct _YAPB_Bus {
+    _Atomic(_YAPB_Subscriber_t *) head;  // most recently added subscriber
+    _Atomic uint32_t readers[2];         // publishes in flight per epoch parity
+    _Atomic uint32_t epoch;
+    _Atomic bool lock;                   // writer lock
+};
+
+_Static_assert(sizeof(_YAPB_Bus_t) <= YAPB_BUS_SIZE,
+    "YAPB_BUS_SIZE too small for _YAPB_Bus_t");
+
+#define BUS(x) ((_YAPB_Bus_t *)(x))
+#define SUB(x) ((_YAPB_Subscriber_t *)(x))
+#define CSUB(x) ((const _YAPB_Subscriber_t *)(x))
+
+bool YAPB_filter_match(const uint8_t *data, size_t len, const YAPB_Filter_t *filter) {
+    if (data == NULL || filter == NULL || len < YAPB_HEADER_SIZE) {
+        return false;
+    }
+    uint32_t pkt_len = read_u32(data);
+    if (pkt_len < YAPB_HEADER_SIZE || pkt_len > len) {
+        return false;
+    }
+
+    size_t pos = YAPB_HEADER_SIZE;
+    for (uint16_t i = 0; i < filter->index; i++) {
+        size_t span = elem_span(data, pos, pkt_len);
+        if (span == 0) return false;
+        pos += span;
+    }
+    if (elem_span(data, pos, pkt_len) == 0 || data[pos] != (uint8_t)filter->type) {
+        return false;
+    }
+
+    const uint8_t *v = data + pos + 1;
+    int64_t val;
+    switch (filter->type) {
+        case YAPB_INT8:  val = (int8_t)v[0]; break;
+        case YAPB_INT16: val = (int16_t)read_u16(v); break;
+        case YAPB_INT32: val = (int32_t)read_u32(v); break;
+        case YAPB_INT64: val = (int64_t)read_u64(v); break;
+        default:         return false;
+    }
+    return val == filter->value;
+}
+
+// Push one reference into a subscriber queue; false if the queue is full
+static bool _sub_enqueue(_YAPB_Subscriber_t *s, YAPB_Shared_t *sh) {
+    size_t pos = atomic_load_explicit(&s->tail, memory_order_relaxed);
+    _YAPB_BusSlot_t *slot;
+    for (;;) {
+        slot = &s->slots[pos & s->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&s->tail, memory_order_relaxed);
+        }
+    }
+    slot->sh = sh;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+static void _writer_lock(_YAPB_Bus_t *b) {
+    while (atomic_exchange_explicit(&b->lock, true, memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+static void _writer_unlock(_YAPB_Bus_t *b) {
+    atomic_store_explicit(&b->lock, false, memory_order_release);
+}
+
+// Register a publish in the current epoch; returns the parity to leave with
+static unsigned _reader_enter(_YAPB_Bus_t *b) {
+    for (;;) {
+        unsigned e = atomic_load(&b->epoch) & 1;
+        atomic_fetch_add(&b->readers[e], 1);
+        if ((atomic_load(&b->epoch) & 1) == e) {
+            return e;
+        }
+        // The epoch moved on meanwhile; the writer may not wait for us
+        atomic_fetch_sub_explicit(&b->readers[e], 1, memory_order_release);
+    }
+}
+
+static void _reader_leave(_YAPB_Bus_t *b, unsigned e) {
+    atomic_fetch_sub_explicit(&b->readers[e], 1, memory_order_release);
+}
+
+// Wait until every publish that started before the call has finished
+static void _synchronize(_YAPB_Bus_t *b) {
+    for (int i = 0; i < 2; i++) {
+        unsigned old = atomic_fetch_add(&b->epoch, 1) & 1;
+        while (atomic_load_explicit(&b->readers[old], memory_order_acquire) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+YAPB_Result_t YAPB_bus_init(YAPB_Bus_t *bus) {
+    if (bus == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Bus_t *b = BUS(bus);
+    atomic_init(&b->head, NULL);
+    atomic_init(&b->readers[0], 0);
+    atomic_init(&b->readers[1], 0);
+    atomic_init(&b->epoch, 0);
+    atomic_init(&b->lock, false);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_bus_subscribe(YAPB_Bus_t *bus, YAPB_Subscriber_t *sub, uint32_t topic,
+                                 YAPB_BusSlot_t *slots, size_t nslots, const YAPB_Filter_t *filter) {
+    if (bus == NULL || sub == NULL || slots == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (nslots < 2 || (nslots & (nslots - 1)) != 0) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    _YAPB_Bus_t *b = BUS(bus);
+    _YAPB_Subscriber_t *s = SUB(sub);
+
+    // Relinking a listed subscriber would make the list a cycle
+    _writer_lock(b);
+    for (_YAPB_Subscriber_t *it = atomic_load_explicit(&b->head, memory_order_relaxed); it != NULL;
+         it = atomic_load_explicit(&it->next, memory_order_relaxed)) {
+        if (it == s) {
+            _writer_unlock(b);
+            return YAPB_ERR_INVALID_MODE;
+        }
+    }
+
+    s->bus = b;
+    s->slots = (_YAPB_BusSlot_t *)slots;
+    s->mask = nslots - 1;
+    s->topic = topic;
+    s->has_filter = (filter != NULL);
+    if (filter != NULL) {
+        s->filter = *filter;
+    }
+    for (size_t i = 0; i < nslots; i++) {
+        atomic_init(&s->slots[i].seq, i);
+        s->slots[i].sh = NULL;
+    }
+    atomic_init(&s->tail, 0);
+    atomic_init(&s->dropped, 0);
+    s->head = 0;
+    atomic_init(&s->active, true);
+
+    // Publish the fully initialized subscriber at the list head
+    atomic_init(&s->next, atomic_load_explicit(&b->head, memory_order_relaxed));
+    atomic_store_explicit(&b->head, s, memory_order_release);
+    _writer_unlock(b);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_bus_unsubscribe(YAPB_Subscriber_t *sub) {
+    if (sub == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Subscriber_t *s = SUB(sub);
+    _YAPB_Bus_t *b = s->bus;
+    if (b == NULL) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    atomic_store_explicit(&s->active, false, memory_order_release);
+
+    _writer_lock(b);
+    _Atomic(_YAPB_Subscriber_t *) *link = &b->head;
+    _YAPB_Subscriber_t *it;
+    while ((it = atomic_load_explicit(link, memory_order_relaxed)) != NULL && it != s) {
+        link = &it->next;
+    }
+    if (it == s) {
+        // Publishers at s still follow its next link
+        atomic_store_explicit(link, atomic_load_explicit(&s->next, memory_order_relaxed),
+                              memory_order_release);
+    }
+    _writer_unlock(b);
+
+    _synchronize(b);
+    s->bus = NULL;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_bus_publish(YAPB_Bus_t *bus, uint32_t topic, YAPB_Shared_t *sh, size_t *out_delivered) {
+    if (bus == NULL || sh == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+
+    YAPB_Packet_t pkt;
+    if (YAPB_shared_load(&pkt, sh) != YAPB_OK) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(&pkt, &len);
+
+    size_t delivered = 0;
+    _YAPB_Bus_t *b = BUS(bus);
+    unsigned epoch = _reader_enter(b);
+    _YAPB_Subscriber_t *s = atomic_load_explicit(&b->head, memory_order_acquire);
+    for (; s != NULL; s = atomic_load_explicit(&s->next, memory_order_acquire)) {
+        if (s->topic != topic || !atomic_load_explicit(&s->active, memory_order_acquire)) {
+            continue;
+        }
+        if (s->has_filter && !YAPB_filter_match(data, len, &s->filter)) {
+            continue;
+        }
+
+        YAPB_shared_retain(sh);
+        if (_sub_enqueue(s, sh)) {
+            delivered++;
+        } else {
+            YAPB_shared_release(sh);
+            atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+        }
+    }
+    _reader_leave(b, epoch);
+
+    if (out_delivered != NULL) {
+        *out_delivered = delivered;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_sub_poll(YAPB_Subscriber_t *sub, YAPB_Shared_t **out, size_t max, size_t *out_n) {
+    if (sub == NULL || out == NULL || out_n == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Subscriber_t *s = SUB(sub);
+
+    size_t n = 0;
+    while (n < max) {
+        _YAPB_BusSlot_t *slot = &s->slots[s->head & s->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != s->head + 1) {
+            break;
+        }
+        out[n++] = slot->sh;
+        slot->sh = NULL;
+        atomic_store_explicit(&slot->seq, s->head + s->mask + 1, memory_order_release);
+        s->head++;
+    }
+
+    *out_n = n;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_sub_get_dropped(const YAPB_Subscriber_t *sub, uint64_t *out_dropped) {
+    if (sub == NULL || out_dropped == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    *out_dropped = atomic_load_explicit(&((_YAPB_Subscriber_t *)CSUB(sub))->dropped, memory_order_relaxed);
+    return YAPB_OK;
+}
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include "yapb_compact.h"
+#include "yapb_internal.h"
+#include "yapb_io.h"
+#include "yapb_segment.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#define WBUF_SIZE (1u << 20)
+
+typedef struct {
+    pthread_t thread;
+    char *in_path;                  // copies owned by the job
+    char *out_path;
+    YAPB_KeyPath_t key;
+    YAPB_CompactConfig_t cfg;
+    YAPB_CompactStats_t stats;
+    YAPB_Result_t result;
+    _Atomic bool done;
+} _YAPB_Compaction_t;
+
+_Static_assert(sizeof(_YAPB_Compaction_t) <= YAPB_COMPACTION_SIZE,
+    "YAPB_COMPACTION_SIZE too small for _YAPB_Compaction_t");
+
+#define JOB(x) ((_YAPB_Compaction_t *)(x))
+
+static bool is_tombstone(const uint8_t *pkt, size_t len, const YAPB_CompactConfig_t *cfg) {
+    YAPB_Key_t mark, want;
+    if (cfg->tombstone.depth == 0 ||
+        YAPB_key_extract(pkt, len, &cfg->tombstone, &mark) != YAPB_OK) {
+        return false;
+    }
+    YAPB_key_from_int(cfg->tombstone_value, &want);
+    return YAPB_key_compare(&mark, &want) == 0;
+}
+
+// Output of a compaction: a plain log, or a segment writer that rebuilds
+// the footer of a sealed input
+typedef struct {
+    YAPB_Writer *w;
+    YAPB_SegmentWriter_t *seg;
+} Sink;
+
+static YAPB_Result_t sink_put(Sink *out, const uint8_t *pkt, size_t len) {
+    if (out->seg == NULL) {
+        return writer_put(out->w, pkt, len);
+    }
+    YAPB_Packet_t p;
+    YAPB_Result_t r = YAPB_load(&p, pkt, len);
+    return (r == YAPB_OK) ? YAPB_segw_append(out->seg, &p) : r;
+}
+
+// Write the last packet of each key group of a sorted log
+static YAPB_Result_t keep_last(const uint8_t *data, size_t len, const YAPB_KeyPath_t *key,
+                               const YAPB_CompactConfig_t *cfg, Sink *out,
+                               YAPB_CompactStats_t *st) {
+    const uint8_t *prev = NULL;
+    size_t prev_len = 0, off = 0;
+    YAPB_Key_t prev_key = { 0 };
+    for (;;) {
+        const uint8_t *pkt = NULL;
+        size_t pkt_len = 0;
+        YAPB_Key_t k = { 0 };
+        YAPB_Result_t r = YAPB_log_next(data, len, &off, &pkt, &pkt_len);
+        if (r == YAPB_OK) {
+            r = YAPB_key_extract(pkt, pkt_len, key, &k);
+        }
+        if (r != YAPB_OK && r != YAPB_ERR_NO_MORE_ELEMENTS) {
+            return r;
+        }
+        bool end = (r == YAPB_ERR_NO_MORE_ELEMENTS);
+
+        // Keyless packets are never superseded
+        if (prev != NULL &&
+            (end || prev_key.kind == YAPB_KEY_NONE || YAPB_key_compare(&prev_key, &k) != 0)) {
+            bool tomb = prev_key.kind != YAPB_KEY_NONE && is_tombstone(prev, prev_len, cfg);
+            st->deleted += tomb;
+            if (!tomb || cfg->keep_tombstones) {
+                r = sink_put(out, prev, prev_len);
+                if (r != YAPB_OK) return r;
+                st->packets_out++;
+            }
+        }
+        if (end) {
+            return YAPB_OK;
+        }
+        prev = pkt;
+        prev_len = pkt_len;
+        prev_key = k;
+    }
+}
+
+// Compacting in place: copy the complete packets appended to the input
+// since the sort mapped its first `from` bytes, so the rename keeps them
+static YAPB_Result_t carry_appends(const char *in_path, const char *out_path, uint64_t from,
+                                   YAPB_Writer *w, uint64_t *out_bytes) {
+    struct stat in_st, out_st;
+    if (stat(out_path, &out_st) != 0) {
+        return YAPB_OK;
+    }
+    int fd = open(in_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &in_st) != 0) {
+        if (fd >= 0) close(fd);
+        return YAPB_ERR_IO;
+    }
+    YAPB_Result_t r = YAPB_OK;
+    uint64_t at = from;
+    if (in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+        uint8_t buf[64 << 10];
+        uint64_t size = (uint64_t)in_st.st_size;
+        while (r == YAPB_OK && size - at >= YAPB_HEADER_SIZE) {
+            uint8_t hdr[YAPB_HEADER_SIZE];
+            if (pread(fd, hdr, sizeof(hdr), (off_t)at) != (ssize_t)sizeof(hdr)) {
+                r = YAPB_ERR_IO;
+                break;
+            }
+            uint32_t len = read_u32(hdr);
+            if (len < YAPB_HEADER_SIZE) {
+                r = YAPB_ERR_INVALID_PACKET;
+                break;
+            }
+            // A packet still being written stays behind
+            if (len > size - at) {
+                break;
+            }
+            for (uint64_t end = at + len; r == YAPB_OK && at < end;) {
+                size_t n = (end - at < sizeof(buf)) ? (size_t)(end - at) : sizeof(buf);
+                ssize_t got = pread(fd, buf, n, (off_t)at);
+                if (got <= 0) {
+                    r = YAPB_ERR_IO;
+                    break;
+                }
+                r = writer_put(w, buf, (size_t)got);
+                at += (uint64_t)got;
+            }
+            // Appends may still be arriving
+            if (size - at < YAPB_HEADER_SIZE && fstat(fd, &in_st) == 0) {
+                size = (uint64_t)in_st.st_size;
+            }
+        }
+    }
+    close(fd);
+    *out_bytes = at - from;
+    return r;
+}
+
+// Create an empty temporary file next to path
+static int make_temp(char *tmp, size_t size, const char *path, const char *suffix) {
+    if (snprintf(tmp, size, "%s%s.XXXXXX", path, suffix) >= (int)size) {
+        return -1;
+    }
+    return mkostemp(tmp, O_CLOEXEC);
+}
+
+// Write a plain log to a temporary file and rename it over out_path
+static YAPB_Result_t write_log(const char *in_path, const char *out_path, const uint8_t *data,
+                               size_t len, const YAPB_KeyPath_t *key,
+                               const YAPB_CompactConfig_t *cfg, YAPB_CompactStats_t *st) {
+    char tmp[PATH_MAX];
+    uint8_t *buf = malloc(WBUF_SIZE);
+    int fd = (buf != NULL) ? make_temp(tmp, sizeof(tmp), out_path, "") : -1;
+    if (fd < 0) {
+        free(buf);
+        return (buf == NULL) ? YAPB_ERR_BUFFER_TOO_SMALL : YAPB_ERR_IO;
+    }
+
+    YAPB_Writer w = { fd, buf, WBUF_SIZE, 0, 0 };
+    Sink out = { &w, NULL };
+    YAPB_Result_t r = keep_last(data, len, key, cfg, &out, st);
+    if (r == YAPB_OK) {
+        r = writer_flush(&w);
+    }
+    if (r == YAPB_OK && fdatasync(fd) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    // Last, to keep the window before the rename short
+    if (r == YAPB_OK) {
+        r = carry_appends(in_path, out_path, st->bytes_in, &w, &st->carried);
+    }
+    if (r == YAPB_OK && st->carried > 0) {
+        r = writer_flush(&w);
+        if (r == YAPB_OK && fdatasync(fd) != 0) {
+            r = YAPB_ERR_IO;
+        }
+    }
+    st->bytes_out = w.bytes;
+    if (close(fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    if (r == YAPB_OK && rename(tmp, out_path) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (r != YAPB_OK) {
+        unlink(tmp);
+    }
+    free(buf);
+    return r;
+}
+
+// Write a sealed segment through a segment writer in a temporary
+// directory, then rename its only segment file over out_path
+static YAPB_Result_t write_segment(const char *out_path, const uint8_t *data, size_t len,
+                                   const YAPB_KeyPath_t *key, const YAPB_CompactConfig_t *cfg,
+                                   YAPB_SegmentConfig_t *seg_cfg, YAPB_CompactStats_t *st) {
+    char dir[PATH_MAX], seg_path[PATH_MAX];
+    if (snprintf(dir, sizeof(dir), "%s.seg.XXXXXX", out_path) >= (int)sizeof(dir) ||
+        mkdtemp(dir) == NULL) {
+        return YAPB_ERR_IO;
+    }
+    // The first segment of a fresh directory
+    if (snprintf(seg_path, sizeof(seg_path), "%s/seg-00000001.yapb", dir) >= (int)sizeof(seg_path)) {
+        rmdir(dir);
+        return YAPB_ERR_IO;
+    }
+
+    // One segment, with Bloom filters sized for the input's packet count
+    seg_cfg->max_bytes = UINT64_MAX;
+    seg_cfg->max_packets = (st->packets_in <= UINT32_MAX) ? (uint32_t)st->packets_in : 0;
+    seg_cfg->sync = true;
+    YAPB_SegmentWriter_t segw;
+    YAPB_Result_t r = YAPB_segw_open(&segw, dir, seg_cfg);
+    if (r == YAPB_OK) {
+        Sink out = { NULL, &segw };
+        r = keep_last(data, len, key, cfg, &out, st);
+        YAPB_Result_t cr = YAPB_segw_close(&segw);
+        if (r == YAPB_OK) r = cr;
+    }
+
+    // Every key deleted: no segment was started
+    struct stat sst;
+    if (r == YAPB_OK && st->packets_out == 0) {
+        int fd = open(seg_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || close(fd) != 0) {
+            r = YAPB_ERR_IO;
+        }
+    }
+    if (r == YAPB_OK && stat(seg_path, &sst) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (r == YAPB_OK) {
+        st->bytes_out = (uint64_t)sst.st_size;
+        if (rename(seg_path, out_path) != 0) {
+            r = YAPB_ERR_IO;
+        }
+    }
+    if (r != YAPB_OK) {
+        unlink(seg_path);
+    }
+    rmdir(dir);
+    return r;
+}
+
+YAPB_Result_t YAPB_compact_file(const char *in_path, const char *out_path, const YAPB_KeyPath_t *key,
+                                const YAPB_CompactConfig_t *cfg, YAPB_CompactStats_t *out_stats) {
+    if (in_path == NULL || out_path == NULL || key == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    static const YAPB_CompactConfig_t defaults = { 0 };
+    if (cfg == NULL) {
+        cfg = &defaults;
+    }
+
+    // A sealed segment is compacted by its packet data, leaving the footer
+    // out of the sort, and gets a footer rebuilt for the kept packets
+    YAPB_SortConfig_t sort_cfg = cfg->sort;
+    YAPB_SegmentKey_t seg_keys[YAPB_SEG_MAX_KEYS];
+    YAPB_SegmentConfig_t seg_cfg;
+    bool sealed = false;
+    YAPB_Segment_t seg;
+    if (YAPB_segment_open(&seg, in_path) == YAPB_OK) {
+        YAPB_Result_t r = YAPB_segment_get_config(&seg, &seg_cfg, seg_keys);
+        sealed = (r == YAPB_OK);
+        if (sealed) {
+            size_t data_len;
+            YAPB_segment_get_data(&seg, &data_len);
+            sort_cfg.in_len = data_len;
+        }
+        YAPB_segment_close(&seg);
+        if (r != YAPB_OK && r != YAPB_ERR_NOT_FOUND) {
+            return r;
+        }
+    }
+
+    // Group the packets of each key, in log order
+    char sorted[PATH_MAX];
+    int fd = make_temp(sorted, sizeof(sorted), out_path, ".sort");
+    if (fd < 0) {
+        return YAPB_ERR_IO;
+    }
+    close(fd);
+    YAPB_SortStats_t ss;
+    YAPB_Result_t r = YAPB_sort_file(in_path, sorted, key, &sort_cfg, &ss);
+    if (r != YAPB_OK) {
+        unlink(sorted);
+        return r;
+    }
+    YAPB_CompactStats_t st = { .packets_in = ss.records, .bytes_in = ss.bytes };
+
+    YAPB_LogMap_t map;
+    r = YAPB_log_map(&map, sorted, YAPB_MAP_SEQUENTIAL);
+    // The mapping keeps the data alive
+    unlink(sorted);
+    if (r != YAPB_OK) {
+        return r;
+    }
+    size_t len;
+    const uint8_t *data = YAPB_log_get_data(&map, &len);
+    // Sealed segments are never appended to, so there is nothing to carry
+    r = sealed ? write_segment(out_path, data, len, key, cfg, &seg_cfg, &st)
+               : write_log(in_path, out_path, data, len, key, cfg, &st);
+    YAPB_log_unmap(&map);
+
+    if (r == YAPB_OK && out_stats != NULL) {
+        *out_stats = st;
+    }
+    return r;
+}
+
+static void *compact_main(void *arg) {
+    _YAPB_Compaction_t *job = arg;
+    job->result = YAPB_compact_file(job->in_path, job->out_path, &job->key, &job->cfg, &job->stats);
+    atomic_store_explicit(&job->done, true, memory_order_release);
+    return NULL;
+}
+
+YAPB_Result_t YAPB_compact_start(YAPB_Compaction_t *job, const char *in_path, const char *out_path,
+                                 const YAPB_KeyPath_t *key, const YAPB_CompactConfig_t *cfg) {
+    if (job == NULL || in_path == NULL || out_path == NULL || key == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Compaction_t *j = JOB(job);
+    j->in_path = strdup(in_path);
+    j->out_path = strdup(out_path);
+    j->key = *key;
+    j->cfg = cfg ? *cfg : (YAPB_CompactConfig_t){ 0 };
+    j->stats = (YAPB_CompactStats_t){ 0 };
+    j->result = YAPB_OK;
+    atomic_init(&j->done, false);
+    if (j->in_path == NULL || j->out_path == NULL ||
+        pthread_create(&j->thread, NULL, compact_main, j) != 0) {
+        free(j->in_path);
+        free(j->out_path);
+        return YAPB_ERR_IO;
+    }
+    return YAPB_OK;
+}
+
+bool YAPB_compact_done(YAPB_Compaction_t *job) {
+    return job != NULL && atomic_load_explicit(&JOB(job)->done, memory_order_acquire);
+}
+
+YAPB_Result_t YAPB_compact_wait(YAPB_Compaction_t *job, YAPB_CompactStats_t *out_stats) {
+    if (job == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Compaction_t *j = JOB(job);
+    pthread_join(j->thread, NULL);
+    free(j->in_path);
+    free(j->out_path);
+    j->in_path = j->out_path = NULL;
+    if (j->result == YAPB_OK && out_stats != NULL) {
+        *out_stats = j->stats;
+    }
+    return j->result;
+}
@@ -0,0 +1,114 @@
+#include "yapb_dedup.h"
+#include "yapb_internal.h"
+#include <string.h>
+
+typedef struct {
+    uint32_t hash;  // hash of the nested packet bytes
+    uint32_t off;   // offset of its NESTED_PKT tag in the packet, 0 if empty
+} DedupSlot;
+
+typedef struct {
+    const uint8_t *buffer;  // buffer of the packet the slots refer to
+    uint64_t refs;          // references written
+    uint64_t saved;         // bytes saved over plain copies
+    DedupSlot slots[YAPB_DEDUP_SLOTS];
+} _YAPB_Dedup_t;
+
+_Static_assert(sizeof(_YAPB_Dedup_t) <= YAPB_DEDUP_SIZE,
+    "YAPB_DEDUP_SIZE too small for _YAPB_Dedup_t");
+_Static_assert((YAPB_DEDUP_SLOTS & (YAPB_DEDUP_SLOTS - 1)) == 0,
+    "YAPB_DEDUP_SLOTS must be a power of two");
+
+#define DD(x) ((_YAPB_Dedup_t *)(x))
+#define CDD(x) ((const _YAPB_Dedup_t *)(x))
+
+// Size of a NESTED_REF element
+#define REF_SPAN 5
+
+// FNV-1a style mix over 8-byte words; the length is in the packet header
+static uint32_t hash_bytes(const uint8_t *p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (; i < n; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+YAPB_Result_t YAPB_dedup_init(YAPB_Dedup_t *dd) {
+    if (dd == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    memset(DD(dd), 0, sizeof(_YAPB_Dedup_t));
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_push_nested_dedup(YAPB_Packet_t *pkt, YAPB_Dedup_t *dd, const YAPB_Packet_t *nested) {
+    size_t nested_len;
+    const uint8_t *nested_buf = YAPB_get_buffer(nested, &nested_len);
+    if (pkt == NULL || dd == NULL || nested_buf == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Packet_t *p = P(pkt);
+    if (p->error < 0) {
+        return p->error;
+    }
+    if (p->mode != YAPB_MODE_WRITE || p->finalized) {
+        p->error = YAPB_ERR_INVALID_MODE;
+        return p->error;
+    }
+    if (1 + nested_len <= REF_SPAN) {
+        return YAPB_push_nested(pkt, nested);
+    }
+
+    _YAPB_Dedup_t *d = DD(dd);
+    if (d->buffer != p->buffer) {
+        memset(d->slots, 0, sizeof(d->slots));
+        d->buffer = p->buffer;
+    }
+    uint32_t h = hash_bytes(nested_buf, nested_len);
+    DedupSlot *s = &d->slots[h & (YAPB_DEDUP_SLOTS - 1)];
+
+    // The first copy must still be there: the buffer may have been reused
+    size_t t = s->off;
+    if (t != 0 && s->hash == h && t + 1 + nested_len <= p->pos &&
+        p->buffer[t] == YAPB_NESTED_PKT && memcmp(p->buffer + t + 1, nested_buf, nested_len) == 0) {
+        if ((size_t)p->pos + REF_SPAN > p->buffer_size) {
+            p->error = YAPB_ERR_BUFFER_TOO_SMALL;
+            return p->error;
+        }
+        p->buffer[p->pos] = YAPB_NESTED_REF;
+        write_u32(p->buffer + p->pos + 1, (uint32_t)t);
+        p->pos += REF_SPAN;
+        d->refs++;
+        d->saved += 1 + nested_len - REF_SPAN;
+        return YAPB_OK;
+    }
+
+    uint32_t at = p->pos;
+    YAPB_Result_t r = YAPB_push_nested(pkt, nested);
+    if (r == YAPB_OK) {
+        s->hash = h;
+        s->off = at;
+    }
+    return r;
+}
+
+YAPB_Result_t YAPB_dedup_get_stats(const YAPB_Dedup_t *dd, uint64_t *out_refs, uint64_t *out_saved) {
+    if (dd == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Dedup_t *d = CDD(dd);
+    if (out_refs != NULL) {
+        *out_refs = d->refs;
+    }
+    if (out_saved != NULL) {
+        *out_saved = d->saved;
+    }
+    return YAPB_OK;
+}
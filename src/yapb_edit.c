@@ -0,0 +1,311 @@
+#include "yapb_edit.h"
+#include "yapb_internal.h"
+#include <string.h>
+
+enum { OP_INSERT, OP_DELETE, OP_REPLACE };
+
+typedef struct {
+    YAPB_KeyPath_t path;  // position in the original packet
+    uint8_t kind;         // OP_*
+    const uint8_t *data;  // packet of new elements for insert/replace
+    uint32_t len;         // its length
+} EditOp;
+
+typedef struct {
+    const uint8_t *src;   // original packet
+    uint32_t src_len;     // its length from the header
+    uint32_t nops;        // recorded operations
+    EditOp ops[YAPB_EDIT_MAX_OPS];  // sorted by path, recording order for equal paths
+} _YAPB_Edit_t;
+
+_Static_assert(sizeof(_YAPB_Edit_t) <= YAPB_EDIT_SIZE,
+    "YAPB_EDIT_SIZE too small for _YAPB_Edit_t");
+
+#define ED(x) ((_YAPB_Edit_t *)(x))
+#define CED(x) ((const _YAPB_Edit_t *)(x))
+
+// ============ Paths ============
+
+// Lexicographic order; a path sorts before the paths inside its element
+static int path_cmp(const YAPB_KeyPath_t *a, const YAPB_KeyPath_t *b) {
+    uint16_t n = a->depth < b->depth ? a->depth : b->depth;
+    for (uint16_t i = 0; i < n; i++) {
+        if (a->index[i] != b->index[i]) {
+            return a->index[i] < b->index[i] ? -1 : 1;
+        }
+    }
+    return (int)a->depth - (int)b->depth;
+}
+
+// True if inner lies inside the element at outer
+static bool path_inside(const YAPB_KeyPath_t *outer, const YAPB_KeyPath_t *inner) {
+    return outer->depth < inner->depth &&
+           memcmp(outer->index, inner->index, outer->depth * sizeof(uint16_t)) == 0;
+}
+
+// Check that a path names an element of the original packet. For inserts
+// the last index may also be the element count (append).
+static YAPB_Result_t locate(const _YAPB_Edit_t *e, const YAPB_KeyPath_t *at, bool insert) {
+    if (at->depth == 0 || at->depth > YAPB_KEY_MAX_DEPTH) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    const uint8_t *pkt = e->src;
+    size_t len = e->src_len;
+    for (uint16_t level = 0;; level++) {
+        size_t pos = YAPB_HEADER_SIZE;
+        for (uint16_t i = 0; i < at->index[level]; i++) {
+            if (pos >= len) return YAPB_ERR_NOT_FOUND;
+            size_t span = elem_span(pkt, pos, len);
+            if (span == 0) return YAPB_ERR_INVALID_PACKET;
+            pos += span;
+        }
+        bool last = level + 1 == at->depth;
+        if (pos >= len) {
+            return (last && insert) ? YAPB_OK : YAPB_ERR_NOT_FOUND;
+        }
+        if (elem_span(pkt, pos, len) == 0) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        if (last) {
+            return YAPB_OK;
+        }
+        if (pkt[pos] != YAPB_NESTED_PKT && pkt[pos] != YAPB_NESTED_REF) {
+            return YAPB_ERR_TYPE_MISMATCH;
+        }
+        size_t at = nested_at(pkt, pos, len);
+        if (at == 0) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        pkt += at;
+        len = read_u32(pkt);
+    }
+}
+
+// ============ Recording ============
+
+YAPB_Result_t YAPB_edit_begin(YAPB_Edit_t *ed, const YAPB_Packet_t *pkt) {
+    if (ed == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (data == NULL) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    _YAPB_Edit_t *e = ED(ed);
+    e->src = data;
+    e->src_len = (uint32_t)len;
+    e->nops = 0;
+    return YAPB_OK;
+}
+
+static YAPB_Result_t record(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at, uint8_t kind,
+                            const YAPB_Packet_t *elems) {
+    if (ed == NULL || at == NULL || (kind != OP_DELETE && elems == NULL)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Edit_t *e = ED(ed);
+    if (e->nops == YAPB_EDIT_MAX_OPS) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    YAPB_Result_t r = locate(e, at, kind == OP_INSERT);
+    if (r != YAPB_OK) {
+        return r;
+    }
+
+    // An element that goes away takes everything inside it along
+    for (uint32_t i = 0; i < e->nops; i++) {
+        const EditOp *o = &e->ops[i];
+        bool removes = o->kind != OP_INSERT;
+        if (removes && path_inside(&o->path, at)) {
+            return YAPB_ERR_INVALID_MODE;
+        }
+        if (kind != OP_INSERT &&
+            (path_inside(at, &o->path) || (removes && path_cmp(&o->path, at) == 0))) {
+            return YAPB_ERR_INVALID_MODE;
+        }
+    }
+
+    EditOp op = { .path = *at, .kind = kind };
+    if (elems != NULL) {
+        size_t len;
+        const uint8_t *data = YAPB_get_buffer(elems, &len);
+        if (data == NULL) {
+            return YAPB_ERR_INVALID_MODE;
+        }
+        for (size_t pos = YAPB_HEADER_SIZE; pos < len;) {
+            size_t span = elem_span(data, pos, len);
+            if (span == 0 || (data[pos] == YAPB_NESTED_REF && nested_at(data, pos, len) == 0) ||
+                (data[pos] == YAPB_TIMESTAMP_DELTA && ts_base_find(data, pos) == 0)) {
+                return YAPB_ERR_INVALID_PACKET;
+            }
+            pos += span;
+        }
+        op.data = data;
+        op.len = (uint32_t)len;
+    }
+
+    // Insertion sort, after any equal paths so recording order is kept
+    uint32_t i = e->nops;
+    while (i > 0 && path_cmp(&e->ops[i - 1].path, at) > 0) {
+        e->ops[i] = e->ops[i - 1];
+        i--;
+    }
+    e->ops[i] = op;
+    e->nops++;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_edit_insert(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at, const YAPB_Packet_t *elems) {
+    return record(ed, at, OP_INSERT, elems);
+}
+
+YAPB_Result_t YAPB_edit_delete(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at) {
+    return record(ed, at, OP_DELETE, NULL);
+}
+
+YAPB_Result_t YAPB_edit_replace(YAPB_Edit_t *ed, const YAPB_KeyPath_t *at, const YAPB_Packet_t *elems) {
+    return record(ed, at, OP_REPLACE, elems);
+}
+
+// ============ Apply ============
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t pos;  // bytes produced, also past the end of buf
+} Out;
+
+// Bytes that do not fit are counted but not written, so a too small
+// buffer still yields the size needed
+static void put(Out *o, const uint8_t *p, size_t n) {
+    if (n > 0 && o->pos + n <= o->size) {
+        memcpy(o->buf + o->pos, p, n);
+    }
+    o->pos += n;
+}
+
+// Copy the elements pkt[from, to) of the packet at pkt, whose first
+// TIMESTAMP is at ts_base (0 if none). References and timestamp deltas
+// are relative to the packet they are in and its layout changes, so each
+// NESTED_REF is written out as a copy of the nested packet it points at
+// and each TIMESTAMP_DELTA as a full TIMESTAMP.
+static YAPB_Result_t put_elems(Out *o, const uint8_t *pkt, size_t from, size_t to, size_t ts_base) {
+    static const uint8_t nested_tag = YAPB_NESTED_PKT;
+    size_t run = from;
+    for (size_t pos = from; pos < to;) {
+        size_t span = elem_span(pkt, pos, to);
+        if (span == 0) return YAPB_ERR_INVALID_PACKET;
+        if (pkt[pos] == YAPB_NESTED_REF) {
+            size_t at = nested_at(pkt, pos, to);
+            if (at == 0) return YAPB_ERR_INVALID_PACKET;
+            put(o, pkt + run, pos - run);
+            put(o, &nested_tag, 1);
+            put(o, pkt + at, read_u32(pkt + at));
+            run = pos + span;
+        } else if (pkt[pos] == YAPB_TIMESTAMP_DELTA) {
+            int64_t ns;
+            if (!decode_timestamp(pkt, pos, ts_base, &ns)) return YAPB_ERR_INVALID_PACKET;
+            uint8_t full[9] = { YAPB_TIMESTAMP };
+            write_u64(full + 1, (uint64_t)ns);
+            put(o, pkt + run, pos - run);
+            put(o, full, sizeof(full));
+            run = pos + span;
+        }
+        pos += span;
+    }
+    put(o, pkt + run, to - run);
+    return YAPB_OK;
+}
+
+// Write the packet pkt[0, len) with the operations ops[lo, hi), which all
+// lie inside it; depth is the path level of its elements. Elements
+// between edited positions are copied as one run.
+static YAPB_Result_t emit(const _YAPB_Edit_t *e, const uint8_t *pkt, size_t len,
+                          uint32_t lo, uint32_t hi, uint16_t depth, Out *o) {
+    static const uint8_t tag = YAPB_NESTED_PKT;
+    size_t hdr = o->pos;
+    put(o, pkt, YAPB_HEADER_SIZE);
+    size_t pos = YAPB_HEADER_SIZE, run = pos;
+    size_t ts_base = ts_base_find(pkt, len);
+    uint32_t idx = 0;
+    YAPB_Result_t r;
+
+    for (uint32_t k = lo;; ) {
+        uint32_t next = k < hi ? e->ops[k].path.index[depth] : UINT32_MAX;
+        while (idx < next && pos < len) {
+            size_t span = elem_span(pkt, pos, len);
+            if (span == 0) return YAPB_ERR_INVALID_PACKET;
+            pos += span;
+            idx++;
+        }
+        if ((r = put_elems(o, pkt, run, pos, ts_base)) != YAPB_OK) return r;
+        run = pos;
+        if (k == hi) {
+            break;
+        }
+
+        // Operations at this position: on the element itself first (sorted
+        // before the ones inside it), inserts ahead of a replacement
+        uint32_t g = k, inner = k;
+        while (g < hi && e->ops[g].path.index[depth] == idx) {
+            g++;
+        }
+        bool removed = false;
+        for (; inner < g && e->ops[inner].path.depth == depth + 1; inner++) {
+            const EditOp *op = &e->ops[inner];
+            if (op->kind == OP_INSERT) {
+                r = put_elems(o, op->data, YAPB_HEADER_SIZE, op->len, ts_base_find(op->data, op->len));
+                if (r != YAPB_OK) return r;
+            } else {
+                removed = true;
+            }
+        }
+        for (uint32_t j = k; j < inner; j++) {
+            const EditOp *op = &e->ops[j];
+            if (op->kind == OP_REPLACE) {
+                r = put_elems(o, op->data, YAPB_HEADER_SIZE, op->len, ts_base_find(op->data, op->len));
+                if (r != YAPB_OK) return r;
+            }
+        }
+
+        if (removed || inner < g) {
+            size_t span = elem_span(pkt, pos, len);
+            if (span == 0) return YAPB_ERR_INVALID_PACKET;
+            if (inner < g) {
+                size_t at = nested_at(pkt, pos, len);
+                if (at == 0) return YAPB_ERR_INVALID_PACKET;
+                put(o, &tag, 1);
+                r = emit(e, pkt + at, read_u32(pkt + at), inner, g, depth + 1, o);
+                if (r != YAPB_OK) return r;
+            }
+            pos += span;
+            idx++;
+            run = pos;
+        }
+        k = g;
+    }
+
+    size_t new_len = o->pos - hdr;
+    if (new_len > UINT32_MAX) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    if (hdr + YAPB_HEADER_SIZE <= o->size) {
+        write_u32(o->buf + hdr, (uint32_t)new_len);
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_edit_apply(const YAPB_Edit_t *ed, uint8_t *out, size_t size, size_t *out_len) {
+    if (ed == NULL || out_len == NULL || (out == NULL && size > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Edit_t *e = CED(ed);
+    Out o = { out, size, 0 };
+    YAPB_Result_t r = emit(e, e->src, e->src_len, 0, e->nops, 0, &o);
+    if (r != YAPB_OK) {
+        return r;
+    }
+    *out_len = o.pos;
+    return o.pos <= size ? YAPB_OK : YAPB_ERR_BUFFER_TOO_SMALL;
+}
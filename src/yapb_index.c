@@ -0,0 +1,636 @@
+#define _GNU_SOURCE
+#include "yapb_index.h"
+#include "yapb_internal.h"
+#include "yapb_io.h"
+#include "yapb_numa.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Index file: header, then `sorted` entries in key order, then the tail:
+// up to TAIL_RUNS runs written by updates, each in key order and listed in
+// the header oldest first. Runs merged into a newer one leave dead space
+// that the next full merge drops. All integers in network byte order.
+#define IDX_MAGIC       "YAPBIDX1"
+#define IDX_HEADER_SIZE 192
+#define IDX_ENTRY_SIZE  16
+#define OFF_DEPTH       8     // u16
+#define OFF_PATH        10    // u16[YAPB_KEY_MAX_DEPTH]
+#define OFF_SORTED      32    // u64 entries in the sorted part
+#define OFF_TAIL        40    // u64 entries in the tail runs
+#define OFF_COVERED     48    // u64 log bytes indexed
+#define OFF_NRUNS       56    // u64 tail runs
+#define OFF_RUNS        64    // { u64 first entry, u64 entries }[TAIL_RUNS]
+#define TAIL_RUNS       8
+
+_Static_assert(OFF_RUNS + TAIL_RUNS * 16 <= IDX_HEADER_SIZE, "tail runs overflow the header");
+
+// Merge everything once the file past the sorted part, dead space
+// included, exceeds this share of the sorted part
+#define TAIL_MIN        1024
+#define TAIL_SHIFT      3
+
+#define WBUF_SIZE       (256u << 10)
+
+typedef struct {
+    uint64_t prefix;
+    uint64_t off;       // log offset
+} Entry;
+
+// Tail runs, oldest first
+typedef struct {
+    uint64_t at[TAIL_RUNS];     // first entry
+    uint64_t len[TAIL_RUNS];
+    uint32_t n;
+} Tail;
+
+typedef struct {
+    YAPB_LogMap_t log;
+    YAPB_LogMap_t file;
+    const uint8_t *entries;     // first entry in the mapped index
+    uint64_t sorted;
+    uint64_t covered;
+    Tail tail;                  // as of open: updates may rewrite the header
+    YAPB_KeyPath_t path;
+} _YAPB_Index_t;
+
+_Static_assert(sizeof(_YAPB_Index_t) <= YAPB_INDEX_SIZE,
+    "YAPB_INDEX_SIZE too small for _YAPB_Index_t");
+
+#define IDX(x) ((_YAPB_Index_t *)(x))
+#define CIDX(x) ((const _YAPB_Index_t *)(x))
+
+static int entry_cmp(const void *pa, const void *pb) {
+    const Entry *a = pa;
+    const Entry *b = pb;
+    if (a->prefix != b->prefix) {
+        return (a->prefix < b->prefix) ? -1 : 1;
+    }
+    return (a->off > b->off) - (a->off < b->off);
+}
+
+// ============ Header ============
+
+static void header_encode(uint8_t *hdr, const YAPB_KeyPath_t *path, uint64_t sorted,
+                          const Tail *tail, uint64_t covered) {
+    memset(hdr, 0, IDX_HEADER_SIZE);
+    memcpy(hdr, IDX_MAGIC, 8);
+    write_u16(hdr + OFF_DEPTH, path->depth);
+    for (uint16_t i = 0; i < YAPB_KEY_MAX_DEPTH; i++) {
+        write_u16(hdr + OFF_PATH + 2 * i, path->index[i]);
+    }
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < tail->n; i++) {
+        write_u64(hdr + OFF_RUNS + 16 * i, tail->at[i]);
+        write_u64(hdr + OFF_RUNS + 16 * i + 8, tail->len[i]);
+        total += tail->len[i];
+    }
+    write_u64(hdr + OFF_SORTED, sorted);
+    write_u64(hdr + OFF_TAIL, total);
+    write_u64(hdr + OFF_COVERED, covered);
+    write_u64(hdr + OFF_NRUNS, tail->n);
+}
+
+static YAPB_Result_t header_decode(const uint8_t *hdr, size_t file_len, YAPB_KeyPath_t *path,
+                                   uint64_t *sorted, Tail *tail, uint64_t *covered) {
+    if (file_len < IDX_HEADER_SIZE || memcmp(hdr, IDX_MAGIC, 8) != 0) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    path->depth = read_u16(hdr + OFF_DEPTH);
+    if (path->depth == 0 || path->depth > YAPB_KEY_MAX_DEPTH) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    for (uint16_t i = 0; i < YAPB_KEY_MAX_DEPTH; i++) {
+        path->index[i] = read_u16(hdr + OFF_PATH + 2 * i);
+    }
+    *sorted = read_u64(hdr + OFF_SORTED);
+    *covered = read_u64(hdr + OFF_COVERED);
+    uint64_t nruns = read_u64(hdr + OFF_NRUNS);
+    uint64_t max_entries = (file_len - IDX_HEADER_SIZE) / IDX_ENTRY_SIZE;
+    if (*sorted > max_entries || nruns > TAIL_RUNS) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    uint64_t total = 0;
+    tail->n = (uint32_t)nruns;
+    for (uint32_t i = 0; i < tail->n; i++) {
+        tail->at[i] = read_u64(hdr + OFF_RUNS + 16 * i);
+        tail->len[i] = read_u64(hdr + OFF_RUNS + 16 * i + 8);
+        if (tail->at[i] < *sorted || tail->at[i] > max_entries ||
+            tail->len[i] > max_entries - tail->at[i]) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        total += tail->len[i];
+    }
+    if (total != read_u64(hdr + OFF_TAIL)) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    return YAPB_OK;
+}
+
+// ============ Key extraction ============
+
+// Record the offsets of the packets in log[from, len); keys are filled in
+// later, possibly in parallel. A last packet still being written ends the
+// scan: *out_end is the end of the last complete packet.
+static YAPB_Result_t scan_log(const uint8_t *log, size_t len, size_t from,
+                              Entry **entries, size_t *n, size_t *cap, size_t *out_end) {
+    size_t off = from;
+    const uint8_t *pkt;
+    size_t pkt_len;
+    YAPB_Result_t r;
+    while ((r = YAPB_log_next(log, len, &off, &pkt, &pkt_len)) == YAPB_OK) {
+        if (*n == *cap) {
+            size_t ncap = *cap ? *cap * 2 : 4096;
+            Entry *e = realloc(*entries, ncap * sizeof(Entry));
+            if (e == NULL) return YAPB_ERR_BUFFER_TOO_SMALL;
+            *entries = e;
+            *cap = ncap;
+        }
+        (*entries)[(*n)++].off = (uint64_t)(pkt - log);
+    }
+    *out_end = off;
+    if (r == YAPB_ERR_INVALID_PACKET &&
+        (len - off < YAPB_HEADER_SIZE || read_u32(log + off) > len - off)) {
+        return YAPB_OK;
+    }
+    return (r == YAPB_ERR_NO_MORE_ELEMENTS) ? YAPB_OK : r;
+}
+
+typedef struct {
+    const uint8_t *log;
+    size_t len;
+    const YAPB_KeyPath_t *path;
+    Entry *entries;     // this worker's slice
+    size_t n;           // in: slice size, out: keyed entries kept
+    int node;           // NUMA node to run on, -1 for no placement
+    YAPB_Result_t result;
+} KeyTask;
+
+// Fill in the key prefixes of a slice, drop unkeyed packets and sort it
+static void *key_task(void *arg) {
+    KeyTask *t = arg;
+    size_t kept = 0;
+    for (size_t i = 0; i < t->n; i++) {
+        uint64_t off = t->entries[i].off;
+        YAPB_Key_t key;
+        YAPB_Result_t r = YAPB_key_extract(t->log + off, t->len - off, t->path, &key);
+        if (r != YAPB_OK) {
+            t->result = r;
+            return NULL;
+        }
+        if (key.kind != YAPB_KEY_NONE) {
+            t->entries[kept].prefix = key.prefix;
+            t->entries[kept].off = off;
+            kept++;
+        }
+    }
+    qsort(t->entries, kept, sizeof(Entry), entry_cmp);
+    t->n = kept;
+    t->result = YAPB_OK;
+    return NULL;
+}
+
+static void *key_worker(void *arg) {
+    KeyTask *t = arg;
+    if (t->node >= 0) {
+        YAPB_numa_pin_thread(t->node);
+    }
+    return key_task(t);
+}
+
+static YAPB_Result_t key_slices(KeyTask *tasks, unsigned ntasks) {
+    pthread_t *th = (ntasks > 1) ? malloc((ntasks - 1) * sizeof(pthread_t)) : NULL;
+    bool *started = (ntasks > 1) ? calloc(ntasks, sizeof(bool)) : NULL;
+    for (unsigned i = 1; i < ntasks; i++) {
+        if (th != NULL && started != NULL && pthread_create(&th[i - 1], NULL, key_worker, &tasks[i]) == 0) {
+            started[i] = true;
+        } else {
+            key_task(&tasks[i]);
+        }
+    }
+    key_task(&tasks[0]);
+    for (unsigned i = 1; i < ntasks; i++) {
+        if (started != NULL && started[i]) pthread_join(th[i - 1], NULL);
+    }
+    free(th);
+    free(started);
+    for (unsigned i = 0; i < ntasks; i++) {
+        if (tasks[i].result != YAPB_OK) return tasks[i].result;
+    }
+    return YAPB_OK;
+}
+
+// ============ Writing ============
+
+typedef struct {
+    const Entry *e;
+    size_t n;
+} Source;
+
+// Write the k-way merge of sorted sources
+static YAPB_Result_t merge_sources(Source *src, unsigned nsrc, YAPB_Writer *w) {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < nsrc; i++) {
+        total += src[i].n;
+    }
+    // Few sources (one per build thread or tail run): a linear scan beats a heap
+    YAPB_Result_t r = YAPB_OK;
+    uint8_t rec[IDX_ENTRY_SIZE];
+    for (uint64_t k = 0; k < total && r == YAPB_OK; k++) {
+        unsigned best = nsrc;
+        for (unsigned i = 0; i < nsrc; i++) {
+            if (src[i].n > 0 && (best == nsrc || entry_cmp(src[i].e, src[best].e) < 0)) {
+                best = i;
+            }
+        }
+        write_u64(rec, src[best].e->prefix);
+        write_u64(rec + 8, src[best].e->off);
+        src[best].e++;
+        src[best].n--;
+        r = writer_put(w, rec, IDX_ENTRY_SIZE);
+    }
+    return (r == YAPB_OK) ? writer_flush(w) : r;
+}
+
+// Write the header and the k-way merge of sorted sources to a temporary
+// file, then rename it over index_path.
+static YAPB_Result_t write_index(const char *index_path, const YAPB_KeyPath_t *path,
+                                 Source *src, unsigned nsrc, uint64_t covered) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", index_path) >= (int)sizeof(tmp)) {
+        return YAPB_ERR_IO;
+    }
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        return YAPB_ERR_IO;
+    }
+    uint8_t *buf = malloc(WBUF_SIZE);
+    if (buf == NULL) {
+        close(fd);
+        unlink(tmp);
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+
+    uint64_t total = 0;
+    for (unsigned i = 0; i < nsrc; i++) {
+        total += src[i].n;
+    }
+    uint8_t hdr[IDX_HEADER_SIZE];
+    Tail none = { .n = 0 };
+    header_encode(hdr, path, total, &none, covered);
+    YAPB_Writer w = { fd, buf, WBUF_SIZE, 0, 0 };
+    YAPB_Result_t r = writer_put(&w, hdr, IDX_HEADER_SIZE);
+    if (r == YAPB_OK) {
+        r = merge_sources(src, nsrc, &w);
+    }
+    if (r == YAPB_OK && fdatasync(fd) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (close(fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    if (r == YAPB_OK && rename(tmp, index_path) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (r != YAPB_OK) {
+        unlink(tmp);
+    }
+    free(buf);
+    return r;
+}
+
+YAPB_Result_t YAPB_index_build(const char *log_path, const char *index_path,
+                               const YAPB_KeyPath_t *key, const YAPB_IndexConfig_t *cfg) {
+    if (log_path == NULL || index_path == NULL || key == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (key->depth == 0 || key->depth > YAPB_KEY_MAX_DEPTH) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    unsigned threads = (cfg != NULL && cfg->threads > 0) ? cfg->threads : 1;
+    bool numa = cfg != NULL && cfg->numa && YAPB_numa_node_count() > 1;
+
+    YAPB_LogMap_t map;
+    YAPB_Result_t r = YAPB_log_map(&map, log_path, YAPB_MAP_SEQUENTIAL);
+    if (r != YAPB_OK) return r;
+    size_t len;
+    const uint8_t *log = YAPB_log_get_data(&map, &len);
+
+    // Packet boundaries are a serial header walk; keys are extracted and
+    // sorted per slice in parallel
+    Entry *entries = NULL;
+    size_t n = 0, cap = 0, end = 0;
+    r = scan_log(log, len, 0, &entries, &n, &cap, &end);
+
+    KeyTask *tasks = NULL;
+    Source *src = NULL;
+    if (r == YAPB_OK) {
+        if (threads > n / 1024 + 1) {
+            threads = (unsigned)(n / 1024 + 1);
+        }
+        tasks = calloc(threads, sizeof(KeyTask));
+        src = calloc(threads, sizeof(Source));
+        if (tasks == NULL || src == NULL) {
+            r = YAPB_ERR_BUFFER_TOO_SMALL;
+        }
+    }
+    if (r == YAPB_OK) {
+        for (unsigned i = 0; i < threads; i++) {
+            size_t lo = n * i / threads, hi = n * (i + 1) / threads;
+            // The caller keeps its own placement; helpers go round-robin over nodes
+            int node = (numa && i > 0) ? YAPB_numa_node_id(i % YAPB_numa_node_count()) : -1;
+            tasks[i] = (KeyTask){ log, len, key, entries + lo, hi - lo, node, YAPB_OK };
+        }
+        r = key_slices(tasks, threads);
+    }
+    if (r == YAPB_OK) {
+        for (unsigned i = 0; i < threads; i++) {
+            src[i] = (Source){ tasks[i].entries, tasks[i].n };
+        }
+        r = write_index(index_path, key, src, threads, end);
+    }
+
+    free(tasks);
+    free(src);
+    free(entries);
+    YAPB_log_unmap(&map);
+    return r;
+}
+
+// Decode n entries from the mapped index
+static void read_entries(const uint8_t *e, uint64_t n, Entry *out) {
+    for (uint64_t i = 0; i < n; i++) {
+        out[i].prefix = read_u64(e + i * IDX_ENTRY_SIZE);
+        out[i].off = read_u64(e + i * IDX_ENTRY_SIZE + 8);
+    }
+}
+
+YAPB_Result_t YAPB_index_update(const char *log_path, const char *index_path) {
+    if (log_path == NULL || index_path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+
+    int fd = open(index_path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return YAPB_ERR_IO;
+    }
+    YAPB_LogMap_t file, map;
+    YAPB_Result_t r = YAPB_log_map(&file, index_path, 0);
+    if (r != YAPB_OK) {
+        close(fd);
+        return r;
+    }
+    r = YAPB_log_map(&map, log_path, 0);
+    if (r != YAPB_OK) {
+        YAPB_log_unmap(&file);
+        close(fd);
+        return r;
+    }
+
+    size_t file_len, len;
+    const uint8_t *idx = YAPB_log_get_data(&file, &file_len);
+    const uint8_t *log = YAPB_log_get_data(&map, &len);
+    YAPB_KeyPath_t path;
+    uint64_t sorted = 0, covered = 0;
+    Tail tail = { .n = 0 };
+    Entry *fresh = NULL, *all = NULL;
+    size_t n = 0, cap = 0, end = 0;
+
+    r = header_decode(idx, file_len, &path, &sorted, &tail, &covered);
+    if (r == YAPB_OK && covered > len) {
+        r = YAPB_ERR_INVALID_PACKET;
+    }
+    if (r == YAPB_OK) {
+        r = scan_log(log, len, covered, &fresh, &n, &cap, &end);
+    }
+    if (r != YAPB_OK || end == covered) {
+        goto out;
+    }
+    KeyTask task = { log, len, &path, fresh, n, -1, YAPB_OK };
+    key_task(&task);
+    r = task.result;
+    n = task.n;
+    if (r != YAPB_OK) {
+        goto out;
+    }
+
+    // New entries take the newest runs no larger than themselves along, so
+    // run sizes at least double towards the oldest and stay few
+    const uint8_t *e = idx + IDX_HEADER_SIZE;
+    uint64_t used = sorted;
+    for (uint32_t i = 0; i < tail.n; i++) {
+        if (tail.at[i] + tail.len[i] > used) used = tail.at[i] + tail.len[i];
+    }
+    uint32_t keep = tail.n;
+    uint64_t run_len = n;
+    while (n > 0 && keep > 0 && (tail.len[keep - 1] <= run_len || keep == TAIL_RUNS)) {
+        keep--;
+        run_len += tail.len[keep];
+    }
+    uint64_t limit = sorted >> TAIL_SHIFT;
+    if (limit < TAIL_MIN) limit = TAIL_MIN;
+
+    if (used - sorted + run_len <= limit) {
+        // Write the new run past everything live, then publish it through the
+        // header. A crash in between leaves the old header and runs intact.
+        if (run_len > n) {
+            all = malloc((run_len - n) * sizeof(Entry));
+            if (all == NULL) {
+                r = YAPB_ERR_BUFFER_TOO_SMALL;
+                goto out;
+            }
+        }
+        Source src[TAIL_RUNS + 1];
+        unsigned nsrc = 0;
+        Entry *dst = all;
+        for (uint32_t i = keep; i < tail.n; i++) {
+            read_entries(e + tail.at[i] * IDX_ENTRY_SIZE, tail.len[i], dst);
+            src[nsrc++] = (Source){ dst, tail.len[i] };
+            dst += tail.len[i];
+        }
+        src[nsrc++] = (Source){ fresh, n };
+        if (run_len > 0) {
+            uint8_t buf[WBUF_SIZE / 16];
+            YAPB_Writer w = { fd, buf, sizeof(buf), 0, 0 };
+            off_t at = IDX_HEADER_SIZE + (off_t)used * IDX_ENTRY_SIZE;
+            r = (lseek(fd, at, SEEK_SET) == at) ? merge_sources(src, nsrc, &w) : YAPB_ERR_IO;
+            tail.at[keep] = used;
+            tail.len[keep] = run_len;
+            tail.n = keep + 1;
+        }
+        if (r == YAPB_OK && fdatasync(fd) != 0) {
+            r = YAPB_ERR_IO;
+        }
+        if (r == YAPB_OK) {
+            uint8_t hdr[IDX_HEADER_SIZE];
+            header_encode(hdr, &path, sorted, &tail, end);
+            r = pwrite_all(fd, hdr, IDX_HEADER_SIZE, 0);
+        }
+        goto out;
+    }
+
+    // Merge everything: the sorted part, every tail run and the new entries
+    uint64_t live = 0;
+    for (uint32_t i = 0; i < tail.n; i++) {
+        live += tail.len[i];
+    }
+    all = malloc((sorted + live + 1) * sizeof(Entry));
+    if (all == NULL) {
+        r = YAPB_ERR_BUFFER_TOO_SMALL;
+        goto out;
+    }
+    Source src[TAIL_RUNS + 2];
+    unsigned nsrc = 0;
+    read_entries(e, sorted, all);
+    src[nsrc++] = (Source){ all, sorted };
+    Entry *dst = all + sorted;
+    for (uint32_t i = 0; i < tail.n; i++) {
+        read_entries(e + tail.at[i] * IDX_ENTRY_SIZE, tail.len[i], dst);
+        src[nsrc++] = (Source){ dst, tail.len[i] };
+        dst += tail.len[i];
+    }
+    src[nsrc++] = (Source){ fresh, n };
+    r = write_index(index_path, &path, src, nsrc, end);
+
+out:
+    free(all);
+    free(fresh);
+    YAPB_log_unmap(&map);
+    YAPB_log_unmap(&file);
+    close(fd);
+    return r;
+}
+
+// ============ Lookup ============
+
+YAPB_Result_t YAPB_index_open(YAPB_Index_t *idx, const char *log_path, const char *index_path) {
+    if (idx == NULL || log_path == NULL || index_path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Index_t *x = IDX(idx);
+
+    YAPB_Result_t r = YAPB_log_map(&x->file, index_path, 0);
+    if (r != YAPB_OK) return r;
+    r = YAPB_log_map(&x->log, log_path, YAPB_MAP_RANDOM);
+    if (r != YAPB_OK) {
+        YAPB_log_unmap(&x->file);
+        return r;
+    }
+
+    size_t file_len, len;
+    const uint8_t *data = YAPB_log_get_data(&x->file, &file_len);
+    YAPB_log_get_data(&x->log, &len);
+    r = header_decode(data, file_len, &x->path, &x->sorted, &x->tail, &x->covered);
+    if (r == YAPB_OK && x->covered > len) {
+        r = YAPB_ERR_INVALID_PACKET;
+    }
+    if (r != YAPB_OK) {
+        YAPB_log_unmap(&x->log);
+        YAPB_log_unmap(&x->file);
+        return r;
+    }
+    x->entries = data + IDX_HEADER_SIZE;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_index_close(YAPB_Index_t *idx) {
+    if (idx == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    YAPB_Result_t r1 = YAPB_log_unmap(&IDX(idx)->log);
+    YAPB_Result_t r2 = YAPB_log_unmap(&IDX(idx)->file);
+    return (r1 != YAPB_OK) ? r1 : r2;
+}
+
+YAPB_Result_t YAPB_index_get_count(const YAPB_Index_t *idx, uint64_t *out_count) {
+    if (idx == NULL || out_count == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Index_t *x = CIDX(idx);
+    *out_count = x->sorted;
+    for (uint32_t i = 0; i < x->tail.n; i++) {
+        *out_count += x->tail.len[i];
+    }
+    return YAPB_OK;
+}
+
+// Confirm that the packet at a log offset really has the key
+static bool entry_matches(const _YAPB_Index_t *x, uint64_t off, const YAPB_Key_t *key) {
+    size_t len;
+    const uint8_t *log = YAPB_log_get_data(&x->log, &len);
+    if (off >= x->covered) {
+        return false;
+    }
+    YAPB_Key_t k;
+    if (YAPB_key_extract(log + off, len - off, &x->path, &k) != YAPB_OK) {
+        return false;
+    }
+    return YAPB_key_compare(&k, key) == 0;
+}
+
+// Collect the confirmed matches in n sorted entries starting at entry first
+static void find_run(const _YAPB_Index_t *x, uint64_t first, uint64_t n, const YAPB_Key_t *key,
+                     uint64_t *out_offs, size_t max, size_t *found) {
+    const uint8_t *e = x->entries + first * IDX_ENTRY_SIZE;
+    // Lower bound of the prefix
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (read_u64(e + mid * IDX_ENTRY_SIZE) < key->prefix) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (uint64_t i = lo; i < n && read_u64(e + i * IDX_ENTRY_SIZE) == key->prefix; i++) {
+        uint64_t off = read_u64(e + i * IDX_ENTRY_SIZE + 8);
+        if (entry_matches(x, off, key)) {
+            if (*found < max) out_offs[*found] = off;
+            (*found)++;
+        }
+    }
+}
+
+YAPB_Result_t YAPB_index_find(const YAPB_Index_t *idx, const YAPB_Key_t *key,
+                              uint64_t *out_offs, size_t max, size_t *out_n) {
+    if (idx == NULL || key == NULL || out_n == NULL || (out_offs == NULL && max > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Index_t *x = CIDX(idx);
+    size_t found = 0;
+    find_run(x, 0, x->sorted, key, out_offs, max, &found);
+
+    // Each tail run holds later log offsets than the ones before it
+    for (uint32_t i = 0; i < x->tail.n; i++) {
+        find_run(x, x->tail.at[i], x->tail.len[i], key, out_offs, max, &found);
+    }
+
+    *out_n = found;
+    return (found > 0) ? YAPB_OK : YAPB_ERR_NOT_FOUND;
+}
+
+YAPB_Result_t YAPB_index_load(const YAPB_Index_t *idx, uint64_t off, YAPB_Packet_t *out_pkt) {
+    if (idx == NULL || out_pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Index_t *x = CIDX(idx);
+    size_t len;
+    const uint8_t *log = YAPB_log_get_data(&x->log, &len);
+    if (off >= x->covered) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    return YAPB_load(out_pkt, log + off, len - off);
+}
+
+YAPB_Result_t YAPB_index_lookup(const YAPB_Index_t *idx, const YAPB_Key_t *key, YAPB_Packet_t *out_pkt) {
+    if (out_pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    uint64_t off;
+    size_t n;
+    YAPB_Result_t r = YAPB_index_find(idx, key, &off, 1, &n);
+    if (r != YAPB_OK) return r;
+    return YAPB_index_load(idx, off, out_pkt);
+}
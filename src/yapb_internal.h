@@ -0,0 +1,247 @@
+#pragma once
+#include "yapb.h"
+#include <string.h>
+#include <arpa/inet.h>
+
+// Private declarations shared by the library's translation units.
+// Not installed; the public headers only expose opaque storage.
+
+typedef struct {
+    uint8_t *buffer;      // buffer for writing / raw data for reading
+    uint32_t buffer_size; // total buffer size (packet lengths are 32-bit)
+    uint32_t pos;         // current read/write position (starts after header)
+    uint32_t ts_base;     // position of the first TIMESTAMP element, 0 if none yet
+    int8_t error;         // sticky YAPB_Result_t, checked by get_error()
+    uint8_t mode;         // YAPB_MODE_WRITE or YAPB_MODE_READ
+    bool finalized;       // true after YAPB_finalize(), prevents further pushes
+} _YAPB_Packet_t;
+
+_Static_assert(sizeof(_YAPB_Packet_t) <= YAPB_PACKET_SIZE,
+    "YAPB_PACKET_SIZE too small for _YAPB_Packet_t");
+
+#define P(x) ((_YAPB_Packet_t *)(x))
+#define CP(x) ((const _YAPB_Packet_t *)(x))
+
+// Helper to write uint16 in network byte order
+static inline void write_u16(uint8_t *dst, uint16_t val) {
+    uint16_t net = htons(val);
+    memcpy(dst, &net, 2);
+}
+
+// Helper to write uint32 in network byte order
+static inline void write_u32(uint8_t *dst, uint32_t val) {
+    uint32_t net = htonl(val);
+    memcpy(dst, &net, 4);
+}
+
+// Helper to write uint64 in network byte order
+static inline void write_u64(uint8_t *dst, uint64_t val) {
+    uint32_t high = htonl((uint32_t)(val >> 32));
+    uint32_t low = htonl((uint32_t)(val & 0xFFFFFFFF));
+    memcpy(dst, &high, 4);
+    memcpy(dst + 4, &low, 4);
+}
+
+// Helper to read uint16 from network byte order
+static inline uint16_t read_u16(const uint8_t *src) {
+    uint16_t net;
+    memcpy(&net, src, 2);
+    return ntohs(net);
+}
+
+// Helper to read uint32 from network byte order
+static inline uint32_t read_u32(const uint8_t *src) {
+    uint32_t net;
+    memcpy(&net, src, 4);
+    return ntohl(net);
+}
+
+// Helper to read uint64 from network byte order
+static inline uint64_t read_u64(const uint8_t *src) {
+    uint32_t high, low;
+    memcpy(&high, src, 4);
+    memcpy(&low, src + 4, 4);
+    return ((uint64_t)ntohl(high) << 32) | ntohl(low);
+}
+
+// Wire layout of one type tag. An element is the tag byte, a length field
+// of len_width bytes (0 for fixed-size types), then a value of size bytes
+// plus the length field's value. Blobs count their 2-byte length in size;
+// nested packets count their own header in the length. A varint value is
+// a LEB128 varint instead (size and len_width are 0). Undefined tags have
+// valid == 0.
+typedef struct {
+    uint8_t valid;
+    uint8_t size;
+    uint8_t len_width;
+    uint8_t varint;
+} _YAPB_TagDesc_t;
+
+// One entry per tag byte value, defined in yapb.c.
+extern const _YAPB_TagDesc_t _yapb_tag_desc[256];
+
+// Read the length field of a variable-size element whose tag is at b.
+// Returns 0 for fixed-size types; b + 1 must hold len_width bytes.
+static inline size_t tag_len_field(_YAPB_TagDesc_t d, const uint8_t *b) {
+    if (d.len_width == 2) return read_u16(b + 1);
+    if (d.len_width == 4) return read_u32(b + 1);
+    return 0;
+}
+
+// Length of the LEB128 varint at src within avail bytes, or 0 if it is
+// unterminated or does not fit 64 bits (at most 10 bytes, the last <= 1).
+static inline size_t varint_len(const uint8_t *src, size_t avail) {
+    size_t max = avail < 10 ? avail : 10;
+    for (size_t i = 0; i < max; i++) {
+        if ((src[i] & 0x80) == 0) {
+            return (i == 9 && src[i] > 1) ? 0 : i + 1;
+        }
+    }
+    return 0;
+}
+
+// Read a varint already checked with varint_len()
+static inline uint64_t read_varint(const uint8_t *src) {
+    uint64_t v = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        v |= (uint64_t)(*src & 0x7F) << shift;
+        if ((*src++ & 0x80) == 0) {
+            return v;
+        }
+    }
+}
+
+// Bytes write_varint() needs for v
+static inline size_t varint_size(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// Write v as a LEB128 varint, return its length
+static inline size_t write_varint(uint8_t *dst, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        dst[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    dst[n++] = (uint8_t)v;
+    return n;
+}
+
+// Value size of a fixed-size value type tag, or 0 for variable-size/unknown
+// tags and NESTED_REF (whose 4 bytes are an offset, not a value).
+static inline size_t fixed_size(uint8_t tag) {
+    _YAPB_TagDesc_t d = _yapb_tag_desc[tag];
+    return (d.len_width == 0 && tag != YAPB_NESTED_REF) ? d.size : 0;
+}
+
+// Total size (type tag + value) of the element whose tag is at buf[pos],
+// or 0 if the tag is unknown or the element runs past end.
+static inline size_t elem_span(const uint8_t *buf, size_t pos, size_t end) {
+    if (pos >= end) {
+        return 0;
+    }
+    const uint8_t *b = buf + pos;
+    size_t avail = end - pos - 1;
+    _YAPB_TagDesc_t d = _yapb_tag_desc[b[0]];
+    if (!d.valid || avail < d.len_width) {
+        return 0;
+    }
+    if (d.varint) {
+        size_t n = varint_len(b + 1, avail);
+        return n ? 1 + n : 0;
+    }
+    size_t field = tag_len_field(d, b);
+    if (d.len_width == 4 && field < YAPB_HEADER_SIZE) {
+        return 0;
+    }
+    size_t len = d.size + field;
+    return (len <= avail) ? 1 + len : 0;
+}
+
+// Offset within pkt of the nested packet (its header) held by the element
+// at pkt[pos]: right after the tag for NESTED_PKT, or the earlier NESTED_PKT
+// a NESTED_REF points back at. pkt is the start of the enclosing packet,
+// which references are relative to. Returns 0 for other tags, a malformed
+// element, or a reference that does not point at a nested packet ending
+// before it.
+static inline size_t nested_at(const uint8_t *pkt, size_t pos, size_t end) {
+    if (elem_span(pkt, pos, end) == 0) {
+        return 0;
+    }
+    if (pkt[pos] == YAPB_NESTED_PKT) {
+        return pos + 1;
+    }
+    if (pkt[pos] != YAPB_NESTED_REF) {
+        return 0;
+    }
+    size_t t = read_u32(pkt + pos + 1);
+    if (t < YAPB_HEADER_SIZE || t >= pos || pkt[t] != YAPB_NESTED_PKT || elem_span(pkt, t, pos) == 0) {
+        return 0;
+    }
+    return t + 1;
+}
+
+// TIMESTAMP_DELTA stores the zigzag-encoded difference to the packet's
+// first TIMESTAMP, so small deltas of either sign take few bytes. The
+// arithmetic is modulo 2^64, so every pair of timestamps round-trips.
+static inline uint64_t ts_delta_encode(int64_t ns, int64_t base) {
+    uint64_t d = (uint64_t)ns - (uint64_t)base;
+    return (d << 1) ^ (0 - (d >> 63));
+}
+
+static inline int64_t ts_delta_decode(uint64_t zz, int64_t base) {
+    uint64_t d = (zz >> 1) ^ (0 - (zz & 1));
+    return (int64_t)((uint64_t)base + d);
+}
+
+// Position of the first TIMESTAMP element of the packet at pkt before
+// position `before`, or 0 if there is none. The elements up to `before`
+// must be well formed.
+static inline size_t ts_base_find(const uint8_t *pkt, size_t before) {
+    for (size_t pos = YAPB_HEADER_SIZE; pos < before;) {
+        if (pkt[pos] == YAPB_TIMESTAMP) {
+            return pos;
+        }
+        size_t span = elem_span(pkt, pos, before);
+        if (span == 0) {
+            return 0;
+        }
+        pos += span;
+    }
+    return 0;
+}
+
+// Nanoseconds of the well-formed TIMESTAMP or TIMESTAMP_DELTA element at
+// pkt[pos]. base is the position of the packet's first TIMESTAMP, 0 if
+// none; returns false for a delta without one.
+static inline bool decode_timestamp(const uint8_t *pkt, size_t pos, size_t base, int64_t *out) {
+    if (pkt[pos] == YAPB_TIMESTAMP) {
+        *out = (int64_t)read_u64(pkt + pos + 1);
+        return true;
+    }
+    if (base == 0 || base >= pos) {
+        return false;
+    }
+    *out = ts_delta_decode(read_varint(pkt + pos + 1), (int64_t)read_u64(pkt + base + 1));
+    return true;
+}
+
+// Store a fixed-size value at dst, reading it from network order at src.
+// dst has the C type matching the tag (int8_t, ..., double).
+static inline void decode_fixed(uint8_t tag, const uint8_t *src, void *dst) {
+    switch ((YAPB_Type_t)tag) {
+        case YAPB_INT8:   *(int8_t *)dst = (int8_t)src[0]; break;
+        case YAPB_INT16:  *(int16_t *)dst = (int16_t)read_u16(src); break;
+        case YAPB_INT32:  *(int32_t *)dst = (int32_t)read_u32(src); break;
+        case YAPB_INT64:
+        case YAPB_TIMESTAMP: *(int64_t *)dst = (int64_t)read_u64(src); break;
+        case YAPB_FLOAT:  { uint32_t b = read_u32(src); memcpy(dst, &b, 4); break; }
+        case YAPB_DOUBLE: { uint64_t b = read_u64(src); memcpy(dst, &b, 8); break; }
+        default: break;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "yapb.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// Private file I/O helpers shared by the file-based modules (sort, index).
+
+// Buffered writer over a file descriptor
+typedef struct {
+    int fd;
+    uint8_t *buf;
+    size_t cap;
+    size_t used;
+    uint64_t bytes;     // total bytes written
+} YAPB_Writer;
+
+static inline YAPB_Result_t write_all(int fd, const uint8_t *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return YAPB_ERR_IO;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return YAPB_OK;
+}
+
+static inline YAPB_Result_t pwrite_all(int fd, const uint8_t *p, size_t n, off_t off) {
+    while (n > 0) {
+        ssize_t w = pwrite(fd, p, n, off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return YAPB_ERR_IO;
+        }
+        p += w;
+        n -= (size_t)w;
+        off += w;
+    }
+    return YAPB_OK;
+}
+
+static inline YAPB_Result_t writer_flush(YAPB_Writer *w) {
+    YAPB_Result_t r = write_all(w->fd, w->buf, w->used);
+    w->used = 0;
+    return r;
+}
+
+static inline YAPB_Result_t writer_put(YAPB_Writer *w, const uint8_t *p, size_t n) {
+    w->bytes += n;
+    if (w->used + n > w->cap) {
+        YAPB_Result_t r = writer_flush(w);
+        if (r != YAPB_OK) return r;
+        if (n >= w->cap) {
+            return write_all(w->fd, p, n);
+        }
+    }
+    memcpy(w->buf + w->used, p, n);
+    w->used += n;
+    return YAPB_OK;
+}
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include "yapb_journal.h"
+#include "yapb_io.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define DEFAULT_BUFFER_BYTES (1u << 20)
+
+typedef struct {
+    pthread_mutex_t lock;       // guards everything below except fd and mem
+    pthread_cond_t work;        // flusher: a batch was started, or closing
+    pthread_cond_t done;        // submitters: a batch is durable, or buffer swapped
+    pthread_t flusher;
+    int fd;
+    uint8_t *mem;               // two staging buffers of cap bytes
+    size_t cap;
+    size_t used;                // bytes in the filling buffer
+    uint64_t batch_packets;     // packets in the filling buffer
+    uint64_t filling;           // number of the batch being filled (from 1)
+    uint64_t durable;           // highest batch on stable storage
+    uint64_t first_us;          // arrival of the first packet of the filling batch
+    uint64_t max_delay_us;
+    uint64_t end;               // file offset after the filling batch
+    YAPB_JournalStats_t stats;
+    YAPB_Result_t error;        // sticky write/sync failure
+    uint8_t active;             // index of the filling buffer
+    bool closing;
+} _YAPB_Journal_t;
+
+_Static_assert(sizeof(_YAPB_Journal_t) <= YAPB_JOURNAL_SIZE,
+    "YAPB_JOURNAL_SIZE too small for _YAPB_Journal_t");
+
+#define JR(x) ((_YAPB_Journal_t *)(x))
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void wait_until_us(pthread_cond_t *cond, pthread_mutex_t *lock, uint64_t deadline) {
+    struct timespec ts = { (time_t)(deadline / 1000000u), (long)(deadline % 1000000u) * 1000 };
+    pthread_cond_timedwait(cond, lock, &ts);
+}
+
+static void *flusher_main(void *arg) {
+    _YAPB_Journal_t *s = arg;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (s->used == 0 && !s->closing) {
+            pthread_cond_wait(&s->work, &s->lock);
+        }
+        if (s->used == 0) {
+            break;
+        }
+        // Optionally let more submitters join, until half the buffer is used
+        if (s->max_delay_us > 0) {
+            uint64_t deadline = s->first_us + s->max_delay_us;
+            while (!s->closing && s->used < s->cap / 2 && now_us() < deadline) {
+                wait_until_us(&s->work, &s->lock, deadline);
+            }
+        }
+
+        // Swap buffers: submitters fill the other one while this one syncs
+        const uint8_t *data = s->mem + (size_t)s->active * s->cap;
+        size_t len = s->used;
+        uint64_t batch = s->filling, packets = s->batch_packets;
+        s->active ^= 1;
+        s->used = 0;
+        s->batch_packets = 0;
+        s->filling++;
+        pthread_cond_broadcast(&s->done);
+        bool failed = (s->error != YAPB_OK);
+        pthread_mutex_unlock(&s->lock);
+
+        YAPB_Result_t r = YAPB_ERR_IO;
+        if (!failed) {
+            r = write_all(s->fd, data, len);
+            if (r == YAPB_OK && fdatasync(s->fd) != 0) {
+                r = YAPB_ERR_IO;
+            }
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if (r == YAPB_OK) {
+            s->durable = batch;
+            s->stats.packets += packets;
+            s->stats.bytes += len;
+            s->stats.syncs++;
+            if (packets > s->stats.max_batch_packets) {
+                s->stats.max_batch_packets = packets;
+            }
+        } else {
+            s->error = YAPB_ERR_IO;
+        }
+        pthread_cond_broadcast(&s->done);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+YAPB_Result_t YAPB_journal_open(YAPB_Journal_t *j, const char *path, const YAPB_JournalConfig_t *cfg) {
+    if (j == NULL || path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Journal_t *s = JR(j);
+    size_t cap = (cfg && cfg->buffer_bytes) ? cfg->buffer_bytes : DEFAULT_BUFFER_BYTES;
+    if (cap < YAPB_HEADER_SIZE) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return YAPB_ERR_IO;
+    }
+    struct stat st;
+    uint8_t *mem = malloc(2 * cap);
+    if (fstat(fd, &st) != 0 || mem == NULL) {
+        free(mem);
+        close(fd);
+        return (mem == NULL) ? YAPB_ERR_BUFFER_TOO_SMALL : YAPB_ERR_IO;
+    }
+
+    *s = (_YAPB_Journal_t){
+        .fd = fd, .mem = mem, .cap = cap, .filling = 1,
+        .max_delay_us = cfg ? cfg->max_delay_us : 0,
+        .end = (uint64_t)st.st_size, .error = YAPB_OK,
+    };
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, &attr);
+    pthread_cond_init(&s->done, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&s->flusher, NULL, flusher_main, s) != 0) {
+        pthread_cond_destroy(&s->done);
+        pthread_cond_destroy(&s->work);
+        pthread_mutex_destroy(&s->lock);
+        free(mem);
+        close(fd);
+        return YAPB_ERR_IO;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_journal_submit(YAPB_Journal_t *j, const YAPB_Packet_t *pkt,
+                                  uint64_t *out_ticket, uint64_t *out_off) {
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (j == NULL || data == NULL || out_ticket == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Journal_t *s = JR(j);
+    if (len > s->cap) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    while (s->error == YAPB_OK && s->used + len > s->cap) {
+        pthread_cond_signal(&s->work);
+        pthread_cond_wait(&s->done, &s->lock);
+    }
+    if (s->error != YAPB_OK) {
+        pthread_mutex_unlock(&s->lock);
+        return s->error;
+    }
+    if (s->used == 0) {
+        s->first_us = now_us();
+        pthread_cond_signal(&s->work);
+    } else if (s->max_delay_us > 0 && s->used < s->cap / 2 && s->used + len >= s->cap / 2) {
+        pthread_cond_signal(&s->work);
+    }
+    memcpy(s->mem + (size_t)s->active * s->cap + s->used, data, len);
+    s->used += len;
+    s->batch_packets++;
+    *out_ticket = s->filling;
+    if (out_off != NULL) {
+        *out_off = s->end;
+    }
+    s->end += len;
+    pthread_mutex_unlock(&s->lock);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_journal_wait(YAPB_Journal_t *j, uint64_t ticket) {
+    if (j == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Journal_t *s = JR(j);
+    pthread_mutex_lock(&s->lock);
+    while (s->durable < ticket && s->error == YAPB_OK) {
+        pthread_cond_wait(&s->done, &s->lock);
+    }
+    // Batches complete in order, so an error only affects later tickets
+    YAPB_Result_t r = (s->durable >= ticket) ? YAPB_OK : s->error;
+    pthread_mutex_unlock(&s->lock);
+    return r;
+}
+
+YAPB_Result_t YAPB_journal_append(YAPB_Journal_t *j, const YAPB_Packet_t *pkt, uint64_t *out_off) {
+    uint64_t ticket;
+    YAPB_Result_t r = YAPB_journal_submit(j, pkt, &ticket, out_off);
+    if (r != YAPB_OK) {
+        return r;
+    }
+    return YAPB_journal_wait(j, ticket);
+}
+
+YAPB_Result_t YAPB_journal_get_stats(YAPB_Journal_t *j, YAPB_JournalStats_t *out) {
+    if (j == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Journal_t *s = JR(j);
+    pthread_mutex_lock(&s->lock);
+    *out = s->stats;
+    pthread_mutex_unlock(&s->lock);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_journal_close(YAPB_Journal_t *j) {
+    if (j == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Journal_t *s = JR(j);
+    pthread_mutex_lock(&s->lock);
+    s->closing = true;
+    pthread_cond_signal(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->flusher, NULL);
+
+    YAPB_Result_t r = s->error;
+    if (close(s->fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    pthread_cond_destroy(&s->done);
+    pthread_cond_destroy(&s->work);
+    pthread_mutex_destroy(&s->lock);
+    free(s->mem);
+    s->mem = NULL;
+    s->fd = -1;
+    return r;
+}
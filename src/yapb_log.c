@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include "yapb_log.h"
+#include "yapb_internal.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    uint8_t *data;      // mapped contents, NULL for empty files
+    size_t len;         // file size
+} _YAPB_LogMap_t;
+
+_Static_assert(sizeof(_YAPB_LogMap_t) <= YAPB_LOG_MAP_SIZE,
+    "YAPB_LOG_MAP_SIZE too small for _YAPB_LogMap_t");
+
+#define LM(x) ((_YAPB_LogMap_t *)(x))
+#define CLM(x) ((const _YAPB_LogMap_t *)(x))
+
+#define SIGN_BIT 0x8000000000000000ULL
+
+#define MAP_FLAGS (YAPB_MAP_POPULATE | YAPB_MAP_SEQUENTIAL | YAPB_MAP_RANDOM | \
+                   YAPB_MAP_WILLNEED | YAPB_MAP_HUGEPAGE)
+
+YAPB_Result_t YAPB_log_map(YAPB_LogMap_t *map, const char *path, unsigned flags) {
+    if (map == NULL || path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if ((flags & ~MAP_FLAGS) != 0 ||
+        (flags & (YAPB_MAP_SEQUENTIAL | YAPB_MAP_RANDOM)) == (YAPB_MAP_SEQUENTIAL | YAPB_MAP_RANDOM)) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    _YAPB_LogMap_t *m = LM(map);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return YAPB_ERR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return YAPB_ERR_IO;
+    }
+
+    m->data = NULL;
+    m->len = (size_t)st.st_size;
+    if (m->len > 0) {
+        int mflags = MAP_PRIVATE;
+        if (flags & YAPB_MAP_POPULATE) {
+            mflags |= MAP_POPULATE;
+        }
+        void *addr = mmap(NULL, m->len, PROT_READ, mflags, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            return YAPB_ERR_IO;
+        }
+        m->data = addr;
+
+        // Hints only: failures (e.g. no THP for this file system) are ignored
+        if (flags & YAPB_MAP_HUGEPAGE) {
+            (void)madvise(addr, m->len, MADV_HUGEPAGE);
+        }
+        if (flags & YAPB_MAP_SEQUENTIAL) {
+            (void)madvise(addr, m->len, MADV_SEQUENTIAL);
+        } else if (flags & YAPB_MAP_RANDOM) {
+            (void)madvise(addr, m->len, MADV_RANDOM);
+        }
+        if (flags & YAPB_MAP_WILLNEED) {
+            (void)madvise(addr, m->len, MADV_WILLNEED);
+        }
+    }
+    // The mapping keeps the file referenced
+    close(fd);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_log_prefetch(const YAPB_LogMap_t *map, size_t off, size_t len) {
+    if (map == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_LogMap_t *m = CLM(map);
+    if (off >= m->len || len == 0) {
+        return YAPB_OK;
+    }
+    if (len > m->len - off) {
+        len = m->len - off;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = off & ~(page - 1);
+    (void)madvise(m->data + start, len + (off - start), MADV_WILLNEED);
+    return YAPB_OK;
+}
+
+const uint8_t *YAPB_log_get_data(const YAPB_LogMap_t *map, size_t *out_len) {
+    if (map == NULL) {
+        return NULL;
+    }
+    if (out_len != NULL) {
+        *out_len = CLM(map)->len;
+    }
+    return CLM(map)->data;
+}
+
+YAPB_Result_t YAPB_log_unmap(YAPB_LogMap_t *map) {
+    if (map == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_LogMap_t *m = LM(map);
+    if (m->data != NULL && munmap(m->data, m->len) != 0) {
+        return YAPB_ERR_IO;
+    }
+    m->data = NULL;
+    m->len = 0;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_log_next(const uint8_t *data, size_t len, size_t *off,
+                            const uint8_t **out_pkt, size_t *out_len) {
+    if (off == NULL || out_pkt == NULL || out_len == NULL || (data == NULL && len > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    size_t at = *off;
+    if (at >= len) {
+        return YAPB_ERR_NO_MORE_ELEMENTS;
+    }
+    if (len - at < YAPB_HEADER_SIZE) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    uint32_t pkt_len = read_u32(data + at);
+    if (pkt_len < YAPB_HEADER_SIZE || pkt_len > len - at) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+
+    *out_pkt = data + at;
+    *out_len = pkt_len;
+    *off = at + pkt_len;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_keypath_parse(const char *spec, YAPB_KeyPath_t *out) {
+    if (spec == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    YAPB_KeyPath_t path = { 0 };
+    const char *s = spec;
+    for (;;) {
+        if (*s < '0' || *s > '9' || path.depth == YAPB_KEY_MAX_DEPTH) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        uint32_t v = 0;
+        while (*s >= '0' && *s <= '9') {
+            v = v * 10 + (uint32_t)(*s++ - '0');
+            if (v > UINT16_MAX) {
+                return YAPB_ERR_INVALID_PACKET;
+            }
+        }
+        path.index[path.depth++] = (uint16_t)v;
+        if (*s == '\0') {
+            break;
+        }
+        if (*s++ != '.') {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+    }
+    *out = path;
+    return YAPB_OK;
+}
+
+// Order-preserving image of a double: flip all bits of negatives, only the
+// sign bit of positives, so unsigned compare matches numeric compare.
+static inline uint64_t real_prefix(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    return (bits & SIGN_BIT) ? ~bits : (bits | SIGN_BIT);
+}
+
+YAPB_Result_t YAPB_key_from_int(int64_t value, YAPB_Key_t *out) {
+    if (out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    *out = (YAPB_Key_t){ (uint64_t)value ^ SIGN_BIT, NULL, 0, YAPB_KEY_INT };
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_key_from_real(double value, YAPB_Key_t *out) {
+    if (out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    *out = (YAPB_Key_t){ real_prefix(value), NULL, 0, YAPB_KEY_REAL };
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_key_from_blob(const uint8_t *data, uint16_t len, YAPB_Key_t *out) {
+    if (out == NULL || (data == NULL && len > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    uint64_t prefix = 0;
+    for (uint16_t i = 0; i < 8; i++) {
+        prefix = (prefix << 8) | (i < len ? data[i] : 0);
+    }
+    *out = (YAPB_Key_t){ prefix, data, len, YAPB_KEY_BLOB };
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_key_extract(const uint8_t *pkt, size_t len, const YAPB_KeyPath_t *path, YAPB_Key_t *out) {
+    if (pkt == NULL || path == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (path->depth == 0 || path->depth > YAPB_KEY_MAX_DEPTH) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    if (len < YAPB_HEADER_SIZE || read_u32(pkt) > len || read_u32(pkt) < YAPB_HEADER_SIZE) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+
+    YAPB_Key_t key = { 0, NULL, 0, YAPB_KEY_NONE };
+    size_t pos = YAPB_HEADER_SIZE;
+    size_t end = read_u32(pkt);
+    size_t ts_base = 0;  // first TIMESTAMP of the current packet
+    for (uint16_t level = 0; level < path->depth; level++) {
+        ts_base = 0;
+        for (uint16_t i = 0; i < path->index[level]; i++) {
+            if (pos >= end) {
+                *out = key;
+                return YAPB_OK;
+            }
+            size_t span = elem_span(pkt, pos, end);
+            if (span == 0) {
+                return YAPB_ERR_INVALID_PACKET;
+            }
+            if (pkt[pos] == YAPB_TIMESTAMP && ts_base == 0) {
+                ts_base = pos;
+            }
+            pos += span;
+        }
+        if (pos >= end) {
+            *out = key;
+            return YAPB_OK;
+        }
+        if (elem_span(pkt, pos, end) == 0) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        if (level + 1 < path->depth) {
+            // References are relative to their own packet, so descend by
+            // moving the packet start
+            size_t at = nested_at(pkt, pos, end);
+            if (at == 0) {
+                if (pkt[pos] == YAPB_NESTED_REF) {
+                    return YAPB_ERR_INVALID_PACKET;
+                }
+                *out = key;
+                return YAPB_OK;
+            }
+            pkt += at;
+            end = read_u32(pkt);
+            pos = YAPB_HEADER_SIZE;
+        }
+    }
+
+    const uint8_t *v = pkt + pos + 1;
+    switch ((YAPB_Type_t)pkt[pos]) {
+        case YAPB_INT8:
+        case YAPB_INT16:
+        case YAPB_INT32:
+        case YAPB_INT64: {
+            int64_t iv = 0;
+            switch ((YAPB_Type_t)pkt[pos]) {
+                case YAPB_INT8:  { int8_t x; decode_fixed(pkt[pos], v, &x); iv = x; break; }
+                case YAPB_INT16: { int16_t x; decode_fixed(pkt[pos], v, &x); iv = x; break; }
+                case YAPB_INT32: { int32_t x; decode_fixed(pkt[pos], v, &x); iv = x; break; }
+                default:         decode_fixed(pkt[pos], v, &iv); break;
+            }
+            YAPB_key_from_int(iv, &key);
+            break;
+        }
+        case YAPB_FLOAT: {
+            float f;
+            decode_fixed(pkt[pos], v, &f);
+            YAPB_key_from_real((double)f, &key);
+            break;
+        }
+        case YAPB_DOUBLE: {
+            double d;
+            decode_fixed(pkt[pos], v, &d);
+            YAPB_key_from_real(d, &key);
+            break;
+        }
+        case YAPB_TIMESTAMP:
+        case YAPB_TIMESTAMP_DELTA: {
+            int64_t ns;
+            if (!decode_timestamp(pkt, pos, ts_base, &ns)) {
+                return YAPB_ERR_INVALID_PACKET;
+            }
+            YAPB_key_from_int(ns, &key);
+            break;
+        }
+        case YAPB_BLOB:
+            YAPB_key_from_blob(v + 2, read_u16(v), &key);
+            break;
+        default:
+            // Nested packet as the final element: not a key
+            break;
+    }
+    *out = key;
+    return YAPB_OK;
+}
+
+int YAPB_key_compare(const YAPB_Key_t *a, const YAPB_Key_t *b) {
+    if (a->kind != b->kind) {
+        return (a->kind < b->kind) ? -1 : 1;
+    }
+    if (a->prefix != b->prefix) {
+        return (a->prefix < b->prefix) ? -1 : 1;
+    }
+    if (a->kind != YAPB_KEY_BLOB) {
+        return 0;
+    }
+    // Equal 8-byte prefixes: compare the rest, shorter blob first on a tie
+    uint16_t n = (a->len < b->len) ? a->len : b->len;
+    int c = (n > 8) ? memcmp(a->data + 8, b->data + 8, n - 8) : 0;
+    if (c != 0) {
+        return c;
+    }
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+uint64_t YAPB_key_hash(const YAPB_Key_t *key) {
+    // FNV-1a over the bytes of blob keys, the prefix otherwise, then a
+    // 64-bit finalizer (MurmurHash3 fmix64)
+    uint64_t h = key->prefix;
+    if (key->kind == YAPB_KEY_BLOB) {
+        h = 0xcbf29ce484222325ULL;
+        for (uint16_t i = 0; i < key->len; i++) {
+            h = (h ^ key->data[i]) * 0x100000001b3ULL;
+        }
+    }
+    h ^= (uint64_t)key->kind << 56;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include "yapb_numa.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NODE_DIR "/sys/devices/system/node"
+
+// mbind() policy, from <linux/mempolicy.h>
+#define MPOL_PREFERRED_ 1
+
+typedef struct {
+    YAPB_Pool_t pools[YAPB_NUMA_MAX_NODES];
+    void *mem[YAPB_NUMA_MAX_NODES];
+    size_t size[YAPB_NUMA_MAX_NODES];
+    int16_t ids[YAPB_NUMA_MAX_NODES];   // node id per pool
+    unsigned count;
+} _YAPB_NodePools_t;
+
+_Static_assert(sizeof(_YAPB_NodePools_t) <= YAPB_NODE_POOLS_SIZE,
+    "YAPB_NODE_POOLS_SIZE too small for _YAPB_NodePools_t");
+
+#define NP(x) ((_YAPB_NodePools_t *)(x))
+
+/* ======== Topology ======== */
+
+static struct {
+    unsigned count;
+    bool known;                         // sysfs node information exists
+    int ids[YAPB_NUMA_MAX_NODES];
+} topo;
+
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+// Calls fn(a, b, ctx) for each range of a sysfs list such as "0-3,8,10-11"
+static bool parse_list(const char *path, void (*fn)(long, long, void *), void *ctx) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (!ok) {
+        return false;
+    }
+    char *p = line;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long a = strtol(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+        long b = a;
+        if (*end == '-') {
+            p = end + 1;
+            b = strtol(p, &end, 10);
+            if (end == p) {
+                return false;
+            }
+        }
+        fn(a, b, ctx);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return true;
+}
+
+static void add_nodes(long a, long b, void *ctx) {
+    (void)ctx;
+    for (long n = a; n <= b && topo.count < YAPB_NUMA_MAX_NODES; n++) {
+        topo.ids[topo.count++] = (int)n;
+    }
+}
+
+static void load_topology(void) {
+    topo.known = parse_list(NODE_DIR "/online", add_nodes, NULL) && topo.count > 0;
+    if (!topo.known) {
+        topo.count = 1;
+        topo.ids[0] = 0;
+    }
+}
+
+static int node_index(int node) {
+    pthread_once(&topo_once, load_topology);
+    for (unsigned i = 0; i < topo.count; i++) {
+        if (topo.ids[i] == node) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+unsigned YAPB_numa_node_count(void) {
+    pthread_once(&topo_once, load_topology);
+    return topo.count;
+}
+
+int YAPB_numa_node_id(unsigned i) {
+    pthread_once(&topo_once, load_topology);
+    return i < topo.count ? topo.ids[i] : -1;
+}
+
+int YAPB_numa_current_node(void) {
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return 0;
+    }
+    return (int)node;
+}
+
+static void add_cpus(long a, long b, void *ctx) {
+    cpu_set_t *set = ctx;
+    for (long c = a; c <= b && c < CPU_SETSIZE; c++) {
+        CPU_SET((int)c, set);
+    }
+}
+
+YAPB_Result_t YAPB_numa_pin_thread(int node) {
+    if (node_index(node) < 0) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    if (!topo.known) {
+        return YAPB_OK;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (!parse_list(path, add_cpus, &set)) {
+        return YAPB_ERR_IO;
+    }
+    if (CPU_COUNT(&set) == 0) {
+        // Memory-only node: nothing to run on
+        return YAPB_ERR_NOT_FOUND;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? YAPB_OK : YAPB_ERR_IO;
+}
+
+YAPB_Result_t YAPB_numa_bind(void *mem, size_t size, int node) {
+    if (mem == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    unsigned long mask;
+    if (node < 0 || node >= (int)(sizeof(mask) * 8)) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    mask = 1UL << node;
+    if (syscall(SYS_mbind, mem, size, MPOL_PREFERRED_, &mask, sizeof(mask) * 8 + 1, 0) != 0) {
+        return YAPB_ERR_IO;
+    }
+    return YAPB_OK;
+}
+
+/* ======== Per-node pools ======== */
+
+YAPB_Result_t YAPB_nodepools_init(YAPB_NodePools_t *np, size_t bytes_per_node, size_t buf_size,
+                                  unsigned mem_flags) {
+    if (np == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if ((mem_flags & ~(YAPB_POOL_MEM_HUGETLB | YAPB_POOL_MEM_THP | YAPB_POOL_MEM_PREFAULT)) != 0) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    _YAPB_NodePools_t *p = NP(np);
+    memset(p, 0, sizeof(*p));
+
+    unsigned count = YAPB_numa_node_count();
+    YAPB_Result_t r = YAPB_OK;
+    for (unsigned i = 0; i < count && r == YAPB_OK; i++) {
+        int node = YAPB_numa_node_id(i);
+        // Without NUMA information there is nothing to place
+        unsigned flags = mem_flags | (topo.known ? YAPB_POOL_MEM_NODE(node) : 0);
+        r = YAPB_pool_mem_alloc(bytes_per_node, flags, &p->mem[i], &p->size[i], NULL);
+        if (r != YAPB_OK) break;
+        p->ids[i] = (int16_t)node;
+        p->count = i + 1;
+        r = YAPB_pool_init(&p->pools[i], p->mem[i], p->size[i], buf_size);
+    }
+    if (r != YAPB_OK) {
+        YAPB_nodepools_destroy(np);
+    }
+    return r;
+}
+
+YAPB_Result_t YAPB_nodepools_alloc(YAPB_NodePools_t *np, YAPB_Shared_t **out) {
+    if (np == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_NodePools_t *p = NP(np);
+    if (p->count == 0) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    int local = YAPB_numa_current_node();
+    unsigned first = 0;
+    for (unsigned i = 0; i < p->count; i++) {
+        if (p->ids[i] == local) {
+            first = i;
+            break;
+        }
+    }
+    // Local node first, then the others in order
+    for (unsigned k = 0; k < p->count; k++) {
+        unsigned i = (first + k) % p->count;
+        if (YAPB_shared_alloc(&p->pools[i], out) == YAPB_OK) {
+            return YAPB_OK;
+        }
+    }
+    return YAPB_ERR_BUFFER_TOO_SMALL;
+}
+
+YAPB_Pool_t *YAPB_nodepools_get_pool(YAPB_NodePools_t *np, int node) {
+    if (np == NULL) {
+        return NULL;
+    }
+    _YAPB_NodePools_t *p = NP(np);
+    for (unsigned i = 0; i < p->count; i++) {
+        if (p->ids[i] == node) {
+            return &p->pools[i];
+        }
+    }
+    return NULL;
+}
+
+YAPB_Result_t YAPB_nodepools_destroy(YAPB_NodePools_t *np) {
+    if (np == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_NodePools_t *p = NP(np);
+    YAPB_Result_t r = YAPB_OK;
+    for (unsigned i = 0; i < p->count; i++) {
+        if (p->mem[i] != NULL && YAPB_pool_mem_free(p->mem[i], p->size[i]) != YAPB_OK) {
+            r = YAPB_ERR_IO;
+        }
+        p->mem[i] = NULL;
+    }
+    p->count = 0;
+    return r;
+}
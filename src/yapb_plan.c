@@ -0,0 +1,551 @@
+#include "yapb_plan.h"
+#include "yapb_internal.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+typedef struct {
+    uint64_t shape;                             // fingerprint of tags[]
+    uint32_t id;                                // user identifier for dispatch
+    uint32_t size;                              // exact packet length of the layout
+    uint16_t count;                             // number of fields
+    bool used;                                  // registry slot in use
+    uint8_t tags[YAPB_PLAN_MAX_FIELDS];         // expected type tags
+    uint16_t offsets[YAPB_PLAN_MAX_FIELDS];     // tag offset from packet start
+} _YAPB_Plan_t;
+
+_Static_assert(sizeof(_YAPB_Plan_t) <= YAPB_PLAN_SIZE,
+    "YAPB_PLAN_SIZE too small for _YAPB_Plan_t");
+
+typedef struct {
+    _YAPB_Plan_t *slots;  // open-addressing table keyed by shape
+    size_t mask;          // nslots - 1
+} _YAPB_Registry_t;
+
+_Static_assert(sizeof(_YAPB_Registry_t) <= YAPB_REGISTRY_SIZE,
+    "YAPB_REGISTRY_SIZE too small for _YAPB_Registry_t");
+
+#define PLAN(x) ((_YAPB_Plan_t *)(x))
+#define CPLAN(x) ((const _YAPB_Plan_t *)(x))
+#define REG(x) ((_YAPB_Registry_t *)(x))
+#define CREG(x) ((const _YAPB_Registry_t *)(x))
+
+// FNV-1a over the tag bytes, finished with the element count
+static inline uint64_t shape_step(uint64_t h, uint8_t tag) {
+    return (h ^ tag) * FNV_PRIME;
+}
+
+static inline uint64_t shape_finish(uint64_t h, uint16_t count) {
+    h = (h ^ count) * FNV_PRIME;
+    return h ^ (h >> 29);
+}
+
+YAPB_Result_t YAPB_shape_of_tags(const YAPB_Type_t *tags, uint16_t count, uint64_t *out_fp) {
+    if ((tags == NULL && count > 0) || out_fp == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    uint64_t h = FNV_OFFSET;
+    for (uint16_t i = 0; i < count; i++) {
+        h = shape_step(h, (uint8_t)tags[i]);
+    }
+    *out_fp = shape_finish(h, count);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_get_shape(const YAPB_Packet_t *pkt, uint64_t *out_fp, uint16_t *out_count) {
+    if (pkt == NULL || out_fp == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Packet_t *p = CP(pkt);
+    if (p->mode != YAPB_MODE_READ) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    uint64_t h = FNV_OFFSET;
+    uint16_t count = 0;
+    size_t pos = YAPB_HEADER_SIZE;
+    while (pos < p->buffer_size) {
+        size_t span = elem_span(p->buffer, pos, p->buffer_size);
+        if (span == 0) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        h = shape_step(h, p->buffer[pos]);
+        pos += span;
+        count++;
+    }
+
+    *out_fp = shape_finish(h, count);
+    if (out_count != NULL) {
+        *out_count = count;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_plan_build(YAPB_Plan_t *plan, uint32_t id, const YAPB_Type_t *tags, uint16_t count) {
+    if (plan == NULL || (tags == NULL && count > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (count > YAPB_PLAN_MAX_FIELDS) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    _YAPB_Plan_t *pl = PLAN(plan);
+
+    size_t pos = YAPB_HEADER_SIZE;
+    for (uint16_t i = 0; i < count; i++) {
+        size_t sz = fixed_size((uint8_t)tags[i]);
+        if (sz == 0) {
+            return YAPB_ERR_TYPE_MISMATCH;
+        }
+        pl->tags[i] = (uint8_t)tags[i];
+        pl->offsets[i] = (uint16_t)pos;
+        pos += 1 + sz;
+    }
+
+    pl->id = id;
+    pl->count = count;
+    pl->size = (uint32_t)pos;
+    pl->used = true;
+    return YAPB_shape_of_tags(tags, count, &pl->shape);
+}
+
+YAPB_Result_t YAPB_plan_from_packet(YAPB_Plan_t *plan, uint32_t id, const YAPB_Packet_t *pkt) {
+    if (plan == NULL || pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Packet_t *p = CP(pkt);
+    if (p->mode != YAPB_MODE_READ) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    YAPB_Type_t tags[YAPB_PLAN_MAX_FIELDS];
+    uint16_t count = 0;
+    size_t pos = YAPB_HEADER_SIZE;
+    while (pos < p->buffer_size) {
+        size_t span = elem_span(p->buffer, pos, p->buffer_size);
+        if (span == 0) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        if (count == YAPB_PLAN_MAX_FIELDS) {
+            return YAPB_ERR_BUFFER_TOO_SMALL;
+        }
+        tags[count++] = (YAPB_Type_t)p->buffer[pos];
+        pos += span;
+    }
+    return YAPB_plan_build(plan, id, tags, count);
+}
+
+uint32_t YAPB_plan_get_id(const YAPB_Plan_t *plan) {
+    return (plan == NULL) ? 0 : CPLAN(plan)->id;
+}
+
+uint64_t YAPB_plan_get_shape(const YAPB_Plan_t *plan) {
+    return (plan == NULL) ? 0 : CPLAN(plan)->shape;
+}
+
+uint16_t YAPB_plan_get_count(const YAPB_Plan_t *plan) {
+    return (plan == NULL) ? 0 : CPLAN(plan)->count;
+}
+
+YAPB_Result_t YAPB_plan_decode(const YAPB_Plan_t *plan, const YAPB_Packet_t *pkt, void *const outs[]) {
+    if (plan == NULL || pkt == NULL || (outs == NULL && CPLAN(plan)->count > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Plan_t *pl = CPLAN(plan);
+    const _YAPB_Packet_t *p = CP(pkt);
+    if (p->mode != YAPB_MODE_READ) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    // The only bounds check: a fixed layout has exactly one valid length
+    if (p->buffer_size != pl->size) {
+        return YAPB_ERR_TYPE_MISMATCH;
+    }
+    const uint8_t *buf = p->buffer;
+    for (uint16_t i = 0; i < pl->count; i++) {
+        if (buf[pl->offsets[i]] != pl->tags[i]) {
+            return YAPB_ERR_TYPE_MISMATCH;
+        }
+    }
+
+    for (uint16_t i = 0; i < pl->count; i++) {
+        if (outs[i] != NULL) {
+            decode_fixed(pl->tags[i], buf + pl->offsets[i] + 1, outs[i]);
+        }
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_registry_init(YAPB_Registry_t *reg, YAPB_Plan_t *slots, size_t nslots) {
+    if (reg == NULL || slots == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (nslots == 0 || (nslots & (nslots - 1)) != 0) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    _YAPB_Registry_t *r = REG(reg);
+
+    r->slots = (_YAPB_Plan_t *)slots;
+    r->mask = nslots - 1;
+    for (size_t i = 0; i < nslots; i++) {
+        r->slots[i].used = false;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_registry_add(YAPB_Registry_t *reg, const YAPB_Plan_t *plan) {
+    if (reg == NULL || plan == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Registry_t *r = REG(reg);
+    const _YAPB_Plan_t *pl = CPLAN(plan);
+
+    for (size_t i = 0; i <= r->mask; i++) {
+        _YAPB_Plan_t *slot = &r->slots[(pl->shape + i) & r->mask];
+        if (!slot->used || slot->shape == pl->shape) {
+            *slot = *pl;
+            slot->used = true;
+            return YAPB_OK;
+        }
+    }
+    return YAPB_ERR_BUFFER_TOO_SMALL;
+}
+
+YAPB_Result_t YAPB_registry_find(const YAPB_Registry_t *reg, uint64_t shape, const YAPB_Plan_t **out_plan) {
+    if (reg == NULL || out_plan == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Registry_t *r = CREG(reg);
+
+    for (size_t i = 0; i <= r->mask; i++) {
+        const _YAPB_Plan_t *slot = &r->slots[(shape + i) & r->mask];
+        if (!slot->used) {
+            break;
+        }
+        if (slot->shape == shape) {
+            *out_plan = (const YAPB_Plan_t *)slot;
+            return YAPB_OK;
+        }
+    }
+    return YAPB_ERR_TYPE_MISMATCH;
+}
+
+YAPB_Result_t YAPB_registry_lookup(const YAPB_Registry_t *reg, const YAPB_Packet_t *pkt, const YAPB_Plan_t **out_plan) {
+    uint64_t shape;
+    YAPB_Result_t r = YAPB_get_shape(pkt, &shape, NULL);
+    if (r != YAPB_OK) return r;
+    return YAPB_registry_find(reg, shape, out_plan);
+}
+
+// How the writer's layout ends relative to the expected one
+enum {
+    STOP_FULL = 0,      // every expected field present; anything may follow
+    STOP_END,           // packet ends after the present fields
+    STOP_MISMATCH,      // next element differs from the next expected type
+};
+
+typedef struct {
+    uint16_t present;                           // leading fields provided
+    uint8_t stop;                               // STOP_* after those fields
+    bool fixed;                                 // all present fields fixed-size
+    bool used;                                  // cache slot in use
+    uint32_t end;                               // fixed: offset after last present field
+    uint16_t offsets[YAPB_PLAN_MAX_FIELDS];     // fixed: tag offset from packet start
+} _YAPB_ReaderPlan_t;
+
+_Static_assert(sizeof(_YAPB_ReaderPlan_t) <= YAPB_READER_PLAN_SIZE,
+    "YAPB_READER_PLAN_SIZE too small for _YAPB_ReaderPlan_t");
+
+typedef struct {
+    uint8_t expected[YAPB_PLAN_MAX_FIELDS];     // reader's type tags
+    uint16_t count;                             // number of expected fields
+    _YAPB_ReaderPlan_t *cache;                  // resolved writer layouts
+    size_t ncache;
+    size_t next;                                // next slot to (re)fill
+    size_t last;                                // slot of the last hit, tried first
+    uint64_t hits;
+    uint64_t misses;
+} _YAPB_Reader_t;
+
+_Static_assert(sizeof(_YAPB_Reader_t) <= YAPB_READER_SIZE,
+    "YAPB_READER_SIZE too small for _YAPB_Reader_t");
+
+#define RD(x) ((_YAPB_Reader_t *)(x))
+#define CRD(x) ((const _YAPB_Reader_t *)(x))
+
+YAPB_Result_t YAPB_reader_init(YAPB_Reader_t *rd, const YAPB_Type_t *expected, uint16_t count,
+                               YAPB_ReaderPlan_t *cache, size_t ncache) {
+    if (rd == NULL || cache == NULL || (expected == NULL && count > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (count > YAPB_PLAN_MAX_FIELDS || ncache == 0) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    _YAPB_Reader_t *r = RD(rd);
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (fixed_size((uint8_t)expected[i]) == 0 &&
+            expected[i] != YAPB_BLOB && expected[i] != YAPB_NESTED_PKT) {
+            return YAPB_ERR_TYPE_MISMATCH;
+        }
+        r->expected[i] = (uint8_t)expected[i];
+    }
+    r->count = count;
+    r->cache = (_YAPB_ReaderPlan_t *)cache;
+    r->ncache = ncache;
+    r->next = 0;
+    r->last = 0;
+    r->hits = 0;
+    r->misses = 0;
+    for (size_t i = 0; i < ncache; i++) {
+        r->cache[i].used = false;
+    }
+    return YAPB_OK;
+}
+
+// Store a resolved plan, unless an identical one is already cached
+static void _reader_insert(_YAPB_Reader_t *r, const _YAPB_ReaderPlan_t *plan) {
+    for (size_t i = 0; i < r->ncache; i++) {
+        const _YAPB_ReaderPlan_t *c = &r->cache[i];
+        if (c->used && c->present == plan->present && c->stop == plan->stop &&
+            c->fixed == plan->fixed && c->end == plan->end &&
+            memcmp(c->offsets, plan->offsets, sizeof(c->offsets)) == 0) {
+            r->last = i;
+            return;
+        }
+    }
+    r->cache[r->next] = *plan;
+    r->cache[r->next].used = true;
+    r->last = r->next;
+    r->next = (r->next + 1) % r->ncache;
+}
+
+// A NESTED_REF stands in for the nested packet it refers to, and a
+// TIMESTAMP_DELTA for a timestamp
+static inline bool _tag_matches(uint8_t expected, uint8_t tag) {
+    return tag == expected || (expected == YAPB_NESTED_PKT && tag == YAPB_NESTED_REF) ||
+           (expected == YAPB_TIMESTAMP && tag == YAPB_TIMESTAMP_DELTA);
+}
+
+// Check what an element read in order depends on: a NESTED_REF's target,
+// a TIMESTAMP_DELTA's base (the first TIMESTAMP, tracked in *ts_base)
+static inline bool _elem_resolves(const uint8_t *buf, size_t at, size_t size, size_t *ts_base) {
+    switch (buf[at]) {
+        case YAPB_NESTED_REF:
+            return nested_at(buf, at, size) != 0;
+        case YAPB_TIMESTAMP:
+            if (*ts_base == 0) *ts_base = at;
+            return true;
+        case YAPB_TIMESTAMP_DELTA:
+            return *ts_base != 0;
+        default:
+            return true;
+    }
+}
+
+// Initialize a plan for the walk below; offsets stay zero past `present`
+static void _plan_start(_YAPB_ReaderPlan_t *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->fixed = true;
+    plan->end = YAPB_HEADER_SIZE;
+}
+
+YAPB_Result_t YAPB_reader_resolve(YAPB_Reader_t *rd, const YAPB_Type_t *tags, uint16_t count) {
+    if (rd == NULL || (tags == NULL && count > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Reader_t *r = RD(rd);
+
+    _YAPB_ReaderPlan_t plan;
+    _plan_start(&plan);
+    plan.stop = STOP_FULL;
+    for (uint16_t i = 0; i < r->count; i++) {
+        if (i == count) {
+            plan.stop = STOP_END;
+            break;
+        }
+        if (!_tag_matches(r->expected[i], (uint8_t)tags[i])) {
+            plan.stop = STOP_MISMATCH;
+            break;
+        }
+        size_t sz = fixed_size((uint8_t)tags[i]);
+        if (sz == 0) {
+            plan.fixed = false;
+        }
+        if (plan.fixed) {
+            plan.offsets[i] = (uint16_t)plan.end;
+            plan.end += (uint32_t)(1 + sz);
+        }
+        plan.present++;
+    }
+    if (!plan.fixed) {
+        plan.end = 0;
+        memset(plan.offsets, 0, sizeof(plan.offsets));
+    }
+    _reader_insert(r, &plan);
+    return YAPB_OK;
+}
+
+// Check that the element following the present fields (at pos) ends the
+// writer's layout the way the plan says.
+static inline bool _stop_matches(const _YAPB_Reader_t *r, const _YAPB_ReaderPlan_t *plan,
+                                 const uint8_t *buf, size_t size, size_t pos) {
+    switch (plan->stop) {
+        case STOP_END:      return pos == size;
+        case STOP_MISMATCH: return pos < size && !_tag_matches(r->expected[plan->present], buf[pos]);
+        default:            return pos <= size;
+    }
+}
+
+// Verify a cached plan against a packet. Fixed plans need no walk: the
+// offsets are known, so one length check and one tag compare per field
+// prove the layout. On success, pos[] holds the tag offset of each field.
+static bool _plan_verify(const _YAPB_Reader_t *r, const _YAPB_ReaderPlan_t *plan,
+                         const uint8_t *buf, size_t size, size_t pos[]) {
+    if (plan->fixed) {
+        if (plan->end > size) {
+            return false;
+        }
+        for (uint16_t i = 0; i < plan->present; i++) {
+            if (buf[plan->offsets[i]] != r->expected[i]) {
+                return false;
+            }
+            pos[i] = plan->offsets[i];
+        }
+        return _stop_matches(r, plan, buf, size, plan->end);
+    }
+
+    size_t at = YAPB_HEADER_SIZE, ts_base = 0;
+    for (uint16_t i = 0; i < plan->present; i++) {
+        if (at >= size || !_tag_matches(r->expected[i], buf[at])) {
+            return false;
+        }
+        size_t span = elem_span(buf, at, size);
+        if (span == 0 || !_elem_resolves(buf, at, size, &ts_base)) {
+            return false;
+        }
+        pos[i] = at;
+        at += span;
+    }
+    return _stop_matches(r, plan, buf, size, at);
+}
+
+// Resolve the plan of an unseen writer layout by walking the packet
+static YAPB_Result_t _plan_resolve(const _YAPB_Reader_t *r, _YAPB_ReaderPlan_t *plan,
+                                   const uint8_t *buf, size_t size, size_t pos[]) {
+    _plan_start(plan);
+    plan->stop = STOP_FULL;
+    size_t at = YAPB_HEADER_SIZE, ts_base = 0;
+    for (uint16_t i = 0; i < r->count; i++) {
+        if (at >= size) {
+            plan->stop = STOP_END;
+            break;
+        }
+        if (!_tag_matches(r->expected[i], buf[at])) {
+            plan->stop = STOP_MISMATCH;
+            break;
+        }
+        size_t span = elem_span(buf, at, size);
+        if (span == 0 || !_elem_resolves(buf, at, size, &ts_base)) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        if (fixed_size(buf[at]) == 0) {
+            plan->fixed = false;
+        }
+        plan->offsets[i] = (uint16_t)at;
+        pos[i] = at;
+        at += span;
+        plan->present++;
+    }
+    if (plan->fixed) {
+        plan->end = (uint32_t)at;
+    } else {
+        plan->end = 0;
+        memset(plan->offsets, 0, sizeof(plan->offsets));
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_reader_decode(YAPB_Reader_t *rd, const YAPB_Packet_t *pkt, void *const outs[],
+                                 uint16_t *out_present) {
+    if (rd == NULL || pkt == NULL || (outs == NULL && CRD(rd)->count > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Reader_t *r = RD(rd);
+    const _YAPB_Packet_t *p = CP(pkt);
+    if (p->mode != YAPB_MODE_READ) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    const uint8_t *buf = p->buffer;
+    size_t size = p->buffer_size;
+
+    size_t pos[YAPB_PLAN_MAX_FIELDS];
+    const _YAPB_ReaderPlan_t *plan = NULL;
+    for (size_t n = 0; n < r->ncache; n++) {
+        size_t i = (r->last + n) % r->ncache;
+        if (r->cache[i].used && _plan_verify(r, &r->cache[i], buf, size, pos)) {
+            plan = &r->cache[i];
+            r->last = i;
+            r->hits++;
+            break;
+        }
+    }
+    if (plan == NULL) {
+        _YAPB_ReaderPlan_t fresh;
+        YAPB_Result_t res = _plan_resolve(r, &fresh, buf, size, pos);
+        if (res != YAPB_OK) {
+            return res;
+        }
+        r->misses++;
+        _reader_insert(r, &fresh);
+        plan = &r->cache[r->last];
+    }
+
+    for (uint16_t i = 0; i < plan->present; i++) {
+        if (outs[i] == NULL) {
+            continue;
+        }
+        const uint8_t *v = buf + pos[i] + 1;
+        switch ((YAPB_Type_t)r->expected[i]) {
+            case YAPB_BLOB: {
+                YAPB_Blob_t *b = outs[i];
+                b->len = read_u16(v);
+                b->data = v + 2;
+                break;
+            }
+            case YAPB_NESTED_PKT: {
+                size_t at = nested_at(buf, pos[i], size);
+                YAPB_load(outs[i], buf + at, read_u32(buf + at));
+                break;
+            }
+            case YAPB_TIMESTAMP: {
+                // Fields are consecutive elements, so the base is a field
+                size_t ts_base = 0;
+                for (uint16_t j = 0; j < i && ts_base == 0; j++) {
+                    if (buf[pos[j]] == YAPB_TIMESTAMP) ts_base = pos[j];
+                }
+                decode_timestamp(buf, pos[i], ts_base, outs[i]);
+                break;
+            }
+            default:
+                decode_fixed(r->expected[i], v, outs[i]);
+                break;
+        }
+    }
+    if (out_present != NULL) {
+        *out_present = plan->present;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_reader_get_stats(const YAPB_Reader_t *rd, uint64_t *out_hits, uint64_t *out_misses) {
+    if (rd == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (out_hits != NULL) {
+        *out_hits = CRD(rd)->hits;
+    }
+    if (out_misses != NULL) {
+        *out_misses = CRD(rd)->misses;
+    }
+    return YAPB_OK;
+}
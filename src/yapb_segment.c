@@ -0,0 +1,602 @@
+#define _GNU_SOURCE
+#include "yapb_segment.h"
+#include "yapb_internal.h"
+#include "yapb_io.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A sealed segment ends with a footer packet:
+//   blob "YAPBSEG1", i64 packets, i64 data length,
+//   per key: nested { blob path (u16 each), i8 flags, i8 kind, i64 min, i64 max,
+//                     i8 bloom hashes, blob bloom bits },
+//   i32 footer length (always the last 4 bytes of the file)
+#define SEG_MAGIC        "YAPBSEG1"
+#define SEG_NAME_FMT     "seg-%08u.yapb"
+#define SEG_NAME_LEN     17
+
+#define DEFAULT_MAX_BYTES   (64u << 20)
+#define DEFAULT_BLOOM_BYTES 8192
+#define WBUF_SIZE           (256u << 10)
+
+// Zone kind beyond YAPB_KeyKind_t: keys of more than one kind were seen
+#define KIND_MIXED 4
+
+typedef struct {
+    YAPB_KeyPath_t path;
+    uint8_t flags;
+    uint8_t kind;       // YAPB_KEY_NONE until the first key, KIND_MIXED on conflict
+    uint64_t min;       // zone over key prefixes
+    uint64_t max;
+    uint8_t *bloom;     // bloom_bytes bytes, NULL without YAPB_SEG_BLOOM
+} KeyState;
+
+typedef struct {
+    const char *dir;
+    KeyState *keys;         // one allocation: key states, Bloom bits, write buffer
+    YAPB_Writer out;        // fd < 0 while no segment is open
+    uint64_t max_bytes;
+    uint32_t max_packets;
+    uint32_t bloom_bytes;
+    uint32_t seq;           // number of the open (or next) segment
+    uint32_t packets;       // packets in the open segment
+    uint16_t nkeys;
+    uint8_t hashes;         // Bloom hash functions
+    bool sync;
+} _YAPB_SegmentWriter_t;
+
+_Static_assert(sizeof(_YAPB_SegmentWriter_t) <= YAPB_SEGMENT_WRITER_SIZE,
+    "YAPB_SEGMENT_WRITER_SIZE too small for _YAPB_SegmentWriter_t");
+
+typedef struct {
+    YAPB_LogMap_t map;
+    size_t data_len;            // packets before the footer
+    const uint8_t *footer;      // NULL for unsealed segments
+    size_t footer_len;
+} _YAPB_Segment_t;
+
+_Static_assert(sizeof(_YAPB_Segment_t) <= YAPB_SEGMENT_SIZE,
+    "YAPB_SEGMENT_SIZE too small for _YAPB_Segment_t");
+
+#define SW(x) ((_YAPB_SegmentWriter_t *)(x))
+#define SEG(x) ((_YAPB_Segment_t *)(x))
+#define CSEG(x) ((const _YAPB_Segment_t *)(x))
+
+// ============ Bloom filter ============
+
+// Double hashing: bit i is h1 + i * h2 (mod m)
+static inline uint32_t bloom_bit(uint64_t h, uint8_t i, uint32_t m) {
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+    return (uint32_t)((h1 + (uint64_t)i * h2) % m);
+}
+
+static void bloom_add(uint8_t *bits, uint32_t nbytes, uint8_t k, uint64_t h) {
+    for (uint8_t i = 0; i < k; i++) {
+        uint32_t b = bloom_bit(h, i, nbytes * 8);
+        bits[b >> 3] |= (uint8_t)(1u << (b & 7));
+    }
+}
+
+static bool bloom_test(const uint8_t *bits, uint32_t nbytes, uint8_t k, uint64_t h) {
+    for (uint8_t i = 0; i < k; i++) {
+        uint32_t b = bloom_bit(h, i, nbytes * 8);
+        if ((bits[b >> 3] & (1u << (b & 7))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============ Directory ============
+
+static int u32_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorted segment numbers in a directory; the caller frees *out
+static YAPB_Result_t list_segments(const char *dir, uint32_t **out, size_t *out_n) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return YAPB_ERR_IO;
+    }
+    uint32_t *nums = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        unsigned num;
+        char tail;
+        if (strlen(de->d_name) != SEG_NAME_LEN ||
+            sscanf(de->d_name, "seg-%8u.yap%c", &num, &tail) != 2 || tail != 'b') {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            uint32_t *p = realloc(nums, cap * sizeof(uint32_t));
+            if (p == NULL) {
+                free(nums);
+                closedir(d);
+                return YAPB_ERR_BUFFER_TOO_SMALL;
+            }
+            nums = p;
+        }
+        nums[n++] = num;
+    }
+    closedir(d);
+    qsort(nums, n, sizeof(uint32_t), u32_cmp);
+    *out = nums;
+    *out_n = n;
+    return YAPB_OK;
+}
+
+static int segment_path(char *buf, size_t size, const char *dir, uint32_t seq) {
+    int n = snprintf(buf, size, "%s/" SEG_NAME_FMT, dir, seq);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+// ============ Writer ============
+
+static void keys_reset(_YAPB_SegmentWriter_t *w) {
+    for (uint16_t i = 0; i < w->nkeys; i++) {
+        KeyState *ks = &w->keys[i];
+        ks->kind = YAPB_KEY_NONE;
+        ks->min = UINT64_MAX;
+        ks->max = 0;
+        if (ks->bloom != NULL) {
+            memset(ks->bloom, 0, w->bloom_bytes);
+        }
+    }
+}
+
+YAPB_Result_t YAPB_segw_open(YAPB_SegmentWriter_t *w, const char *dir, const YAPB_SegmentConfig_t *cfg) {
+    if (w == NULL || dir == NULL || cfg == NULL || (cfg->keys == NULL && cfg->nkeys > 0)) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    uint32_t bloom_bytes = cfg->bloom_bytes ? cfg->bloom_bytes : DEFAULT_BLOOM_BYTES;
+    if (cfg->nkeys > YAPB_SEG_MAX_KEYS || bloom_bytes > UINT16_MAX) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    for (uint16_t i = 0; i < cfg->nkeys; i++) {
+        if (cfg->keys[i].path.depth == 0 || cfg->keys[i].path.depth > YAPB_KEY_MAX_DEPTH) {
+            return YAPB_ERR_INVALID_MODE;
+        }
+    }
+    _YAPB_SegmentWriter_t *s = SW(w);
+
+    uint32_t *nums;
+    size_t n;
+    YAPB_Result_t r = list_segments(dir, &nums, &n);
+    if (r != YAPB_OK) return r;
+    s->seq = (n > 0) ? nums[n - 1] + 1 : 1;
+    free(nums);
+
+    size_t blooms = 0;
+    for (uint16_t i = 0; i < cfg->nkeys; i++) {
+        if (cfg->keys[i].flags & YAPB_SEG_BLOOM) blooms++;
+    }
+    uint8_t *mem = malloc(cfg->nkeys * sizeof(KeyState) + blooms * bloom_bytes + WBUF_SIZE);
+    if (mem == NULL) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    s->dir = dir;
+    s->keys = (KeyState *)mem;
+    s->nkeys = cfg->nkeys;
+    s->bloom_bytes = bloom_bytes;
+    s->max_bytes = cfg->max_bytes ? cfg->max_bytes : DEFAULT_MAX_BYTES;
+    s->max_packets = cfg->max_packets;
+    s->packets = 0;
+    s->sync = cfg->sync;
+
+    uint8_t *p = mem + cfg->nkeys * sizeof(KeyState);
+    for (uint16_t i = 0; i < cfg->nkeys; i++) {
+        s->keys[i].path = cfg->keys[i].path;
+        s->keys[i].flags = cfg->keys[i].flags;
+        s->keys[i].bloom = NULL;
+        if (cfg->keys[i].flags & YAPB_SEG_BLOOM) {
+            s->keys[i].bloom = p;
+            p += bloom_bytes;
+        }
+    }
+    keys_reset(s);
+    s->out = (YAPB_Writer){ -1, p, WBUF_SIZE, 0, 0 };
+
+    // k = (m / n) ln 2 for the expected keys per segment (64-byte packets
+    // when only a size limit is set)
+    uint64_t expect = s->max_packets ? s->max_packets : s->max_bytes / 64;
+    if (expect == 0) expect = 1;
+    double k = (double)bloom_bytes * 8.0 / (double)expect * 0.6931;
+    s->hashes = (k < 1.0) ? 1 : (k > 12.0) ? 12 : (uint8_t)(k + 0.5);
+    return YAPB_OK;
+}
+
+// Write the footer and close the open segment
+static YAPB_Result_t segment_seal(_YAPB_SegmentWriter_t *s) {
+    if (s->out.fd < 0) {
+        return YAPB_OK;
+    }
+    YAPB_Result_t r = writer_flush(&s->out);
+
+    size_t cap = 64 + (size_t)s->nkeys * (64 + 2 * YAPB_KEY_MAX_DEPTH + s->bloom_bytes);
+    uint8_t *buf = (r == YAPB_OK) ? malloc(cap) : NULL;
+    if (r == YAPB_OK && buf == NULL) {
+        r = YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    if (r == YAPB_OK) {
+        YAPB_Packet_t f;
+        YAPB_initialize(&f, buf, cap);
+        int64_t packets = s->packets, data_len = (int64_t)s->out.bytes;
+        YAPB_push_blob(&f, (const uint8_t *)SEG_MAGIC, 8);
+        YAPB_push_i64(&f, &packets);
+        YAPB_push_i64(&f, &data_len);
+        for (uint16_t i = 0; i < s->nkeys; i++) {
+            const KeyState *ks = &s->keys[i];
+            uint8_t nbuf[64 + 2 * YAPB_KEY_MAX_DEPTH];
+            uint8_t path[2 * YAPB_KEY_MAX_DEPTH];
+            for (uint16_t d = 0; d < ks->path.depth; d++) {
+                write_u16(path + 2 * d, ks->path.index[d]);
+            }
+            int8_t flags = (int8_t)ks->flags, kind = (int8_t)ks->kind;
+            int8_t hashes = (int8_t)(ks->bloom ? s->hashes : 0);
+            int64_t min = (int64_t)ks->min, max = (int64_t)ks->max;
+
+            YAPB_Packet_t nested;
+            YAPB_initialize(&nested, nbuf, sizeof(nbuf));
+            YAPB_push_blob(&nested, path, (uint16_t)(2 * ks->path.depth));
+            YAPB_push_i8(&nested, &flags);
+            YAPB_push_i8(&nested, &kind);
+            YAPB_push_i64(&nested, &min);
+            YAPB_push_i64(&nested, &max);
+            YAPB_push_i8(&nested, &hashes);
+            YAPB_finalize(&nested, NULL);
+            YAPB_push_nested(&f, &nested);
+            // Appended after the nested packet so it can be popped in place
+            YAPB_push_blob(&f, ks->bloom, ks->bloom ? (uint16_t)s->bloom_bytes : 0);
+        }
+        int32_t placeholder = 0;
+        YAPB_push_i32(&f, &placeholder);
+        size_t len;
+        r = YAPB_finalize(&f, &len);
+        if (r == YAPB_OK) {
+            // Trailing footer length lets readers find the footer from the end
+            write_u32(buf + len - 4, (uint32_t)len);
+            r = write_all(s->out.fd, buf, len);
+        }
+        free(buf);
+    }
+    if (r == YAPB_OK && s->sync && fdatasync(s->out.fd) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (close(s->out.fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    s->out.fd = -1;
+    s->out.used = 0;
+    s->out.bytes = 0;
+    s->packets = 0;
+    s->seq++;
+    keys_reset(s);
+    return r;
+}
+
+YAPB_Result_t YAPB_segw_append(YAPB_SegmentWriter_t *w, const YAPB_Packet_t *pkt) {
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (w == NULL || data == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SegmentWriter_t *s = SW(w);
+    YAPB_Result_t r;
+
+    if (s->out.fd >= 0 && s->packets > 0 && s->out.bytes + len > s->max_bytes) {
+        r = segment_seal(s);
+        if (r != YAPB_OK) return r;
+    }
+    if (s->out.fd < 0) {
+        char path[PATH_MAX];
+        if (segment_path(path, sizeof(path), s->dir, s->seq) != 0) {
+            return YAPB_ERR_IO;
+        }
+        s->out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (s->out.fd < 0) {
+            return YAPB_ERR_IO;
+        }
+    }
+
+    for (uint16_t i = 0; i < s->nkeys; i++) {
+        KeyState *ks = &s->keys[i];
+        YAPB_Key_t key;
+        if (YAPB_key_extract(data, len, &ks->path, &key) != YAPB_OK || key.kind == YAPB_KEY_NONE) {
+            continue;
+        }
+        if (ks->kind == YAPB_KEY_NONE) {
+            ks->kind = key.kind;
+        } else if (ks->kind != key.kind) {
+            ks->kind = KIND_MIXED;
+        }
+        if (key.prefix < ks->min) ks->min = key.prefix;
+        if (key.prefix > ks->max) ks->max = key.prefix;
+        if (ks->bloom != NULL) {
+            bloom_add(ks->bloom, s->bloom_bytes, s->hashes, YAPB_key_hash(&key));
+        }
+    }
+
+    r = writer_put(&s->out, data, len);
+    if (r != YAPB_OK) return r;
+    s->packets++;
+    if (s->max_packets > 0 && s->packets >= s->max_packets) {
+        return segment_seal(s);
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_segw_roll(YAPB_SegmentWriter_t *w) {
+    if (w == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    return segment_seal(SW(w));
+}
+
+YAPB_Result_t YAPB_segw_close(YAPB_SegmentWriter_t *w) {
+    if (w == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SegmentWriter_t *s = SW(w);
+    YAPB_Result_t r = segment_seal(s);
+    free(s->keys);
+    s->keys = NULL;
+    s->nkeys = 0;
+    return r;
+}
+
+// ============ Reader ============
+
+YAPB_Result_t YAPB_segment_open(YAPB_Segment_t *seg, const char *path) {
+    if (seg == NULL || path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Segment_t *g = SEG(seg);
+    YAPB_Result_t r = YAPB_log_map(&g->map, path, 0);
+    if (r != YAPB_OK) return r;
+
+    size_t len;
+    const uint8_t *data = YAPB_log_get_data(&g->map, &len);
+    g->data_len = len;
+    g->footer = NULL;
+    g->footer_len = 0;
+    if (len < YAPB_HEADER_SIZE) {
+        return YAPB_OK;
+    }
+
+    // Validate the footer; without one the whole file is packet data
+    uint32_t flen = read_u32(data + len - 4);
+    if (flen < YAPB_HEADER_SIZE + 5 || flen > len) {
+        return YAPB_OK;
+    }
+    const uint8_t *footer = data + len - flen;
+    YAPB_Packet_t f;
+    const uint8_t *magic;
+    uint16_t mlen;
+    int64_t packets, data_len;
+    if (YAPB_load(&f, footer, flen) != YAPB_OK || read_u32(footer) != flen ||
+        YAPB_pop_blob(&f, &magic, &mlen) < 0 || mlen != 8 || memcmp(magic, SEG_MAGIC, 8) != 0 ||
+        YAPB_pop_i64(&f, &packets) < 0 || YAPB_pop_i64(&f, &data_len) < 0 ||
+        (uint64_t)data_len != len - flen) {
+        return YAPB_OK;
+    }
+    g->footer = footer;
+    g->footer_len = flen;
+    g->data_len = (size_t)data_len;
+    return YAPB_OK;
+}
+
+const uint8_t *YAPB_segment_get_data(const YAPB_Segment_t *seg, size_t *out_len) {
+    if (seg == NULL) {
+        return NULL;
+    }
+    if (out_len != NULL) {
+        *out_len = CSEG(seg)->data_len;
+    }
+    return YAPB_log_get_data(&CSEG(seg)->map, NULL);
+}
+
+bool YAPB_segment_is_sealed(const YAPB_Segment_t *seg) {
+    return seg != NULL && CSEG(seg)->footer != NULL;
+}
+
+YAPB_Result_t YAPB_segment_get_config(const YAPB_Segment_t *seg, YAPB_SegmentConfig_t *cfg,
+                                      YAPB_SegmentKey_t keys[YAPB_SEG_MAX_KEYS]) {
+    if (seg == NULL || cfg == NULL || keys == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Segment_t *g = CSEG(seg);
+    if (g->footer == NULL) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    *cfg = (YAPB_SegmentConfig_t){ .keys = keys };
+
+    YAPB_Packet_t f;
+    YAPB_load(&f, g->footer, g->footer_len);
+    const uint8_t *skip;
+    uint16_t skip_len;
+    int64_t skip_i64;
+    YAPB_pop_blob(&f, &skip, &skip_len);
+    YAPB_pop_i64(&f, &skip_i64);
+    YAPB_pop_i64(&f, &skip_i64);
+
+    YAPB_Element_t el;
+    while (YAPB_pop_next(&f, &el) >= 0 && el.type == YAPB_NESTED_PKT) {
+        YAPB_Packet_t sum = el.val.nested;
+        const uint8_t *bloom, *enc;
+        uint16_t bloom_len, enc_len;
+        int8_t flags;
+        if (cfg->nkeys == YAPB_SEG_MAX_KEYS || YAPB_pop_blob(&f, &bloom, &bloom_len) < 0 ||
+            YAPB_pop_blob(&sum, &enc, &enc_len) < 0 || YAPB_pop_i8(&sum, &flags) < 0 ||
+            enc_len == 0 || enc_len % 2 != 0 || enc_len > 2 * YAPB_KEY_MAX_DEPTH) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        YAPB_SegmentKey_t *k = &keys[cfg->nkeys++];
+        k->path.depth = enc_len / 2;
+        for (uint16_t d = 0; d < k->path.depth; d++) {
+            k->path.index[d] = read_u16(enc + 2 * d);
+        }
+        k->flags = (uint8_t)flags & (YAPB_SEG_BLOOM | YAPB_SEG_ZONE);
+        if (bloom_len > 0) {
+            cfg->bloom_bytes = bloom_len;
+        }
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_segment_close(YAPB_Segment_t *seg) {
+    if (seg == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    return YAPB_log_unmap(&SEG(seg)->map);
+}
+
+static bool path_equal(const uint8_t *enc, uint16_t enc_len, const YAPB_KeyPath_t *path) {
+    if (enc_len != 2 * path->depth) {
+        return false;
+    }
+    for (uint16_t d = 0; d < path->depth; d++) {
+        if (read_u16(enc + 2 * d) != path->index[d]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test one key summary; false rules the segment out
+static bool summary_may_match(YAPB_Packet_t *sum, const uint8_t *bloom, uint16_t bloom_len,
+                              const YAPB_SegmentFilter_t *q) {
+    int8_t flags, kind, hashes;
+    int64_t min, max;
+    YAPB_pop_i8(sum, &flags);
+    YAPB_pop_i8(sum, &kind);
+    YAPB_pop_i64(sum, &min);
+    YAPB_pop_i64(sum, &max);
+    YAPB_pop_i8(sum, &hashes);
+    if (YAPB_get_error(sum) < 0) {
+        return true;
+    }
+
+    // No packet in the segment has this key
+    if (kind == YAPB_KEY_NONE) {
+        return false;
+    }
+    if ((flags & YAPB_SEG_ZONE) && kind != KIND_MIXED) {
+        if (q->lo.kind != (uint8_t)kind || (q->op == YAPB_SEG_RANGE && q->hi.kind != (uint8_t)kind)) {
+            return false;
+        }
+        uint64_t hi = (q->op == YAPB_SEG_RANGE) ? q->hi.prefix : q->lo.prefix;
+        if (hi < (uint64_t)min || q->lo.prefix > (uint64_t)max) {
+            return false;
+        }
+    }
+    if (q->op == YAPB_SEG_EQ && hashes > 0 && bloom_len > 0 &&
+        !bloom_test(bloom, bloom_len, (uint8_t)hashes, YAPB_key_hash(&q->lo))) {
+        return false;
+    }
+    return true;
+}
+
+bool YAPB_segment_may_match(const YAPB_Segment_t *seg, const YAPB_SegmentFilter_t *filter) {
+    if (seg == NULL || filter == NULL) {
+        return true;
+    }
+    const _YAPB_Segment_t *g = CSEG(seg);
+    if (g->footer == NULL) {
+        return true;
+    }
+
+    YAPB_Packet_t f;
+    YAPB_load(&f, g->footer, g->footer_len);
+    const uint8_t *skip;
+    uint16_t skip_len;
+    int64_t skip_i64;
+    YAPB_pop_blob(&f, &skip, &skip_len);
+    YAPB_pop_i64(&f, &skip_i64);
+    YAPB_pop_i64(&f, &skip_i64);
+
+    YAPB_Element_t el;
+    while (YAPB_pop_next(&f, &el) >= 0 && el.type == YAPB_NESTED_PKT) {
+        YAPB_Packet_t sum = el.val.nested;
+        const uint8_t *bloom, *enc;
+        uint16_t bloom_len, enc_len;
+        if (YAPB_pop_blob(&f, &bloom, &bloom_len) < 0 || YAPB_pop_blob(&sum, &enc, &enc_len) < 0) {
+            return true;
+        }
+        if (path_equal(enc, enc_len, &filter->path)) {
+            return summary_may_match(&sum, bloom, bloom_len, filter);
+        }
+    }
+    // No summary for this key: cannot rule anything out
+    return true;
+}
+
+bool YAPB_segment_filter_packet(const uint8_t *pkt, size_t len, const YAPB_SegmentFilter_t *filter) {
+    if (pkt == NULL || filter == NULL) {
+        return false;
+    }
+    YAPB_Key_t key;
+    if (YAPB_key_extract(pkt, len, &filter->path, &key) != YAPB_OK || key.kind == YAPB_KEY_NONE) {
+        return false;
+    }
+    if (filter->op == YAPB_SEG_EQ) {
+        return YAPB_key_compare(&key, &filter->lo) == 0;
+    }
+    return YAPB_key_compare(&filter->lo, &key) <= 0 && YAPB_key_compare(&key, &filter->hi) <= 0;
+}
+
+YAPB_Result_t YAPB_segment_scan(const char *dir, const YAPB_SegmentFilter_t *filter,
+                                YAPB_SegmentFn_t fn, void *ctx, YAPB_SegmentScanStats_t *out_stats) {
+    if (dir == NULL || filter == NULL || fn == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    uint32_t *nums;
+    size_t n;
+    YAPB_Result_t r = list_segments(dir, &nums, &n);
+    if (r != YAPB_OK) return r;
+
+    YAPB_SegmentScanStats_t st = { 0 };
+    bool stop = false;
+    for (size_t i = 0; i < n && !stop && r == YAPB_OK; i++) {
+        char path[PATH_MAX];
+        YAPB_Segment_t seg;
+        if (segment_path(path, sizeof(path), dir, nums[i]) != 0) {
+            r = YAPB_ERR_IO;
+            break;
+        }
+        r = YAPB_segment_open(&seg, path);
+        if (r != YAPB_OK) break;
+        st.segments++;
+        if (!YAPB_segment_may_match(&seg, filter)) {
+            st.skipped++;
+            YAPB_segment_close(&seg);
+            continue;
+        }
+
+        size_t len, off = 0, pkt_len;
+        const uint8_t *data = YAPB_segment_get_data(&seg, &len);
+        const uint8_t *pkt;
+        while (!stop && YAPB_log_next(data, len, &off, &pkt, &pkt_len) == YAPB_OK) {
+            st.scanned++;
+            if (YAPB_segment_filter_packet(pkt, pkt_len, filter)) {
+                YAPB_Packet_t p;
+                YAPB_load(&p, pkt, pkt_len);
+                st.matched++;
+                stop = !fn(ctx, &p);
+            }
+        }
+        YAPB_segment_close(&seg);
+    }
+    free(nums);
+
+    if (out_stats != NULL) {
+        *out_stats = st;
+    }
+    return r;
+}
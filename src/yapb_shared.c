@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include "yapb_shared.h"
+#include "yapb_numa.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define DEFAULT_HUGE_PAGE (2u << 20)
+
+#define MEM_FLAGS (YAPB_POOL_MEM_HUGETLB | YAPB_POOL_MEM_THP | YAPB_POOL_MEM_PREFAULT)
+#define MEM_NODE_MASK 0xFF00u
+
+// Free list head: upper 32 bits are an ABA tag, lower 32 bits slot index + 1
+// (0 means empty).
+#define HEAD_PACK(tag, idx) (((uint64_t)(tag) << 32) | (uint64_t)(idx))
+#define HEAD_TAG(h) ((uint32_t)((h) >> 32))
+#define HEAD_IDX(h) ((uint32_t)((h) & 0xFFFFFFFFu))
+
+typedef struct {
+    uint8_t *slots;             // first slot, aligned to YAPB_SHARED_ALIGN
+    size_t stride;              // bytes per slot (header + data)
+    size_t buf_size;            // usable data bytes per slot
+    uint32_t count;             // number of slots
+    _Atomic uint32_t free_count;
+    _Atomic uint64_t head;      // tagged free list head
+} _YAPB_Pool_t;
+
+_Static_assert(sizeof(_YAPB_Pool_t) <= YAPB_POOL_SIZE,
+    "YAPB_POOL_SIZE too small for _YAPB_Pool_t");
+
+struct YAPB_Shared {
+    _Atomic uint32_t refs;      // 0 while the slot is on the free list
+    _Atomic uint32_t next;      // free list link (index + 1)
+    _YAPB_Pool_t *pool;         // owning pool
+};
+
+_Static_assert(sizeof(struct YAPB_Shared) <= YAPB_SHARED_ALIGN,
+    "YAPB_SHARED_ALIGN too small for the shared buffer header");
+
+#define PL(x) ((_YAPB_Pool_t *)(x))
+#define CPL(x) ((const _YAPB_Pool_t *)(x))
+
+static inline YAPB_Shared_t *_slot(_YAPB_Pool_t *p, uint32_t idx) {
+    return (YAPB_Shared_t *)(p->slots + (size_t)idx * p->stride);
+}
+
+static inline uint8_t *_slot_data(YAPB_Shared_t *sh) {
+    return (uint8_t *)sh + YAPB_SHARED_ALIGN;
+}
+
+static void _free_push(_YAPB_Pool_t *p, uint32_t idx) {
+    YAPB_Shared_t *sh = _slot(p, idx);
+    uint64_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    uint64_t next;
+    do {
+        atomic_store_explicit(&sh->next, HEAD_IDX(head), memory_order_relaxed);
+        next = HEAD_PACK(HEAD_TAG(head) + 1, idx + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&p->head, &head, next,
+                 memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&p->free_count, 1, memory_order_relaxed);
+}
+
+YAPB_Result_t YAPB_pool_init(YAPB_Pool_t *pool, void *mem, size_t mem_size, size_t buf_size) {
+    if (pool == NULL || mem == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (buf_size < YAPB_HEADER_SIZE) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    _YAPB_Pool_t *p = PL(pool);
+
+    uintptr_t start = (uintptr_t)mem;
+    uintptr_t aligned = (start + YAPB_SHARED_ALIGN - 1) & ~(uintptr_t)(YAPB_SHARED_ALIGN - 1);
+    if (aligned - start >= mem_size) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    size_t usable = mem_size - (aligned - start);
+    size_t stride = YAPB_SHARED_ALIGN +
+        ((buf_size + YAPB_SHARED_ALIGN - 1) & ~(size_t)(YAPB_SHARED_ALIGN - 1));
+    size_t count = usable / stride;
+    if (count == 0) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    if (count > UINT32_MAX - 1) {
+        count = UINT32_MAX - 1;
+    }
+
+    p->slots = (uint8_t *)aligned;
+    p->stride = stride;
+    p->buf_size = buf_size;
+    p->count = (uint32_t)count;
+    atomic_init(&p->free_count, 0);
+    atomic_init(&p->head, 0);
+
+    // Push in reverse so allocation walks memory front to back
+    for (uint32_t i = p->count; i-- > 0;) {
+        YAPB_Shared_t *sh = _slot(p, i);
+        atomic_init(&sh->refs, 0);
+        atomic_init(&sh->next, 0);
+        sh->pool = p;
+        _free_push(p, i);
+    }
+
+    return YAPB_OK;
+}
+
+// Default huge page size from /proc/meminfo (2 MiB if unavailable)
+static size_t _huge_page_size(void) {
+    size_t size = DEFAULT_HUGE_PAGE;
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f == NULL) {
+        return size;
+    }
+    char line[128];
+    unsigned long kib;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kib) == 1) {
+            size = (size_t)kib << 10;
+            break;
+        }
+    }
+    fclose(f);
+    return size;
+}
+
+static inline size_t _round_up(size_t n, size_t to) {
+    return (n + to - 1) & ~(to - 1);
+}
+
+YAPB_Result_t YAPB_pool_mem_alloc(size_t size, unsigned flags, void **out_mem,
+                                  size_t *out_size, unsigned *out_flags) {
+    if (out_mem == NULL || out_size == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if ((flags & ~(MEM_FLAGS | MEM_NODE_MASK)) != 0) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    if (size == 0) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t huge = (flags & (YAPB_POOL_MEM_HUGETLB | YAPB_POOL_MEM_THP)) ? _huge_page_size() : page;
+    if (size > SIZE_MAX - 2 * huge) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    size = _round_up(size, huge);
+    // With a node, pages must not be faulted before the policy is set
+    int populate = (flags & YAPB_POOL_MEM_PREFAULT) && !(flags & MEM_NODE_MASK) ? MAP_POPULATE : 0;
+    uint8_t *mem = MAP_FAILED;
+
+    if (flags & YAPB_POOL_MEM_HUGETLB) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+        if (mem == MAP_FAILED) {
+            flags = (flags & ~YAPB_POOL_MEM_HUGETLB) | YAPB_POOL_MEM_THP;
+        }
+    }
+    if (mem == MAP_FAILED && (flags & YAPB_POOL_MEM_THP)) {
+        // Over-map and trim so the range starts on a huge page boundary
+        uint8_t *raw = mmap(NULL, size + huge, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return YAPB_ERR_IO;
+        }
+        mem = (uint8_t *)_round_up((uintptr_t)raw, huge);
+        if (mem > raw) {
+            munmap(raw, (size_t)(mem - raw));
+        }
+        if (raw + huge > mem) {
+            munmap(mem + size, (size_t)(raw + huge - mem));
+        }
+        // Advice first, so the prefault below gets huge pages
+        (void)madvise(mem, size, MADV_HUGEPAGE);
+    } else if (mem == MAP_FAILED) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+        if (mem == MAP_FAILED) {
+            return YAPB_ERR_IO;
+        }
+    }
+
+    if ((flags & MEM_NODE_MASK) &&
+        YAPB_numa_bind(mem, size, (int)((flags & MEM_NODE_MASK) >> 8) - 1) != YAPB_OK) {
+        flags &= ~MEM_NODE_MASK;
+    }
+    if (flags & YAPB_POOL_MEM_PREFAULT) {
+        // Writes make sure no page is left mapped to the shared zero page
+        for (size_t off = 0; off < size; off += page) {
+            ((volatile uint8_t *)mem)[off] = 0;
+        }
+    }
+    *out_mem = mem;
+    *out_size = size;
+    if (out_flags != NULL) {
+        *out_flags = flags;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_pool_mem_free(void *mem, size_t size) {
+    if (mem == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    return munmap(mem, size) == 0 ? YAPB_OK : YAPB_ERR_IO;
+}
+
+YAPB_Result_t YAPB_pool_get_count(const YAPB_Pool_t *pool, size_t *out_total, size_t *out_free) {
+    if (pool == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Pool_t *p = CPL(pool);
+    if (out_total != NULL) {
+        *out_total = p->count;
+    }
+    if (out_free != NULL) {
+        *out_free = atomic_load_explicit(&((_YAPB_Pool_t *)p)->free_count, memory_order_relaxed);
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_shared_alloc(YAPB_Pool_t *pool, YAPB_Shared_t **out) {
+    if (pool == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Pool_t *p = PL(pool);
+
+    uint64_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+    YAPB_Shared_t *sh;
+    uint64_t next;
+    do {
+        if (HEAD_IDX(head) == 0) {
+            return YAPB_ERR_BUFFER_TOO_SMALL;
+        }
+        sh = _slot(p, HEAD_IDX(head) - 1);
+        // The tag makes a stale link harmless: the CAS fails if the head moved
+        uint32_t link = atomic_load_explicit(&sh->next, memory_order_relaxed);
+        next = HEAD_PACK(HEAD_TAG(head) + 1, link);
+    } while (!atomic_compare_exchange_weak_explicit(&p->head, &head, next,
+                 memory_order_acquire, memory_order_acquire));
+
+    atomic_fetch_sub_explicit(&p->free_count, 1, memory_order_relaxed);
+    atomic_store_explicit(&sh->refs, 1, memory_order_relaxed);
+    *out = sh;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_shared_retain(YAPB_Shared_t *sh) {
+    if (sh == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    atomic_fetch_add_explicit(&sh->refs, 1, memory_order_relaxed);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_shared_release(YAPB_Shared_t *sh) {
+    if (sh == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    // Never step below zero: a count that wrapped, even briefly, would be
+    // corrupted by a concurrent ref or alloc of the slot
+    uint32_t old = atomic_load_explicit(&sh->refs, memory_order_relaxed);
+    do {
+        if (old == 0) {
+            // Released more often than retained
+            return YAPB_ERR_INVALID_MODE;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&sh->refs, &old, old - 1,
+                 memory_order_release, memory_order_relaxed));
+    if (old == 1) {
+        // Make all writes by other owners visible before the slot is reused
+        atomic_thread_fence(memory_order_acquire);
+        _YAPB_Pool_t *p = sh->pool;
+        _free_push(p, (uint32_t)(((uint8_t *)sh - p->slots) / p->stride));
+    }
+    return YAPB_OK;
+}
+
+uint8_t *YAPB_shared_data(YAPB_Shared_t *sh, size_t *out_capacity) {
+    if (sh == NULL) {
+        return NULL;
+    }
+    if (out_capacity != NULL) {
+        *out_capacity = sh->pool->buf_size;
+    }
+    return _slot_data(sh);
+}
+
+YAPB_Result_t YAPB_shared_initialize(YAPB_Packet_t *pkt, YAPB_Shared_t *sh) {
+    if (sh == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    return YAPB_initialize(pkt, _slot_data(sh), sh->pool->buf_size);
+}
+
+YAPB_Result_t YAPB_shared_load(YAPB_Packet_t *pkt, const YAPB_Shared_t *sh) {
+    if (sh == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    return YAPB_load(pkt, _slot_data((YAPB_Shared_t *)sh), sh->pool->buf_size);
+}
+
+YAPB_Result_t YAPB_shared_ref(YAPB_Pool_t *pool, const void *ptr, YAPB_Shared_t **out) {
+    if (pool == NULL || ptr == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Pool_t *p = PL(pool);
+
+    uintptr_t addr = (uintptr_t)ptr;
+    uintptr_t base = (uintptr_t)p->slots;
+    if (addr < base || addr >= base + (size_t)p->count * p->stride) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    size_t idx = (addr - base) / p->stride;
+    size_t off = (addr - base) % p->stride;
+    if (off < YAPB_SHARED_ALIGN || off - YAPB_SHARED_ALIGN >= p->buf_size) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    // Only a live count is incremented, so a slot whose last reference is
+    // being dropped concurrently is never revived once it is free
+    YAPB_Shared_t *sh = _slot(p, (uint32_t)idx);
+    uint32_t refs = atomic_load_explicit(&sh->refs, memory_order_relaxed);
+    do {
+        if (refs == 0) {
+            return YAPB_ERR_INVALID_MODE;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&sh->refs, &refs, refs + 1,
+                 memory_order_relaxed, memory_order_relaxed));
+    *out = sh;
+    return YAPB_OK;
+}
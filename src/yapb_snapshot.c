@@ -0,0 +1,503 @@
+#define _GNU_SOURCE
+#include "yapb_snapshot.h"
+#include "yapb_internal.h"
+#include "yapb_io.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// File layout (integers big-endian):
+//   subtree packets back to back
+//   index:  count x { u64 id, u64 offset, u32 length, u32 crc32c, u8 file, 7 pad }
+//   files:  (nfiles - 1) x { u16 length, path }  -- file 0 is the snapshot itself
+//   footer: magic, u64 index offset, u64 count, u64 files offset, u32 nfiles,
+//           u32 crc32c of index and files, 8 reserved
+#define SNAP_MAGIC      "YAPBSNP1"
+#define ENTRY_SIZE      32
+#define FOOTER_SIZE     48
+#define WBUF_SIZE       (1u << 20)
+
+typedef struct {
+    uint64_t id;
+    uint64_t off;
+    uint32_t len;
+    uint32_t crc;
+    uint8_t file;
+} Entry;
+
+typedef struct {
+    YAPB_LogMap_t maps[YAPB_SNAP_MAX_FILES];    // [0] is the snapshot itself
+    const uint8_t *index;
+    const uint8_t *files;
+    uint64_t count;
+    uint32_t nfiles;
+} _YAPB_Snapshot_t;
+
+_Static_assert(sizeof(_YAPB_Snapshot_t) <= YAPB_SNAPSHOT_SIZE,
+    "YAPB_SNAPSHOT_SIZE too small for _YAPB_Snapshot_t");
+
+typedef struct {
+    YAPB_Writer out;
+    char *path;
+    char *tmp;
+    _YAPB_Snapshot_t *base;                 // NULL without a base
+    char *base_path;
+    Entry *entries;
+    size_t n;
+    size_t cap;
+    char *files[YAPB_SNAP_MAX_FILES];       // paths of files 1 .. nfiles - 1
+    uint32_t nfiles;
+    int8_t file_map[YAPB_SNAP_MAX_FILES];   // base file number -> ours, -1 if none yet
+    YAPB_SnapStats_t stats;
+} _YAPB_SnapWriter_t;
+
+_Static_assert(sizeof(_YAPB_SnapWriter_t) <= YAPB_SNAP_WRITER_SIZE,
+    "YAPB_SNAP_WRITER_SIZE too small for _YAPB_SnapWriter_t");
+
+#define SNAP(x) ((_YAPB_Snapshot_t *)(x))
+#define CSNAP(x) ((const _YAPB_Snapshot_t *)(x))
+#define SWR(x) ((_YAPB_SnapWriter_t *)(x))
+
+// ============ CRC-32C ============
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32c(uint32_t crc, const uint8_t *p, size_t n) {
+    pthread_once(&crc_once, crc_init);
+    crc = ~crc;
+    while (n--) {
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// ============ Reader ============
+
+static void entry_decode(const uint8_t *p, Entry *e) {
+    e->id = read_u64(p);
+    e->off = read_u64(p + 8);
+    e->len = read_u32(p + 16);
+    e->crc = read_u32(p + 20);
+    e->file = p[24];
+}
+
+// Copy path k (1-based) of the file table into buf
+static YAPB_Result_t file_path(const _YAPB_Snapshot_t *s, uint32_t k, char *buf, size_t size) {
+    const uint8_t *p = s->files;
+    for (uint32_t i = 1; i < k; i++) {
+        p += 2 + read_u16(p);
+    }
+    uint16_t len = read_u16(p);
+    if (len >= size) {
+        return YAPB_ERR_IO;
+    }
+    memcpy(buf, p + 2, len);
+    buf[len] = '\0';
+    return YAPB_OK;
+}
+
+static void unmap_all(_YAPB_Snapshot_t *s, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        YAPB_log_unmap(&s->maps[i]);
+    }
+}
+
+YAPB_Result_t YAPB_snap_open(YAPB_Snapshot_t *snap, const char *path) {
+    if (snap == NULL || path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Snapshot_t *s = SNAP(snap);
+    YAPB_Result_t r = YAPB_log_map(&s->maps[0], path, 0);
+    if (r != YAPB_OK) return r;
+
+    size_t size;
+    const uint8_t *data = YAPB_log_get_data(&s->maps[0], &size);
+    if (size < FOOTER_SIZE || memcmp(data + size - FOOTER_SIZE, SNAP_MAGIC, 8) != 0) {
+        unmap_all(s, 1);
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    const uint8_t *ft = data + size - FOOTER_SIZE;
+    uint64_t index_off = read_u64(ft + 8), count = read_u64(ft + 16), files_off = read_u64(ft + 24);
+    uint32_t nfiles = read_u32(ft + 32);
+    size_t meta_end = size - FOOTER_SIZE;
+    if (index_off > files_off || files_off > meta_end || (files_off - index_off) / ENTRY_SIZE != count ||
+        (files_off - index_off) % ENTRY_SIZE != 0 || nfiles == 0 || nfiles > YAPB_SNAP_MAX_FILES ||
+        crc32c(0, data + index_off, meta_end - index_off) != read_u32(ft + 36)) {
+        unmap_all(s, 1);
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    s->index = data + index_off;
+    s->files = data + files_off;
+    s->count = count;
+    s->nfiles = nfiles;
+
+    // The file table is covered by the checksum; only its bounds need care
+    const uint8_t *p = s->files;
+    for (uint32_t k = 1; k < nfiles; k++) {
+        if ((size_t)(data + meta_end - p) < 2 || (size_t)(data + meta_end - p) < 2u + read_u16(p)) {
+            unmap_all(s, k);
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        char base[PATH_MAX];
+        r = file_path(s, k, base, sizeof(base));
+        if (r == YAPB_OK) {
+            r = YAPB_log_map(&s->maps[k], base, 0);
+        }
+        if (r != YAPB_OK) {
+            unmap_all(s, k);
+            return r;
+        }
+        p += 2 + read_u16(p);
+    }
+    return YAPB_OK;
+}
+
+// Binary search of the index; returns false if absent
+static bool find_entry(const _YAPB_Snapshot_t *s, uint64_t id, Entry *out) {
+    uint64_t lo = 0, hi = s->count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t mid_id = read_u64(s->index + mid * ENTRY_SIZE);
+        if (mid_id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == s->count || read_u64(s->index + lo * ENTRY_SIZE) != id) {
+        return false;
+    }
+    entry_decode(s->index + lo * ENTRY_SIZE, out);
+    return true;
+}
+
+// Locate the bytes of an entry; NULL if they lie outside their file
+static const uint8_t *entry_bytes(const _YAPB_Snapshot_t *s, const Entry *e) {
+    if (e->file >= s->nfiles) {
+        return NULL;
+    }
+    size_t size;
+    const uint8_t *data = YAPB_log_get_data(&s->maps[e->file], &size);
+    if (data == NULL || e->off > size || e->len > size - e->off) {
+        return NULL;
+    }
+    return data + e->off;
+}
+
+YAPB_Result_t YAPB_snap_get_count(const YAPB_Snapshot_t *s, uint64_t *out_count) {
+    if (s == NULL || out_count == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    *out_count = CSNAP(s)->count;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_snap_get_id(const YAPB_Snapshot_t *s, uint64_t i, uint64_t *out_id) {
+    if (s == NULL || out_id == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (i >= CSNAP(s)->count) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    *out_id = read_u64(CSNAP(s)->index + i * ENTRY_SIZE);
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_snap_get(const YAPB_Snapshot_t *snap, uint64_t id, YAPB_Packet_t *out_pkt) {
+    if (snap == NULL || out_pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Snapshot_t *s = CSNAP(snap);
+    Entry e;
+    if (!find_entry(s, id, &e)) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    const uint8_t *bytes = entry_bytes(s, &e);
+    if (bytes == NULL || crc32c(0, bytes, e.len) != e.crc) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    return YAPB_load(out_pkt, bytes, e.len);
+}
+
+YAPB_Result_t YAPB_snap_close(YAPB_Snapshot_t *snap) {
+    if (snap == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Snapshot_t *s = SNAP(snap);
+    unmap_all(s, s->nfiles);
+    s->nfiles = 0;
+    s->count = 0;
+    return YAPB_OK;
+}
+
+// ============ Writer ============
+
+static void writer_free(_YAPB_SnapWriter_t *w) {
+    if (w->base != NULL) {
+        YAPB_snap_close((YAPB_Snapshot_t *)w->base);
+        free(w->base);
+    }
+    for (uint32_t i = 1; i < w->nfiles; i++) {
+        free(w->files[i]);
+    }
+    free(w->out.buf);
+    free(w->entries);
+    free(w->base_path);
+    free(w->tmp);
+    free(w->path);
+    memset(w, 0, sizeof(*w));
+    w->out.fd = -1;
+}
+
+YAPB_Result_t YAPB_snap_begin(YAPB_SnapWriter_t *wr, const char *path, const char *base_path) {
+    if (wr == NULL || path == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SnapWriter_t *w = SWR(wr);
+    memset(w, 0, sizeof(*w));
+    w->out.fd = -1;
+    w->nfiles = 1;
+    memset(w->file_map, -1, sizeof(w->file_map));
+
+    size_t tlen = strlen(path) + 8;
+    w->path = strdup(path);
+    w->tmp = malloc(tlen);
+    w->out.buf = malloc(WBUF_SIZE);
+    w->out.cap = WBUF_SIZE;
+    if (base_path != NULL) {
+        w->base_path = strdup(base_path);
+        w->base = malloc(sizeof(_YAPB_Snapshot_t));
+    }
+    if (w->path == NULL || w->tmp == NULL || w->out.buf == NULL ||
+        (base_path != NULL && (w->base_path == NULL || w->base == NULL))) {
+        writer_free(w);
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    if (base_path != NULL) {
+        YAPB_Result_t r = YAPB_snap_open((YAPB_Snapshot_t *)w->base, base_path);
+        if (r != YAPB_OK) {
+            free(w->base);
+            w->base = NULL;
+            writer_free(w);
+            return r;
+        }
+        // Replacing a file the new snapshot reads from would break it
+        bool clash = (strcmp(path, base_path) == 0);
+        for (uint32_t k = 1; k < w->base->nfiles && !clash; k++) {
+            char buf[PATH_MAX];
+            clash = (file_path(w->base, k, buf, sizeof(buf)) != YAPB_OK || strcmp(path, buf) == 0);
+        }
+        if (clash) {
+            writer_free(w);
+            return YAPB_ERR_INVALID_MODE;
+        }
+    }
+
+    snprintf(w->tmp, tlen, "%s.XXXXXX", path);
+    w->out.fd = mkostemp(w->tmp, O_CLOEXEC);
+    if (w->out.fd < 0) {
+        writer_free(w);
+        return YAPB_ERR_IO;
+    }
+    return YAPB_OK;
+}
+
+static YAPB_Result_t add_entry(_YAPB_SnapWriter_t *w, const Entry *e) {
+    if (w->n == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 1024;
+        Entry *p = realloc(w->entries, cap * sizeof(Entry));
+        if (p == NULL) {
+            return YAPB_ERR_BUFFER_TOO_SMALL;
+        }
+        w->entries = p;
+        w->cap = cap;
+    }
+    w->entries[w->n++] = *e;
+    return YAPB_OK;
+}
+
+// Write subtree bytes to this file
+static YAPB_Result_t write_subtree(_YAPB_SnapWriter_t *w, uint64_t id, const uint8_t *data,
+                                   uint32_t len, uint32_t crc) {
+    Entry e = { id, w->out.bytes, len, crc, 0 };
+    YAPB_Result_t r = writer_put(&w->out, data, len);
+    if (r != YAPB_OK) return r;
+    return add_entry(w, &e);
+}
+
+YAPB_Result_t YAPB_snap_put(YAPB_SnapWriter_t *wr, uint64_t id, const YAPB_Packet_t *pkt) {
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (wr == NULL || data == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SnapWriter_t *w = SWR(wr);
+    if (w->out.fd < 0) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    YAPB_Result_t r = write_subtree(w, id, data, (uint32_t)len, crc32c(0, data, len));
+    w->stats.written += (r == YAPB_OK);
+    return r;
+}
+
+YAPB_Result_t YAPB_snap_reuse(YAPB_SnapWriter_t *wr, uint64_t id) {
+    if (wr == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SnapWriter_t *w = SWR(wr);
+    if (w->out.fd < 0) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    Entry e;
+    if (w->base == NULL || !find_entry(w->base, id, &e)) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+
+    // Refer to the file that holds the bytes, adding it to our file table
+    uint8_t bf = e.file;
+    if (bf < w->base->nfiles && w->file_map[bf] < 0 && w->nfiles < YAPB_SNAP_MAX_FILES) {
+        char buf[PATH_MAX];
+        const char *src = w->base_path;
+        if (bf > 0) {
+            YAPB_Result_t r = file_path(w->base, bf, buf, sizeof(buf));
+            if (r != YAPB_OK) return r;
+            src = buf;
+        }
+        // Several base files may name the same path
+        for (uint32_t i = 1; i < w->nfiles && w->file_map[bf] < 0; i++) {
+            if (strcmp(w->files[i], src) == 0) w->file_map[bf] = (int8_t)i;
+        }
+        if (w->file_map[bf] < 0) {
+            w->files[w->nfiles] = strdup(src);
+            if (w->files[w->nfiles] == NULL) {
+                return YAPB_ERR_BUFFER_TOO_SMALL;
+            }
+            w->file_map[bf] = (int8_t)w->nfiles++;
+        }
+    }
+    if (bf < w->base->nfiles && w->file_map[bf] >= 0) {
+        e.file = (uint8_t)w->file_map[bf];
+        YAPB_Result_t r = add_entry(w, &e);
+        w->stats.reused += (r == YAPB_OK);
+        return r;
+    }
+
+    // File table full: copy the (verified) bytes to cut the chain
+    const uint8_t *bytes = entry_bytes(w->base, &e);
+    if (bytes == NULL || crc32c(0, bytes, e.len) != e.crc) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    YAPB_Result_t r = write_subtree(w, id, bytes, e.len, e.crc);
+    w->stats.copied += (r == YAPB_OK);
+    return r;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    uint64_t x = ((const Entry *)a)->id, y = ((const Entry *)b)->id;
+    return (x > y) - (x < y);
+}
+
+YAPB_Result_t YAPB_snap_commit(YAPB_SnapWriter_t *wr, YAPB_SnapStats_t *out_stats) {
+    if (wr == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SnapWriter_t *w = SWR(wr);
+    if (w->out.fd < 0) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    YAPB_Result_t r = YAPB_OK;
+    qsort(w->entries, w->n, sizeof(Entry), entry_cmp);
+    for (size_t i = 1; i < w->n; i++) {
+        if (w->entries[i].id == w->entries[i - 1].id) {
+            r = YAPB_ERR_INVALID_MODE;
+        }
+    }
+
+    uint64_t index_off = w->out.bytes;
+    uint32_t crc = 0;
+    for (size_t i = 0; i < w->n && r == YAPB_OK; i++) {
+        uint8_t rec[ENTRY_SIZE] = { 0 };
+        const Entry *e = &w->entries[i];
+        write_u64(rec, e->id);
+        write_u64(rec + 8, e->off);
+        write_u32(rec + 16, e->len);
+        write_u32(rec + 20, e->crc);
+        rec[24] = e->file;
+        crc = crc32c(crc, rec, ENTRY_SIZE);
+        r = writer_put(&w->out, rec, ENTRY_SIZE);
+    }
+    uint64_t files_off = w->out.bytes;
+    for (uint32_t k = 1; k < w->nfiles && r == YAPB_OK; k++) {
+        uint8_t len[2];
+        size_t n = strlen(w->files[k]);
+        if (n > UINT16_MAX) {
+            r = YAPB_ERR_IO;
+            break;
+        }
+        write_u16(len, (uint16_t)n);
+        crc = crc32c(crc, len, 2);
+        crc = crc32c(crc, (const uint8_t *)w->files[k], n);
+        r = writer_put(&w->out, len, 2);
+        if (r == YAPB_OK) r = writer_put(&w->out, (const uint8_t *)w->files[k], n);
+    }
+    if (r == YAPB_OK) {
+        uint8_t ft[FOOTER_SIZE] = { 0 };
+        memcpy(ft, SNAP_MAGIC, 8);
+        write_u64(ft + 8, index_off);
+        write_u64(ft + 16, w->n);
+        write_u64(ft + 24, files_off);
+        write_u32(ft + 32, w->nfiles);
+        write_u32(ft + 36, crc);
+        r = writer_put(&w->out, ft, FOOTER_SIZE);
+    }
+    if (r == YAPB_OK) {
+        r = writer_flush(&w->out);
+    }
+    if (r == YAPB_OK && fdatasync(w->out.fd) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (close(w->out.fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    w->out.fd = -1;
+    if (r == YAPB_OK && rename(w->tmp, w->path) != 0) {
+        r = YAPB_ERR_IO;
+    }
+    if (r != YAPB_OK) {
+        unlink(w->tmp);
+    }
+
+    w->stats.subtrees = w->n;
+    w->stats.bytes = w->out.bytes;
+    if (r == YAPB_OK && out_stats != NULL) {
+        *out_stats = w->stats;
+    }
+    writer_free(w);
+    return r;
+}
+
+YAPB_Result_t YAPB_snap_abort(YAPB_SnapWriter_t *wr) {
+    if (wr == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_SnapWriter_t *w = SWR(wr);
+    if (w->out.fd >= 0) {
+        close(w->out.fd);
+        unlink(w->tmp);
+    }
+    writer_free(w);
+    return YAPB_OK;
+}
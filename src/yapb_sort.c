@@ -0,0 +1,517 @@
+#define _GNU_SOURCE
+#include "yapb_sort.h"
+#include "yapb_internal.h"
+#include "yapb_numa.h"
+#include "yapb_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_BUDGET  (64u << 20)
+#define MAX_WBUF        (1u << 20)
+#define MIN_WBUF        (4u << 10)
+#define MERGE_FANIN     128u
+
+// One record of a run being sorted: 16 bytes, four per cache line
+typedef struct {
+    uint64_t prefix;    // order-preserving key prefix
+    uint32_t rec;       // record number within the run (input order)
+    uint8_t kind;       // YAPB_KeyKind_t
+} SortEntry;
+
+_Static_assert(sizeof(SortEntry) == 16, "SortEntry should stay 16 bytes");
+
+// A run holds the same bytes as its input slice, reordered, so every run
+// lives in one shared file at its slice's input offset
+typedef struct {
+    uint64_t off;
+    uint64_t len;
+    uint64_t records;
+} Run;
+
+// Buffered writer at explicit file offsets, so threads can share one file
+typedef struct {
+    int fd;
+    uint8_t *buf;
+    size_t cap;
+    size_t used;
+    uint64_t at;        // file offset of buf[0]
+} RunWriter;
+
+static YAPB_Result_t run_flush(RunWriter *w) {
+    YAPB_Result_t r = pwrite_all(w->fd, w->buf, w->used, (off_t)w->at);
+    w->at += w->used;
+    w->used = 0;
+    return r;
+}
+
+static YAPB_Result_t run_put(RunWriter *w, const uint8_t *p, size_t n) {
+    if (w->used + n > w->cap) {
+        YAPB_Result_t r = run_flush(w);
+        if (r != YAPB_OK) return r;
+        if (n > w->cap) {
+            r = pwrite_all(w->fd, p, n, (off_t)w->at);
+            w->at += n;
+            return r;
+        }
+    }
+    memcpy(w->buf + w->used, p, n);
+    w->used += n;
+    return YAPB_OK;
+}
+
+typedef struct {
+    const uint8_t *data;        // mapped input
+    size_t len;
+    const YAPB_KeyPath_t *key;
+    const char *tmp_dir;
+    int out_fd;
+    size_t max_records;         // per run
+    size_t wbuf_size;           // per thread
+    uint32_t fanin;             // runs merged at once
+
+    pthread_mutex_t lock;       // guards everything below
+    size_t cursor;              // next unclaimed input offset
+    int run_fd;                 // shared run file (unlinked), opened with the second run
+    Run *runs;
+    uint32_t nruns;
+    uint32_t runs_cap;
+    uint64_t out_bytes;         // bytes written by a single direct run
+    YAPB_Result_t error;        // first error, stops all workers
+} SortJob;
+
+typedef struct {
+    SortJob *job;
+    int node;                   // NUMA node to run on, -1 for no placement
+} SortWorker;
+
+typedef struct {
+    const uint8_t *data;
+    const uint64_t *offs;
+    const YAPB_KeyPath_t *key;
+} SortCtx;
+
+static void job_fail(SortJob *job, YAPB_Result_t r) {
+    pthread_mutex_lock(&job->lock);
+    if (job->error == YAPB_OK) {
+        job->error = r;
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static int entry_cmp(const void *pa, const void *pb, void *arg) {
+    const SortEntry *a = pa;
+    const SortEntry *b = pb;
+    if (a->kind != b->kind) {
+        return (a->kind < b->kind) ? -1 : 1;
+    }
+    if (a->prefix != b->prefix) {
+        return (a->prefix < b->prefix) ? -1 : 1;
+    }
+    if (a->kind == YAPB_KEY_BLOB) {
+        // Rare slow path: re-extract both blob keys for the full compare
+        const SortCtx *ctx = arg;
+        const uint8_t *pa_pkt = ctx->data + ctx->offs[a->rec];
+        const uint8_t *pb_pkt = ctx->data + ctx->offs[b->rec];
+        YAPB_Key_t ka, kb;
+        YAPB_key_extract(pa_pkt, read_u32(pa_pkt), ctx->key, &ka);
+        YAPB_key_extract(pb_pkt, read_u32(pb_pkt), ctx->key, &kb);
+        int c = YAPB_key_compare(&ka, &kb);
+        if (c != 0) return c;
+    }
+    // Record number keeps the sort stable
+    return (a->rec > b->rec) - (a->rec < b->rec);
+}
+
+static int open_run_file(const char *dir) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/yapb-sort-XXXXXX", dir) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) {
+        // Nothing to clean up later, even if the process dies mid-sort
+        unlink(path);
+    }
+    return fd;
+}
+
+// Sort one claimed slice of the input and write it as a run
+static YAPB_Result_t sort_run(SortJob *job, SortEntry *entries, uint64_t *offs, size_t n,
+                              RunWriter *w) {
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *pkt = job->data + offs[i];
+        YAPB_Key_t k;
+        YAPB_Result_t r = YAPB_key_extract(pkt, read_u32(pkt), job->key, &k);
+        if (r != YAPB_OK) return r;
+        entries[i].prefix = k.prefix;
+        entries[i].rec = (uint32_t)i;
+        entries[i].kind = k.kind;
+    }
+
+    SortCtx ctx = { job->data, offs, job->key };
+    qsort_r(entries, n, sizeof(SortEntry), entry_cmp, &ctx);
+
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *pkt = job->data + offs[entries[i].rec];
+        YAPB_Result_t r = run_put(w, pkt, read_u32(pkt));
+        if (r != YAPB_OK) return r;
+    }
+    return run_flush(w);
+}
+
+static void *sort_worker(void *arg) {
+    SortWorker *sw = arg;
+    SortJob *job = sw->job;
+    // Pin before allocating, so the buffers are first touched on the node
+    if (sw->node >= 0) {
+        YAPB_numa_pin_thread(sw->node);
+    }
+    SortEntry *entries = malloc(job->max_records * sizeof(SortEntry));
+    uint64_t *offs = malloc(job->max_records * sizeof(uint64_t));
+    uint8_t *wbuf = malloc(job->wbuf_size);
+    if (entries == NULL || offs == NULL || wbuf == NULL) {
+        job_fail(job, YAPB_ERR_BUFFER_TOO_SMALL);
+        goto out;
+    }
+
+    for (;;) {
+        // Claim the next slice; the header walk is the only serial part
+        pthread_mutex_lock(&job->lock);
+        if (job->error != YAPB_OK || job->cursor >= job->len) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        size_t n = 0;
+        size_t start = job->cursor;
+        YAPB_Result_t r = YAPB_OK;
+        while (n < job->max_records && job->cursor < job->len) {
+            const uint8_t *pkt;
+            size_t pkt_len;
+            size_t at = job->cursor;
+            r = YAPB_log_next(job->data, job->len, &job->cursor, &pkt, &pkt_len);
+            if (r != YAPB_OK) break;
+            offs[n++] = at;
+        }
+        if (r != YAPB_OK) {
+            job->error = r;
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        if (job->nruns == job->runs_cap) {
+            uint32_t cap = job->runs_cap ? job->runs_cap * 2 : 16;
+            Run *runs = realloc(job->runs, cap * sizeof(Run));
+            if (runs == NULL) {
+                job->error = YAPB_ERR_BUFFER_TOO_SMALL;
+                pthread_mutex_unlock(&job->lock);
+                break;
+            }
+            job->runs = runs;
+            job->runs_cap = cap;
+        }
+        uint32_t run = job->nruns++;
+        job->runs[run].off = start;
+        job->runs[run].len = job->cursor - start;
+        job->runs[run].records = n;
+        // The whole input in one slice needs no merge: write the output directly
+        bool direct = (run == 0 && job->cursor >= job->len);
+        if (!direct && job->run_fd < 0) {
+            job->run_fd = open_run_file(job->tmp_dir);
+            if (job->run_fd < 0) {
+                job->error = YAPB_ERR_IO;
+                pthread_mutex_unlock(&job->lock);
+                break;
+            }
+        }
+        int fd = direct ? job->out_fd : job->run_fd;
+        pthread_mutex_unlock(&job->lock);
+
+        RunWriter w = { fd, wbuf, job->wbuf_size, 0, direct ? 0 : start };
+        r = sort_run(job, entries, offs, n, &w);
+        if (direct) {
+            pthread_mutex_lock(&job->lock);
+            job->out_bytes = w.at;
+            pthread_mutex_unlock(&job->lock);
+        }
+        if (r != YAPB_OK) {
+            job_fail(job, r);
+            break;
+        }
+    }
+
+out:
+    free(entries);
+    free(offs);
+    free(wbuf);
+    return NULL;
+}
+
+// ============ Merge ============
+
+typedef struct {
+    const uint8_t *data;    // mapped run
+    size_t len;
+    size_t off;             // next packet
+    const uint8_t *pkt;     // current packet
+    size_t pkt_len;
+    YAPB_Key_t key;         // key of the current packet
+} MergeCursor;
+
+// Load the next packet of a run; false at the end
+static bool cursor_next(MergeCursor *c, const YAPB_KeyPath_t *key) {
+    if (YAPB_log_next(c->data, c->len, &c->off, &c->pkt, &c->pkt_len) != YAPB_OK) {
+        return false;
+    }
+    YAPB_key_extract(c->pkt, c->pkt_len, key, &c->key);
+    return true;
+}
+
+// Heap order: key, then run number, so equal keys keep input order
+static inline bool cursor_less(const MergeCursor *cur, uint32_t a, uint32_t b) {
+    int c = YAPB_key_compare(&cur[a].key, &cur[b].key);
+    return c < 0 || (c == 0 && a < b);
+}
+
+static void heap_down(const MergeCursor *cur, uint32_t *heap, uint32_t n, uint32_t i) {
+    for (;;) {
+        uint32_t l = 2 * i + 1, m = i;
+        if (l < n && cursor_less(cur, heap[l], heap[m])) m = l;
+        if (l + 1 < n && cursor_less(cur, heap[l + 1], heap[m])) m = l + 1;
+        if (m == i) return;
+        uint32_t t = heap[i]; heap[i] = heap[m]; heap[m] = t;
+        i = m;
+    }
+}
+
+// Merge k consecutive runs of a mapped run file through one writer
+static YAPB_Result_t merge_group(const uint8_t *src, const Run *runs, uint32_t k,
+                                 const YAPB_KeyPath_t *key, MergeCursor *cur, uint32_t *heap,
+                                 RunWriter *w) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < k; i++) {
+        cur[i] = (MergeCursor){ .data = src + runs[i].off, .len = runs[i].len };
+        if (cursor_next(&cur[i], key)) {
+            heap[n++] = i;
+        }
+    }
+    for (uint32_t i = n / 2; i-- > 0;) {
+        heap_down(cur, heap, n, i);
+    }
+
+    YAPB_Result_t r = YAPB_OK;
+    while (n > 0 && r == YAPB_OK) {
+        MergeCursor *c = &cur[heap[0]];
+        r = run_put(w, c->pkt, c->pkt_len);
+        if (!cursor_next(c, key)) {
+            heap[0] = heap[--n];
+        }
+        heap_down(cur, heap, n, 0);
+    }
+    return (r == YAPB_OK) ? run_flush(w) : r;
+}
+
+// Merge in passes of at most job->fanin runs each. Groups are consecutive
+// runs, so equal keys keep input order across passes. Intermediate passes
+// write each merged group back at its input offset in a second file and
+// the two files swap roles; the last pass writes the output. Open files
+// and heap size stay bounded however many runs there are.
+static YAPB_Result_t merge_runs(SortJob *job, uint8_t *wbuf, uint64_t *out_bytes,
+                                uint32_t *out_passes) {
+    uint32_t fanin = job->fanin;
+    MergeCursor *cur = calloc(fanin, sizeof(MergeCursor));
+    uint32_t *heap = malloc(fanin * sizeof(uint32_t));
+    YAPB_Result_t r = YAPB_OK;
+    if (cur == NULL || heap == NULL) {
+        r = YAPB_ERR_BUFFER_TOO_SMALL;
+        goto out;
+    }
+
+    int src_fd = job->run_fd;
+    int dst_fd = -1;
+    uint32_t n = job->nruns;
+    for (;;) {
+        bool last = (n <= fanin);
+        if (!last && dst_fd < 0) {
+            dst_fd = open_run_file(job->tmp_dir);
+            if (dst_fd < 0) {
+                r = YAPB_ERR_IO;
+                break;
+            }
+        }
+        void *addr = mmap(NULL, job->len, PROT_READ, MAP_SHARED, src_fd, 0);
+        if (addr == MAP_FAILED) {
+            r = YAPB_ERR_IO;
+            break;
+        }
+        madvise(addr, job->len, MADV_SEQUENTIAL);
+
+        // Merged groups replace their first run in place
+        uint32_t groups = 0;
+        for (uint32_t g = 0; g < n && r == YAPB_OK; g += fanin) {
+            uint32_t k = (n - g < fanin) ? n - g : fanin;
+            Run merged = { job->runs[g].off, 0, 0 };
+            for (uint32_t i = 0; i < k; i++) {
+                merged.len += job->runs[g + i].len;
+                merged.records += job->runs[g + i].records;
+            }
+            RunWriter w = { last ? job->out_fd : dst_fd, wbuf, job->wbuf_size, 0,
+                            last ? 0 : merged.off };
+            r = merge_group(addr, job->runs + g, k, job->key, cur, heap, &w);
+            if (last) {
+                *out_bytes = w.at;
+            }
+            job->runs[groups++] = merged;
+        }
+        munmap(addr, job->len);
+        (*out_passes)++;
+        if (last || r != YAPB_OK) break;
+
+        n = groups;
+        int t = src_fd; src_fd = dst_fd; dst_fd = t;
+    }
+    // One of the two is job->run_fd, closed by the caller
+    if (dst_fd >= 0 && dst_fd != job->run_fd) close(dst_fd);
+    if (src_fd != job->run_fd) close(src_fd);
+
+out:
+    free(cur);
+    free(heap);
+    return r;
+}
+
+YAPB_Result_t YAPB_sort_file(const char *in_path, const char *out_path, const YAPB_KeyPath_t *key,
+                             const YAPB_SortConfig_t *cfg, YAPB_SortStats_t *out_stats) {
+    if (in_path == NULL || out_path == NULL || key == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (key->depth == 0 || key->depth > YAPB_KEY_MAX_DEPTH) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    size_t budget = (cfg != NULL && cfg->mem_budget > 0) ? cfg->mem_budget : DEFAULT_BUDGET;
+    unsigned threads = (cfg != NULL && cfg->threads > 0) ? cfg->threads : 1;
+
+    // Per thread: a write buffer plus 24 bytes per record (entry + offset)
+    size_t share = budget / threads;
+    size_t wbuf = share / 8;
+    if (wbuf > MAX_WBUF) wbuf = MAX_WBUF;
+    if (wbuf < MIN_WBUF) wbuf = MIN_WBUF;
+    if (share <= wbuf || (share - wbuf) / (sizeof(SortEntry) + sizeof(uint64_t)) == 0) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+    size_t max_records = (share - wbuf) / (sizeof(SortEntry) + sizeof(uint64_t));
+    if (max_records > UINT32_MAX) max_records = UINT32_MAX;
+
+    // Run files default to the output's directory
+    char dir[PATH_MAX];
+    const char *tmp_dir = (cfg != NULL) ? cfg->tmp_dir : NULL;
+    if (tmp_dir == NULL) {
+        const char *slash = strrchr(out_path, '/');
+        if (slash == NULL) {
+            tmp_dir = ".";
+        } else if (slash == out_path) {
+            tmp_dir = "/";
+        } else {
+            size_t n = (size_t)(slash - out_path);
+            if (n >= sizeof(dir)) return YAPB_ERR_IO;
+            memcpy(dir, out_path, n);
+            dir[n] = '\0';
+            tmp_dir = dir;
+        }
+    }
+
+    // Truncating the output must not truncate the mapped input
+    struct stat in_st, out_st;
+    if (stat(in_path, &in_st) == 0 && stat(out_path, &out_st) == 0 &&
+        in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+
+    YAPB_LogMap_t map;
+    YAPB_Result_t r = YAPB_log_map(&map, in_path, 0);
+    if (r != YAPB_OK) return r;
+    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0) {
+        YAPB_log_unmap(&map);
+        return YAPB_ERR_IO;
+    }
+
+    SortJob job = { 0 };
+    job.data = YAPB_log_get_data(&map, &job.len);
+    if (cfg != NULL && cfg->in_len > 0) {
+        if (cfg->in_len > job.len) {
+            close(out_fd);
+            YAPB_log_unmap(&map);
+            return YAPB_ERR_INVALID_PACKET;
+        }
+        job.len = (size_t)cfg->in_len;
+    }
+    job.key = key;
+    job.tmp_dir = tmp_dir;
+    job.out_fd = out_fd;
+    job.max_records = max_records;
+    job.wbuf_size = wbuf;
+    job.fanin = (cfg != NULL && cfg->merge_fanin >= 2) ? cfg->merge_fanin : MERGE_FANIN;
+    job.run_fd = -1;
+    job.error = YAPB_OK;
+    pthread_mutex_init(&job.lock, NULL);
+
+    // Run generation: the caller is one of the workers
+    pthread_t *th = (threads > 1) ? malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+    SortWorker *ws = malloc(threads * sizeof(SortWorker));
+    bool numa = cfg != NULL && cfg->numa && YAPB_numa_node_count() > 1;
+    unsigned started = 0;
+    // The caller keeps its own placement; helpers go round-robin over nodes
+    for (unsigned i = 0; i < threads && ws != NULL; i++) {
+        ws[i].job = &job;
+        ws[i].node = (numa && i > 0) ? YAPB_numa_node_id(i % YAPB_numa_node_count()) : -1;
+    }
+    for (unsigned i = 1; i < threads && th != NULL && ws != NULL; i++) {
+        if (pthread_create(&th[started], NULL, sort_worker, &ws[i]) == 0) {
+            started++;
+        }
+    }
+    SortWorker self = { &job, -1 };
+    sort_worker(&self);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(th[i], NULL);
+    }
+    free(th);
+    free(ws);
+    r = job.error;
+
+    uint64_t records = 0;
+    for (uint32_t i = 0; i < job.nruns; i++) {
+        records += job.runs[i].records;
+    }
+    uint64_t bytes = job.out_bytes;
+    uint32_t nruns = job.nruns;
+    uint32_t passes = 0;
+    if (r == YAPB_OK && job.nruns > 1) {
+        uint8_t *buf = malloc(wbuf);
+        r = (buf != NULL) ? merge_runs(&job, buf, &bytes, &passes) : YAPB_ERR_BUFFER_TOO_SMALL;
+        free(buf);
+    }
+
+    if (job.run_fd >= 0) close(job.run_fd);
+    free(job.runs);
+    pthread_mutex_destroy(&job.lock);
+    if (close(out_fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    YAPB_log_unmap(&map);
+
+    if (r == YAPB_OK && out_stats != NULL) {
+        out_stats->records = records;
+        out_stats->bytes = bytes;
+        out_stats->runs = nruns;
+        out_stats->passes = passes;
+    }
+    return r;
+}
@@ -0,0 +1,514 @@
+#define _GNU_SOURCE
+#include "yapb_table.h"
+#include "yapb_internal.h"
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout (integers big-endian):
+//   header page: magic, key path, slot count, published data end, counters,
+//                clean-shutdown flag
+//   slots:       nslots x { u64 tag, u64 data offset }
+//   data:        packets back to back, from the first page after the slots
+#define TBL_MAGIC       "YAPBTBL1"
+#define HDR_PAGE        4096
+#define HDR_DEPTH       8
+#define HDR_PATH        10
+#define HDR_SLOTS       32
+#define HDR_USED        40
+#define HDR_COUNT       48
+#define HDR_TOMBS       56
+#define HDR_LIVE        64
+#define HDR_CLEAN       72
+#define SLOT_SIZE       16
+
+#define TAG_EMPTY       0
+#define TAG_TOMB        1
+
+#define DEFAULT_SLOTS       1024
+#define DEFAULT_DATA_BYTES  (1u << 20)
+
+typedef struct {
+    uint8_t *base;          // mapping of the whole file
+    size_t size;            // file size
+    uint64_t mask;          // slot count - 1
+    uint64_t data_start;    // file offset of the data region
+    char *path;             // copy, for rebuilds
+    int fd;
+    YAPB_KeyPath_t key;
+    bool sync;
+    bool read_only;
+    bool dirty;             // clean flag cleared in the file
+} _YAPB_Table_t;
+
+_Static_assert(sizeof(_YAPB_Table_t) <= YAPB_TABLE_SIZE,
+    "YAPB_TABLE_SIZE too small for _YAPB_Table_t");
+
+#define TB(x) ((_YAPB_Table_t *)(x))
+#define CTB(x) ((const _YAPB_Table_t *)(x))
+
+// Header and slot words are published with single aligned 8-byte stores
+static inline uint64_t ld64(const uint8_t *p) {
+    return be64toh(atomic_load_explicit((const _Atomic uint64_t *)p, memory_order_acquire));
+}
+
+static inline void st64(uint8_t *p, uint64_t v) {
+    atomic_store_explicit((_Atomic uint64_t *)p, htobe64(v), memory_order_release);
+}
+
+static inline uint64_t data_start_for(uint64_t nslots) {
+    return (HDR_PAGE + nslots * SLOT_SIZE + HDR_PAGE - 1) & ~(uint64_t)(HDR_PAGE - 1);
+}
+
+static inline uint64_t tag_of(uint64_t h) {
+    return (h < 2) ? h + 2 : h;
+}
+
+static inline uint8_t *slot_at(const _YAPB_Table_t *s, uint64_t i) {
+    return s->base + HDR_PAGE + i * SLOT_SIZE;
+}
+
+static inline uint64_t data_cap(const _YAPB_Table_t *s) {
+    return s->size - s->data_start;
+}
+
+// msync() the pages covering [off, off + len) when syncing is enabled
+static YAPB_Result_t flush_range(const _YAPB_Table_t *s, uint64_t off, uint64_t len) {
+    if (!s->sync || len == 0) {
+        return YAPB_OK;
+    }
+    uint64_t start = off & ~(uint64_t)(HDR_PAGE - 1);
+    return msync(s->base + start, off + len - start, MS_SYNC) == 0 ? YAPB_OK : YAPB_ERR_IO;
+}
+
+// Probe for a key: *found is its slot (or UINT64_MAX), *free_slot the first
+// empty or tombstone slot on the way
+static void probe(const _YAPB_Table_t *s, const YAPB_Key_t *key, uint64_t tag,
+                  uint64_t *found, uint64_t *free_slot) {
+    *found = UINT64_MAX;
+    *free_slot = UINT64_MAX;
+    for (uint64_t i = tag & s->mask, n = 0; n <= s->mask; i = (i + 1) & s->mask, n++) {
+        const uint8_t *slot = slot_at(s, i);
+        uint64_t t = ld64(slot);
+        if (t == TAG_EMPTY || t == TAG_TOMB) {
+            if (*free_slot == UINT64_MAX) *free_slot = i;
+            if (t == TAG_EMPTY) return;
+            continue;
+        }
+        if (t != tag) {
+            continue;
+        }
+        const uint8_t *pkt = s->base + s->data_start + ld64(slot + 8);
+        YAPB_Key_t k;
+        if (YAPB_key_extract(pkt, read_u32(pkt), &s->key, &k) == YAPB_OK &&
+            YAPB_key_compare(&k, key) == 0) {
+            *found = i;
+            return;
+        }
+    }
+}
+
+static YAPB_Result_t map_fd(int fd, uint8_t **base, size_t *size, bool read_only) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return YAPB_ERR_IO;
+    }
+    if ((size_t)st.st_size < HDR_PAGE) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    void *addr = mmap(NULL, (size_t)st.st_size, read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return YAPB_ERR_IO;
+    }
+    *base = addr;
+    *size = (size_t)st.st_size;
+    return YAPB_OK;
+}
+
+// Write a fresh table with the live packets of @p old (may be NULL) to a
+// temporary file and rename it over s->path. On success @p s uses the new
+// file.
+static YAPB_Result_t rebuild(_YAPB_Table_t *s, const _YAPB_Table_t *old, uint64_t nslots, uint64_t cap) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", s->path) >= (int)sizeof(tmp)) {
+        return YAPB_ERR_IO;
+    }
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        return YAPB_ERR_IO;
+    }
+    _YAPB_Table_t n = *s;
+    n.fd = fd;
+    n.mask = nslots - 1;
+    n.data_start = data_start_for(nslots);
+    YAPB_Result_t r = (ftruncate(fd, (off_t)(n.data_start + cap)) == 0) ? YAPB_OK : YAPB_ERR_IO;
+    if (r == YAPB_OK) {
+        r = map_fd(fd, &n.base, &n.size, false);
+    }
+    if (r != YAPB_OK) {
+        close(fd);
+        unlink(tmp);
+        return r;
+    }
+
+    uint8_t *hdr = n.base;
+    memcpy(hdr, TBL_MAGIC, 8);
+    write_u16(hdr + HDR_DEPTH, s->key.depth);
+    for (uint16_t d = 0; d < YAPB_KEY_MAX_DEPTH; d++) {
+        write_u16(hdr + HDR_PATH + 2 * d, s->key.index[d]);
+    }
+    st64(hdr + HDR_SLOTS, nslots);
+
+    uint64_t used = 0, count = 0;
+    for (uint64_t i = 0; old != NULL && i <= old->mask; i++) {
+        const uint8_t *slot = slot_at(old, i);
+        uint64_t tag = ld64(slot);
+        if (tag == TAG_EMPTY || tag == TAG_TOMB) {
+            continue;
+        }
+        const uint8_t *pkt = old->base + old->data_start + ld64(slot + 8);
+        uint32_t len = read_u32(pkt);
+        memcpy(n.base + n.data_start + used, pkt, len);
+        // Keys are unique: the first empty slot is the right one
+        uint64_t j = tag & n.mask;
+        while (ld64(slot_at(&n, j)) != TAG_EMPTY) {
+            j = (j + 1) & n.mask;
+        }
+        st64(slot_at(&n, j) + 8, used);
+        st64(slot_at(&n, j), tag);
+        used += len;
+        count++;
+    }
+    st64(hdr + HDR_USED, used);
+    st64(hdr + HDR_COUNT, count);
+    st64(hdr + HDR_TOMBS, 0);
+    st64(hdr + HDR_LIVE, used);
+    st64(hdr + HDR_CLEAN, old == NULL);
+
+    // The new file must be complete on disk before it replaces the old one
+    if (msync(n.base, n.size, MS_SYNC) != 0 || rename(tmp, s->path) != 0) {
+        munmap(n.base, n.size);
+        close(fd);
+        unlink(tmp);
+        return YAPB_ERR_IO;
+    }
+    if (old != NULL) {
+        munmap(old->base, old->size);
+        close(old->fd);
+    }
+    n.dirty = (old != NULL);
+    *s = n;
+    return YAPB_OK;
+}
+
+// Recompute the header counters after an unclean shutdown
+static void recount(_YAPB_Table_t *s) {
+    uint64_t count = 0, tombs = 0, live = 0;
+    for (uint64_t i = 0; i <= s->mask; i++) {
+        const uint8_t *slot = slot_at(s, i);
+        uint64_t tag = ld64(slot);
+        if (tag == TAG_TOMB) {
+            tombs++;
+        } else if (tag != TAG_EMPTY) {
+            count++;
+            live += read_u32(s->base + s->data_start + ld64(slot + 8));
+        }
+    }
+    st64(s->base + HDR_COUNT, count);
+    st64(s->base + HDR_TOMBS, tombs);
+    st64(s->base + HDR_LIVE, live);
+}
+
+static YAPB_Result_t check_header(const _YAPB_Table_t *s) {
+    const uint8_t *hdr = s->base;
+    if (memcmp(hdr, TBL_MAGIC, 8) != 0 || read_u16(hdr + HDR_DEPTH) != s->key.depth) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    for (uint16_t d = 0; d < s->key.depth; d++) {
+        if (read_u16(hdr + HDR_PATH + 2 * d) != s->key.index[d]) {
+            return YAPB_ERR_INVALID_PACKET;
+        }
+    }
+    uint64_t nslots = ld64(hdr + HDR_SLOTS);
+    if (nslots == 0 || (nslots & (nslots - 1)) != 0 || data_start_for(nslots) > s->size ||
+        ld64(hdr + HDR_USED) > s->size - data_start_for(nslots)) {
+        return YAPB_ERR_INVALID_PACKET;
+    }
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_table_open(YAPB_Table_t *t, const char *path, const YAPB_KeyPath_t *key,
+                              const YAPB_TableConfig_t *cfg) {
+    if (t == NULL || path == NULL || key == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    if (key->depth == 0 || key->depth > YAPB_KEY_MAX_DEPTH) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    static const YAPB_TableConfig_t defaults = { 0 };
+    if (cfg == NULL) {
+        cfg = &defaults;
+    }
+    _YAPB_Table_t *s = TB(t);
+    *s = (_YAPB_Table_t){ .fd = -1, .key = *key, .sync = cfg->sync, .read_only = cfg->read_only };
+    // Unused levels are stored as zero
+    for (uint16_t d = key->depth; d < YAPB_KEY_MAX_DEPTH; d++) {
+        s->key.index[d] = 0;
+    }
+    s->path = strdup(path);
+    if (s->path == NULL) {
+        return YAPB_ERR_BUFFER_TOO_SMALL;
+    }
+
+    YAPB_Result_t r;
+    int fd = open(path, (cfg->read_only ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT && !cfg->read_only) {
+        uint64_t nslots = 1;
+        while (nslots < (cfg->slots ? cfg->slots : DEFAULT_SLOTS)) {
+            nslots <<= 1;
+        }
+        r = rebuild(s, NULL, nslots, cfg->data_bytes ? cfg->data_bytes : DEFAULT_DATA_BYTES);
+        if (r != YAPB_OK) {
+            free(s->path);
+        }
+        return r;
+    }
+    if (fd < 0) {
+        free(s->path);
+        return YAPB_ERR_IO;
+    }
+
+    s->fd = fd;
+    r = map_fd(fd, &s->base, &s->size, cfg->read_only);
+    if (r == YAPB_OK) {
+        r = check_header(s);
+        if (r != YAPB_OK) {
+            munmap(s->base, s->size);
+        }
+    }
+    if (r != YAPB_OK) {
+        close(fd);
+        free(s->path);
+        return r;
+    }
+    s->mask = ld64(s->base + HDR_SLOTS) - 1;
+    s->data_start = data_start_for(s->mask + 1);
+    if (!s->read_only && ld64(s->base + HDR_CLEAN) == 0) {
+        recount(s);
+    }
+    return YAPB_OK;
+}
+
+// Clear the clean-shutdown flag before the first modification
+static YAPB_Result_t mark_dirty(_YAPB_Table_t *s) {
+    if (s->dirty) {
+        return YAPB_OK;
+    }
+    st64(s->base + HDR_CLEAN, 0);
+    s->dirty = true;
+    return flush_range(s, 0, HDR_PAGE);
+}
+
+// Make room for a packet of @p len bytes and, if @p new_key, one more slot
+static YAPB_Result_t reserve(_YAPB_Table_t *s, uint64_t len, bool new_key) {
+    const uint8_t *hdr = s->base;
+    uint64_t nslots = s->mask + 1, count = ld64(hdr + HDR_COUNT);
+    uint64_t used = ld64(hdr + HDR_USED), live = ld64(hdr + HDR_LIVE);
+    uint64_t cap = data_cap(s);
+
+    bool grow_slots = new_key && (count + ld64(hdr + HDR_TOMBS) + 1) * 4 > nslots * 3;
+    if (!grow_slots && used + len <= cap) {
+        return YAPB_OK;
+    }
+    if (grow_slots) {
+        // Mostly tombstones: rebuilding at the same size clears them
+        if ((count + 1) * 2 > nslots) {
+            nslots *= 2;
+        }
+        while (live + len > cap / 2) {
+            cap *= 2;
+        }
+        return rebuild(s, s, nslots, cap);
+    }
+    // Superseded packets take over half the data: drop them
+    if (live + len <= cap / 2) {
+        return rebuild(s, s, nslots, cap);
+    }
+
+    // Extend the data region in place
+    while (used + len > cap) {
+        cap *= 2;
+    }
+    size_t size = (size_t)(s->data_start + cap);
+    if (ftruncate(s->fd, (off_t)size) != 0) {
+        return YAPB_ERR_IO;
+    }
+    void *addr = mremap(s->base, s->size, size, MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED) {
+        return YAPB_ERR_IO;
+    }
+    s->base = addr;
+    s->size = size;
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_table_put(YAPB_Table_t *t, const YAPB_Packet_t *pkt) {
+    size_t len;
+    const uint8_t *data = YAPB_get_buffer(pkt, &len);
+    if (t == NULL || data == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Table_t *s = TB(t);
+    if (s->read_only) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    YAPB_Key_t key;
+    YAPB_Result_t r = YAPB_key_extract(data, len, &s->key, &key);
+    if (r != YAPB_OK) return r;
+    if (key.kind == YAPB_KEY_NONE) {
+        return YAPB_ERR_TYPE_MISMATCH;
+    }
+    r = mark_dirty(s);
+    if (r != YAPB_OK) return r;
+
+    uint64_t tag = tag_of(YAPB_key_hash(&key));
+    uint64_t found, free_slot;
+    probe(s, &key, tag, &found, &free_slot);
+    bool new_key = (found == UINT64_MAX);
+    r = reserve(s, len, new_key);
+    if (r != YAPB_OK) return r;
+    // Slots move when the table is rebuilt (the key points into @p data,
+    // not into the mapping)
+    probe(s, &key, tag, &found, &free_slot);
+
+    // 1. Packet bytes beyond the published end
+    uint8_t *hdr = s->base;
+    uint64_t off = ld64(hdr + HDR_USED);
+    memcpy(s->base + s->data_start + off, data, len);
+    r = flush_range(s, s->data_start + off, len);
+    if (r != YAPB_OK) return r;
+
+    // 2. Publish the new end of the data
+    st64(hdr + HDR_USED, off + len);
+    r = flush_range(s, 0, HDR_PAGE);
+    if (r != YAPB_OK) return r;
+
+    // 3. Point the slot at the packet: one store for an existing key; the
+    //    offset before the tag for a new one, so a torn slot reads as free
+    uint64_t live = ld64(hdr + HDR_LIVE) + len;
+    uint64_t slot_i = new_key ? free_slot : found;
+    uint8_t *slot = slot_at(s, slot_i);
+    if (new_key) {
+        bool reuse = (ld64(slot) == TAG_TOMB);
+        st64(slot + 8, off);
+        st64(slot, tag);
+        st64(hdr + HDR_COUNT, ld64(hdr + HDR_COUNT) + 1);
+        if (reuse) st64(hdr + HDR_TOMBS, ld64(hdr + HDR_TOMBS) - 1);
+    } else {
+        live -= read_u32(s->base + s->data_start + ld64(slot + 8));
+        st64(slot + 8, off);
+    }
+    st64(hdr + HDR_LIVE, live);
+    return flush_range(s, HDR_PAGE + slot_i * SLOT_SIZE, SLOT_SIZE);
+}
+
+YAPB_Result_t YAPB_table_get(const YAPB_Table_t *t, const YAPB_Key_t *key, YAPB_Packet_t *out_pkt) {
+    if (t == NULL || key == NULL || out_pkt == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Table_t *s = CTB(t);
+    uint64_t found, free_slot;
+    probe(s, key, tag_of(YAPB_key_hash(key)), &found, &free_slot);
+    if (found == UINT64_MAX) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    const uint8_t *pkt = s->base + s->data_start + ld64(slot_at(s, found) + 8);
+    return YAPB_load(out_pkt, pkt, read_u32(pkt));
+}
+
+YAPB_Result_t YAPB_table_remove(YAPB_Table_t *t, const YAPB_Key_t *key) {
+    if (t == NULL || key == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Table_t *s = TB(t);
+    if (s->read_only) {
+        return YAPB_ERR_INVALID_MODE;
+    }
+    uint64_t found, free_slot;
+    probe(s, key, tag_of(YAPB_key_hash(key)), &found, &free_slot);
+    if (found == UINT64_MAX) {
+        return YAPB_ERR_NOT_FOUND;
+    }
+    YAPB_Result_t r = mark_dirty(s);
+    if (r != YAPB_OK) return r;
+
+    uint8_t *hdr = s->base, *slot = slot_at(s, found);
+    uint32_t len = read_u32(s->base + s->data_start + ld64(slot + 8));
+    st64(slot, TAG_TOMB);
+    st64(hdr + HDR_COUNT, ld64(hdr + HDR_COUNT) - 1);
+    st64(hdr + HDR_TOMBS, ld64(hdr + HDR_TOMBS) + 1);
+    st64(hdr + HDR_LIVE, ld64(hdr + HDR_LIVE) - len);
+    return flush_range(s, HDR_PAGE + found * SLOT_SIZE, SLOT_SIZE);
+}
+
+YAPB_Result_t YAPB_table_get_stats(const YAPB_Table_t *t, YAPB_TableStats_t *out) {
+    if (t == NULL || out == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    const _YAPB_Table_t *s = CTB(t);
+    const uint8_t *hdr = s->base;
+    *out = (YAPB_TableStats_t){
+        .count = ld64(hdr + HDR_COUNT),
+        .slots = s->mask + 1,
+        .data_used = ld64(hdr + HDR_USED),
+        .data_live = ld64(hdr + HDR_LIVE),
+        .data_bytes = data_cap(s),
+    };
+    return YAPB_OK;
+}
+
+YAPB_Result_t YAPB_table_sync(YAPB_Table_t *t) {
+    if (t == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Table_t *s = TB(t);
+    if (s->read_only) {
+        return YAPB_OK;
+    }
+    return msync(s->base, s->size, MS_SYNC) == 0 ? YAPB_OK : YAPB_ERR_IO;
+}
+
+YAPB_Result_t YAPB_table_close(YAPB_Table_t *t) {
+    if (t == NULL) {
+        return YAPB_ERR_NULL_PTR;
+    }
+    _YAPB_Table_t *s = TB(t);
+    YAPB_Result_t r = YAPB_OK;
+    if (s->dirty) {
+        // Everything else reaches the disk before the clean flag
+        r = YAPB_table_sync(t);
+        if (r == YAPB_OK) {
+            st64(s->base + HDR_CLEAN, 1);
+            if (msync(s->base, HDR_PAGE, MS_SYNC) != 0) r = YAPB_ERR_IO;
+        }
+    }
+    if (munmap(s->base, s->size) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    if (close(s->fd) != 0 && r == YAPB_OK) {
+        r = YAPB_ERR_IO;
+    }
+    free(s->path);
+    s->path = NULL;
+    s->base = NULL;
+    s->fd = -1;
+    return r;
+}
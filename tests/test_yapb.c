@@ -119,6 +119,159 @@ static MunitResult test_i64_roundtrip(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+/* ======== Timestamps ======== */
+
+static MunitResult test_timestamp_roundtrip(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[256];
+    YAPB_Packet_t pkt;
+    size_t len;
+
+    /* Plain timestamps are always absolute; delta ones are relative to the
+       first timestamp, which is absolute */
+    const int64_t base = 1760000000123456789LL;
+    const int64_t ts[] = { base, base + 1000, base - 5, base + 10000000000LL, INT64_MIN };
+    const size_t span[] = { 9, 3, 2, 6, 11 };
+    for (size_t i = 1; i < 5; i++) {
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_timestamp(&pkt, &ts[0]);
+        munit_assert_int(YAPB_push_timestamp(&pkt, &ts[i]), ==, YAPB_OK);
+        YAPB_finalize(&pkt, &len);
+        munit_assert_size(len, ==, YAPB_HEADER_SIZE + 9 + 9);
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_timestamp_delta(&pkt, &ts[0]);
+        munit_assert_int(YAPB_push_timestamp_delta(&pkt, &ts[i]), ==, YAPB_OK);
+        YAPB_finalize(&pkt, &len);
+        munit_assert_size(len, ==, YAPB_HEADER_SIZE + span[0] + span[i]);
+        munit_assert_uint8(buf[YAPB_HEADER_SIZE + span[0]], ==, YAPB_TIMESTAMP_DELTA);
+    }
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    for (size_t i = 0; i < 5; i++) {
+        YAPB_push_timestamp_delta(&pkt, &ts[i]);
+    }
+    struct timespec tv = { .tv_sec = -2, .tv_nsec = 250 };
+    YAPB_push_timespec(&pkt, &tv);
+    YAPB_finalize(&pkt, &len);
+    munit_assert_size(len, ==, YAPB_HEADER_SIZE + 9 + 3 + 2 + 6 + 11 + 9);
+
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, buf, len);
+    uint16_t count;
+    munit_assert_int(YAPB_get_elem_count(&rpkt, &count), ==, YAPB_OK);
+    munit_assert_uint16(count, ==, 6);
+    int64_t out = 0, i64;
+    munit_assert_int(YAPB_pop_timestamp(&rpkt, &out), ==, YAPB_OK);
+    munit_assert_int64(out, ==, ts[0]);
+    YAPB_Element_t elem;
+    munit_assert_int(YAPB_pop_next(&rpkt, &elem), ==, YAPB_OK);
+    munit_assert_int(elem.type, ==, YAPB_TIMESTAMP);
+    munit_assert_int64(elem.val.i64, ==, ts[1]);
+    for (size_t i = 2; i < 5; i++) {
+        munit_assert_int(YAPB_pop_timestamp(&rpkt, &out), ==, YAPB_OK);
+        munit_assert_int64(out, ==, ts[i]);
+    }
+    struct timespec tv_out;
+    munit_assert_int(YAPB_pop_timespec(&rpkt, &tv_out), ==, YAPB_STS_COMPLETE);
+    munit_assert_int64(tv_out.tv_sec, ==, -2);
+    munit_assert_long(tv_out.tv_nsec, ==, 250);
+
+    /* Timestamps are not integers */
+    YAPB_load(&rpkt, buf, len);
+    munit_assert_int(YAPB_pop_i64(&rpkt, &i64), ==, YAPB_ERR_TYPE_MISMATCH);
+    YAPB_load(&rpkt, buf, len);
+    YAPB_pop_timestamp(&rpkt, &out);
+    munit_assert_int(YAPB_pop_i64(&rpkt, &i64), ==, YAPB_ERR_TYPE_MISMATCH);
+
+    /* Negative nanoseconds round down to the second */
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    const int64_t neg = -1500000000LL;
+    YAPB_push_timestamp(&pkt, &neg);
+    YAPB_finalize(&pkt, &len);
+    YAPB_load(&rpkt, buf, len);
+    munit_assert_int(YAPB_pop_timespec(&rpkt, &tv_out), ==, YAPB_STS_COMPLETE);
+    munit_assert_int64(tv_out.tv_sec, ==, -2);
+    munit_assert_long(tv_out.tv_nsec, ==, 500000000);
+
+    /* Out of the int64_t nanosecond range or not normalized: refused, but
+       the packet stays usable */
+    const struct timespec bad_tv[] = {
+        { .tv_sec = INT64_MAX / 1000000000 + 1 },
+        { .tv_sec = INT64_MAX / 1000000000, .tv_nsec = 999999999 },
+        { .tv_sec = -(INT64_MAX / 1000000000) - 1 },
+        { .tv_sec = 1, .tv_nsec = 1000000000 },
+        { .tv_sec = 1, .tv_nsec = -1 },
+    };
+    for (size_t i = 0; i < sizeof(bad_tv) / sizeof(bad_tv[0]); i++) {
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        munit_assert_int(YAPB_push_timespec(&pkt, &bad_tv[i]), ==, YAPB_ERR_OUT_OF_RANGE);
+        munit_assert_int(YAPB_get_error(&pkt), ==, YAPB_OK);
+        munit_assert_int(YAPB_push_timestamp(&pkt, &neg), ==, YAPB_OK);
+        munit_assert_int(YAPB_finalize(&pkt, &len), ==, YAPB_OK);
+        munit_assert_size(len, ==, YAPB_HEADER_SIZE + 9);
+    }
+    const struct timespec edge = { .tv_sec = INT64_MAX / 1000000000, .tv_nsec = INT64_MAX % 1000000000 };
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    munit_assert_int(YAPB_push_timespec(&pkt, &edge), ==, YAPB_OK);
+    YAPB_finalize(&pkt, &len);
+    YAPB_load(&rpkt, buf, len);
+    munit_assert_int(YAPB_pop_timestamp(&rpkt, &out), ==, YAPB_STS_COMPLETE);
+    munit_assert_int64(out, ==, INT64_MAX);
+
+    munit_assert_int(YAPB_push_timestamp(NULL, &neg), ==, YAPB_ERR_NULL_PTR);
+    munit_assert_int(YAPB_push_timestamp_delta(NULL, &neg), ==, YAPB_ERR_NULL_PTR);
+    munit_assert_int(YAPB_pop_timestamp(&rpkt, NULL), ==, YAPB_ERR_NULL_PTR);
+    return MUNIT_OK;
+}
+
+static MunitResult test_timestamp_malformed(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Packet_t pkt;
+    YAPB_Element_t elem;
+    uint16_t count;
+    int64_t out;
+
+    /* A delta needs an earlier absolute timestamp, but is still well formed */
+    const uint8_t no_base[] = { 0, 0, 0, 6, YAPB_TIMESTAMP_DELTA, 2 };
+    YAPB_load(&pkt, no_base, sizeof(no_base));
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_OK);
+    munit_assert_uint16(count, ==, 1);
+    munit_assert_int(YAPB_pop_timestamp(&pkt, &out), ==, YAPB_ERR_INVALID_PACKET);
+    YAPB_load(&pkt, no_base, sizeof(no_base));
+    munit_assert_int(YAPB_pop_next(&pkt, &elem), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* Truncated, overlong and overflowing varints */
+    const uint8_t truncated[] = { 0, 0, 0, 15, YAPB_TIMESTAMP, 0, 0, 0, 0, 0, 0, 0, 1,
+                                  YAPB_TIMESTAMP_DELTA, 0x80 };
+    const uint8_t overlong[] = { 0, 0, 0, 25, YAPB_TIMESTAMP, 0, 0, 0, 0, 0, 0, 0, 1,
+                                 YAPB_TIMESTAMP_DELTA, 0x80, 0x80, 0x80, 0x80, 0x80,
+                                 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    const uint8_t overflow[] = { 0, 0, 0, 24, YAPB_TIMESTAMP, 0, 0, 0, 0, 0, 0, 0, 1,
+                                 YAPB_TIMESTAMP_DELTA, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                 0xFF, 0xFF, 0xFF, 0xFF, 0x02 };
+    const uint8_t *bad[] = { truncated, overlong, overflow };
+    const size_t bad_len[] = { sizeof(truncated), sizeof(overlong), sizeof(overflow) };
+    for (size_t i = 0; i < 3; i++) {
+        YAPB_load(&pkt, bad[i], bad_len[i]);
+        munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_ERR_INVALID_PACKET);
+        YAPB_load(&pkt, bad[i], bad_len[i]);
+        YAPB_pop_timestamp(&pkt, &out);
+        munit_assert_int(YAPB_pop_timestamp(&pkt, &out), ==, YAPB_ERR_INVALID_PACKET);
+        YAPB_load(&pkt, bad[i], bad_len[i]);
+        YAPB_pop_next(&pkt, &elem);
+        munit_assert_int(YAPB_pop_next(&pkt, &elem), ==, YAPB_ERR_INVALID_PACKET);
+    }
+
+    /* The largest valid varint: 10 bytes, the last one 1 */
+    const uint8_t widest[] = { 0, 0, 0, 24, YAPB_TIMESTAMP, 0, 0, 0, 0, 0, 0, 0, 0,
+                               YAPB_TIMESTAMP_DELTA, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                               0xFF, 0xFF, 0xFF, 0xFF, 0x01 };
+    YAPB_load(&pkt, widest, sizeof(widest));
+    YAPB_pop_timestamp(&pkt, &out);
+    munit_assert_int(YAPB_pop_timestamp(&pkt, &out), ==, YAPB_STS_COMPLETE);
+    munit_assert_int64(out, ==, INT64_MIN);
+    return MUNIT_OK;
+}
+
 /* ======== Push / Pop unsigned ======== */
 
 static MunitResult test_u16_roundtrip(const MunitParameter params[], void *data) {
@@ -319,6 +472,32 @@ static MunitResult test_elem_count(const MunitParameter params[], void *data) {
     return MUNIT_OK;
 }
 
+static MunitResult test_abi(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    munit_assert_uint(YAPB_abi_version(), ==, YAPB_ABI_VERSION);
+    munit_assert_size(sizeof(YAPB_Packet_t), ==, YAPB_PACKET_SIZE);
+#ifndef YAPB_COMPAT_HANDLES
+    munit_assert_size(sizeof(YAPB_Element_t), <=, 32);
+#endif
+
+    /* Handles in an array stay independent */
+    uint8_t bufs[4][16];
+    YAPB_Packet_t pkts[4];
+    for (int i = 0; i < 4; i++) {
+        int8_t v = (int8_t)i;
+        YAPB_initialize(&pkts[i], bufs[i], sizeof(bufs[i]));
+        YAPB_push_i8(&pkts[i], &v);
+    }
+    munit_assert_int(YAPB_pop_i8(&pkts[1], &(int8_t){0}), ==, YAPB_ERR_INVALID_MODE);
+    for (int i = 0; i < 4; i++) {
+        size_t len;
+        munit_assert_int(YAPB_finalize(&pkts[i], &len), ==, YAPB_OK);
+        munit_assert_size(len, ==, YAPB_HEADER_SIZE + 2);
+        munit_assert_int(YAPB_get_error(&pkts[i]), ==, i == 1 ? YAPB_ERR_INVALID_MODE : YAPB_OK);
+    }
+    return MUNIT_OK;
+}
+
 /* ======== Sticky errors ======== */
 
 static MunitResult test_sticky_error(const MunitParameter params[], void *data) {
@@ -415,6 +594,7 @@ static MunitResult test_result_str(const MunitParameter params[], void *data) {
     munit_assert_string_equal(YAPB_Result_str(YAPB_OK), "OK");
     munit_assert_string_equal(YAPB_Result_str(YAPB_STS_COMPLETE), "Complete");
     munit_assert_string_equal(YAPB_Result_str(YAPB_ERR_NULL_PTR), "Null pointer");
+    munit_assert_string_equal(YAPB_Result_str(YAPB_ERR_OUT_OF_RANGE), "Out of range");
     return MUNIT_OK;
 }
 
@@ -546,6 +726,115 @@ static MunitResult test_pop_next_empty(const MunitParameter params[], void *data
     return MUNIT_OK;
 }
 
+/* Each case is one malformed element after the header */
+static YAPB_Result_t pop_next_bytes(const uint8_t *bytes, size_t len, YAPB_Element_t *elem) {
+    YAPB_Packet_t pkt;
+    munit_assert_int(YAPB_load(&pkt, bytes, len), ==, YAPB_OK);
+    YAPB_Result_t r = YAPB_pop_next(&pkt, elem);
+    /* Errors are sticky */
+    if (r < 0) munit_assert_int(YAPB_pop_next(&pkt, elem), ==, r);
+    return r;
+}
+
+static MunitResult test_pop_next_malformed(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Element_t elem;
+    YAPB_Packet_t pkt;
+    uint16_t count;
+
+    const uint8_t short_i32[] = { 0, 0, 0, 6, YAPB_INT32, 1 };
+    munit_assert_int(pop_next_bytes(short_i32, sizeof(short_i32), &elem), ==, YAPB_ERR_INVALID_PACKET);
+    YAPB_load(&pkt, short_i32, sizeof(short_i32));
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_ERR_INVALID_PACKET);
+
+    const uint8_t short_blob_len[] = { 0, 0, 0, 6, YAPB_BLOB, 0 };
+    munit_assert_int(pop_next_bytes(short_blob_len, sizeof(short_blob_len), &elem), ==, YAPB_ERR_INVALID_PACKET);
+    YAPB_load(&pkt, short_blob_len, sizeof(short_blob_len));
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_ERR_INVALID_PACKET);
+
+    const uint8_t long_blob[] = { 0, 0, 0, 8, YAPB_BLOB, 0, 5, 1 };
+    munit_assert_int(pop_next_bytes(long_blob, sizeof(long_blob), &elem), ==, YAPB_ERR_INVALID_PACKET);
+    YAPB_load(&pkt, long_blob, sizeof(long_blob));
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_ERR_INVALID_PACKET);
+
+    const uint8_t short_nested_len[] = { 0, 0, 0, 7, YAPB_NESTED_PKT, 0, 0 };
+    munit_assert_int(pop_next_bytes(short_nested_len, sizeof(short_nested_len), &elem), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* Nested length below its own header size */
+    const uint8_t runt_nested[] = { 0, 0, 0, 9, YAPB_NESTED_PKT, 0, 0, 0, 2 };
+    munit_assert_int(pop_next_bytes(runt_nested, sizeof(runt_nested), &elem), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+
+    /* Nested header claiming more than its element */
+    const uint8_t bad_nested[] = { 0, 0, 0, 10, YAPB_NESTED_PKT, 0, 0, 0, 5, YAPB_INT8 };
+    munit_assert_int(pop_next_bytes(bad_nested, sizeof(bad_nested), &elem), ==, YAPB_STS_COMPLETE);
+    const uint8_t bad_inner[] = { 0, 0, 0, 10, YAPB_NESTED_PKT, 0, 0, 0, 6, YAPB_INT8 };
+    munit_assert_int(pop_next_bytes(bad_inner, sizeof(bad_inner), &elem), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* References must point back at a nested packet that ends before them */
+    const uint8_t ref_ok[] = { 0, 0, 0, 20, YAPB_NESTED_PKT, 0, 0, 0, 6, YAPB_INT8, 7,
+                               YAPB_INT8, 1, YAPB_NESTED_REF, 0, 0, 0, 4, YAPB_INT8, 9 };
+    YAPB_Packet_t nested;
+    int8_t v = 0;
+    YAPB_load(&pkt, ref_ok, sizeof(ref_ok));
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_OK);
+    munit_assert_uint16(count, ==, 4);
+    YAPB_pop_next(&pkt, &elem);
+    YAPB_pop_next(&pkt, &elem);
+    munit_assert_int(YAPB_pop_next(&pkt, &elem), ==, YAPB_OK);
+    munit_assert_int(elem.type, ==, YAPB_NESTED_PKT);
+    munit_assert_int(YAPB_pop_i8(&elem.val.nested, &v), ==, YAPB_STS_COMPLETE);
+    munit_assert_int(v, ==, 7);
+    YAPB_load(&pkt, ref_ok, sizeof(ref_ok));
+    YAPB_pop_nested(&pkt, &nested);
+    YAPB_pop_i8(&pkt, &v);
+    munit_assert_int(YAPB_pop_nested(&pkt, &nested), ==, YAPB_OK);
+    munit_assert_ptr_equal(YAPB_get_buffer(&nested, NULL), ref_ok + 5);
+
+    const uint8_t bad_refs[][5] = {
+        { YAPB_NESTED_REF, 0, 0, 0, 0 },   /* into the header */
+        { YAPB_NESTED_REF, 0, 0, 0, 11 },  /* not a nested packet */
+        { YAPB_NESTED_REF, 0, 0, 0, 13 },  /* itself */
+        { YAPB_NESTED_REF, 0, 0, 0, 99 },  /* past the end */
+    };
+    for (size_t i = 0; i < sizeof(bad_refs) / sizeof(bad_refs[0]); i++) {
+        uint8_t bad[sizeof(ref_ok)];
+        memcpy(bad, ref_ok, sizeof(bad));
+        memcpy(bad + 13, bad_refs[i], 5);
+        YAPB_load(&pkt, bad, sizeof(bad));
+        YAPB_pop_next(&pkt, &elem);
+        YAPB_pop_next(&pkt, &elem);
+        munit_assert_int(YAPB_pop_next(&pkt, &elem), ==, YAPB_ERR_INVALID_PACKET);
+        YAPB_load(&pkt, bad, sizeof(bad));
+        YAPB_pop_nested(&pkt, &nested);
+        YAPB_pop_i8(&pkt, &v);
+        munit_assert_int(YAPB_pop_nested(&pkt, &nested), ==, YAPB_ERR_INVALID_PACKET);
+    }
+    /* A target that runs past the reference (here, bytes inside a blob) */
+    const uint8_t ref_overlap[] = { 0, 0, 0, 17, YAPB_BLOB, 0, 5, YAPB_NESTED_PKT, 0, 0, 0, 20,
+                                    YAPB_NESTED_REF, 0, 0, 0, 7 };
+    const uint8_t *blob;
+    uint16_t blob_len;
+    YAPB_load(&pkt, ref_overlap, sizeof(ref_overlap));
+    YAPB_pop_blob(&pkt, &blob, &blob_len);
+    munit_assert_int(YAPB_pop_next(&pkt, &elem), ==, YAPB_ERR_INVALID_PACKET);
+
+    for (unsigned tag = YAPB_TIMESTAMP_DELTA + 1; tag < 256; tag++) {
+        if (tag == YAPB_NESTED_REF || tag == YAPB_BLOB || tag == YAPB_NESTED_PKT) continue;
+        const uint8_t unknown[] = { 0, 0, 0, 14, (uint8_t)tag, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        munit_assert_int(pop_next_bytes(unknown, sizeof(unknown), &elem), ==, YAPB_ERR_INVALID_PACKET);
+        YAPB_load(&pkt, unknown, sizeof(unknown));
+        munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_ERR_INVALID_PACKET);
+    }
+
+    /* Read mode only */
+    uint8_t buf[16];
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    munit_assert_int(YAPB_pop_next(&pkt, &elem), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_pop_next(NULL, &elem), ==, YAPB_ERR_NULL_PTR);
+    return MUNIT_OK;
+}
+
 /* ======== Corpus files ======== */
 
 static MunitResult test_corpus_bins(const MunitParameter params[], void *data) {
@@ -601,6 +890,7 @@ static MunitTest tests[] = {
     { "/roundtrip/i16",      test_i16_roundtrip,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/roundtrip/i32",      test_i32_roundtrip,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/roundtrip/i64",      test_i64_roundtrip,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/roundtrip/timestamp", test_timestamp_roundtrip, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/roundtrip/u16",      test_u16_roundtrip,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/roundtrip/float",    test_float_roundtrip,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/roundtrip/double",   test_double_roundtrip,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
@@ -609,6 +899,7 @@ static MunitTest tests[] = {
     { "/roundtrip/nested",   test_nested_roundtrip,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/roundtrip/multi",    test_multi_element,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/query/elem_count",   test_elem_count,         NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/query/abi",          test_abi,                NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/error/sticky",       test_sticky_error,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/error/type_mismatch", test_type_mismatch,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/error/push_read",    test_push_in_read_mode,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
@@ -619,6 +910,8 @@ static MunitTest tests[] = {
     { "/compat/forward",     test_forward_compat,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/pop_next/all_types", test_pop_next_all_types, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/pop_next/empty",     test_pop_next_empty,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/pop_next/malformed", test_pop_next_malformed, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/timestamp/malformed", test_timestamp_malformed, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { "/corpus/bins",        test_corpus_bins,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
@@ -0,0 +1,421 @@
+#include "munit.h"
+#include "yapb_batch.h"
+#include <string.h>
+
+/* ======== Batch writer ======== */
+
+static MunitResult test_batch_back_to_back(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[256];
+    YAPB_Batch_t batch;
+    YAPB_Packet_t pkt;
+
+    munit_assert_int(YAPB_batch_init(&batch, buf, sizeof(buf)), ==, YAPB_OK);
+
+    for (int32_t i = 0; i < 3; i++) {
+        munit_assert_int(YAPB_batch_begin(&batch, &pkt), ==, YAPB_OK);
+        YAPB_push_i32(&pkt, &i);
+        munit_assert_int(YAPB_batch_commit(&batch, &pkt), ==, YAPB_OK);
+    }
+
+    size_t len, count;
+    const uint8_t *out = YAPB_batch_get_buffer(&batch, &len);
+    munit_assert_ptr_equal(out, buf);
+    munit_assert_size(len, ==, 3 * (YAPB_HEADER_SIZE + 5));
+    munit_assert_int(YAPB_batch_get_count(&batch, &count), ==, YAPB_OK);
+    munit_assert_size(count, ==, 3);
+
+    /* Walk the packets back out of the contiguous range */
+    size_t off = 0;
+    for (int32_t i = 0; i < 3; i++) {
+        YAPB_Packet_t rpkt;
+        munit_assert_int(YAPB_load(&rpkt, out + off, len - off), ==, YAPB_OK);
+        int32_t v = -1;
+        munit_assert_int(YAPB_pop_i32(&rpkt, &v), ==, YAPB_STS_COMPLETE);
+        munit_assert_int32(v, ==, i);
+        size_t plen;
+        YAPB_get_buffer(&rpkt, &plen);
+        off += plen;
+    }
+    munit_assert_size(off, ==, len);
+    return MUNIT_OK;
+}
+
+static MunitResult test_batch_prefinalized(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[64];
+    YAPB_Batch_t batch;
+    YAPB_Packet_t pkt;
+
+    YAPB_batch_init(&batch, buf, sizeof(buf));
+    YAPB_batch_begin(&batch, &pkt);
+    int8_t v = 7;
+    YAPB_push_i8(&pkt, &v);
+    size_t plen;
+    YAPB_finalize(&pkt, &plen);
+    munit_assert_int(YAPB_batch_commit(&batch, &pkt), ==, YAPB_OK);
+
+    size_t len;
+    YAPB_batch_get_buffer(&batch, &len);
+    munit_assert_size(len, ==, plen);
+    return MUNIT_OK;
+}
+
+static MunitResult test_batch_overflow(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[24];
+    YAPB_Batch_t batch;
+    YAPB_Packet_t pkt;
+
+    YAPB_batch_init(&batch, buf, sizeof(buf));
+    YAPB_batch_begin(&batch, &pkt);
+    int64_t v = 1;
+    YAPB_push_i64(&pkt, &v);
+    munit_assert_int(YAPB_batch_commit(&batch, &pkt), ==, YAPB_OK);
+
+    /* Second packet does not fit; it is dropped, batch stays intact */
+    YAPB_batch_begin(&batch, &pkt);
+    munit_assert_int(YAPB_push_i64(&pkt, &v), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_int(YAPB_batch_commit(&batch, &pkt), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+
+    size_t len, count;
+    YAPB_batch_get_buffer(&batch, &len);
+    YAPB_batch_get_count(&batch, &count);
+    munit_assert_size(len, ==, YAPB_HEADER_SIZE + 9);
+    munit_assert_size(count, ==, 1);
+
+    /* Reset drops all committed packets */
+    YAPB_batch_reset(&batch);
+    YAPB_batch_get_buffer(&batch, &len);
+    munit_assert_size(len, ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult test_batch_modes(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[64];
+    uint8_t other[64];
+    YAPB_Batch_t batch;
+    YAPB_Packet_t pkt, foreign;
+
+    YAPB_batch_init(&batch, buf, sizeof(buf));
+    munit_assert_int(YAPB_batch_commit(&batch, &pkt), ==, YAPB_ERR_INVALID_MODE);
+
+    YAPB_batch_begin(&batch, &pkt);
+    munit_assert_int(YAPB_batch_begin(&batch, &pkt), ==, YAPB_ERR_INVALID_MODE);
+
+    /* A packet built outside the batch cannot be committed in place */
+    YAPB_initialize(&foreign, other, sizeof(other));
+    munit_assert_int(YAPB_batch_commit(&batch, &foreign), ==, YAPB_ERR_INVALID_MODE);
+
+    /* ... but it can be appended by copy */
+    YAPB_finalize(&foreign, NULL);
+    munit_assert_int(YAPB_batch_append(&batch, &foreign), ==, YAPB_OK);
+
+    size_t count;
+    YAPB_batch_get_count(&batch, &count);
+    munit_assert_size(count, ==, 1);
+
+    munit_assert_int(YAPB_batch_begin(&batch, &pkt), ==, YAPB_OK);
+    munit_assert_int(YAPB_batch_append(&batch, &foreign), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_batch_abort(&batch), ==, YAPB_OK);
+    munit_assert_int(YAPB_batch_append(&batch, &foreign), ==, YAPB_OK);
+    return MUNIT_OK;
+}
+
+static MunitResult test_batch_null(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[8];
+    YAPB_Batch_t batch;
+
+    munit_assert_int(YAPB_batch_init(NULL, buf, sizeof(buf)), ==, YAPB_ERR_NULL_PTR);
+    munit_assert_int(YAPB_batch_init(&batch, NULL, sizeof(buf)), ==, YAPB_ERR_NULL_PTR);
+    munit_assert_int(YAPB_batch_init(&batch, buf, 2), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_null(YAPB_batch_get_buffer(NULL, NULL));
+    return MUNIT_OK;
+}
+
+/* ======== Coalescing writer ======== */
+
+typedef struct {
+    int calls;
+    size_t last_len;
+    size_t last_count;
+    YAPB_Result_t ret;
+} flush_log_t;
+
+static YAPB_Result_t record_flush(void *ctx, const uint8_t *data, size_t len, size_t count) {
+    flush_log_t *log = ctx;
+    munit_assert_not_null(data);
+    if (log->ret < 0) return log->ret;
+    log->calls++;
+    log->last_len = len;
+    log->last_count = count;
+    return YAPB_OK;
+}
+
+static void push_one(YAPB_Coalescer_t *c, int32_t v, uint64_t now) {
+    YAPB_Packet_t pkt;
+    munit_assert_int(YAPB_coalesce_begin(c, &pkt, now), ==, YAPB_OK);
+    YAPB_push_i32(&pkt, &v);
+    munit_assert_int(YAPB_coalesce_commit(c, &pkt, now), ==, YAPB_OK);
+}
+
+static MunitResult test_coalesce_count(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[256];
+    YAPB_Coalescer_t c;
+    flush_log_t log = {0};
+    YAPB_CoalesceConfig_t cfg = { .max_packets = 4 };
+
+    munit_assert_int(YAPB_coalesce_init(&c, buf, sizeof(buf), &cfg, record_flush, &log), ==, YAPB_OK);
+    for (int32_t i = 0; i < 10; i++) {
+        push_one(&c, i, 0);
+    }
+    munit_assert_int(log.calls, ==, 2);
+    munit_assert_size(log.last_count, ==, 4);
+
+    munit_assert_int(YAPB_coalesce_flush(&c), ==, YAPB_OK);
+    munit_assert_int(log.calls, ==, 3);
+    munit_assert_size(log.last_count, ==, 2);
+
+    YAPB_CoalesceStats_t st;
+    YAPB_coalesce_get_stats(&c, &st);
+    munit_assert_uint64(st.flushes[YAPB_FLUSH_COUNT], ==, 2);
+    munit_assert_uint64(st.flushes[YAPB_FLUSH_EXPLICIT], ==, 1);
+    munit_assert_uint64(st.packets, ==, 10);
+    munit_assert_uint64(st.bytes, ==, 10 * (YAPB_HEADER_SIZE + 5));
+    munit_assert_uint64(st.max_batch_packets, ==, 4);
+    munit_assert_uint64(st.batch_hist[1], ==, 1);  /* batch of 2 */
+    munit_assert_uint64(st.batch_hist[2], ==, 2);  /* batches of 4 */
+    return MUNIT_OK;
+}
+
+static MunitResult test_coalesce_size(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[256];
+    YAPB_Coalescer_t c;
+    flush_log_t log = {0};
+    YAPB_CoalesceConfig_t cfg = { .max_bytes = 18 };
+
+    YAPB_coalesce_init(&c, buf, sizeof(buf), &cfg, record_flush, &log);
+    push_one(&c, 1, 0);
+    munit_assert_int(log.calls, ==, 0);
+    push_one(&c, 2, 0);
+    munit_assert_int(log.calls, ==, 1);
+    munit_assert_size(log.last_len, ==, 2 * (YAPB_HEADER_SIZE + 5));
+
+    YAPB_CoalesceStats_t st;
+    YAPB_coalesce_get_stats(&c, &st);
+    munit_assert_uint64(st.flushes[YAPB_FLUSH_SIZE], ==, 1);
+    return MUNIT_OK;
+}
+
+static MunitResult test_coalesce_deadline(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[256];
+    YAPB_Coalescer_t c;
+    flush_log_t log = {0};
+    YAPB_CoalesceConfig_t cfg = { .max_delay_us = 100 };
+    uint64_t deadline;
+
+    YAPB_coalesce_init(&c, buf, sizeof(buf), &cfg, record_flush, &log);
+    YAPB_coalesce_get_deadline(&c, &deadline);
+    munit_assert_uint64(deadline, ==, UINT64_MAX);
+
+    push_one(&c, 1, 1000);
+    push_one(&c, 2, 1050);
+    YAPB_coalesce_get_deadline(&c, &deadline);
+    munit_assert_uint64(deadline, ==, 1100);
+
+    munit_assert_int(YAPB_coalesce_poll(&c, 1099), ==, YAPB_OK);
+    munit_assert_int(log.calls, ==, 0);
+
+    /* A packet under construction holds the flush back until commit */
+    YAPB_Packet_t pkt;
+    YAPB_coalesce_begin(&c, &pkt, 1099);
+    munit_assert_int(YAPB_coalesce_poll(&c, 1200), ==, YAPB_OK);
+    munit_assert_int(log.calls, ==, 0);
+    munit_assert_int(YAPB_coalesce_flush(&c), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_coalesce_commit(&c, &pkt, 1200), ==, YAPB_OK);
+    munit_assert_int(log.calls, ==, 1);
+    munit_assert_size(log.last_count, ==, 3);
+
+    YAPB_coalesce_get_deadline(&c, &deadline);
+    munit_assert_uint64(deadline, ==, UINT64_MAX);
+
+    YAPB_CoalesceStats_t st;
+    YAPB_coalesce_get_stats(&c, &st);
+    munit_assert_uint64(st.flushes[YAPB_FLUSH_DEADLINE], ==, 1);
+    return MUNIT_OK;
+}
+
+static MunitResult test_coalesce_full(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[32];
+    uint8_t pbuf[32];
+    YAPB_Coalescer_t c;
+    flush_log_t log = {0};
+    YAPB_CoalesceConfig_t cfg = {0};
+    YAPB_Packet_t pkt;
+
+    YAPB_coalesce_init(&c, buf, sizeof(buf), &cfg, record_flush, &log);
+
+    /* 13-byte packets: the third append does not fit and flushes first */
+    YAPB_initialize(&pkt, pbuf, sizeof(pbuf));
+    int64_t v = 5;
+    YAPB_push_i64(&pkt, &v);
+    YAPB_finalize(&pkt, NULL);
+    for (int i = 0; i < 3; i++) {
+        munit_assert_int(YAPB_coalesce_append(&c, &pkt, 0), ==, YAPB_OK);
+    }
+    munit_assert_int(log.calls, ==, 1);
+    munit_assert_size(log.last_count, ==, 2);
+
+    YAPB_CoalesceStats_t st;
+    YAPB_coalesce_get_stats(&c, &st);
+    munit_assert_uint64(st.flushes[YAPB_FLUSH_FULL], ==, 1);
+
+    /* A failing flush keeps the batch for a retry */
+    log.ret = YAPB_ERR_UNKNOWN;
+    munit_assert_int(YAPB_coalesce_flush(&c), ==, YAPB_ERR_UNKNOWN);
+    log.ret = YAPB_OK;
+    munit_assert_int(YAPB_coalesce_flush(&c), ==, YAPB_OK);
+    munit_assert_size(log.last_count, ==, 1);
+    return MUNIT_OK;
+}
+
+/* ======== Batch reader ======== */
+
+#define READ_PACKETS 1000
+
+/* Packets: i32 seq, blob of seq % 200 bytes */
+static size_t fill_batch(uint8_t *buf, size_t size) {
+    static const uint8_t pad[200] = {0};
+    YAPB_Batch_t batch;
+    YAPB_Packet_t pkt;
+    YAPB_batch_init(&batch, buf, size);
+    for (int32_t i = 0; i < READ_PACKETS; i++) {
+        munit_assert_int(YAPB_batch_begin(&batch, &pkt), ==, YAPB_OK);
+        YAPB_push_i32(&pkt, &i);
+        YAPB_push_blob(&pkt, pad, (uint16_t)(i % 200));
+        munit_assert_int(YAPB_batch_commit(&batch, &pkt), ==, YAPB_OK);
+    }
+    size_t len;
+    YAPB_batch_get_buffer(&batch, &len);
+    return len;
+}
+
+typedef struct {
+    int32_t next;
+    int32_t stop_at;
+} ReadCtx;
+
+static YAPB_Result_t check_packet(void *ctx, YAPB_Packet_t *pkt) {
+    ReadCtx *c = ctx;
+    int32_t seq = -1;
+    YAPB_pop_i32(pkt, &seq);
+    munit_assert_int32(seq, ==, c->next);
+    c->next++;
+    return seq == c->stop_at ? YAPB_ERR_NOT_FOUND : YAPB_OK;
+}
+
+static MunitResult test_batch_reader(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    static uint8_t buf[READ_PACKETS * 220];
+    size_t len = fill_batch(buf, sizeof(buf));
+    static const unsigned distances[] = { 0, 1, 4, YAPB_BATCH_PREFETCH_DEFAULT, 5000 };
+
+    for (size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+        YAPB_BatchReader_t rd;
+        munit_assert_int(YAPB_batch_reader_init(&rd, buf, len, distances[d]), ==, YAPB_OK);
+        YAPB_Packet_t pkt;
+        ReadCtx c = { 0, -1 };
+        YAPB_Result_t r;
+        while ((r = YAPB_batch_reader_next(&rd, &pkt)) == YAPB_OK) {
+            check_packet(&c, &pkt);
+        }
+        munit_assert_int(r, ==, YAPB_ERR_NO_MORE_ELEMENTS);
+        munit_assert_int32(c.next, ==, READ_PACKETS);
+        size_t off, count;
+        YAPB_batch_reader_tell(&rd, &off, &count);
+        munit_assert_size(off, ==, len);
+        munit_assert_size(count, ==, READ_PACKETS);
+
+        c = (ReadCtx){ 0, -1 };
+        munit_assert_int(YAPB_batch_for_each(buf, len, distances[d], check_packet, &c), ==, YAPB_OK);
+        munit_assert_int32(c.next, ==, READ_PACKETS);
+    }
+
+    /* The callback stops the walk */
+    ReadCtx c = { 0, 10 };
+    munit_assert_int(YAPB_batch_for_each(buf, len, 4, check_packet, &c), ==, YAPB_ERR_NOT_FOUND);
+    munit_assert_int32(c.next, ==, 11);
+
+    munit_assert_int(YAPB_batch_for_each(NULL, 0, 4, check_packet, &c), ==, YAPB_OK);
+    munit_assert_int(YAPB_batch_for_each(buf, len, 4, NULL, NULL), ==, YAPB_ERR_NULL_PTR);
+    return MUNIT_OK;
+}
+
+static MunitResult test_batch_reader_truncated(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    static uint8_t buf[READ_PACKETS * 220];
+    size_t len = fill_batch(buf, sizeof(buf));
+
+    /* Last packet cut short: everything before it is still read */
+    YAPB_BatchReader_t rd;
+    YAPB_batch_reader_init(&rd, buf, len - 1, 8);
+    YAPB_Packet_t pkt;
+    size_t n = 0;
+    YAPB_Result_t r;
+    while ((r = YAPB_batch_reader_next(&rd, &pkt)) == YAPB_OK) {
+        n++;
+    }
+    munit_assert_int(r, ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_size(n, ==, READ_PACKETS - 1);
+    munit_assert_int(YAPB_batch_reader_next(&rd, &pkt), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* Bad header of packet 10, inside the prefetch window first */
+    size_t off;
+    YAPB_batch_reader_init(&rd, buf, len, 0);
+    for (int i = 0; i < 10; i++) {
+        YAPB_batch_reader_next(&rd, &pkt);
+    }
+    YAPB_batch_reader_tell(&rd, &off, NULL);
+    memset(buf + off, 0, YAPB_HEADER_SIZE);
+    ReadCtx c = { 0, -1 };
+    YAPB_batch_reader_init(&rd, buf, len, 64);
+    while ((r = YAPB_batch_reader_next(&rd, &pkt)) == YAPB_OK) {
+        check_packet(&c, &pkt);
+    }
+    munit_assert_int(r, ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int32(c.next, ==, 10);
+    c = (ReadCtx){ 0, -1 };
+    munit_assert_int(YAPB_batch_for_each(buf, len, 64, check_packet, &c), ==, YAPB_ERR_INVALID_PACKET);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/batch/back_to_back", test_batch_back_to_back, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/batch/prefinalized", test_batch_prefinalized, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/batch/overflow",     test_batch_overflow,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/batch/modes",        test_batch_modes,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/batch/null",         test_batch_null,         NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/reader/walk",        test_batch_reader,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/reader/truncated",   test_batch_reader_truncated, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/coalesce/count",     test_coalesce_count,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/coalesce/size",      test_coalesce_size,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/coalesce/deadline",  test_coalesce_deadline,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/coalesce/full",      test_coalesce_full,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,322 @@
+#include "munit.h"
+#include "yapb_bus.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+static _Alignas(64) uint8_t pool_mem[64 * 1024];
+
+static YAPB_Shared_t *make_packet(YAPB_Pool_t *pool, int32_t id, int8_t kind) {
+    YAPB_Shared_t *sh;
+    munit_assert_int(YAPB_shared_alloc(pool, &sh), ==, YAPB_OK);
+    YAPB_Packet_t pkt;
+    YAPB_shared_initialize(&pkt, sh);
+    const uint8_t name[] = "sensor";
+    YAPB_push_blob(&pkt, name, sizeof(name));
+    YAPB_push_i8(&pkt, &kind);
+    YAPB_push_i32(&pkt, &id);
+    YAPB_finalize(&pkt, NULL);
+    return sh;
+}
+
+/* ======== Filter ======== */
+
+static MunitResult test_filter_match(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[64];
+    YAPB_Packet_t pkt;
+
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    int16_t a = -5;
+    int64_t b = 1234567890123LL;
+    YAPB_push_i16(&pkt, &a);
+    YAPB_push_blob(&pkt, (const uint8_t *)"xy", 2);
+    YAPB_push_i64(&pkt, &b);
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+
+    YAPB_Filter_t f = { .index = 0, .type = YAPB_INT16, .value = -5 };
+    munit_assert_true(YAPB_filter_match(buf, len, &f));
+    f.value = 5;
+    munit_assert_false(YAPB_filter_match(buf, len, &f));
+
+    f = (YAPB_Filter_t){ .index = 2, .type = YAPB_INT64, .value = 1234567890123LL };
+    munit_assert_true(YAPB_filter_match(buf, len, &f));
+    f.type = YAPB_INT32;
+    munit_assert_false(YAPB_filter_match(buf, len, &f));
+    f = (YAPB_Filter_t){ .index = 3, .type = YAPB_INT8, .value = 0 };
+    munit_assert_false(YAPB_filter_match(buf, len, &f));
+
+    /* Truncated packet never matches */
+    f = (YAPB_Filter_t){ .index = 2, .type = YAPB_INT64, .value = 1234567890123LL };
+    munit_assert_false(YAPB_filter_match(buf, len - 1, &f));
+    return MUNIT_OK;
+}
+
+/* ======== Publish / subscribe ======== */
+
+static MunitResult test_bus_fanout(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 128);
+
+    YAPB_Bus_t bus;
+    YAPB_bus_init(&bus);
+
+    static YAPB_BusSlot_t slots_a[8], slots_b[8], slots_c[8];
+    static YAPB_Subscriber_t sub_a, sub_b, sub_c;
+    YAPB_Filter_t kind2 = { .index = 1, .type = YAPB_INT8, .value = 2 };
+    munit_assert_int(YAPB_bus_subscribe(&bus, &sub_a, 1, slots_a, 8, NULL), ==, YAPB_OK);
+    munit_assert_int(YAPB_bus_subscribe(&bus, &sub_b, 1, slots_b, 8, &kind2), ==, YAPB_OK);
+    munit_assert_int(YAPB_bus_subscribe(&bus, &sub_c, 2, slots_c, 8, NULL), ==, YAPB_OK);
+
+    for (int32_t i = 0; i < 4; i++) {
+        YAPB_Shared_t *sh = make_packet(&pool, i, (int8_t)(i % 3));
+        size_t delivered;
+        munit_assert_int(YAPB_bus_publish(&bus, 1, sh, &delivered), ==, YAPB_OK);
+        munit_assert_size(delivered, ==, (i % 3 == 2) ? 2 : 1);
+        YAPB_shared_release(sh);
+    }
+
+    YAPB_Shared_t *got[8];
+    size_t n;
+    YAPB_sub_poll(&sub_a, got, 8, &n);
+    munit_assert_size(n, ==, 4);
+    for (size_t i = 0; i < n; i++) {
+        YAPB_Packet_t pkt;
+        YAPB_shared_load(&pkt, got[i]);
+        const uint8_t *name; uint16_t nlen; int8_t kind; int32_t id = -1;
+        YAPB_pop_blob(&pkt, &name, &nlen);
+        YAPB_pop_i8(&pkt, &kind);
+        YAPB_pop_i32(&pkt, &id);
+        munit_assert_int32(id, ==, (int32_t)i);
+        YAPB_shared_release(got[i]);
+    }
+
+    YAPB_sub_poll(&sub_b, got, 8, &n);
+    munit_assert_size(n, ==, 1);
+    YAPB_shared_release(got[0]);
+    YAPB_sub_poll(&sub_c, got, 8, &n);
+    munit_assert_size(n, ==, 0);
+
+    size_t total, nfree;
+    YAPB_pool_get_count(&pool, &total, &nfree);
+    munit_assert_size(nfree, ==, total);
+    return MUNIT_OK;
+}
+
+static MunitResult test_bus_full_and_unsubscribe(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 128);
+
+    YAPB_Bus_t bus;
+    YAPB_bus_init(&bus);
+    static YAPB_BusSlot_t slots[2];
+    static YAPB_Subscriber_t sub;
+    munit_assert_int(YAPB_bus_subscribe(&bus, &sub, 7, slots, 3, NULL), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    YAPB_bus_subscribe(&bus, &sub, 7, slots, 2, NULL);
+    munit_assert_int(YAPB_bus_subscribe(&bus, &sub, 7, slots, 2, NULL), ==, YAPB_ERR_INVALID_MODE);
+
+    YAPB_Shared_t *sh = make_packet(&pool, 1, 0);
+    size_t delivered;
+    for (int i = 0; i < 3; i++) {
+        YAPB_bus_publish(&bus, 7, sh, &delivered);
+    }
+    munit_assert_size(delivered, ==, 0);
+    uint64_t dropped;
+    YAPB_sub_get_dropped(&sub, &dropped);
+    munit_assert_uint64(dropped, ==, 1);
+
+    YAPB_bus_unsubscribe(&sub);
+    YAPB_Shared_t *got[4];
+    size_t n;
+    YAPB_sub_poll(&sub, got, 4, &n);
+    munit_assert_size(n, ==, 2);
+    YAPB_bus_publish(&bus, 7, sh, &delivered);
+    munit_assert_size(delivered, ==, 0);
+    munit_assert_int(YAPB_bus_unsubscribe(&sub), ==, YAPB_ERR_INVALID_MODE);
+
+    /* The same storage subscribes again, e.g. on reconnect */
+    munit_assert_int(YAPB_bus_subscribe(&bus, &sub, 7, slots, 2, NULL), ==, YAPB_OK);
+    YAPB_bus_publish(&bus, 7, sh, &delivered);
+    munit_assert_size(delivered, ==, 1);
+    YAPB_bus_unsubscribe(&sub);
+    YAPB_sub_poll(&sub, got + 2, 2, &n);
+    munit_assert_size(n, ==, 1);
+
+    YAPB_shared_release(got[0]);
+    YAPB_shared_release(got[1]);
+    YAPB_shared_release(got[2]);
+    YAPB_shared_release(sh);
+    size_t total, nfree;
+    YAPB_pool_get_count(&pool, &total, &nfree);
+    munit_assert_size(nfree, ==, total);
+    return MUNIT_OK;
+}
+
+/* ======== Concurrency ======== */
+
+#define BUS_PUBLISHERS 4
+#define BUS_PER_PUB    2000
+
+typedef struct {
+    YAPB_Bus_t *bus;
+    YAPB_Pool_t *pool;
+    int32_t base;
+} pub_arg_t;
+
+static void *publisher(void *arg) {
+    pub_arg_t *a = arg;
+    for (int32_t i = 0; i < BUS_PER_PUB; i++) {
+        YAPB_Shared_t *sh;
+        while (YAPB_shared_alloc(a->pool, &sh) != YAPB_OK) {
+            /* consumer frees buffers */
+        }
+        YAPB_Packet_t pkt;
+        YAPB_shared_initialize(&pkt, sh);
+        int32_t v = a->base + i;
+        YAPB_push_i32(&pkt, &v);
+        YAPB_finalize(&pkt, NULL);
+        size_t delivered = 0;
+        while (delivered == 0) {
+            YAPB_bus_publish(a->bus, 1, sh, &delivered);
+        }
+        YAPB_shared_release(sh);
+    }
+    return NULL;
+}
+
+static MunitResult test_bus_threads(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 64);
+    YAPB_Bus_t bus;
+    YAPB_bus_init(&bus);
+    static YAPB_BusSlot_t slots[256];
+    static YAPB_Subscriber_t sub;
+    YAPB_bus_subscribe(&bus, &sub, 1, slots, 256, NULL);
+
+    pthread_t th[BUS_PUBLISHERS];
+    pub_arg_t args[BUS_PUBLISHERS];
+    for (int i = 0; i < BUS_PUBLISHERS; i++) {
+        args[i] = (pub_arg_t){ &bus, &pool, i * BUS_PER_PUB };
+        pthread_create(&th[i], NULL, publisher, &args[i]);
+    }
+
+    static uint8_t seen[BUS_PUBLISHERS * BUS_PER_PUB];
+    memset(seen, 0, sizeof(seen));
+    int32_t last[BUS_PUBLISHERS];
+    for (int i = 0; i < BUS_PUBLISHERS; i++) last[i] = -1;
+
+    size_t received = 0;
+    while (received < BUS_PUBLISHERS * BUS_PER_PUB) {
+        YAPB_Shared_t *got[16];
+        size_t n;
+        YAPB_sub_poll(&sub, got, 16, &n);
+        for (size_t i = 0; i < n; i++) {
+            YAPB_Packet_t pkt;
+            YAPB_shared_load(&pkt, got[i]);
+            int32_t v = -1;
+            munit_assert_int(YAPB_pop_i32(&pkt, &v), ==, YAPB_STS_COMPLETE);
+            munit_assert_int(seen[v], ==, 0);
+            seen[v] = 1;
+            /* per-publisher order is preserved */
+            munit_assert_int32(v, >, last[v / BUS_PER_PUB]);
+            last[v / BUS_PER_PUB] = v;
+            YAPB_shared_release(got[i]);
+        }
+        received += n;
+    }
+
+    for (int i = 0; i < BUS_PUBLISHERS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    return MUNIT_OK;
+}
+
+/* Subscribers come and go, always in the same storage, under publishers */
+#define CHURN_ROUNDS 2000
+
+typedef struct {
+    YAPB_Bus_t *bus;
+    YAPB_Pool_t *pool;
+    _Atomic bool stop;
+} churn_arg_t;
+
+static void *churn_publisher(void *arg) {
+    churn_arg_t *a = arg;
+    while (!atomic_load(&a->stop)) {
+        YAPB_Shared_t *sh;
+        if (YAPB_shared_alloc(a->pool, &sh) != YAPB_OK) continue;
+        YAPB_Packet_t pkt;
+        YAPB_shared_initialize(&pkt, sh);
+        int32_t v = 1;
+        YAPB_push_i32(&pkt, &v);
+        YAPB_finalize(&pkt, NULL);
+        YAPB_bus_publish(a->bus, 2, sh, NULL);
+        YAPB_shared_release(sh);
+    }
+    return NULL;
+}
+
+static MunitResult test_bus_resubscribe(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 64);
+    YAPB_Bus_t bus;
+    YAPB_bus_init(&bus);
+    static YAPB_BusSlot_t slots[2][16];
+    static YAPB_Subscriber_t subs[2];
+
+    churn_arg_t arg = { &bus, &pool, false };
+    pthread_t th[2];
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&th[i], NULL, churn_publisher, &arg);
+    }
+    for (int r = 0; r < CHURN_ROUNDS; r++) {
+        YAPB_Subscriber_t *sub = &subs[r & 1];
+        munit_assert_int(YAPB_bus_subscribe(&bus, sub, 2, slots[r & 1], 16, NULL), ==, YAPB_OK);
+        YAPB_Shared_t *got[16];
+        size_t n;
+        YAPB_sub_poll(sub, got, 16, &n);
+        munit_assert_int(YAPB_bus_unsubscribe(sub), ==, YAPB_OK);
+        /* Nothing is enqueued after unsubscribe returns, so one more poll
+           empties the queue for good */
+        size_t m;
+        YAPB_sub_poll(sub, got + n, 16 - n, &m);
+        for (size_t i = 0; i < n + m; i++) {
+            YAPB_shared_release(got[i]);
+        }
+        YAPB_sub_poll(sub, got, 16, &n);
+        munit_assert_size(n, ==, 0);
+    }
+    atomic_store(&arg.stop, true);
+    for (int i = 0; i < 2; i++) {
+        pthread_join(th[i], NULL);
+    }
+
+    size_t total, nfree;
+    YAPB_pool_get_count(&pool, &total, &nfree);
+    munit_assert_size(nfree, ==, total);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/filter/match",       test_filter_match,             NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/bus/fanout",         test_bus_fanout,               NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/bus/full",           test_bus_full_and_unsubscribe, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/bus/threads",        test_bus_threads,              NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/bus/resubscribe",    test_bus_resubscribe,          NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
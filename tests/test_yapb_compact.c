@@ -0,0 +1,308 @@
+#include "munit.h"
+#include "yapb_compact.h"
+#include "yapb_segment.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define KEYS     500
+#define UPDATES  5000
+#define OP_PUT   0
+#define OP_DEL   1
+
+/* Packets: i64 key, i64 version, i8 op */
+static void put_record(FILE *f, int64_t key, int64_t version, int8_t op) {
+    uint8_t buf[64];
+    YAPB_Packet_t pkt;
+    size_t len;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i64(&pkt, &key);
+    YAPB_push_i64(&pkt, &version);
+    YAPB_push_i8(&pkt, &op);
+    YAPB_finalize(&pkt, &len);
+    fwrite(buf, 1, len, f);
+}
+
+/* Every key updated ten times; keys divisible by 7 deleted, key 14 put again */
+static void write_history(const char *path) {
+    FILE *f = fopen(path, "wb");
+    munit_assert_not_null(f);
+    for (int64_t i = 0; i < UPDATES; i++) {
+        put_record(f, i % KEYS, i, OP_PUT);
+        if (i == 1234) {
+            /* Keyless packet: kept as is */
+            uint8_t empty[YAPB_HEADER_SIZE];
+            YAPB_Packet_t pkt;
+            size_t len;
+            YAPB_initialize(&pkt, empty, sizeof(empty));
+            YAPB_finalize(&pkt, &len);
+            fwrite(empty, 1, len, f);
+        }
+    }
+    for (int64_t k = 0; k < KEYS; k += 7) {
+        put_record(f, k, UPDATES + k, OP_DEL);
+    }
+    put_record(f, 14, 99999, OP_PUT);
+    fclose(f);
+}
+
+static const YAPB_CompactConfig_t base_cfg = {
+    .sort = { .mem_budget = 1u << 20, .threads = 2 },
+    .tombstone = { 1, { 2 } },
+    .tombstone_value = OP_DEL,
+};
+
+/* Check the compacted log: sorted keys, newest version of each, no dead keys */
+static void check_output(const char *path, bool tombstones) {
+    YAPB_LogMap_t map;
+    munit_assert_int(YAPB_log_map(&map, path, 0), ==, YAPB_OK);
+    size_t len, off = 0, pkt_len;
+    const uint8_t *data = YAPB_log_get_data(&map, &len);
+    const uint8_t *p;
+    int64_t last_key = -1;
+    uint64_t keyed = 0, keyless = 0;
+    while (YAPB_log_next(data, len, &off, &p, &pkt_len) == YAPB_OK) {
+        YAPB_Packet_t pkt;
+        int64_t key, version;
+        int8_t op;
+        YAPB_load(&pkt, p, pkt_len);
+        if (YAPB_pop_i64(&pkt, &key) < 0) {
+            keyless++;
+            continue;
+        }
+        munit_assert_uint64(keyless, ==, 0);
+        YAPB_pop_i64(&pkt, &version);
+        YAPB_pop_i8(&pkt, &op);
+        munit_assert_int64(key, >, last_key);
+        last_key = key;
+        keyed++;
+        if (key == 14) {
+            munit_assert_int64(version, ==, 99999);
+        } else if (key % 7 == 0) {
+            munit_assert_true(tombstones);
+            munit_assert_int(op, ==, OP_DEL);
+            munit_assert_int64(version, ==, UPDATES + key);
+        } else {
+            munit_assert_int(op, ==, OP_PUT);
+            munit_assert_int64(version, ==, UPDATES - KEYS + key);
+        }
+    }
+    munit_assert_size(off, ==, len);
+    munit_assert_uint64(keyless, ==, 1);
+    munit_assert_uint64(keyed, ==, tombstones ? KEYS : KEYS - 71);
+    YAPB_log_unmap(&map);
+}
+
+/* ======== Compaction ======== */
+
+static MunitResult test_compact_file(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char in[] = "/tmp/yapb-compact-XXXXXX";
+    close(mkstemp(in));
+    char out[sizeof(in) + 4];
+    snprintf(out, sizeof(out), "%s.out", in);
+    write_history(in);
+
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    YAPB_CompactStats_t st;
+    munit_assert_int(YAPB_compact_file(in, out, &key, &base_cfg, &st), ==, YAPB_OK);
+    munit_assert_uint64(st.packets_in, ==, UPDATES + 1 + 72 + 1);
+    munit_assert_uint64(st.packets_out, ==, KEYS - 71 + 1);
+    munit_assert_uint64(st.deleted, ==, 71);
+    munit_assert_uint64(st.bytes_out, <, st.bytes_in);
+    check_output(out, false);
+
+    /* Tombstones kept for partial histories */
+    YAPB_CompactConfig_t cfg = base_cfg;
+    cfg.keep_tombstones = true;
+    munit_assert_int(YAPB_compact_file(in, out, &key, &cfg, &st), ==, YAPB_OK);
+    munit_assert_uint64(st.packets_out, ==, KEYS + 1);
+    check_output(out, true);
+
+    /* Compacting a compacted log changes nothing */
+    uint64_t bytes = st.bytes_out;
+    munit_assert_int(YAPB_compact_file(out, out, &key, &cfg, &st), ==, YAPB_OK);
+    munit_assert_uint64(st.bytes_out, ==, bytes);
+
+    unlink(in);
+    unlink(out);
+    return MUNIT_OK;
+}
+
+/* ======== Background, in place ======== */
+
+static MunitResult test_compact_background(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-compact-XXXXXX";
+    close(mkstemp(path));
+    write_history(path);
+
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    YAPB_Compaction_t job;
+    munit_assert_int(YAPB_compact_start(&job, path, path, &key, &base_cfg), ==, YAPB_OK);
+    YAPB_CompactStats_t st;
+    munit_assert_int(YAPB_compact_wait(&job, &st), ==, YAPB_OK);
+    munit_assert_true(YAPB_compact_done(&job));
+    munit_assert_uint64(st.packets_out, ==, KEYS - 71 + 1);
+    check_output(path, false);
+
+    /* Errors are reported by wait */
+    munit_assert_int(YAPB_compact_start(&job, "/nonexistent/log", path, &key, NULL), ==, YAPB_OK);
+    munit_assert_int(YAPB_compact_wait(&job, NULL), ==, YAPB_ERR_IO);
+
+    unlink(path);
+    return MUNIT_OK;
+}
+
+static MunitResult test_compact_appends(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-compact-XXXXXX";
+    close(mkstemp(path));
+    write_history(path);
+
+    /* Appends that reopen the file survive an in-place compaction,
+       whether they land before, during or after it */
+    enum { APPENDS = 50 };
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    YAPB_Compaction_t job;
+    munit_assert_int(YAPB_compact_start(&job, path, path, &key, &base_cfg), ==, YAPB_OK);
+    for (int64_t i = 0; i < APPENDS; i++) {
+        FILE *f = fopen(path, "ab");
+        put_record(f, KEYS + i, i, OP_PUT);
+        fclose(f);
+    }
+    YAPB_CompactStats_t st;
+    munit_assert_int(YAPB_compact_wait(&job, &st), ==, YAPB_OK);
+
+    YAPB_LogMap_t map;
+    munit_assert_int(YAPB_log_map(&map, path, 0), ==, YAPB_OK);
+    size_t len, off = 0, pkt_len;
+    const uint8_t *log = YAPB_log_get_data(&map, &len);
+    const uint8_t *p;
+    int seen[APPENDS] = { 0 };
+    while (YAPB_log_next(log, len, &off, &p, &pkt_len) == YAPB_OK) {
+        YAPB_Packet_t pkt;
+        int64_t k;
+        YAPB_load(&pkt, p, pkt_len);
+        if (YAPB_pop_i64(&pkt, &k) >= 0 && k >= KEYS) {
+            seen[k - KEYS]++;
+        }
+    }
+    munit_assert_size(off, ==, len);
+    for (int i = 0; i < APPENDS; i++) {
+        munit_assert_int(seen[i], ==, 1);
+    }
+    munit_assert_uint64(st.bytes_out, <=, len);
+    YAPB_log_unmap(&map);
+
+    unlink(path);
+    return MUNIT_OK;
+}
+
+static MunitResult test_compact_segment(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char dir[] = "/tmp/yapb-compact-seg-XXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+
+    static const YAPB_SegmentKey_t keys[] = {
+        { .path = { 1, { 0 } }, .flags = YAPB_SEG_BLOOM | YAPB_SEG_ZONE },
+        { .path = { 1, { 1 } }, .flags = YAPB_SEG_ZONE },
+    };
+    YAPB_SegmentConfig_t scfg = { .keys = keys, .nkeys = 2, .bloom_bytes = 1024 };
+    YAPB_SegmentWriter_t w;
+    munit_assert_int(YAPB_segw_open(&w, dir, &scfg), ==, YAPB_OK);
+    /* Keys 0..9 three times over, then key 2 deleted */
+    for (int64_t i = 0; i <= 30; i++) {
+        uint8_t buf[64];
+        YAPB_Packet_t pkt;
+        int64_t k = (i < 30) ? i % 10 : 2;
+        int8_t op = (i < 30) ? OP_PUT : OP_DEL;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_i64(&pkt, &k);
+        YAPB_push_i64(&pkt, &i);
+        YAPB_push_i8(&pkt, &op);
+        YAPB_finalize(&pkt, NULL);
+        munit_assert_int(YAPB_segw_append(&w, &pkt), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_segw_close(&w), ==, YAPB_OK);
+
+    /* Compacted in place: the footer stays out of the data */
+    char seg[sizeof(dir) + 32];
+    snprintf(seg, sizeof(seg), "%s/seg-00000001.yapb", dir);
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    YAPB_CompactStats_t st;
+    munit_assert_int(YAPB_compact_file(seg, seg, &key, &base_cfg, &st), ==, YAPB_OK);
+    munit_assert_uint64(st.packets_in, ==, 31);
+    munit_assert_uint64(st.packets_out, ==, 9);
+    munit_assert_uint64(st.deleted, ==, 1);
+
+    /* And rebuilt for the kept packets, with the same keys */
+    YAPB_Segment_t g;
+    YAPB_SegmentKey_t got_keys[YAPB_SEG_MAX_KEYS];
+    YAPB_SegmentConfig_t got;
+    munit_assert_int(YAPB_segment_open(&g, seg), ==, YAPB_OK);
+    munit_assert_int(YAPB_segment_get_config(&g, &got, got_keys), ==, YAPB_OK);
+    munit_assert_int(got.nkeys, ==, 2);
+    munit_assert_uint32(got.bloom_bytes, ==, 1024);
+    for (int i = 0; i < 2; i++) {
+        munit_assert_int(got_keys[i].path.depth, ==, 1);
+        munit_assert_int(got_keys[i].path.index[0], ==, keys[i].path.index[0]);
+        munit_assert_int(got_keys[i].flags, ==, keys[i].flags);
+    }
+
+    size_t len, off = 0, pkt_len;
+    const uint8_t *p = YAPB_segment_get_data(&g, &len);
+    const uint8_t *pkt;
+    int64_t want = 0;
+    while (YAPB_log_next(p, len, &off, &pkt, &pkt_len) == YAPB_OK) {
+        YAPB_Packet_t rd;
+        int64_t k, version;
+        YAPB_load(&rd, pkt, pkt_len);
+        YAPB_pop_i64(&rd, &k);
+        YAPB_pop_i64(&rd, &version);
+        if (want == 2) want++;
+        munit_assert_int64(k, ==, want);
+        munit_assert_int64(version, ==, 20 + want);
+        want++;
+    }
+    munit_assert_int64(want, ==, 10);
+    munit_assert_uint64(st.bytes_out, >, len);
+
+    YAPB_SegmentFilter_t q = { .path = keys[0].path, .op = YAPB_SEG_EQ };
+    YAPB_key_from_int(5, &q.lo);
+    munit_assert_true(YAPB_segment_may_match(&g, &q));
+    YAPB_key_from_int(2, &q.lo);
+    munit_assert_false(YAPB_segment_may_match(&g, &q));
+    /* Versions 0..19 are gone from the zone map */
+    q = (YAPB_SegmentFilter_t){ .path = keys[1].path, .op = YAPB_SEG_RANGE };
+    YAPB_key_from_int(0, &q.lo);
+    YAPB_key_from_int(19, &q.hi);
+    munit_assert_false(YAPB_segment_may_match(&g, &q));
+    YAPB_segment_close(&g);
+
+    unlink(seg);
+    munit_assert_int(rmdir(dir), ==, 0);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/compact/file",       test_compact_file,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/compact/background", test_compact_background, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/compact/appends",    test_compact_appends,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/compact/segment",    test_compact_segment,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
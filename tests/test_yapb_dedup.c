@@ -0,0 +1,223 @@
+#include "munit.h"
+#include "yapb_dedup.h"
+#include "yapb_edit.h"
+#include "yapb_plan.h"
+#include <string.h>
+
+#define SAMPLES 100
+
+/* Device descriptor: { i32 id, blob name, double scale } */
+static size_t build_descriptor(uint8_t *buf, size_t size, int32_t id, YAPB_Packet_t *pkt) {
+    static const char name[] = "thermocouple-probe-k";
+    double scale = 0.25;
+    size_t len;
+    YAPB_initialize(pkt, buf, size);
+    YAPB_push_i32(pkt, &id);
+    YAPB_push_blob(pkt, (const uint8_t *)name, sizeof(name) - 1);
+    YAPB_push_double(pkt, &scale);
+    YAPB_finalize(pkt, &len);
+    return len;
+}
+
+/* SAMPLES x { descriptor of device i % 3, double value } */
+static size_t build_batch(uint8_t *buf, size_t size, YAPB_Dedup_t *dd) {
+    uint8_t dbuf[3][64];
+    YAPB_Packet_t desc[3], pkt;
+    for (int d = 0; d < 3; d++) {
+        build_descriptor(dbuf[d], sizeof(dbuf[d]), d, &desc[d]);
+    }
+    YAPB_initialize(&pkt, buf, size);
+    for (int i = 0; i < SAMPLES; i++) {
+        double v = i * 1.5;
+        if (dd != NULL) {
+            YAPB_push_nested_dedup(&pkt, dd, &desc[i % 3]);
+        } else {
+            YAPB_push_nested(&pkt, &desc[i % 3]);
+        }
+        YAPB_push_double(&pkt, &v);
+    }
+    size_t len;
+    munit_assert_int(YAPB_finalize(&pkt, &len), ==, YAPB_OK);
+    return len;
+}
+
+/* Pops every sample and checks descriptor and value */
+static void check_batch(const uint8_t *buf, size_t len, bool by_next) {
+    YAPB_Packet_t pkt, nested;
+    YAPB_Element_t el;
+    uint16_t count;
+    YAPB_load(&pkt, buf, len);
+    munit_assert_int(YAPB_get_elem_count(&pkt, &count), ==, YAPB_OK);
+    munit_assert_uint16(count, ==, 2 * SAMPLES);
+
+    for (int i = 0; i < SAMPLES; i++) {
+        if (by_next) {
+            munit_assert_int(YAPB_pop_next(&pkt, &el), ==, YAPB_OK);
+            munit_assert_int(el.type, ==, YAPB_NESTED_PKT);
+            nested = el.val.nested;
+        } else {
+            munit_assert_int(YAPB_pop_nested(&pkt, &nested), ==, YAPB_OK);
+        }
+        /* Zero-copy: the nested packet lies in the batch buffer */
+        size_t nlen;
+        const uint8_t *nbuf = YAPB_get_buffer(&nested, &nlen);
+        munit_assert_ptr(nbuf, >=, buf);
+        munit_assert_ptr(nbuf + nlen, <=, buf + len);
+
+        int32_t id = -1;
+        const uint8_t *name;
+        uint16_t name_len;
+        double scale = 0, v = -1;
+        YAPB_pop_i32(&nested, &id);
+        YAPB_pop_blob(&nested, &name, &name_len);
+        munit_assert_int(YAPB_pop_double(&nested, &scale), ==, YAPB_STS_COMPLETE);
+        munit_assert_int(id, ==, i % 3);
+        munit_assert_memory_equal(name_len, name, "thermocouple-probe-k");
+        munit_assert_double(scale, ==, 0.25);
+
+        YAPB_Result_t r = YAPB_pop_double(&pkt, &v);
+        munit_assert_int(r, ==, i + 1 == SAMPLES ? YAPB_STS_COMPLETE : YAPB_OK);
+        munit_assert_double(v, ==, i * 1.5);
+    }
+}
+
+static MunitResult test_dedup_batch(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    static uint8_t plain[8192], packed[8192];
+    uint8_t dbuf[64];
+    YAPB_Packet_t desc;
+    size_t desc_len = build_descriptor(dbuf, sizeof(dbuf), 0, &desc);
+
+    size_t plain_len = build_batch(plain, sizeof(plain), NULL);
+    YAPB_Dedup_t dd;
+    YAPB_dedup_init(&dd);
+    size_t packed_len = build_batch(packed, sizeof(packed), &dd);
+
+    /* Three first copies, the rest are 5-byte references */
+    uint64_t refs, saved;
+    YAPB_dedup_get_stats(&dd, &refs, &saved);
+    munit_assert_uint64(refs, ==, SAMPLES - 3);
+    munit_assert_uint64(saved, ==, (SAMPLES - 3) * (1 + desc_len - 5));
+    munit_assert_size(packed_len, ==, plain_len - saved);
+
+    check_batch(plain, plain_len, false);
+    check_batch(packed, packed_len, false);
+    check_batch(packed, packed_len, true);
+
+    /* Key paths descend through references */
+    YAPB_KeyPath_t path;
+    YAPB_Key_t key, want;
+    YAPB_keypath_parse("8.0", &path);
+    munit_assert_int(YAPB_key_extract(packed, packed_len, &path, &key), ==, YAPB_OK);
+    YAPB_key_from_int(1, &want);
+    munit_assert_int(YAPB_key_compare(&key, &want), ==, 0);
+
+    /* Reader plans take a reference where a nested packet is expected */
+    const YAPB_Type_t expected[] = { YAPB_NESTED_PKT, YAPB_DOUBLE, YAPB_NESTED_PKT, YAPB_DOUBLE,
+                                     YAPB_NESTED_PKT, YAPB_DOUBLE, YAPB_NESTED_PKT };
+    YAPB_ReaderPlan_t cache[2];
+    YAPB_Reader_t rd;
+    YAPB_reader_init(&rd, expected, 7, cache, 2);
+    YAPB_Packet_t pkt, n0, n3;
+    double d0, d1, d2;
+    YAPB_Packet_t n1, n2;
+    void *outs[] = { &n0, &d0, &n1, &d1, &n2, &d2, &n3 };
+    uint16_t present;
+    for (int pass = 0; pass < 2; pass++) {
+        YAPB_load(&pkt, packed, packed_len);
+        munit_assert_int(YAPB_reader_decode(&rd, &pkt, outs, &present), ==, YAPB_OK);
+        munit_assert_uint16(present, ==, 7);
+        size_t l0, l3;
+        const uint8_t *b0 = YAPB_get_buffer(&n0, &l0), *b3 = YAPB_get_buffer(&n3, &l3);
+        munit_assert_ptr(b0, ==, b3);
+        munit_assert_size(l0, ==, desc_len);
+    }
+
+    /* Deleting the first copy writes its references out in full */
+    YAPB_Edit_t ed;
+    static uint8_t edited[8192];
+    size_t edited_len;
+    YAPB_load(&pkt, packed, packed_len);
+    YAPB_edit_begin(&ed, &pkt);
+    YAPB_keypath_parse("0", &path);
+    YAPB_edit_delete(&ed, &path);
+    YAPB_keypath_parse("1", &path);
+    YAPB_edit_delete(&ed, &path);
+    munit_assert_int(YAPB_edit_apply(&ed, edited, sizeof(edited), &edited_len), ==, YAPB_OK);
+    YAPB_load(&pkt, edited, edited_len);
+    YAPB_Packet_t nested;
+    int32_t id = -1;
+    munit_assert_int(YAPB_pop_nested(&pkt, &nested), ==, YAPB_OK);
+    YAPB_pop_i32(&nested, &id);
+    munit_assert_int(id, ==, 1);
+    munit_assert_uint8(edited[YAPB_HEADER_SIZE], ==, YAPB_NESTED_PKT);
+    munit_assert_size(edited_len, ==, plain_len - (1 + desc_len + 9));
+    return MUNIT_OK;
+}
+
+static MunitResult test_dedup_reuse(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[256], abuf[64], bbuf[64], ebuf[8];
+    YAPB_Packet_t pkt, a, b, empty, nested;
+    size_t a_len = build_descriptor(abuf, sizeof(abuf), 1, &a);
+    build_descriptor(bbuf, sizeof(bbuf), 2, &b);
+    YAPB_initialize(&empty, ebuf, sizeof(ebuf));
+    YAPB_finalize(&empty, NULL);
+
+    YAPB_Dedup_t dd;
+    uint64_t refs;
+    size_t len;
+    YAPB_dedup_init(&dd);
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &a), ==, YAPB_OK);
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &a), ==, YAPB_OK);
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &empty), ==, YAPB_OK);
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &empty), ==, YAPB_OK);
+    YAPB_finalize(&pkt, &len);
+    munit_assert_size(len, ==, YAPB_HEADER_SIZE + 1 + a_len + 5 + 2 * (1 + YAPB_HEADER_SIZE));
+    YAPB_dedup_get_stats(&dd, &refs, NULL);
+    munit_assert_uint64(refs, ==, 1);
+
+    /* Same buffer again: the old entry for a now covers b, so no reference */
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_nested_dedup(&pkt, &dd, &b);
+    YAPB_push_nested_dedup(&pkt, &dd, &a);
+    YAPB_finalize(&pkt, &len);
+    YAPB_dedup_get_stats(&dd, &refs, NULL);
+    munit_assert_uint64(refs, ==, 1);
+    YAPB_load(&pkt, buf, len);
+    int32_t id = 0;
+    YAPB_pop_nested(&pkt, &nested);
+    YAPB_pop_i32(&nested, &id);
+    munit_assert_int(id, ==, 2);
+    munit_assert_int(YAPB_pop_nested(&pkt, &nested), ==, YAPB_STS_COMPLETE);
+    YAPB_pop_i32(&nested, &id);
+    munit_assert_int(id, ==, 1);
+
+    /* Errors stick to the packet as for YAPB_push_nested() */
+    uint8_t small[64];
+    YAPB_initialize(&pkt, small, YAPB_HEADER_SIZE + 1 + a_len + 4);
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &a), ==, YAPB_OK);
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &a), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_int(YAPB_get_error(&pkt), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    YAPB_load(&pkt, buf, len);
+    munit_assert_int(YAPB_push_nested_dedup(&pkt, &dd, &a), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_push_nested_dedup(NULL, &dd, &a), ==, YAPB_ERR_NULL_PTR);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/dedup/batch", test_dedup_batch, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/dedup/reuse", test_dedup_reuse, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
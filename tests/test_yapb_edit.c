@@ -0,0 +1,248 @@
+#include "munit.h"
+#include "yapb_edit.h"
+#include <string.h>
+
+/* [i32 0, i32 1, { i8 10, blob "ab", { i16 100, i16 101 } }, i32 3] */
+static size_t build_original(uint8_t *buf, size_t size, YAPB_Packet_t *pkt) {
+    uint8_t ibuf[64], obuf[64];
+    YAPB_Packet_t inner, outer;
+    int16_t h0 = 100, h1 = 101;
+    YAPB_initialize(&inner, ibuf, sizeof(ibuf));
+    YAPB_push_i16(&inner, &h0);
+    YAPB_push_i16(&inner, &h1);
+    YAPB_finalize(&inner, NULL);
+
+    int8_t b = 10;
+    YAPB_initialize(&outer, obuf, sizeof(obuf));
+    YAPB_push_i8(&outer, &b);
+    YAPB_push_blob(&outer, (const uint8_t *)"ab", 2);
+    YAPB_push_nested(&outer, &inner);
+    YAPB_finalize(&outer, NULL);
+
+    int32_t v0 = 0, v1 = 1, v3 = 3;
+    size_t len;
+    YAPB_initialize(pkt, buf, size);
+    YAPB_push_i32(pkt, &v0);
+    YAPB_push_i32(pkt, &v1);
+    YAPB_push_nested(pkt, &outer);
+    YAPB_push_i32(pkt, &v3);
+    YAPB_finalize(pkt, &len);
+    return len;
+}
+
+static YAPB_KeyPath_t path(const char *spec) {
+    YAPB_KeyPath_t p;
+    munit_assert_int(YAPB_keypath_parse(spec, &p), ==, YAPB_OK);
+    return p;
+}
+
+static MunitResult test_edit_ops(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[128], copy[128];
+    YAPB_Packet_t pkt;
+    size_t len = build_original(buf, sizeof(buf), &pkt);
+    memcpy(copy, buf, len);
+
+    /* New elements, each built as a small packet */
+    uint8_t e1[32], e2[32], e3[32], e4[32], e5[32];
+    YAPB_Packet_t neg, blob, h102, dbl, i8s;
+    int64_t m5 = -5;
+    int16_t v102 = 102;
+    double d = 1.5;
+    int8_t a = 1, b = 2;
+    YAPB_initialize(&neg, e1, sizeof(e1));
+    YAPB_push_i64(&neg, &m5);
+    YAPB_finalize(&neg, NULL);
+    YAPB_initialize(&blob, e2, sizeof(e2));
+    YAPB_push_blob(&blob, (const uint8_t *)"xyz", 3);
+    YAPB_finalize(&blob, NULL);
+    YAPB_initialize(&h102, e3, sizeof(e3));
+    YAPB_push_i16(&h102, &v102);
+    YAPB_finalize(&h102, NULL);
+    YAPB_initialize(&dbl, e4, sizeof(e4));
+    YAPB_push_double(&dbl, &d);
+    YAPB_finalize(&dbl, NULL);
+    YAPB_initialize(&i8s, e5, sizeof(e5));
+    YAPB_push_i8(&i8s, &a);
+    YAPB_push_i8(&i8s, &b);
+    YAPB_finalize(&i8s, NULL);
+
+    /* Recorded out of order; positions refer to the original packet */
+    YAPB_Edit_t ed;
+    YAPB_KeyPath_t at;
+    munit_assert_int(YAPB_edit_begin(&ed, &pkt), ==, YAPB_OK);
+    at = path("2.2.2");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &h102), ==, YAPB_OK);
+    at = path("1");
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_OK);
+    at = path("4");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &dbl), ==, YAPB_OK);
+    at = path("2.1");
+    munit_assert_int(YAPB_edit_replace(&ed, &at, &blob), ==, YAPB_OK);
+    at = path("0");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &neg), ==, YAPB_OK);
+    at = path("2.2.0");
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_OK);
+    at = path("3");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &i8s), ==, YAPB_OK);
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &neg), ==, YAPB_OK);
+
+    /* Expected: [i64 -5, i32 0, { i8 10, blob "xyz", { i16 101, i16 102 } },
+     *            i8 1, i8 2, i64 -5, i32 3, double 1.5] */
+    uint8_t xbuf[128], ibuf[64], obuf[64];
+    YAPB_Packet_t inner, outer, want;
+    int16_t h101 = 101;
+    int8_t b10 = 10;
+    int32_t v0 = 0, v3 = 3;
+    size_t want_len;
+    YAPB_initialize(&inner, ibuf, sizeof(ibuf));
+    YAPB_push_i16(&inner, &h101);
+    YAPB_push_i16(&inner, &v102);
+    YAPB_finalize(&inner, NULL);
+    YAPB_initialize(&outer, obuf, sizeof(obuf));
+    YAPB_push_i8(&outer, &b10);
+    YAPB_push_blob(&outer, (const uint8_t *)"xyz", 3);
+    YAPB_push_nested(&outer, &inner);
+    YAPB_finalize(&outer, NULL);
+    YAPB_initialize(&want, xbuf, sizeof(xbuf));
+    YAPB_push_i64(&want, &m5);
+    YAPB_push_i32(&want, &v0);
+    YAPB_push_nested(&want, &outer);
+    YAPB_push_i8(&want, &a);
+    YAPB_push_i8(&want, &b);
+    YAPB_push_i64(&want, &m5);
+    YAPB_push_i32(&want, &v3);
+    YAPB_push_double(&want, &d);
+    YAPB_finalize(&want, &want_len);
+
+    uint8_t out[128];
+    size_t out_len;
+    for (int pass = 0; pass < 2; pass++) {
+        memset(out, 0xAA, sizeof(out));
+        munit_assert_int(YAPB_edit_apply(&ed, out, sizeof(out), &out_len), ==, YAPB_OK);
+        munit_assert_size(out_len, ==, want_len);
+        munit_assert_memory_equal(want_len, out, xbuf);
+    }
+    munit_assert_memory_equal(len, buf, copy);
+
+    /* Too small: the size needed is reported */
+    size_t need;
+    munit_assert_int(YAPB_edit_apply(&ed, out, 10, &need), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_size(need, ==, want_len);
+    munit_assert_int(YAPB_edit_apply(&ed, NULL, 0, &need), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_size(need, ==, want_len);
+
+    /* No operations: a plain copy */
+    YAPB_Packet_t rd;
+    YAPB_load(&rd, buf, len);
+    YAPB_edit_begin(&ed, &rd);
+    munit_assert_int(YAPB_edit_apply(&ed, out, sizeof(out), &out_len), ==, YAPB_OK);
+    munit_assert_size(out_len, ==, len);
+    munit_assert_memory_equal(len, out, buf);
+
+    /* Deleting the base timestamp writes the deltas after it in full */
+    int64_t t0 = 1760000000000000000LL, t1 = t0 + 5, t;
+    YAPB_Packet_t wr;
+    YAPB_initialize(&wr, buf, sizeof(buf));
+    YAPB_push_timestamp(&wr, &t0);
+    YAPB_push_timestamp_delta(&wr, &t1);
+    YAPB_finalize(&wr, &len);
+    munit_assert_size(len, ==, YAPB_HEADER_SIZE + 9 + 2);
+    YAPB_load(&rd, buf, len);
+    YAPB_edit_begin(&ed, &rd);
+    at = path("0");
+    YAPB_edit_delete(&ed, &at);
+    munit_assert_int(YAPB_edit_apply(&ed, out, sizeof(out), &out_len), ==, YAPB_OK);
+    munit_assert_size(out_len, ==, YAPB_HEADER_SIZE + 9);
+    munit_assert_uint8(out[YAPB_HEADER_SIZE], ==, YAPB_TIMESTAMP);
+    YAPB_load(&rd, out, out_len);
+    munit_assert_int(YAPB_pop_timestamp(&rd, &t), ==, YAPB_STS_COMPLETE);
+    munit_assert_int64(t, ==, t1);
+    return MUNIT_OK;
+}
+
+static MunitResult test_edit_errors(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[128], ebuf[16];
+    YAPB_Packet_t pkt, elems;
+    build_original(buf, sizeof(buf), &pkt);
+    int8_t v = 7;
+    YAPB_initialize(&elems, ebuf, sizeof(ebuf));
+    YAPB_push_i8(&elems, &v);
+
+    YAPB_Edit_t ed;
+    YAPB_KeyPath_t at;
+    uint8_t wbuf[16];
+    YAPB_Packet_t open_pkt;
+    YAPB_initialize(&open_pkt, wbuf, sizeof(wbuf));
+    munit_assert_int(YAPB_edit_begin(&ed, &open_pkt), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_edit_begin(&ed, &pkt), ==, YAPB_OK);
+
+    /* Unfinished packet of new elements */
+    at = path("0");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_ERR_INVALID_MODE);
+    YAPB_finalize(&elems, NULL);
+
+    at = path("5");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_ERR_NOT_FOUND);
+    at = path("4");
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_ERR_NOT_FOUND);
+    at = path("1.0");
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_ERR_TYPE_MISMATCH);
+    at = path("2.3");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_OK);
+    at = path("2.4");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_ERR_NOT_FOUND);
+
+    /* Conflicts with deleted or replaced elements */
+    at = path("2");
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_ERR_INVALID_MODE);
+    at = path("2.2");
+    munit_assert_int(YAPB_edit_replace(&ed, &at, &elems), ==, YAPB_OK);
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_ERR_INVALID_MODE);
+    at = path("2.2.0");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_ERR_INVALID_MODE);
+    at = path("2.2");
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_OK);
+
+    /* Operation limit */
+    munit_assert_int(YAPB_edit_begin(&ed, &pkt), ==, YAPB_OK);
+    at = path("0");
+    for (int i = 0; i < YAPB_EDIT_MAX_OPS; i++) {
+        munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_edit_insert(&ed, &at, &elems), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    uint8_t out[256];
+    size_t out_len;
+    munit_assert_int(YAPB_edit_apply(&ed, out, sizeof(out), &out_len), ==, YAPB_OK);
+    YAPB_Packet_t rd;
+    uint16_t count;
+    YAPB_load(&rd, out, out_len);
+    YAPB_get_elem_count(&rd, &count);
+    munit_assert_uint16(count, ==, 4 + YAPB_EDIT_MAX_OPS);
+
+    /* Malformed original */
+    buf[YAPB_HEADER_SIZE] = 0x0B;
+    YAPB_load(&rd, buf, sizeof(buf));
+    munit_assert_int(YAPB_edit_begin(&ed, &rd), ==, YAPB_OK);
+    at = path("1");
+    munit_assert_int(YAPB_edit_delete(&ed, &at), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_edit_apply(&ed, out, sizeof(out), &out_len), ==, YAPB_ERR_INVALID_PACKET);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/edit/ops",    test_edit_ops,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/edit/errors", test_edit_errors, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,352 @@
+#include "munit.h"
+#include "yapb.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+static_assert(std::ranges::forward_range<yapb::packet_view>);
+static_assert(std::ranges::view<yapb::packet_view>);
+static_assert(std::ranges::borrowed_range<yapb::packet_view>);
+static_assert(sizeof(yapb::element) == 2 * sizeof(void *));
+
+#define PACKETS 2000
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+struct stream_stats {
+    size_t packets = 0;
+    size_t batches = 0;
+    size_t max_batch = 0;
+    YAPB_Result_t end = YAPB_OK;
+};
+
+/* Packets: i32 seq, blob of seq % 300 bytes */
+static yapb::task<void> produce(yapb::executor &ex, int fd) {
+    static const uint8_t pad[300] = {0};
+    yapb::stream_writer out(ex, fd);
+    std::vector<uint8_t> bufs(8 * 512);
+    YAPB_Packet_t batch[8];
+    for (int32_t seq = 0; seq < PACKETS; seq += 8) {
+        for (int k = 0; k < 8; k++) {
+            int32_t v = seq + k;
+            YAPB_initialize(&batch[k], bufs.data() + k * 512, 512);
+            YAPB_push_i32(&batch[k], &v);
+            YAPB_push_blob(&batch[k], pad, (uint16_t)(v % 300));
+            YAPB_finalize(&batch[k], NULL);
+        }
+        munit_assert_int(co_await out.send_batch(batch), ==, YAPB_OK);
+    }
+    shutdown(fd, SHUT_WR);
+}
+
+static yapb::task<void> consume(yapb::executor &ex, int fd, stream_stats &st) {
+    std::vector<uint8_t> rx(4096);     /* small: packets straddle reads */
+    yapb::stream_reader in(ex, fd, rx);
+    YAPB_Packet_t batch[32];
+    size_t n;
+    YAPB_Result_t r;
+    while ((r = co_await in.next_batch(batch, n)) == YAPB_OK) {
+        for (size_t i = 0; i < n; i++) {
+            int32_t seq;
+            const uint8_t *blob;
+            uint16_t len;
+            YAPB_pop_i32(&batch[i], &seq);
+            YAPB_pop_blob(&batch[i], &blob, &len);
+            munit_assert_int(seq, ==, (int32_t)st.packets);
+            munit_assert_int(len, ==, seq % 300);
+            st.packets++;
+        }
+        st.batches++;
+        st.max_batch = std::max(st.max_batch, n);
+    }
+    st.end = r;
+}
+
+/* ======== Element ranges ======== */
+
+static MunitResult test_hpp_range(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t inner_buf[64], buf[256];
+    YAPB_Packet_t inner, pkt;
+    YAPB_initialize(&inner, inner_buf, sizeof(inner_buf));
+    int16_t i16 = -300;
+    YAPB_push_i16(&inner, &i16);
+    YAPB_push_blob(&inner, (const uint8_t *)"deep", 4);
+    YAPB_finalize(&inner, NULL);
+
+    int8_t i8 = -5;
+    int32_t i32 = 70000;
+    int64_t i64 = -(1LL << 40);
+    float f = 1.5f;
+    double d = -2.25;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i8(&pkt, &i8);
+    YAPB_push_i32(&pkt, &i32);
+    YAPB_push_i64(&pkt, &i64);
+    YAPB_push_float(&pkt, &f);
+    YAPB_push_double(&pkt, &d);
+    YAPB_push_blob(&pkt, (const uint8_t *)"hello", 5);
+    YAPB_push_nested(&pkt, &inner);
+    YAPB_push_blob(&pkt, NULL, 0);
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+
+    /* Same elements as YAPB_pop_next() */
+    YAPB_Packet_t rd;
+    YAPB_load(&rd, buf, len);
+    yapb::packet_view view(rd);
+    munit_assert_int(view.check(), ==, YAPB_OK);
+    size_t count = 0;
+    for (yapb::element e : view) {
+        YAPB_Element_t ref;
+        munit_assert_int(YAPB_pop_next(&rd, &ref), >=, 0);
+        munit_assert_int(e.type(), ==, ref.type);
+        if (e.is_integer()) {
+            int64_t want = ref.type == YAPB_INT8 ? ref.val.i8 : ref.type == YAPB_INT32 ? ref.val.i32 : ref.val.i64;
+            munit_assert_int64(e.as_int(), ==, want);
+        } else if (e.type() == YAPB_BLOB) {
+            munit_assert_size(e.blob().size(), ==, ref.val.blob.len);
+            munit_assert_ptr_equal(e.blob().data(), ref.val.blob.data);
+        }
+        count++;
+    }
+    munit_assert_size(count, ==, 8);
+
+    /* Typed access, nested ranges and std::ranges algorithms */
+    auto it = view.begin();
+    munit_assert_true((*it).get<int8_t>() == std::optional<int8_t>(-5));
+    munit_assert_false((*it).get<int32_t>().has_value());
+    ++it;
+    munit_assert_true((*it).get<uint32_t>() == std::optional<uint32_t>(70000));
+    munit_assert_double((*std::next(it, 2)).as_real(), ==, 1.5);
+    munit_assert_double((*std::next(it, 3)).get<double>().value(), ==, -2.25);
+    munit_assert_long(std::ranges::count_if(view, &yapb::element::is_integer), ==, 3);
+    munit_assert_long(std::ranges::count_if(view, &yapb::element::is_real), ==, 2);
+
+    auto nested = std::ranges::find_if(view, [](yapb::element e) { return e.type() == YAPB_NESTED_PKT; });
+    munit_assert_true(nested != view.end());
+    yapb::packet_view sub = (*nested).nested();
+    munit_assert_long(std::ranges::distance(sub), ==, 2);
+    munit_assert_int64((*sub.begin()).as_int(), ==, -300);
+    munit_assert_true((*std::next(sub.begin())).str() == "deep");
+    munit_assert_true((*std::ranges::find_if(view, [](yapb::element e) { return e.str() == "hello"; })).blob().size() == 5);
+
+    /* Malformed packets end the iteration early and fail check() */
+    buf[len - 3 - 15] = 0x08;   /* the nested element (tag + 14 bytes) gets a reserved tag */
+    yapb::packet_view broken(std::span<const uint8_t>(buf, len));
+    munit_assert_int(broken.check(), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_long(std::ranges::distance(broken), <, 8);
+    yapb::packet_view truncated(std::span<const uint8_t>(buf, len - 1));
+    munit_assert_int(truncated.check(), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_true(truncated.begin() == truncated.end());
+    return MUNIT_OK;
+}
+
+/* ======== Lazy field access ======== */
+
+/* 60 fields: i64 id, blob name, double price, then i32 0..56 */
+struct wide_msg : yapb::lazy_packet<int64_t, std::string_view, double, int32_t, int32_t, int32_t,
+    int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, int32_t, int32_t> {
+    using lazy_packet::lazy_packet;
+    std::optional<int64_t> id() const { return get<0>(); }
+    std::optional<std::string_view> name() const { return get<1>(); }
+    std::optional<double> price() const { return get<2>(); }
+};
+static_assert(wide_msg::field_count == 60);
+
+static MunitResult test_hpp_lazy(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[512];
+    YAPB_Packet_t pkt;
+    int64_t id = 42;
+    double price = 9.5;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i64(&pkt, &id);
+    YAPB_push_blob(&pkt, (const uint8_t *)"widget", 6);
+    YAPB_push_double(&pkt, &price);
+    for (int32_t i = 0; i < 57; i++)
+        YAPB_push_i32(&pkt, &i);
+    munit_assert_int(YAPB_finalize(&pkt, NULL), ==, YAPB_OK);
+
+    wide_msg m(pkt);
+    munit_assert_size(m.indexed(), ==, 0);
+    munit_assert_true(m.price() == 9.5);
+    munit_assert_size(m.indexed(), ==, 3);
+    munit_assert_true(m.id() == 42);
+    munit_assert_true(m.name() == std::string_view("widget"));
+    munit_assert_size(m.indexed(), ==, 3);
+    munit_assert_true(m.get<40>() == 37);
+    munit_assert_size(m.indexed(), ==, 41);
+    munit_assert_true(m.get<10>() == 7);
+    munit_assert_size(m.indexed(), ==, 41);
+    munit_assert_true(m.get<59>() == 56);
+
+    /* Wrong declared type: mismatch, output unchanged */
+    yapb::lazy_packet<int64_t, int64_t, std::span<const uint8_t>, yapb::element> other(pkt);
+    int64_t out = -1;
+    munit_assert_int(other.get<1>(out), ==, YAPB_ERR_TYPE_MISMATCH);
+    munit_assert_int64(out, ==, -1);
+    munit_assert_false(other.get<2>().has_value());
+    munit_assert_int(other.get<3>()->type(), ==, YAPB_INT32);
+
+    /* Older sender with fewer fields */
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i64(&pkt, &id);
+    YAPB_finalize(&pkt, NULL);
+    wide_msg old(pkt);
+    munit_assert_true(old.id() == 42);
+    std::string_view name;
+    munit_assert_int(old.get<1>(name), ==, YAPB_ERR_NO_MORE_ELEMENTS);
+    munit_assert_false(old.price().has_value());
+
+    /* Malformed element before the field */
+    uint8_t bad[] = { 0, 0, 0, 8, 0x00, 1, 0x0B, 0 };
+    wide_msg broken(yapb::packet_view(std::span<const uint8_t>(bad, sizeof(bad))));
+    int64_t v;
+    munit_assert_int(broken.get<0>(v), ==, YAPB_ERR_TYPE_MISMATCH);
+    munit_assert_false(broken.get<3>().has_value());
+    double d;
+    munit_assert_int(broken.get<2>(d), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* Back-reference to the nested packet at offset 4 */
+    uint8_t refs[] = { 0, 0, 0, 20, YAPB_NESTED_PKT, 0, 0, 0, 6, YAPB_INT8, 7,
+                       YAPB_INT8, 1, YAPB_NESTED_REF, 0, 0, 0, 4, YAPB_INT8, 9 };
+    yapb::packet_view rv(std::span<const uint8_t>(refs, sizeof(refs)));
+    munit_assert_int(rv.check(), ==, YAPB_OK);
+    auto it = std::ranges::next(rv.begin(), 2);
+    munit_assert_int((*it).type(), ==, YAPB_NESTED_REF);
+    munit_assert_true((*it).nested().empty());
+    munit_assert_int((*rv.nested(*it).begin()).as_int(), ==, 7);
+    yapb::lazy_packet<yapb::packet_view, int8_t, yapb::packet_view, int8_t> with_ref(rv);
+    yapb::packet_view target;
+    munit_assert_int(with_ref.get<2>(target), ==, YAPB_OK);
+    munit_assert_ptr_equal(target.bytes().data(), refs + 5);
+    refs[17] = 11;
+    munit_assert_int(rv.check(), ==, YAPB_ERR_INVALID_PACKET);
+    yapb::lazy_packet<yapb::packet_view, int8_t, yapb::packet_view, int8_t> bad_ref(rv);
+    munit_assert_int(bad_ref.get<2>(target), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_true(bad_ref.get<3>() == 9);
+
+    /* Timestamp deltas are relative to the packet's first timestamp */
+    int64_t t0 = 1760000000000000000LL, t1 = t0 - 250;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i64(&pkt, &id);
+    YAPB_push_timestamp(&pkt, &t0);
+    YAPB_push_timestamp_delta(&pkt, &t1);
+    YAPB_finalize(&pkt, NULL);
+    yapb::packet_view tv(pkt);
+    munit_assert_int(tv.check(), ==, YAPB_OK);
+    auto ts = std::ranges::next(tv.begin(), 2);
+    munit_assert_int((*ts).type(), ==, YAPB_TIMESTAMP_DELTA);
+    munit_assert_true(tv.timestamp(*ts) == t1);
+    munit_assert_true(tv.timestamp(*std::ranges::next(tv.begin(), 1)) == t0);
+    munit_assert_false(tv.timestamp(*tv.begin()).has_value());
+    return MUNIT_OK;
+}
+
+/* ======== Reader and writer on a socket ======== */
+
+static MunitResult test_hpp_stream(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    int sv[2];
+    munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv), ==, 0);
+    set_nonblocking(sv[0]);
+    set_nonblocking(sv[1]);
+
+    yapb::epoll_executor ex;
+    munit_assert_true(ex.valid());
+    stream_stats st;
+    ex.spawn(consume(ex, sv[1], st));
+    ex.spawn(produce(ex, sv[0]));
+    ex.run();
+
+    munit_assert_size(st.packets, ==, PACKETS);
+    munit_assert_int(st.end, ==, YAPB_ERR_NO_MORE_ELEMENTS);
+    /* Several packets per resumption */
+    munit_assert_size(st.max_batch, >, 1);
+    munit_assert_size(st.batches, <, PACKETS);
+    close(sv[0]);
+    close(sv[1]);
+    return MUNIT_OK;
+}
+
+/* ======== Framing and send errors ======== */
+
+static yapb::task<YAPB_Result_t> read_one(yapb::executor &ex, int fd, size_t buf_size, int skip) {
+    std::vector<uint8_t> rx(buf_size);
+    yapb::stream_reader in(ex, fd, rx);
+    YAPB_Packet_t pkt;
+    YAPB_Result_t r;
+    while ((r = co_await in.next_packet(pkt)) == YAPB_OK && skip-- > 0) {
+    }
+    co_return r;
+}
+
+static YAPB_Result_t read_bytes(const uint8_t *bytes, size_t len, size_t buf_size, int skip) {
+    int p[2];
+    munit_assert_int(pipe2(p, O_CLOEXEC | O_NONBLOCK), ==, 0);
+    munit_assert_int(write(p[1], bytes, len), ==, (ssize_t)len);
+    close(p[1]);
+    yapb::epoll_executor ex;
+    YAPB_Result_t r = ex.run(read_one(ex, p[0], buf_size, skip));
+    close(p[0]);
+    return r;
+}
+
+static MunitResult test_hpp_errors(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    /* One INT8 packet, then the start of another */
+    const uint8_t stream[] = { 0, 0, 0, 6, 0x00, 7, 0, 0, 0, 6, 0x00 };
+    munit_assert_int(read_bytes(stream, 6, 64, 0), ==, YAPB_OK);
+    munit_assert_int(read_bytes(stream, 6, 64, 1), ==, YAPB_ERR_NO_MORE_ELEMENTS);
+    munit_assert_int(read_bytes(stream, sizeof(stream), 64, 1), ==, YAPB_ERR_INVALID_PACKET);
+
+    const uint8_t huge[] = { 0, 1, 0, 0, 0x00 };
+    munit_assert_int(read_bytes(huge, sizeof(huge), 64, 0), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    const uint8_t runt[] = { 0, 0, 0, 2, 0x00 };
+    munit_assert_int(read_bytes(runt, sizeof(runt), 64, 0), ==, YAPB_ERR_INVALID_PACKET);
+
+    int sv[2];
+    munit_assert_int(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, sv), ==, 0);
+    yapb::epoll_executor ex;
+    yapb::stream_writer out(ex, sv[0]);
+    uint8_t buf[32];
+    YAPB_Packet_t pkt;
+    int8_t v = 1;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i8(&pkt, &v);
+    munit_assert_int(ex.run(out.send(pkt)), ==, YAPB_ERR_INVALID_MODE);
+    YAPB_finalize(&pkt, NULL);
+    munit_assert_int(ex.run(out.send(pkt)), ==, YAPB_OK);
+
+    /* A closed peer is an error, not SIGPIPE */
+    close(sv[1]);
+    munit_assert_int(ex.run(out.send(pkt)), ==, YAPB_ERR_IO);
+    close(sv[0]);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { (char *)"/hpp/range",   test_hpp_range,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { (char *)"/hpp/lazy",    test_hpp_lazy,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { (char *)"/hpp/stream",  test_hpp_stream, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { (char *)"/hpp/errors",  test_hpp_errors, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    (char *)"/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,285 @@
+#include "munit.h"
+#include "yapb_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Packets: i64 id (every id appears twice), nested { blob name } */
+static void append_records(const char *path, int64_t first, int64_t count) {
+    FILE *f = fopen(path, "ab");
+    munit_assert_not_null(f);
+    for (int64_t i = first; i < first + count; i++) {
+        char name[32];
+        int n = snprintf(name, sizeof(name), "user-name-%06lld", (long long)i);
+        uint8_t inner_buf[64], buf[128];
+        YAPB_Packet_t inner, pkt;
+        YAPB_initialize(&inner, inner_buf, sizeof(inner_buf));
+        YAPB_push_blob(&inner, (const uint8_t *)name, (uint16_t)n);
+        YAPB_finalize(&inner, NULL);
+
+        int64_t id = i / 2;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_i64(&pkt, &id);
+        YAPB_push_nested(&pkt, &inner);
+        size_t len;
+        YAPB_finalize(&pkt, &len);
+        fwrite(buf, 1, len, f);
+    }
+    fclose(f);
+}
+
+static int64_t packet_id(YAPB_Packet_t *pkt) {
+    int64_t id = -1;
+    YAPB_pop_i64(pkt, &id);
+    return id;
+}
+
+/* ======== Build and lookup ======== */
+
+static MunitResult test_index_lookup(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char log[] = "/tmp/yapb-index-XXXXXX";
+    close(mkstemp(log));
+    char idx_path[sizeof(log) + 4];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", log);
+    append_records(log, 0, 10000);
+
+    YAPB_KeyPath_t path;
+    YAPB_keypath_parse("0", &path);
+    YAPB_IndexConfig_t cfg = { .threads = 3 };
+    munit_assert_int(YAPB_index_build(log, idx_path, &path, &cfg), ==, YAPB_OK);
+
+    YAPB_Index_t idx;
+    munit_assert_int(YAPB_index_open(&idx, log, idx_path), ==, YAPB_OK);
+    uint64_t count;
+    YAPB_index_get_count(&idx, &count);
+    munit_assert_uint64(count, ==, 10000);
+
+    YAPB_Key_t key;
+    YAPB_Packet_t pkt;
+    YAPB_key_from_int(1234, &key);
+    munit_assert_int(YAPB_index_lookup(&idx, &key, &pkt), ==, YAPB_OK);
+    munit_assert_int64(packet_id(&pkt), ==, 1234);
+
+    /* Both packets with the id, in log order */
+    uint64_t offs[4];
+    size_t n;
+    munit_assert_int(YAPB_index_find(&idx, &key, offs, 4, &n), ==, YAPB_OK);
+    munit_assert_size(n, ==, 2);
+    munit_assert_uint64(offs[0], <, offs[1]);
+    munit_assert_int(YAPB_index_load(&idx, offs[1], &pkt), ==, YAPB_OK);
+    munit_assert_int64(packet_id(&pkt), ==, 1234);
+
+    YAPB_key_from_int(-7, &key);
+    munit_assert_int(YAPB_index_lookup(&idx, &key, &pkt), ==, YAPB_ERR_NOT_FOUND);
+    /* Same prefix bits, different kind */
+    YAPB_key_from_int(1234, &key);
+    key.kind = YAPB_KEY_REAL;
+    munit_assert_int(YAPB_index_find(&idx, &key, NULL, 0, &n), ==, YAPB_ERR_NOT_FOUND);
+    YAPB_index_close(&idx);
+
+    /* Blob keys longer than the 8-byte prefix */
+    YAPB_keypath_parse("1.0", &path);
+    munit_assert_int(YAPB_index_build(log, idx_path, &path, NULL), ==, YAPB_OK);
+    YAPB_index_open(&idx, log, idx_path);
+    const char *name = "user-name-004321";
+    YAPB_key_from_blob((const uint8_t *)name, (uint16_t)strlen(name), &key);
+    munit_assert_int(YAPB_index_find(&idx, &key, offs, 4, &n), ==, YAPB_OK);
+    munit_assert_size(n, ==, 1);
+    YAPB_index_load(&idx, offs[0], &pkt);
+    munit_assert_int64(packet_id(&pkt), ==, 4321 / 2);
+    YAPB_index_close(&idx);
+
+    unlink(log);
+    unlink(idx_path);
+    return MUNIT_OK;
+}
+
+/* ======== Incremental maintenance ======== */
+
+static MunitResult test_index_update(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char log[] = "/tmp/yapb-index-XXXXXX";
+    close(mkstemp(log));
+    char idx_path[sizeof(log) + 4];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", log);
+    append_records(log, 0, 4000);
+
+    YAPB_KeyPath_t path;
+    YAPB_keypath_parse("0", &path);
+    YAPB_IndexConfig_t cfg = { .threads = 2 };
+    YAPB_index_build(log, idx_path, &path, &cfg);
+    munit_assert_int(YAPB_index_update(log, idx_path), ==, YAPB_OK);
+
+    /* Small appends go to the tail, larger ones are merged in */
+    const int64_t batches[] = { 10, 300, 5000 };
+    int64_t total = 4000;
+    for (size_t b = 0; b < 3; b++) {
+        append_records(log, total, batches[b]);
+        total += batches[b];
+        munit_assert_int(YAPB_index_update(log, idx_path), ==, YAPB_OK);
+
+        YAPB_Index_t idx;
+        munit_assert_int(YAPB_index_open(&idx, log, idx_path), ==, YAPB_OK);
+        uint64_t count;
+        YAPB_index_get_count(&idx, &count);
+        munit_assert_uint64(count, ==, (uint64_t)total);
+
+        /* Old and newest ids, including one split across old and new data */
+        const int64_t ids[] = { 0, 1999, (total - 1) / 2 };
+        for (size_t i = 0; i < 3; i++) {
+            YAPB_Key_t key;
+            YAPB_Packet_t pkt;
+            YAPB_key_from_int(ids[i], &key);
+            munit_assert_int(YAPB_index_lookup(&idx, &key, &pkt), ==, YAPB_OK);
+            munit_assert_int64(packet_id(&pkt), ==, ids[i]);
+        }
+        YAPB_index_close(&idx);
+    }
+
+    /* An index does not match a log that shrank */
+    munit_assert_int(truncate(log, 100), ==, 0);
+    YAPB_Index_t idx;
+    munit_assert_int(YAPB_index_open(&idx, log, idx_path), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_index_update(log, idx_path), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_index_open(&idx, idx_path, log), ==, YAPB_ERR_INVALID_PACKET);
+
+    unlink(log);
+    unlink(idx_path);
+    return MUNIT_OK;
+}
+
+static MunitResult test_index_runs(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char log[] = "/tmp/yapb-index-XXXXXX";
+    close(mkstemp(log));
+    char idx_path[sizeof(log) + 4];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", log);
+    append_records(log, 0, 20000);
+
+    YAPB_KeyPath_t path;
+    YAPB_keypath_parse("0", &path);
+    YAPB_index_build(log, idx_path, &path, NULL);
+
+    /* Many small appends stack up as sorted tail runs */
+    int64_t total = 20000;
+    for (int b = 0; b < 60; b++) {
+        int64_t count = 1 + (b * 7) % 23;
+        append_records(log, total, count);
+        total += count;
+        munit_assert_int(YAPB_index_update(log, idx_path), ==, YAPB_OK);
+
+        YAPB_Index_t idx;
+        munit_assert_int(YAPB_index_open(&idx, log, idx_path), ==, YAPB_OK);
+        uint64_t n;
+        YAPB_index_get_count(&idx, &n);
+        munit_assert_uint64(n, ==, (uint64_t)total);
+        for (int64_t id = (total - count - 2) / 2; id <= (total - 1) / 2; id++) {
+            YAPB_Key_t key;
+            uint64_t offs[4];
+            size_t found;
+            YAPB_key_from_int(id, &key);
+            munit_assert_int(YAPB_index_find(&idx, &key, offs, 4, &found), ==, YAPB_OK);
+            munit_assert_size(found, ==, (id == (total - 1) / 2 && total % 2 == 1) ? 1 : 2);
+            if (found == 2) munit_assert_uint64(offs[0], <, offs[1]);
+        }
+        YAPB_index_close(&idx);
+    }
+
+    /* A packet still being written is left for the next update */
+    uint8_t buf[16];
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    int64_t id = total / 2;
+    YAPB_push_i64(&pkt, &id);
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+    FILE *f = fopen(log, "ab");
+    fwrite(buf, 1, 6, f);
+    fclose(f);
+    munit_assert_int(YAPB_index_update(log, idx_path), ==, YAPB_OK);
+    YAPB_Index_t idx;
+    uint64_t n;
+    YAPB_index_open(&idx, log, idx_path);
+    YAPB_index_get_count(&idx, &n);
+    munit_assert_uint64(n, ==, (uint64_t)total);
+    YAPB_index_close(&idx);
+
+    f = fopen(log, "ab");
+    fwrite(buf + 6, 1, len - 6, f);
+    fclose(f);
+    munit_assert_int(YAPB_index_update(log, idx_path), ==, YAPB_OK);
+    YAPB_index_open(&idx, log, idx_path);
+    YAPB_index_get_count(&idx, &n);
+    munit_assert_uint64(n, ==, (uint64_t)total + 1);
+    YAPB_Key_t key;
+    YAPB_key_from_int(id, &key);
+    munit_assert_int(YAPB_index_lookup(&idx, &key, &pkt), ==, YAPB_OK);
+    YAPB_index_close(&idx);
+
+    unlink(log);
+    unlink(idx_path);
+    return MUNIT_OK;
+}
+
+static MunitResult test_index_numa(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char log[] = "/tmp/yapb-index-XXXXXX";
+    close(mkstemp(log));
+    char idx_path[sizeof(log) + 4], numa_path[sizeof(log) + 5];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", log);
+    snprintf(numa_path, sizeof(numa_path), "%s.numa", log);
+    append_records(log, 0, 10000);
+
+    /* Placement must not change the index */
+    YAPB_KeyPath_t path;
+    YAPB_keypath_parse("0", &path);
+    YAPB_IndexConfig_t cfg = { .threads = 4 };
+    munit_assert_int(YAPB_index_build(log, idx_path, &path, &cfg), ==, YAPB_OK);
+    cfg.numa = true;
+    munit_assert_int(YAPB_index_build(log, numa_path, &path, &cfg), ==, YAPB_OK);
+
+    YAPB_LogMap_t a, b;
+    size_t a_len, b_len;
+    YAPB_log_map(&a, idx_path, 0);
+    YAPB_log_map(&b, numa_path, 0);
+    const uint8_t *a_data = YAPB_log_get_data(&a, &a_len);
+    const uint8_t *b_data = YAPB_log_get_data(&b, &b_len);
+    munit_assert_size(a_len, ==, b_len);
+    munit_assert_memory_equal(a_len, a_data, b_data);
+    YAPB_log_unmap(&a);
+    YAPB_log_unmap(&b);
+
+    YAPB_Index_t idx;
+    YAPB_Key_t key;
+    YAPB_Packet_t pkt;
+    munit_assert_int(YAPB_index_open(&idx, log, numa_path), ==, YAPB_OK);
+    YAPB_key_from_int(4321, &key);
+    munit_assert_int(YAPB_index_lookup(&idx, &key, &pkt), ==, YAPB_OK);
+    munit_assert_int64(packet_id(&pkt), ==, 4321);
+    YAPB_index_close(&idx);
+
+    unlink(log);
+    unlink(idx_path);
+    unlink(numa_path);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/index/lookup",       test_index_lookup, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/index/update",       test_index_update, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/index/runs",         test_index_runs,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/index/numa",         test_index_numa,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,164 @@
+#include "munit.h"
+#include "yapb_journal.h"
+#include "yapb_log.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define THREADS     8
+#define PER_THREAD  200
+
+/* Packets: i32 thread, i32 sequence */
+static void make_packet(int32_t thread, int32_t seq, uint8_t *buf, YAPB_Packet_t *pkt) {
+    YAPB_initialize(pkt, buf, 32);
+    YAPB_push_i32(pkt, &thread);
+    YAPB_push_i32(pkt, &seq);
+    YAPB_finalize(pkt, NULL);
+}
+
+typedef struct {
+    YAPB_Journal_t *j;
+    int32_t id;
+    uint64_t offs[PER_THREAD];
+    int failures;
+} Submitter;
+
+static void *submitter_main(void *arg) {
+    Submitter *s = arg;
+    for (int32_t i = 0; i < PER_THREAD; i++) {
+        uint8_t buf[32];
+        YAPB_Packet_t pkt;
+        make_packet(s->id, i, buf, &pkt);
+        if (YAPB_journal_append(s->j, &pkt, &s->offs[i]) != YAPB_OK) {
+            s->failures++;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* ======== Concurrent appends ======== */
+
+static MunitResult test_journal_concurrent(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-journal-XXXXXX";
+    close(mkstemp(path));
+
+    YAPB_JournalConfig_t cfg = { .buffer_bytes = 4096 };
+    YAPB_Journal_t j;
+    munit_assert_int(YAPB_journal_open(&j, path, &cfg), ==, YAPB_OK);
+
+    static Submitter subs[THREADS];
+    pthread_t th[THREADS];
+    for (int32_t t = 0; t < THREADS; t++) {
+        subs[t] = (Submitter){ .j = &j, .id = t };
+        munit_assert_int(pthread_create(&th[t], NULL, submitter_main, &subs[t]), ==, 0);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+        munit_assert_int(subs[t].failures, ==, 0);
+    }
+
+    YAPB_JournalStats_t st;
+    YAPB_journal_get_stats(&j, &st);
+    munit_assert_uint64(st.packets, ==, THREADS * PER_THREAD);
+    munit_assert_uint64(st.syncs, <=, st.packets);
+    munit_assert_int(YAPB_journal_close(&j), ==, YAPB_OK);
+
+    /* Every packet is in the file, at its reported offset, in submit order per thread */
+    YAPB_LogMap_t map;
+    munit_assert_int(YAPB_log_map(&map, path, 0), ==, YAPB_OK);
+    size_t len;
+    const uint8_t *log = YAPB_log_get_data(&map, &len);
+    munit_assert_size(len, ==, st.bytes);
+
+    static uint64_t all[THREADS * PER_THREAD];
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < PER_THREAD; i++) {
+            YAPB_Packet_t pkt;
+            int32_t thread, seq;
+            munit_assert_uint64(subs[t].offs[i], <, len);
+            munit_assert_int(YAPB_load(&pkt, log + subs[t].offs[i], len - subs[t].offs[i]), ==, YAPB_OK);
+            YAPB_pop_i32(&pkt, &thread);
+            YAPB_pop_i32(&pkt, &seq);
+            munit_assert_int(thread, ==, t);
+            munit_assert_int(seq, ==, i);
+            if (i > 0) munit_assert_uint64(subs[t].offs[i], >, subs[t].offs[i - 1]);
+            all[t * PER_THREAD + i] = subs[t].offs[i];
+        }
+    }
+    qsort(all, THREADS * PER_THREAD, sizeof(uint64_t), cmp_u64);
+    for (size_t i = 1; i < THREADS * PER_THREAD; i++) {
+        munit_assert_uint64(all[i], >, all[i - 1]);
+    }
+
+    YAPB_log_unmap(&map);
+    unlink(path);
+    return MUNIT_OK;
+}
+
+/* ======== Batching, offsets and limits ======== */
+
+static MunitResult test_journal_batch(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-journal-XXXXXX";
+    int fd = mkstemp(path);
+    munit_assert_int(write(fd, "existing", 8), ==, 8);
+    close(fd);
+
+    /* A long delay lets every submitted packet join the first batch */
+    YAPB_JournalConfig_t cfg = { .buffer_bytes = 32 * 1024, .max_delay_us = 50000 };
+    YAPB_Journal_t j;
+    munit_assert_int(YAPB_journal_open(&j, path, &cfg), ==, YAPB_OK);
+
+    uint64_t ticket = 0, off = 0, expect = 8;
+    for (int32_t i = 0; i < 100; i++) {
+        uint8_t buf[32];
+        YAPB_Packet_t pkt;
+        size_t plen;
+        make_packet(0, i, buf, &pkt);
+        YAPB_get_buffer(&pkt, &plen);
+        munit_assert_int(YAPB_journal_submit(&j, &pkt, &ticket, &off), ==, YAPB_OK);
+        munit_assert_uint64(off, ==, expect);
+        expect += plen;
+    }
+    munit_assert_int(YAPB_journal_wait(&j, ticket), ==, YAPB_OK);
+    YAPB_JournalStats_t st;
+    YAPB_journal_get_stats(&j, &st);
+    munit_assert_uint64(st.packets, ==, 100);
+    munit_assert_uint64(st.syncs, <=, 10);
+
+    /* Packets larger than the staging buffer are refused */
+    static uint8_t big_buf[40100];
+    static uint8_t blob[40000];
+    YAPB_Packet_t big;
+    YAPB_initialize(&big, big_buf, sizeof(big_buf));
+    YAPB_push_blob(&big, blob, sizeof(blob));
+    YAPB_finalize(&big, NULL);
+    munit_assert_int(YAPB_journal_submit(&j, &big, &ticket, NULL), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+
+    munit_assert_int(YAPB_journal_close(&j), ==, YAPB_OK);
+    unlink(path);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/journal/concurrent", test_journal_concurrent, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/journal/batch",      test_journal_batch,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
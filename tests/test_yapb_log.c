@@ -0,0 +1,172 @@
+#include "munit.h"
+#include "yapb_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static size_t build_record(uint8_t *buf, size_t size, int64_t id, double score, const char *name) {
+    uint8_t inner_buf[64];
+    YAPB_Packet_t inner, pkt;
+    YAPB_initialize(&inner, inner_buf, sizeof(inner_buf));
+    YAPB_push_double(&inner, &score);
+    YAPB_push_blob(&inner, (const uint8_t *)name, (uint16_t)strlen(name));
+    YAPB_finalize(&inner, NULL);
+
+    YAPB_initialize(&pkt, buf, size);
+    YAPB_push_i64(&pkt, &id);
+    YAPB_push_nested(&pkt, &inner);
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+    return len;
+}
+
+/* ======== Key paths ======== */
+
+static MunitResult test_keypath_parse(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_KeyPath_t path;
+    munit_assert_int(YAPB_keypath_parse("2.0.13", &path), ==, YAPB_OK);
+    munit_assert_uint16(path.depth, ==, 3);
+    munit_assert_uint16(path.index[0], ==, 2);
+    munit_assert_uint16(path.index[2], ==, 13);
+
+    munit_assert_int(YAPB_keypath_parse("", &path), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_keypath_parse("1.", &path), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_keypath_parse("1.x", &path), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_keypath_parse("70000", &path), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_keypath_parse("0.0.0.0.0.0.0.0.0", &path), ==, YAPB_ERR_INVALID_PACKET);
+    return MUNIT_OK;
+}
+
+static MunitResult test_key_extract(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t a[128], b[128];
+    size_t alen = build_record(a, sizeof(a), -5, -1.5, "alpha-long-name");
+    size_t blen = build_record(b, sizeof(b), 3, 0.25, "alpha-long-other");
+
+    YAPB_KeyPath_t path;
+    YAPB_Key_t ka, kb;
+
+    /* Signed integers order correctly across zero */
+    YAPB_keypath_parse("0", &path);
+    YAPB_key_extract(a, alen, &path, &ka);
+    YAPB_key_extract(b, blen, &path, &kb);
+    munit_assert_int(ka.kind, ==, YAPB_KEY_INT);
+    munit_assert_int(YAPB_key_compare(&ka, &kb), <, 0);
+
+    /* Doubles inside a nested packet */
+    YAPB_keypath_parse("1.0", &path);
+    YAPB_key_extract(a, alen, &path, &ka);
+    YAPB_key_extract(b, blen, &path, &kb);
+    munit_assert_int(ka.kind, ==, YAPB_KEY_REAL);
+    munit_assert_int(YAPB_key_compare(&ka, &kb), <, 0);
+
+    /* Blobs with equal 8-byte prefixes fall back to the full bytes */
+    YAPB_keypath_parse("1.1", &path);
+    YAPB_key_extract(a, alen, &path, &ka);
+    YAPB_key_extract(b, blen, &path, &kb);
+    munit_assert_int(ka.kind, ==, YAPB_KEY_BLOB);
+    munit_assert_uint64(ka.prefix, ==, kb.prefix);
+    munit_assert_int(YAPB_key_compare(&ka, &kb), <, 0);
+    munit_assert_int(YAPB_key_compare(&kb, &ka), >, 0);
+    munit_assert_int(YAPB_key_compare(&ka, &ka), ==, 0);
+
+    /* Missing elements and non-nested intermediates give no key */
+    YAPB_keypath_parse("1.5", &path);
+    YAPB_key_extract(a, alen, &path, &ka);
+    munit_assert_int(ka.kind, ==, YAPB_KEY_NONE);
+    YAPB_keypath_parse("0.0", &path);
+    YAPB_key_extract(a, alen, &path, &ka);
+    munit_assert_int(ka.kind, ==, YAPB_KEY_NONE);
+    munit_assert_int(YAPB_key_compare(&kb, &ka), <, 0);
+
+    /* Malformed data along the path is reported */
+    a[4] = 0x0A;
+    YAPB_keypath_parse("1", &path);
+    munit_assert_int(YAPB_key_extract(a, alen, &path, &ka), ==, YAPB_ERR_INVALID_PACKET);
+    return MUNIT_OK;
+}
+
+/* ======== Log files ======== */
+
+static MunitResult test_log_scan(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-log-XXXXXX";
+    int fd = mkstemp(path);
+    munit_assert_int(fd, >=, 0);
+    FILE *f = fdopen(fd, "wb");
+    for (int64_t i = 0; i < 10; i++) {
+        uint8_t buf[128];
+        size_t len = build_record(buf, sizeof(buf), i, (double)i, "x");
+        fwrite(buf, 1, len, f);
+    }
+    fclose(f);
+
+    YAPB_LogMap_t map;
+    munit_assert_int(YAPB_log_map(&map, path, 0), ==, YAPB_OK);
+    size_t len, off = 0;
+    const uint8_t *log = YAPB_log_get_data(&map, &len);
+
+    const uint8_t *pkt;
+    size_t pkt_len;
+    int64_t expect = 0;
+    while (YAPB_log_next(log, len, &off, &pkt, &pkt_len) == YAPB_OK) {
+        YAPB_Packet_t rpkt;
+        int64_t id;
+        YAPB_load(&rpkt, pkt, pkt_len);
+        YAPB_pop_i64(&rpkt, &id);
+        munit_assert_int64(id, ==, expect++);
+    }
+    munit_assert_int64(expect, ==, 10);
+    munit_assert_size(off, ==, len);
+    munit_assert_int(YAPB_log_next(log, len, &off, &pkt, &pkt_len), ==, YAPB_ERR_NO_MORE_ELEMENTS);
+
+    /* A truncated tail is reported, not skipped */
+    off = 0;
+    munit_assert_int(YAPB_log_next(log, len - 1, &off, &pkt, &pkt_len), ==, YAPB_OK);
+    off = len - pkt_len;
+    munit_assert_int(YAPB_log_next(log, len - 1, &off, &pkt, &pkt_len), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* Access hints change how pages arrive, not what is read */
+    static const unsigned hints[] = {
+        YAPB_MAP_SEQUENTIAL | YAPB_MAP_WILLNEED, YAPB_MAP_RANDOM,
+        YAPB_MAP_POPULATE | YAPB_MAP_HUGEPAGE,
+    };
+    for (size_t i = 0; i < sizeof(hints) / sizeof(hints[0]); i++) {
+        YAPB_LogMap_t hinted;
+        size_t hinted_len;
+        munit_assert_int(YAPB_log_map(&hinted, path, hints[i]), ==, YAPB_OK);
+        const uint8_t *bytes = YAPB_log_get_data(&hinted, &hinted_len);
+        munit_assert_size(hinted_len, ==, len);
+        munit_assert_memory_equal(len, bytes, log);
+        munit_assert_int(YAPB_log_prefetch(&hinted, 7, len), ==, YAPB_OK);
+        munit_assert_int(YAPB_log_prefetch(&hinted, len, 4096), ==, YAPB_OK);
+        YAPB_log_unmap(&hinted);
+    }
+    YAPB_LogMap_t bad;
+    munit_assert_int(YAPB_log_map(&bad, path, YAPB_MAP_SEQUENTIAL | YAPB_MAP_RANDOM), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_log_map(&bad, path, 0x100), ==, YAPB_ERR_INVALID_MODE);
+
+    YAPB_log_unmap(&map);
+    unlink(path);
+    munit_assert_int(YAPB_log_map(&map, path, 0), ==, YAPB_ERR_IO);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/keypath/parse",      test_keypath_parse, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/key/extract",        test_key_extract,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/log/scan",           test_log_scan,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,100 @@
+#include "munit.h"
+#include "yapb_numa.h"
+#include <sys/mman.h>
+
+/* ======== Topology and placement ======== */
+
+static MunitResult test_numa_topology(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    unsigned count = YAPB_numa_node_count();
+    munit_assert_uint(count, >=, 1);
+    munit_assert_uint(count, <=, YAPB_NUMA_MAX_NODES);
+    munit_assert_int(YAPB_numa_node_id(count), ==, -1);
+
+    /* The current node is one of the online nodes */
+    int here = YAPB_numa_current_node();
+    bool found = false;
+    for (unsigned i = 0; i < count; i++) {
+        munit_assert_int(YAPB_numa_node_id(i), >=, 0);
+        found |= YAPB_numa_node_id(i) == here;
+    }
+    munit_assert_true(found);
+
+    munit_assert_int(YAPB_numa_pin_thread(here), ==, YAPB_OK);
+    munit_assert_int(YAPB_numa_current_node(), ==, here);
+    munit_assert_int(YAPB_numa_pin_thread(1000), ==, YAPB_ERR_NOT_FOUND);
+
+    size_t size = 1 << 20;
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    munit_assert_ptr_not_equal(mem, MAP_FAILED);
+    munit_assert_int(YAPB_numa_bind(mem, size, here), ==, YAPB_OK);
+    munit_assert_int(YAPB_numa_bind(mem, size, 4096), ==, YAPB_ERR_INVALID_MODE);
+    munmap(mem, size);
+    return MUNIT_OK;
+}
+
+/* ======== Per-node pools ======== */
+
+static MunitResult test_numa_pools(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_NodePools_t np;
+    munit_assert_int(YAPB_nodepools_init(&np, 64 * 1024, 960, YAPB_POOL_MEM_PREFAULT), ==, YAPB_OK);
+
+    unsigned count = YAPB_numa_node_count();
+    size_t total = 0;
+    for (unsigned i = 0; i < count; i++) {
+        size_t n;
+        YAPB_Pool_t *pool = YAPB_nodepools_get_pool(&np, YAPB_numa_node_id(i));
+        munit_assert_not_null(pool);
+        YAPB_pool_get_count(pool, &n, NULL);
+        munit_assert_size(n, ==, 64);
+        total += n;
+    }
+    munit_assert_null(YAPB_nodepools_get_pool(&np, 1000));
+
+    /* The local pool is used first, then the others */
+    YAPB_Pool_t *local = YAPB_nodepools_get_pool(&np, YAPB_numa_current_node());
+    static YAPB_Shared_t *held[64 * YAPB_NUMA_MAX_NODES];
+    YAPB_Shared_t *sh;
+    munit_assert_int(YAPB_nodepools_alloc(&np, &held[0]), ==, YAPB_OK);
+    munit_assert_int(YAPB_shared_ref(local, YAPB_shared_data(held[0], NULL), &sh), ==, YAPB_OK);
+    YAPB_shared_release(sh);
+    for (size_t i = 1; i < total; i++) {
+        munit_assert_int(YAPB_nodepools_alloc(&np, &held[i]), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_nodepools_alloc(&np, &sh), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+
+    /* Buffers go back to the pool they came from */
+    for (size_t i = 0; i < total; i++) {
+        YAPB_Packet_t pkt;
+        int32_t v = (int32_t)i;
+        YAPB_shared_initialize(&pkt, held[i]);
+        YAPB_push_i32(&pkt, &v);
+        YAPB_finalize(&pkt, NULL);
+        YAPB_shared_release(held[i]);
+    }
+    size_t nfree;
+    YAPB_pool_get_count(local, NULL, &nfree);
+    munit_assert_size(nfree, ==, 64);
+
+    munit_assert_int(YAPB_nodepools_destroy(&np), ==, YAPB_OK);
+    munit_assert_int(YAPB_nodepools_alloc(&np, &sh), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_nodepools_init(&np, 4096, 64, 0x80), ==, YAPB_ERR_INVALID_MODE);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/numa/topology",      test_numa_topology, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/numa/pools",         test_numa_pools,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,331 @@
+#include "munit.h"
+#include "yapb_plan.h"
+#include <string.h>
+
+static size_t build_position(uint8_t *buf, size_t size, int32_t x, int32_t y, double z) {
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, buf, size);
+    YAPB_push_i32(&pkt, &x);
+    YAPB_push_i32(&pkt, &y);
+    YAPB_push_double(&pkt, &z);
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+    return len;
+}
+
+/* ======== Shape fingerprint ======== */
+
+static MunitResult test_shape_matches_tags(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[64];
+    size_t len = build_position(buf, sizeof(buf), 1, 2, 3.0);
+
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, buf, len);
+    uint64_t fp_pkt, fp_tags;
+    uint16_t count;
+    munit_assert_int(YAPB_get_shape(&rpkt, &fp_pkt, &count), ==, YAPB_OK);
+    munit_assert_uint16(count, ==, 3);
+
+    const YAPB_Type_t tags[] = { YAPB_INT32, YAPB_INT32, YAPB_DOUBLE };
+    YAPB_shape_of_tags(tags, 3, &fp_tags);
+    munit_assert_uint64(fp_pkt, ==, fp_tags);
+
+    /* Different order or count gives a different shape */
+    const YAPB_Type_t swapped[] = { YAPB_INT32, YAPB_DOUBLE, YAPB_INT32 };
+    YAPB_shape_of_tags(swapped, 3, &fp_tags);
+    munit_assert_uint64(fp_pkt, !=, fp_tags);
+    YAPB_shape_of_tags(tags, 2, &fp_tags);
+    munit_assert_uint64(fp_pkt, !=, fp_tags);
+
+    /* Read position is untouched */
+    int32_t x = 0;
+    munit_assert_int(YAPB_pop_i32(&rpkt, &x), ==, YAPB_OK);
+    munit_assert_int32(x, ==, 1);
+
+    /* Timestamps are written in full whatever their values */
+    const YAPB_Type_t ts_tags[] = { YAPB_TIMESTAMP, YAPB_TIMESTAMP };
+    YAPB_shape_of_tags(ts_tags, 2, &fp_tags);
+    const int64_t t0 = 1760000000000000000LL, later[] = { t0 + 5, t0 + 86400000000000LL };
+    for (int i = 0; i < 2; i++) {
+        YAPB_Packet_t pkt;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_timestamp(&pkt, &t0);
+        YAPB_push_timestamp(&pkt, &later[i]);
+        YAPB_finalize(&pkt, &len);
+        YAPB_load(&rpkt, buf, len);
+        munit_assert_int(YAPB_get_shape(&rpkt, &fp_pkt, NULL), ==, YAPB_OK);
+        munit_assert_uint64(fp_pkt, ==, fp_tags);
+    }
+    return MUNIT_OK;
+}
+
+static MunitResult test_shape_invalid(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[] = { 0, 0, 0, 7, YAPB_INT32, 0, 0 };
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, buf, sizeof(buf));
+    uint64_t fp;
+    munit_assert_int(YAPB_get_shape(&rpkt, &fp, NULL), ==, YAPB_ERR_INVALID_PACKET);
+
+    uint8_t wbuf[16];
+    YAPB_Packet_t wpkt;
+    YAPB_initialize(&wpkt, wbuf, sizeof(wbuf));
+    munit_assert_int(YAPB_get_shape(&wpkt, &fp, NULL), ==, YAPB_ERR_INVALID_MODE);
+    return MUNIT_OK;
+}
+
+/* ======== Decode plans ======== */
+
+static MunitResult test_plan_decode(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    uint8_t buf[64];
+    size_t len = build_position(buf, sizeof(buf), -7, 1 << 20, 2.5);
+
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, buf, len);
+    YAPB_Plan_t plan;
+    munit_assert_int(YAPB_plan_from_packet(&plan, 42, &rpkt), ==, YAPB_OK);
+    munit_assert_uint32(YAPB_plan_get_id(&plan), ==, 42);
+    munit_assert_uint16(YAPB_plan_get_count(&plan), ==, 3);
+
+    int32_t x = 0, y = 0;
+    double z = 0;
+    void *outs[] = { &x, &y, &z };
+    munit_assert_int(YAPB_plan_decode(&plan, &rpkt, outs), ==, YAPB_OK);
+    munit_assert_int32(x, ==, -7);
+    munit_assert_int32(y, ==, 1 << 20);
+    munit_assert_double(z, ==, 2.5);
+
+    /* NULL outputs skip fields */
+    int32_t y2 = 0;
+    void *some[] = { NULL, &y2, NULL };
+    munit_assert_int(YAPB_plan_decode(&plan, &rpkt, some), ==, YAPB_OK);
+    munit_assert_int32(y2, ==, 1 << 20);
+    return MUNIT_OK;
+}
+
+static MunitResult test_plan_mismatch(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    const YAPB_Type_t tags[] = { YAPB_INT32, YAPB_INT32, YAPB_DOUBLE };
+    YAPB_Plan_t plan;
+    YAPB_plan_build(&plan, 1, tags, 3);
+
+    /* Same length as the plan, different tags */
+    uint8_t buf[64];
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    int64_t a = 1; int32_t b = 2; int16_t c = 3; int8_t d = 4;
+    YAPB_push_i64(&pkt, &a);
+    YAPB_push_i32(&pkt, &b);
+    YAPB_push_i16(&pkt, &c);
+    YAPB_push_i8(&pkt, &d);
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+    munit_assert_size(len, ==, YAPB_HEADER_SIZE + 5 + 5 + 9);
+
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, buf, len);
+    int32_t x = 11, y = 12;
+    double z = 13;
+    void *outs[] = { &x, &y, &z };
+    munit_assert_int(YAPB_plan_decode(&plan, &rpkt, outs), ==, YAPB_ERR_TYPE_MISMATCH);
+    munit_assert_int32(x, ==, 11);
+    munit_assert_int32(y, ==, 12);
+    munit_assert_double(z, ==, 13);
+
+    /* Variable-size elements cannot be planned */
+    const YAPB_Type_t blob[] = { YAPB_INT8, YAPB_BLOB };
+    munit_assert_int(YAPB_plan_build(&plan, 2, blob, 2), ==, YAPB_ERR_TYPE_MISMATCH);
+    return MUNIT_OK;
+}
+
+/* ======== Registry ======== */
+
+static MunitResult test_registry_dispatch(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Plan_t slots[4];
+    YAPB_Registry_t reg;
+    munit_assert_int(YAPB_registry_init(&reg, slots, 3), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_int(YAPB_registry_init(&reg, slots, 4), ==, YAPB_OK);
+
+    const YAPB_Type_t pos_tags[] = { YAPB_INT32, YAPB_INT32, YAPB_DOUBLE };
+    const YAPB_Type_t tick_tags[] = { YAPB_INT64, YAPB_FLOAT };
+    YAPB_Plan_t plan;
+    YAPB_plan_build(&plan, 1, pos_tags, 3);
+    munit_assert_int(YAPB_registry_add(&reg, &plan), ==, YAPB_OK);
+    YAPB_plan_build(&plan, 2, tick_tags, 2);
+    munit_assert_int(YAPB_registry_add(&reg, &plan), ==, YAPB_OK);
+
+    uint8_t buf[64];
+    size_t len = build_position(buf, sizeof(buf), 3, 4, 5.0);
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, buf, len);
+    const YAPB_Plan_t *found = NULL;
+    munit_assert_int(YAPB_registry_lookup(&reg, &rpkt, &found), ==, YAPB_OK);
+    munit_assert_uint32(YAPB_plan_get_id(found), ==, 1);
+
+    /* Unknown shape falls back */
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    int8_t v = 1;
+    YAPB_push_i8(&pkt, &v);
+    YAPB_finalize(&pkt, &len);
+    YAPB_load(&rpkt, buf, len);
+    found = NULL;
+    munit_assert_int(YAPB_registry_lookup(&reg, &rpkt, &found), ==, YAPB_ERR_TYPE_MISMATCH);
+    munit_assert_null(found);
+
+    /* Fill up the registry */
+    const YAPB_Type_t t3[] = { YAPB_INT8 };
+    const YAPB_Type_t t4[] = { YAPB_INT16 };
+    const YAPB_Type_t t5[] = { YAPB_INT32 };
+    YAPB_plan_build(&plan, 3, t3, 1);
+    munit_assert_int(YAPB_registry_add(&reg, &plan), ==, YAPB_OK);
+    YAPB_plan_build(&plan, 4, t4, 1);
+    munit_assert_int(YAPB_registry_add(&reg, &plan), ==, YAPB_OK);
+    YAPB_plan_build(&plan, 5, t5, 1);
+    munit_assert_int(YAPB_registry_add(&reg, &plan), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_int(YAPB_registry_lookup(&reg, &rpkt, &found), ==, YAPB_OK);
+    munit_assert_uint32(YAPB_plan_get_id(found), ==, 3);
+    return MUNIT_OK;
+}
+
+/* ======== Reader plans ======== */
+
+/* Reader schema v2: id, value, flags. v1 writers lack flags; v3 writers
+ * append a blob; a writer that changed value to int64 breaks from there. */
+static const YAPB_Type_t reader_v2[] = { YAPB_INT32, YAPB_INT32, YAPB_INT16 };
+
+static size_t build_versioned(uint8_t *buf, size_t size, int version, int32_t id) {
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, buf, size);
+    YAPB_push_i32(&pkt, &id);
+    if (version == 4) {
+        int64_t wide = 1000;
+        YAPB_push_i64(&pkt, &wide);
+    } else {
+        int32_t value = id * 10;
+        YAPB_push_i32(&pkt, &value);
+    }
+    if (version >= 2) {
+        int16_t flags = 7;
+        YAPB_push_i16(&pkt, &flags);
+    }
+    if (version == 3) {
+        const uint8_t note[] = "v3";
+        YAPB_push_blob(&pkt, note, sizeof(note));
+    }
+    size_t len;
+    YAPB_finalize(&pkt, &len);
+    return len;
+}
+
+static MunitResult test_reader_versions(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_ReaderPlan_t cache[4];
+    YAPB_Reader_t rd;
+    munit_assert_int(YAPB_reader_init(&rd, reader_v2, 3, cache, 4), ==, YAPB_OK);
+
+    static const struct { int version; uint16_t present; int32_t value; int16_t flags; } cases[] = {
+        { 1, 2, 10, -1 },   /* older writer: flags keeps its default */
+        { 2, 3, 10,  7 },
+        { 3, 3, 10,  7 },   /* newer writer: trailing blob is ignored */
+        { 4, 1,  0, -1 },   /* changed type: defaults from there on */
+    };
+    for (int round = 0; round < 2; round++) {
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            uint8_t buf[64];
+            size_t len = build_versioned(buf, sizeof(buf), cases[c].version, 1);
+            YAPB_Packet_t rpkt;
+            YAPB_load(&rpkt, buf, len);
+
+            int32_t id = 0, value = 0;
+            int16_t flags = -1;
+            void *outs[] = { &id, &value, &flags };
+            uint16_t present;
+            munit_assert_int(YAPB_reader_decode(&rd, &rpkt, outs, &present), ==, YAPB_OK);
+            munit_assert_uint16(present, ==, cases[c].present);
+            munit_assert_int32(id, ==, 1);
+            munit_assert_int32(value, ==, cases[c].value);
+            munit_assert_int16(flags, ==, cases[c].flags);
+        }
+    }
+
+    /* Each writer layout is resolved once; the second round only hits */
+    uint64_t hits, misses;
+    YAPB_reader_get_stats(&rd, &hits, &misses);
+    munit_assert_uint64(misses, ==, 3);   /* v2 and v3 share one plan */
+    munit_assert_uint64(hits, ==, 5);
+    return MUNIT_OK;
+}
+
+static MunitResult test_reader_variable(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    static const YAPB_Type_t expected[] = { YAPB_BLOB, YAPB_INT8 };
+    YAPB_ReaderPlan_t cache[1];
+    YAPB_Reader_t rd;
+    YAPB_reader_init(&rd, expected, 2, cache, 1);
+
+    /* Warm the cache from the writer's tag list */
+    const YAPB_Type_t writer[] = { YAPB_BLOB, YAPB_INT8 };
+    munit_assert_int(YAPB_reader_resolve(&rd, writer, 2), ==, YAPB_OK);
+
+    for (uint16_t n = 1; n <= 3; n++) {
+        uint8_t buf[32], name[3] = { 'a', 'b', 'c' };
+        YAPB_Packet_t pkt;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        int8_t level = (int8_t)n;
+        YAPB_push_blob(&pkt, name, n);
+        YAPB_push_i8(&pkt, &level);
+        size_t len;
+        YAPB_finalize(&pkt, &len);
+
+        YAPB_Packet_t rpkt;
+        YAPB_load(&rpkt, buf, len);
+        YAPB_Blob_t blob = { NULL, 0 };
+        int8_t out = 0;
+        void *outs[] = { &blob, &out };
+        munit_assert_int(YAPB_reader_decode(&rd, &rpkt, outs, NULL), ==, YAPB_OK);
+        munit_assert_uint16(blob.len, ==, n);
+        munit_assert_memory_equal(n, blob.data, name);
+        munit_assert_int8(out, ==, (int8_t)n);
+    }
+    uint64_t misses;
+    YAPB_reader_get_stats(&rd, NULL, &misses);
+    munit_assert_uint64(misses, ==, 0);
+
+    /* Malformed packets leave outputs alone */
+    uint8_t bad[] = { 0, 0, 0, 8, YAPB_BLOB, 0, 9, 'x' };
+    YAPB_Packet_t rpkt;
+    YAPB_load(&rpkt, bad, sizeof(bad));
+    YAPB_Blob_t blob = { NULL, 0 };
+    void *outs[] = { &blob, NULL };
+    munit_assert_int(YAPB_reader_decode(&rd, &rpkt, outs, NULL), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_null(blob.data);
+
+    const YAPB_Type_t unknown[] = { (YAPB_Type_t)0x0A };
+    munit_assert_int(YAPB_reader_init(&rd, unknown, 1, cache, 1), ==, YAPB_ERR_TYPE_MISMATCH);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/shape/tags",         test_shape_matches_tags, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/shape/invalid",      test_shape_invalid,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/plan/decode",        test_plan_decode,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/plan/mismatch",      test_plan_mismatch,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/registry/dispatch",  test_registry_dispatch,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/reader/versions",    test_reader_versions,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/reader/variable",    test_reader_variable,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
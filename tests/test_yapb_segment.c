@@ -0,0 +1,252 @@
+#include "munit.h"
+#include "yapb_segment.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Packets: i32 device, i64 timestamp; devices are even and grouped by segment */
+#define PACKETS      4000
+#define PER_SEGMENT  500
+#define DEVICES      400
+
+static int32_t device_of(int64_t i) { return (int32_t)(i / 10 % DEVICES * 2); }
+
+static void make_packet(int64_t i, uint8_t *buf, YAPB_Packet_t *pkt) {
+    int32_t dev = device_of(i);
+    int64_t ts = 1000000 + i;
+    YAPB_initialize(pkt, buf, 64);
+    YAPB_push_i32(pkt, &dev);
+    YAPB_push_i64(pkt, &ts);
+    YAPB_finalize(pkt, NULL);
+}
+
+static const YAPB_SegmentKey_t keys[] = {
+    { .path = { 1, { 0 } }, .flags = YAPB_SEG_BLOOM | YAPB_SEG_ZONE },
+    { .path = { 1, { 1 } }, .flags = YAPB_SEG_ZONE },
+};
+
+static void remove_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    while (d != NULL && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] != '.') unlinkat(dirfd(d), de->d_name, 0);
+    }
+    if (d != NULL) closedir(d);
+    rmdir(dir);
+}
+
+typedef struct {
+    uint64_t count;
+    int64_t last_ts;
+    bool ordered;
+} Collect;
+
+static bool collect(void *ctx, YAPB_Packet_t *pkt) {
+    Collect *c = ctx;
+    int32_t dev;
+    int64_t ts;
+    YAPB_pop_i32(pkt, &dev);
+    YAPB_pop_i64(pkt, &ts);
+    c->ordered = c->ordered && ts > c->last_ts;
+    c->last_ts = ts;
+    c->count++;
+    return true;
+}
+
+/* ======== Equality and range queries ======== */
+
+static MunitResult test_segment_query(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char dir[] = "/tmp/yapb-seg-XXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+
+    YAPB_SegmentConfig_t cfg = { .max_packets = PER_SEGMENT, .bloom_bytes = 1024, .keys = keys, .nkeys = 2 };
+    YAPB_SegmentWriter_t w;
+    munit_assert_int(YAPB_segw_open(&w, dir, &cfg), ==, YAPB_OK);
+    for (int64_t i = 0; i < PACKETS; i++) {
+        uint8_t buf[64];
+        YAPB_Packet_t pkt;
+        make_packet(i, buf, &pkt);
+        munit_assert_int(YAPB_segw_append(&w, &pkt), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_segw_close(&w), ==, YAPB_OK);
+
+    /* Device 14 only appears in the first segment */
+    YAPB_SegmentFilter_t q = { .path = keys[0].path, .op = YAPB_SEG_EQ };
+    YAPB_key_from_int(14, &q.lo);
+    YAPB_SegmentScanStats_t st;
+    Collect c = { 0, 0, true };
+    munit_assert_int(YAPB_segment_scan(dir, &q, collect, &c, &st), ==, YAPB_OK);
+    munit_assert_uint64(c.count, ==, 10);
+    munit_assert_true(c.ordered);
+    munit_assert_uint32(st.segments, ==, PACKETS / PER_SEGMENT);
+    munit_assert_uint32(st.skipped, ==, st.segments - 1);
+    munit_assert_uint64(st.matched, ==, 10);
+
+    /* Absent devices: beyond every zone, or inside one but not in its Bloom filter */
+    const int64_t absent[] = { 2 * DEVICES + 6, 15 };
+    for (size_t i = 0; i < 2; i++) {
+        YAPB_key_from_int(absent[i], &q.lo);
+        c = (Collect){ 0, 0, true };
+        YAPB_segment_scan(dir, &q, collect, &c, &st);
+        munit_assert_uint64(c.count, ==, 0);
+        munit_assert_uint32(st.skipped, ==, st.segments);
+    }
+
+    /* Wrong key kind never matches */
+    YAPB_key_from_real(7.0, &q.lo);
+    YAPB_segment_scan(dir, &q, collect, &c, &st);
+    munit_assert_uint32(st.skipped, ==, st.segments);
+
+    /* Time range spanning a segment boundary */
+    YAPB_SegmentFilter_t r = { .path = keys[1].path, .op = YAPB_SEG_RANGE };
+    YAPB_key_from_int(1000000 + 1450, &r.lo);
+    YAPB_key_from_int(1000000 + 1549, &r.hi);
+    c = (Collect){ 0, 0, true };
+    munit_assert_int(YAPB_segment_scan(dir, &r, collect, &c, &st), ==, YAPB_OK);
+    munit_assert_uint64(c.count, ==, 100);
+    munit_assert_true(c.ordered);
+    munit_assert_uint32(st.skipped, ==, st.segments - 2);
+    munit_assert_uint64(st.scanned, ==, 2 * PER_SEGMENT);
+
+    /* Sealed segments are valid packet logs up to the footer */
+    char path[256];
+    snprintf(path, sizeof(path), "%s/seg-00000001.yapb", dir);
+    YAPB_Segment_t seg;
+    munit_assert_int(YAPB_segment_open(&seg, path), ==, YAPB_OK);
+    size_t len, off = 0, pkt_len;
+    const uint8_t *seg_data = YAPB_segment_get_data(&seg, &len);
+    const uint8_t *p;
+    uint64_t n = 0;
+    while (YAPB_log_next(seg_data, len, &off, &p, &pkt_len) == YAPB_OK) n++;
+    munit_assert_uint64(n, ==, PER_SEGMENT);
+    munit_assert_size(off, ==, len);
+    YAPB_segment_close(&seg);
+
+    remove_dir(dir);
+    return MUNIT_OK;
+}
+
+/* ======== Unsealed segments and reopening ======== */
+
+static MunitResult test_segment_unsealed(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char dir[] = "/tmp/yapb-seg-XXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+
+    YAPB_SegmentConfig_t cfg = { .max_packets = PER_SEGMENT, .keys = keys, .nkeys = 2 };
+    YAPB_SegmentWriter_t w;
+    munit_assert_int(YAPB_segw_open(&w, dir, &cfg), ==, YAPB_OK);
+    for (int64_t i = 0; i < 700; i++) {
+        uint8_t buf[64];
+        YAPB_Packet_t pkt;
+        make_packet(i, buf, &pkt);
+        YAPB_segw_append(&w, &pkt);
+    }
+    munit_assert_int(YAPB_segw_roll(&w), ==, YAPB_OK);
+    munit_assert_int(YAPB_segw_roll(&w), ==, YAPB_OK);
+    munit_assert_int(YAPB_segw_close(&w), ==, YAPB_OK);
+
+    /* A reopened writer continues the numbering */
+    munit_assert_int(YAPB_segw_open(&w, dir, &cfg), ==, YAPB_OK);
+    uint8_t buf[64];
+    YAPB_Packet_t pkt;
+    make_packet(10000, buf, &pkt);
+    YAPB_segw_append(&w, &pkt);
+    munit_assert_int(YAPB_segw_close(&w), ==, YAPB_OK);
+
+    /* Simulate a crash mid-segment: packets without a footer, torn last one */
+    char path[256];
+    snprintf(path, sizeof(path), "%s/seg-00000004.yapb", dir);
+    FILE *f = fopen(path, "wb");
+    munit_assert_not_null(f);
+    for (int64_t i = 20000; i < 20003; i++) {
+        size_t len;
+        make_packet(i, buf, &pkt);
+        const uint8_t *bytes = YAPB_get_buffer(&pkt, &len);
+        fwrite(bytes, 1, (i == 20002) ? len - 3 : len, f);
+    }
+    fclose(f);
+
+    YAPB_SegmentFilter_t q = { .path = keys[1].path, .op = YAPB_SEG_RANGE };
+    YAPB_key_from_int(1000000 + 10000, &q.lo);
+    YAPB_key_from_int(1000000 + 30000, &q.hi);
+    YAPB_SegmentScanStats_t st;
+    Collect c = { 0, 0, true };
+    munit_assert_int(YAPB_segment_scan(dir, &q, collect, &c, &st), ==, YAPB_OK);
+    munit_assert_uint32(st.segments, ==, 4);
+    munit_assert_uint32(st.skipped, ==, 2);
+    munit_assert_uint64(c.count, ==, 3);
+    munit_assert_true(c.ordered);
+
+    remove_dir(dir);
+    return MUNIT_OK;
+}
+
+/* ======== Timestamp keys ======== */
+
+static bool count_packet(void *ctx, YAPB_Packet_t *pkt) {
+    (void)pkt;
+    (*(uint64_t *)ctx)++;
+    return true;
+}
+
+static MunitResult test_segment_timestamps(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char dir[] = "/tmp/yapb-seg-XXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+
+    /* { batch start, sample time }: the sample time is a delta to the start */
+    static const YAPB_SegmentKey_t ts_keys[] = {
+        { .path = { 1, { 1 } }, .flags = YAPB_SEG_ZONE },
+    };
+    YAPB_SegmentConfig_t cfg = { .max_packets = PER_SEGMENT, .keys = ts_keys, .nkeys = 1 };
+    YAPB_SegmentWriter_t w;
+    munit_assert_int(YAPB_segw_open(&w, dir, &cfg), ==, YAPB_OK);
+    const int64_t t0 = 1760000000000000000LL;
+    for (int64_t i = 0; i < PACKETS; i++) {
+        uint8_t buf[64];
+        YAPB_Packet_t pkt;
+        int64_t start = t0 + i / 100 * 1000000000LL, sample = t0 + i * 10000000LL;
+        size_t len;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_timestamp(&pkt, &start);
+        YAPB_push_timestamp_delta(&pkt, &sample);
+        YAPB_finalize(&pkt, &len);
+        munit_assert_size(len, <, YAPB_HEADER_SIZE + 2 * 9);
+        munit_assert_int(YAPB_segw_append(&w, &pkt), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_segw_close(&w), ==, YAPB_OK);
+
+    /* Zone maps hold the decoded times */
+    YAPB_SegmentFilter_t r = { .path = ts_keys[0].path, .op = YAPB_SEG_RANGE };
+    YAPB_key_from_int(t0 + 1450 * 10000000LL, &r.lo);
+    YAPB_key_from_int(t0 + 1549 * 10000000LL, &r.hi);
+    YAPB_SegmentScanStats_t st;
+    uint64_t n = 0;
+    munit_assert_int(YAPB_segment_scan(dir, &r, count_packet, &n, &st), ==, YAPB_OK);
+    munit_assert_uint64(n, ==, 100);
+    munit_assert_uint32(st.skipped, ==, st.segments - 2);
+
+    remove_dir(dir);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/segment/query",      test_segment_query,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/segment/unsealed",   test_segment_unsealed, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/segment/timestamps", test_segment_timestamps, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
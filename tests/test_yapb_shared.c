@@ -0,0 +1,224 @@
+#include "munit.h"
+#include "yapb_shared.h"
+#include <pthread.h>
+#include <string.h>
+
+static _Alignas(64) uint8_t pool_mem[16 * 1024];
+
+/* ======== Pool ======== */
+
+static MunitResult test_pool_exhaust(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    size_t total, nfree;
+
+    /* 64 header + 64 data per slot */
+    munit_assert_int(YAPB_pool_init(&pool, pool_mem, 4 * 128, 60), ==, YAPB_OK);
+    YAPB_pool_get_count(&pool, &total, &nfree);
+    munit_assert_size(total, ==, 4);
+    munit_assert_size(nfree, ==, 4);
+
+    YAPB_Shared_t *sh[5];
+    for (int i = 0; i < 4; i++) {
+        munit_assert_int(YAPB_shared_alloc(&pool, &sh[i]), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_shared_alloc(&pool, &sh[4]), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+
+    YAPB_shared_release(sh[2]);
+    YAPB_pool_get_count(&pool, NULL, &nfree);
+    munit_assert_size(nfree, ==, 1);
+    munit_assert_int(YAPB_shared_alloc(&pool, &sh[4]), ==, YAPB_OK);
+    munit_assert_ptr_equal(sh[4], sh[2]);
+
+    size_t cap;
+    munit_assert_not_null(YAPB_shared_data(sh[4], &cap));
+    munit_assert_size(cap, ==, 60);
+    return MUNIT_OK;
+}
+
+static MunitResult test_pool_invalid(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+
+    munit_assert_int(YAPB_pool_init(NULL, pool_mem, sizeof(pool_mem), 64), ==, YAPB_ERR_NULL_PTR);
+    munit_assert_int(YAPB_pool_init(&pool, pool_mem, 100, 64), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_int(YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 2), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+
+    YAPB_Shared_t *sh;
+    YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 64);
+    YAPB_shared_alloc(&pool, &sh);
+    munit_assert_int(YAPB_shared_release(sh), ==, YAPB_OK);
+    munit_assert_int(YAPB_shared_release(sh), ==, YAPB_ERR_INVALID_MODE);
+    return MUNIT_OK;
+}
+
+static MunitResult test_pool_mem(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    static const unsigned modes[] = {
+        0, YAPB_POOL_MEM_PREFAULT, YAPB_POOL_MEM_THP | YAPB_POOL_MEM_PREFAULT,
+        YAPB_POOL_MEM_HUGETLB,
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        void *mem;
+        size_t size;
+        unsigned got;
+        munit_assert_int(YAPB_pool_mem_alloc(3 << 20, modes[i], &mem, &size, &got), ==, YAPB_OK);
+        munit_assert_size(size, >=, 3 << 20);
+        /* Huge page backing is aligned; HUGETLB may have fallen back to THP */
+        if (got & (YAPB_POOL_MEM_HUGETLB | YAPB_POOL_MEM_THP)) {
+            munit_assert_size((uintptr_t)mem % (2 << 20), ==, 0);
+        }
+        munit_assert_uint(got & YAPB_POOL_MEM_PREFAULT, ==, modes[i] & YAPB_POOL_MEM_PREFAULT);
+
+        YAPB_Pool_t pool;
+        YAPB_Shared_t *sh;
+        size_t total;
+        munit_assert_int(YAPB_pool_init(&pool, mem, size, 2048), ==, YAPB_OK);
+        YAPB_pool_get_count(&pool, &total, NULL);
+        munit_assert_size(total, ==, size / (2048 + YAPB_SHARED_ALIGN));
+        munit_assert_int(YAPB_shared_alloc(&pool, &sh), ==, YAPB_OK);
+        YAPB_shared_release(sh);
+        munit_assert_int(YAPB_pool_mem_free(mem, size), ==, YAPB_OK);
+    }
+
+    void *mem;
+    size_t size;
+    munit_assert_int(YAPB_pool_mem_alloc(4096, 0x80, &mem, &size, NULL), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_pool_mem_alloc(0, 0, &mem, &size, NULL), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    return MUNIT_OK;
+}
+
+/* ======== Packets in shared buffers ======== */
+
+static MunitResult test_shared_packet_slices(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    YAPB_pool_init(&pool, pool_mem, sizeof(pool_mem), 256);
+
+    uint8_t inner_buf[64];
+    YAPB_Packet_t inner;
+    YAPB_initialize(&inner, inner_buf, sizeof(inner_buf));
+    int32_t ival = 77;
+    YAPB_push_i32(&inner, &ival);
+    YAPB_finalize(&inner, NULL);
+
+    YAPB_Shared_t *sh;
+    YAPB_shared_alloc(&pool, &sh);
+    YAPB_Packet_t pkt;
+    munit_assert_int(YAPB_shared_initialize(&pkt, sh), ==, YAPB_OK);
+    const uint8_t blob[] = "slice";
+    YAPB_push_blob(&pkt, blob, sizeof(blob));
+    YAPB_push_nested(&pkt, &inner);
+    YAPB_finalize(&pkt, NULL);
+
+    YAPB_Packet_t rpkt, nested;
+    munit_assert_int(YAPB_shared_load(&rpkt, sh), ==, YAPB_OK);
+    const uint8_t *bdata;
+    uint16_t blen;
+    YAPB_pop_blob(&rpkt, &bdata, &blen);
+    YAPB_pop_nested(&rpkt, &nested);
+
+    /* Both slices pin the same buffer past the original reference */
+    YAPB_Shared_t *blob_owner, *nested_owner;
+    munit_assert_int(YAPB_shared_ref(&pool, bdata, &blob_owner), ==, YAPB_OK);
+    munit_assert_int(YAPB_shared_ref(&pool, YAPB_get_buffer(&nested, NULL), &nested_owner), ==, YAPB_OK);
+    munit_assert_ptr_equal(blob_owner, sh);
+    munit_assert_ptr_equal(nested_owner, sh);
+    YAPB_shared_release(sh);
+
+    size_t nfree, total;
+    YAPB_pool_get_count(&pool, &total, &nfree);
+    munit_assert_size(nfree, ==, total - 1);
+
+    int32_t out = 0;
+    munit_assert_int(YAPB_pop_i32(&nested, &out), ==, YAPB_STS_COMPLETE);
+    munit_assert_int32(out, ==, 77);
+    munit_assert_memory_equal(sizeof(blob), bdata, blob);
+
+    YAPB_shared_release(blob_owner);
+    YAPB_shared_release(nested_owner);
+    YAPB_pool_get_count(&pool, NULL, &nfree);
+    munit_assert_size(nfree, ==, total);
+
+    /* Pointers outside allocated data areas are rejected */
+    munit_assert_int(YAPB_shared_ref(&pool, bdata, &blob_owner), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_shared_ref(&pool, inner_buf, &blob_owner), ==, YAPB_ERR_INVALID_MODE);
+    return MUNIT_OK;
+}
+
+/* ======== Concurrency ======== */
+
+#define FANOUT_THREADS 4
+#define FANOUT_ROUNDS  20000
+
+static void *fanout_worker(void *arg) {
+    YAPB_Pool_t *pool = arg;
+    const uint8_t *stale = NULL;
+    for (int i = 0; i < FANOUT_ROUNDS; i++) {
+        YAPB_Shared_t *sh;
+        /* Races the last release of the previous round's slot by any
+           thread: ref() either finds it live and owns it, or fails */
+        if (stale != NULL && YAPB_shared_ref(pool, stale, &sh) == YAPB_OK) {
+            YAPB_shared_release(sh);
+        }
+        if (YAPB_shared_alloc(pool, &sh) != YAPB_OK) continue;
+        stale = YAPB_shared_data(sh, NULL);
+        YAPB_Packet_t pkt;
+        YAPB_shared_initialize(&pkt, sh);
+        int32_t v = i;
+        YAPB_push_i32(&pkt, &v);
+        YAPB_finalize(&pkt, NULL);
+        for (int j = 0; j < 3; j++) YAPB_shared_retain(sh);
+        for (int j = 0; j < 4; j++) YAPB_shared_release(sh);
+    }
+    return NULL;
+}
+
+static MunitResult test_shared_threads(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    YAPB_Pool_t pool;
+    YAPB_pool_init(&pool, pool_mem, 8 * 128, 64);
+
+    pthread_t th[FANOUT_THREADS];
+    for (int i = 0; i < FANOUT_THREADS; i++) {
+        pthread_create(&th[i], NULL, fanout_worker, &pool);
+    }
+    for (int i = 0; i < FANOUT_THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+
+    size_t total, nfree;
+    YAPB_pool_get_count(&pool, &total, &nfree);
+    munit_assert_size(nfree, ==, total);
+
+    /* Every slot is still reachable from the free list */
+    YAPB_Shared_t *sh[8];
+    for (size_t i = 0; i < total; i++) {
+        munit_assert_int(YAPB_shared_alloc(&pool, &sh[i]), ==, YAPB_OK);
+    }
+    for (size_t i = 0; i < total; i++) {
+        for (size_t j = i + 1; j < total; j++) {
+            munit_assert_ptr_not_equal(sh[i], sh[j]);
+        }
+    }
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/pool/exhaust",       test_pool_exhaust,         NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/pool/invalid",       test_pool_invalid,         NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/pool/mem",           test_pool_mem,             NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/shared/slices",      test_shared_packet_slices, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/shared/threads",     test_shared_threads,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
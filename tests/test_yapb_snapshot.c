@@ -0,0 +1,205 @@
+#include "munit.h"
+#include "yapb_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OBJECTS 1000
+
+/* Subtree: i64 id, i64 version, nested { blob name, i32 x 8 } */
+static void encode(uint64_t id, int64_t version, uint8_t *buf, size_t size, YAPB_Packet_t *pkt) {
+    uint8_t inner_buf[128];
+    YAPB_Packet_t inner;
+    char name[32];
+    int n = snprintf(name, sizeof(name), "object-%llu", (unsigned long long)id);
+    YAPB_initialize(&inner, inner_buf, sizeof(inner_buf));
+    YAPB_push_blob(&inner, (const uint8_t *)name, (uint16_t)n);
+    for (int32_t i = 0; i < 8; i++) {
+        int32_t v = (int32_t)(version * 8 + i);
+        YAPB_push_i32(&inner, &v);
+    }
+    YAPB_finalize(&inner, NULL);
+
+    int64_t sid = (int64_t)id;
+    YAPB_initialize(pkt, buf, size);
+    YAPB_push_i64(pkt, &sid);
+    YAPB_push_i64(pkt, &version);
+    YAPB_push_nested(pkt, &inner);
+    YAPB_finalize(pkt, NULL);
+}
+
+static void put_object(YAPB_SnapWriter_t *w, uint64_t id, int64_t version) {
+    uint8_t buf[256];
+    YAPB_Packet_t pkt;
+    encode(id, version, buf, sizeof(buf), &pkt);
+    munit_assert_int(YAPB_snap_put(w, id, &pkt), ==, YAPB_OK);
+}
+
+/* Check every object against the expected versions */
+static void check_snapshot(const char *path, const int64_t *versions) {
+    YAPB_Snapshot_t s;
+    munit_assert_int(YAPB_snap_open(&s, path), ==, YAPB_OK);
+    uint64_t count;
+    YAPB_snap_get_count(&s, &count);
+    munit_assert_uint64(count, ==, OBJECTS);
+    for (uint64_t i = 0; i < OBJECTS; i++) {
+        uint64_t id;
+        munit_assert_int(YAPB_snap_get_id(&s, i, &id), ==, YAPB_OK);
+        munit_assert_uint64(id, ==, i * 7);
+
+        YAPB_Packet_t pkt, inner;
+        int64_t got_id, version;
+        int32_t first;
+        munit_assert_int(YAPB_snap_get(&s, id, &pkt), ==, YAPB_OK);
+        YAPB_pop_i64(&pkt, &got_id);
+        YAPB_pop_i64(&pkt, &version);
+        YAPB_pop_nested(&pkt, &inner);
+        const uint8_t *name;
+        uint16_t len;
+        YAPB_pop_blob(&inner, &name, &len);
+        YAPB_pop_i32(&inner, &first);
+        munit_assert_int64(got_id, ==, (int64_t)id);
+        munit_assert_int64(version, ==, versions[i]);
+        munit_assert_int(first, ==, (int32_t)(versions[i] * 8));
+    }
+    YAPB_Packet_t pkt;
+    munit_assert_int(YAPB_snap_get(&s, 3, &pkt), ==, YAPB_ERR_NOT_FOUND);
+    YAPB_snap_close(&s);
+}
+
+static uint64_t file_size(const char *path) {
+    struct stat st;
+    munit_assert_int(stat(path, &st), ==, 0);
+    return (uint64_t)st.st_size;
+}
+
+/* ======== Full and incremental snapshots ======== */
+
+static MunitResult test_snapshot_incremental(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char dir[] = "/tmp/yapb-snap-XXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+    char paths[12][64];
+    for (int i = 0; i < 12; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/ckpt-%02d.snap", dir, i);
+    }
+
+    static int64_t versions[OBJECTS];
+    YAPB_SnapWriter_t w;
+    YAPB_SnapStats_t st;
+    munit_assert_int(YAPB_snap_begin(&w, paths[0], NULL), ==, YAPB_OK);
+    /* Ids in any order; the index sorts them */
+    for (int64_t i = OBJECTS - 1; i >= 0; i--) {
+        put_object(&w, (uint64_t)i * 7, 0);
+    }
+    munit_assert_int(YAPB_snap_commit(&w, &st), ==, YAPB_OK);
+    munit_assert_uint64(st.written, ==, OBJECTS);
+    check_snapshot(paths[0], versions);
+
+    /* Each checkpoint changes a tenth of the objects */
+    for (int c = 1; c < 12; c++) {
+        munit_assert_int(YAPB_snap_begin(&w, paths[c], paths[c - 1]), ==, YAPB_OK);
+        for (uint64_t i = 0; i < OBJECTS; i++) {
+            if ((i + (uint64_t)c) % 10 == 0) {
+                versions[i] = c;
+                put_object(&w, i * 7, c);
+            } else {
+                munit_assert_int(YAPB_snap_reuse(&w, i * 7), ==, YAPB_OK);
+            }
+        }
+        munit_assert_int(YAPB_snap_reuse(&w, 3), ==, YAPB_ERR_NOT_FOUND);
+        munit_assert_int(YAPB_snap_commit(&w, &st), ==, YAPB_OK);
+        munit_assert_uint64(st.subtrees, ==, OBJECTS);
+        munit_assert_uint64(st.written, ==, OBJECTS / 10);
+        munit_assert_uint64(st.reused + st.copied, ==, OBJECTS - OBJECTS / 10);
+        if (c < YAPB_SNAP_MAX_FILES) {
+            munit_assert_uint64(st.copied, ==, 0);
+            munit_assert_uint64(file_size(paths[c]), <, file_size(paths[0]) / 2);
+        }
+        check_snapshot(paths[c], versions);
+    }
+    /* The chain was cut: the oldest files are no longer needed */
+    unlink(paths[0]);
+    unlink(paths[1]);
+    check_snapshot(paths[11], versions);
+
+    for (int i = 2; i < 12; i++) unlink(paths[i]);
+    rmdir(dir);
+    return MUNIT_OK;
+}
+
+/* ======== Corruption and misuse ======== */
+
+static MunitResult test_snapshot_errors(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char base[] = "/tmp/yapb-snap-XXXXXX";
+    close(mkstemp(base));
+    char next[sizeof(base) + 5];
+    snprintf(next, sizeof(next), "%s.next", base);
+
+    YAPB_SnapWriter_t w;
+    munit_assert_int(YAPB_snap_begin(&w, base, NULL), ==, YAPB_OK);
+    for (uint64_t i = 0; i < 10; i++) {
+        put_object(&w, i, 1);
+    }
+    munit_assert_int(YAPB_snap_commit(&w, NULL), ==, YAPB_OK);
+
+    munit_assert_int(YAPB_snap_begin(&w, next, base), ==, YAPB_OK);
+    for (uint64_t i = 0; i < 10; i++) {
+        munit_assert_int(YAPB_snap_reuse(&w, i), ==, YAPB_OK);
+    }
+    munit_assert_int(YAPB_snap_commit(&w, NULL), ==, YAPB_OK);
+
+    /* Corrupt the first subtree in the base: only that one fails */
+    FILE *f = fopen(base, "r+b");
+    fseek(f, 20, SEEK_SET);
+    fputc(0x5a, f);
+    fclose(f);
+    YAPB_Snapshot_t s;
+    YAPB_Packet_t pkt;
+    munit_assert_int(YAPB_snap_open(&s, next), ==, YAPB_OK);
+    munit_assert_int(YAPB_snap_get(&s, 0, &pkt), ==, YAPB_ERR_INVALID_PACKET);
+    munit_assert_int(YAPB_snap_get(&s, 1, &pkt), ==, YAPB_OK);
+    YAPB_snap_close(&s);
+
+    /* A damaged index is detected at open */
+    f = fopen(next, "r+b");
+    fseek(f, -60, SEEK_END);
+    fputc(0x5a, f);
+    fclose(f);
+    munit_assert_int(YAPB_snap_open(&s, next), ==, YAPB_ERR_INVALID_PACKET);
+
+    /* Duplicate ids; overwriting the base */
+    munit_assert_int(YAPB_snap_begin(&w, next, NULL), ==, YAPB_OK);
+    put_object(&w, 5, 1);
+    put_object(&w, 5, 2);
+    munit_assert_int(YAPB_snap_commit(&w, NULL), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_snap_begin(&w, base, base), ==, YAPB_ERR_INVALID_MODE);
+
+    /* Aborted snapshots leave nothing behind */
+    unlink(next);
+    munit_assert_int(YAPB_snap_begin(&w, next, NULL), ==, YAPB_OK);
+    put_object(&w, 1, 1);
+    munit_assert_int(YAPB_snap_abort(&w), ==, YAPB_OK);
+    munit_assert_int(access(next, F_OK), !=, 0);
+
+    unlink(base);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/snapshot/incremental", test_snapshot_incremental, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/snapshot/errors",      test_snapshot_errors,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
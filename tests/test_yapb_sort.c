@@ -0,0 +1,232 @@
+#include "munit.h"
+#include "yapb_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SORT_RECORDS 20000
+
+/* Records carry a small key (many duplicates) and their input sequence
+ * number, so the output can be checked for order and stability. */
+static void write_log(const char *path, int key_mod) {
+    FILE *f = fopen(path, "wb");
+    munit_assert_not_null(f);
+    uint32_t seed = 12345;
+    for (int32_t seq = 0; seq < SORT_RECORDS; seq++) {
+        seed = seed * 1103515245u + 12345u;
+        int16_t key = (int16_t)((seed >> 16) % (uint32_t)key_mod) - 50;
+        uint8_t buf[64];
+        YAPB_Packet_t pkt;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_i32(&pkt, &seq);
+        YAPB_push_i16(&pkt, &key);
+        size_t len;
+        YAPB_finalize(&pkt, &len);
+        fwrite(buf, 1, len, f);
+    }
+    fclose(f);
+}
+
+static void check_sorted(const char *path) {
+    YAPB_LogMap_t map;
+    munit_assert_int(YAPB_log_map(&map, path, 0), ==, YAPB_OK);
+    size_t len, off = 0, pkt_len;
+    const uint8_t *log = YAPB_log_get_data(&map, &len);
+    const uint8_t *pkt;
+
+    int count = 0;
+    int16_t prev_key = INT16_MIN;
+    int32_t prev_seq = -1;
+    while (YAPB_log_next(log, len, &off, &pkt, &pkt_len) == YAPB_OK) {
+        YAPB_Packet_t rpkt;
+        int32_t seq;
+        int16_t key;
+        YAPB_load(&rpkt, pkt, pkt_len);
+        YAPB_pop_i32(&rpkt, &seq);
+        YAPB_pop_i16(&rpkt, &key);
+        munit_assert_int16(key, >=, prev_key);
+        if (key == prev_key) {
+            munit_assert_int32(seq, >, prev_seq);
+        }
+        prev_key = key;
+        prev_seq = seq;
+        count++;
+    }
+    munit_assert_int(count, ==, SORT_RECORDS);
+    YAPB_log_unmap(&map);
+}
+
+/* ======== Sort ======== */
+
+static MunitResult test_sort_single_run(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char in[] = "/tmp/yapb-sort-in-XXXXXX";
+    close(mkstemp(in));
+    char out[sizeof(in) + 4];
+    snprintf(out, sizeof(out), "%s.out", in);
+    write_log(in, 1000);
+
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("1", &key);
+    YAPB_SortStats_t stats;
+    munit_assert_int(YAPB_sort_file(in, out, &key, NULL, &stats), ==, YAPB_OK);
+    munit_assert_uint32(stats.runs, ==, 1);
+    munit_assert_uint64(stats.records, ==, SORT_RECORDS);
+    check_sorted(out);
+
+    unlink(in);
+    unlink(out);
+    return MUNIT_OK;
+}
+
+static MunitResult test_sort_merge(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char in[] = "/tmp/yapb-sort-in-XXXXXX";
+    close(mkstemp(in));
+    char out[sizeof(in) + 4];
+    snprintf(out, sizeof(out), "%s.out", in);
+    write_log(in, 100);
+
+    /* A small budget forces many runs and a real merge */
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("1", &key);
+    YAPB_SortConfig_t cfg = { .mem_budget = 2 * 64 * 1024, .threads = 2, .tmp_dir = "/tmp" };
+    YAPB_SortStats_t stats;
+    munit_assert_int(YAPB_sort_file(in, out, &key, &cfg, &stats), ==, YAPB_OK);
+    munit_assert_uint32(stats.runs, >, 4);
+    munit_assert_uint64(stats.records, ==, SORT_RECORDS);
+    check_sorted(out);
+
+    unlink(in);
+    unlink(out);
+    return MUNIT_OK;
+}
+
+static MunitResult test_sort_passes(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char in[] = "/tmp/yapb-sort-in-XXXXXX";
+    close(mkstemp(in));
+    char out[sizeof(in) + 4];
+    snprintf(out, sizeof(out), "%s.out", in);
+    write_log(in, 100);
+
+    /* A fan-in below the run count needs intermediate merge passes */
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("1", &key);
+    YAPB_SortConfig_t cfg = { .mem_budget = 2 * 64 * 1024, .threads = 2, .tmp_dir = "/tmp",
+                              .merge_fanin = 3 };
+    YAPB_SortStats_t stats;
+    munit_assert_int(YAPB_sort_file(in, out, &key, &cfg, &stats), ==, YAPB_OK);
+    munit_assert_uint32(stats.runs, >, 3 * 2);
+    munit_assert_uint32(stats.passes, >=, 2);
+    munit_assert_uint64(stats.records, ==, SORT_RECORDS);
+    check_sorted(out);
+
+    struct stat in_st, out_st;
+    stat(in, &in_st);
+    stat(out, &out_st);
+    munit_assert_uint64(stats.bytes, ==, (uint64_t)in_st.st_size);
+    munit_assert_uint64((uint64_t)out_st.st_size, ==, (uint64_t)in_st.st_size);
+
+    unlink(in);
+    unlink(out);
+    return MUNIT_OK;
+}
+
+static MunitResult test_sort_numa(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char in[] = "/tmp/yapb-sort-in-XXXXXX";
+    close(mkstemp(in));
+    char out[sizeof(in) + 4], numa_out[sizeof(in) + 5];
+    snprintf(out, sizeof(out), "%s.out", in);
+    snprintf(numa_out, sizeof(numa_out), "%s.numa", in);
+    write_log(in, 100);
+
+    /* Placement must not change the result: on one node it is a no-op,
+       on several the pinned workers produce the same runs */
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("1", &key);
+    YAPB_SortConfig_t cfg = { .mem_budget = 4 * 64 * 1024, .threads = 4, .tmp_dir = "/tmp" };
+    munit_assert_int(YAPB_sort_file(in, out, &key, &cfg, NULL), ==, YAPB_OK);
+    cfg.numa = true;
+    YAPB_SortStats_t stats;
+    munit_assert_int(YAPB_sort_file(in, numa_out, &key, &cfg, &stats), ==, YAPB_OK);
+    munit_assert_uint32(stats.runs, >, 1);
+    munit_assert_uint64(stats.records, ==, SORT_RECORDS);
+    check_sorted(numa_out);
+
+    YAPB_LogMap_t a, b;
+    size_t a_len, b_len;
+    YAPB_log_map(&a, out, 0);
+    YAPB_log_map(&b, numa_out, 0);
+    const uint8_t *a_data = YAPB_log_get_data(&a, &a_len);
+    const uint8_t *b_data = YAPB_log_get_data(&b, &b_len);
+    munit_assert_size(a_len, ==, b_len);
+    munit_assert_memory_equal(a_len, a_data, b_data);
+    YAPB_log_unmap(&a);
+    YAPB_log_unmap(&b);
+
+    unlink(in);
+    unlink(out);
+    unlink(numa_out);
+    return MUNIT_OK;
+}
+
+static MunitResult test_sort_errors(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char in[] = "/tmp/yapb-sort-in-XXXXXX";
+    int fd = mkstemp(in);
+    char out[sizeof(in) + 4];
+    snprintf(out, sizeof(out), "%s.out", in);
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+
+    /* Empty input gives an empty output */
+    YAPB_SortStats_t stats;
+    munit_assert_int(YAPB_sort_file(in, out, &key, NULL, &stats), ==, YAPB_OK);
+    munit_assert_uint64(stats.records, ==, 0);
+
+    /* Truncated input */
+    const uint8_t bad[] = { 0, 0, 0, 9, YAPB_INT8, 1 };
+    munit_assert_int(write(fd, bad, sizeof(bad)), ==, (int)sizeof(bad));
+    close(fd);
+    munit_assert_int(YAPB_sort_file(in, out, &key, NULL, NULL), ==, YAPB_ERR_INVALID_PACKET);
+
+    YAPB_SortConfig_t tiny = { .mem_budget = 1024 };
+    munit_assert_int(YAPB_sort_file(in, out, &key, &tiny, NULL), ==, YAPB_ERR_BUFFER_TOO_SMALL);
+    munit_assert_int(YAPB_sort_file("/nonexistent/in", out, &key, NULL, NULL), ==, YAPB_ERR_IO);
+
+    /* Sorting a file onto itself would truncate the mapped input */
+    munit_assert_int(YAPB_sort_file(in, in, &key, NULL, NULL), ==, YAPB_ERR_INVALID_MODE);
+    char alias[sizeof(in) + 8];
+    snprintf(alias, sizeof(alias), "/tmp/./%s", in + 5);
+    munit_assert_int(YAPB_sort_file(in, alias, &key, NULL, NULL), ==, YAPB_ERR_INVALID_MODE);
+    struct stat st;
+    munit_assert_int(stat(in, &st), ==, 0);
+    munit_assert_int64(st.st_size, ==, 6);
+
+    unlink(in);
+    unlink(out);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/sort/single_run",    test_sort_single_run, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/sort/merge",         test_sort_merge,      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/sort/numa",          test_sort_numa,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/sort/passes",        test_sort_passes,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/sort/errors",        test_sort_errors,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,195 @@
+#include "munit.h"
+#include "yapb_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define KEYS     5000
+#define ROUNDS   4
+
+/* Packets: i64 key, i64 version, blob padding */
+static void put_record(YAPB_Table_t *t, int64_t key, int64_t version) {
+    static const uint8_t pad[40];
+    uint8_t buf[96];
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, buf, sizeof(buf));
+    YAPB_push_i64(&pkt, &key);
+    YAPB_push_i64(&pkt, &version);
+    YAPB_push_blob(&pkt, pad, (uint16_t)(version % 41));
+    YAPB_finalize(&pkt, NULL);
+    munit_assert_int(YAPB_table_put(t, &pkt), ==, YAPB_OK);
+}
+
+static int64_t get_version(const YAPB_Table_t *t, int64_t key) {
+    YAPB_Key_t k;
+    YAPB_Packet_t pkt;
+    int64_t got, version;
+    YAPB_key_from_int(key, &k);
+    if (YAPB_table_get(t, &k, &pkt) != YAPB_OK) {
+        return -1;
+    }
+    YAPB_pop_i64(&pkt, &got);
+    YAPB_pop_i64(&pkt, &version);
+    munit_assert_int64(got, ==, key);
+    return version;
+}
+
+/* ======== Put, get, remove, reopen ======== */
+
+static MunitResult test_table_basic(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-table-XXXXXX";
+    close(mkstemp(path));
+    unlink(path);
+
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    YAPB_TableConfig_t cfg = { .slots = 64, .data_bytes = 4096 };
+    YAPB_Table_t t;
+    munit_assert_int(YAPB_table_open(&t, path, &key, &cfg), ==, YAPB_OK);
+
+    /* Grows slots and data, and rebuilds away superseded packets */
+    for (int64_t r = 0; r < ROUNDS; r++) {
+        for (int64_t k = 0; k < KEYS; k++) {
+            put_record(&t, k, r * KEYS + k);
+        }
+    }
+    for (int64_t k = 0; k < KEYS; k += 3) {
+        YAPB_Key_t rk;
+        YAPB_key_from_int(k, &rk);
+        munit_assert_int(YAPB_table_remove(&t, &rk), ==, YAPB_OK);
+        munit_assert_int(YAPB_table_remove(&t, &rk), ==, YAPB_ERR_NOT_FOUND);
+    }
+    YAPB_TableStats_t st;
+    YAPB_table_get_stats(&t, &st);
+    munit_assert_uint64(st.count, ==, KEYS - (KEYS + 2) / 3);
+    munit_assert_uint64(st.slots, >=, KEYS);
+    munit_assert_uint64(st.data_used, <=, st.data_bytes);
+
+    /* Keyless packets have nowhere to go */
+    uint8_t buf[16];
+    YAPB_Packet_t empty;
+    YAPB_initialize(&empty, buf, sizeof(buf));
+    YAPB_finalize(&empty, NULL);
+    munit_assert_int(YAPB_table_put(&t, &empty), ==, YAPB_ERR_TYPE_MISMATCH);
+    munit_assert_int(YAPB_table_close(&t), ==, YAPB_OK);
+
+    /* Reopened read-only: same contents, straight from the mapping */
+    cfg.read_only = true;
+    munit_assert_int(YAPB_table_open(&t, path, &key, &cfg), ==, YAPB_OK);
+    for (int64_t k = 0; k < KEYS; k++) {
+        munit_assert_int64(get_version(&t, k), ==, (k % 3 == 0) ? -1 : (ROUNDS - 1) * KEYS + k);
+    }
+    YAPB_TableStats_t st2;
+    YAPB_table_get_stats(&t, &st2);
+    munit_assert_uint64(st2.count, ==, st.count);
+    munit_assert_uint64(st2.data_live, ==, st.data_live);
+    munit_assert_int(YAPB_table_put(&t, &empty), ==, YAPB_ERR_INVALID_MODE);
+    munit_assert_int(YAPB_table_close(&t), ==, YAPB_OK);
+
+    /* A different key path does not match the file */
+    YAPB_keypath_parse("1", &key);
+    munit_assert_int(YAPB_table_open(&t, path, &key, NULL), ==, YAPB_ERR_INVALID_PACKET);
+
+    unlink(path);
+    return MUNIT_OK;
+}
+
+/* ======== Blob keys sharing a prefix ======== */
+
+static MunitResult test_table_blob(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-table-XXXXXX";
+    close(mkstemp(path));
+    unlink(path);
+
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    YAPB_Table_t t;
+    munit_assert_int(YAPB_table_open(&t, path, &key, NULL), ==, YAPB_OK);
+    for (int32_t i = 0; i < 1000; i++) {
+        char name[32];
+        int n = snprintf(name, sizeof(name), "sensor/%05d", i % 500);
+        uint8_t buf[64];
+        YAPB_Packet_t pkt;
+        YAPB_initialize(&pkt, buf, sizeof(buf));
+        YAPB_push_blob(&pkt, (const uint8_t *)name, (uint16_t)n);
+        YAPB_push_i32(&pkt, &i);
+        YAPB_finalize(&pkt, NULL);
+        munit_assert_int(YAPB_table_put(&t, &pkt), ==, YAPB_OK);
+    }
+    for (int32_t i = 0; i < 500; i++) {
+        char name[32];
+        int n = snprintf(name, sizeof(name), "sensor/%05d", i);
+        YAPB_Key_t k;
+        YAPB_Packet_t pkt;
+        const uint8_t *b;
+        uint16_t blen;
+        int32_t v;
+        YAPB_key_from_blob((const uint8_t *)name, (uint16_t)n, &k);
+        munit_assert_int(YAPB_table_get(&t, &k, &pkt), ==, YAPB_OK);
+        YAPB_pop_blob(&pkt, &b, &blen);
+        YAPB_pop_i32(&pkt, &v);
+        munit_assert_int(v, ==, 500 + i);
+    }
+    YAPB_table_close(&t);
+    unlink(path);
+    return MUNIT_OK;
+}
+
+/* ======== Crash without close ======== */
+
+static MunitResult test_table_crash(const MunitParameter params[], void *data) {
+    (void)params; (void)data;
+    char path[] = "/tmp/yapb-table-XXXXXX";
+    close(mkstemp(path));
+    unlink(path);
+
+    YAPB_KeyPath_t key;
+    YAPB_keypath_parse("0", &key);
+    pid_t pid = fork();
+    munit_assert_int(pid, >=, 0);
+    if (pid == 0) {
+        YAPB_TableConfig_t cfg = { .sync = true };
+        YAPB_Table_t t;
+        if (YAPB_table_open(&t, path, &key, &cfg) != YAPB_OK) _exit(1);
+        for (int64_t k = 0; k < 100; k++) {
+            put_record(&t, k, k);
+            put_record(&t, k, 1000 + k);
+        }
+        _exit(0);   /* no close: the clean flag stays cleared */
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    munit_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    YAPB_Table_t t;
+    munit_assert_int(YAPB_table_open(&t, path, &key, NULL), ==, YAPB_OK);
+    YAPB_TableStats_t st;
+    YAPB_table_get_stats(&t, &st);
+    munit_assert_uint64(st.count, ==, 100);
+    for (int64_t k = 0; k < 100; k++) {
+        munit_assert_int64(get_version(&t, k), ==, 1000 + k);
+    }
+    YAPB_table_close(&t);
+    unlink(path);
+    return MUNIT_OK;
+}
+
+/* ======== Test suite ======== */
+
+static MunitTest tests[] = {
+    { "/table/basic",        test_table_basic, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/table/blob",         test_table_blob,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { "/table/crash",        test_table_crash, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+static const MunitSuite suite = {
+    "/yapb", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char *argv[]) {
+    return munit_suite_main(&suite, NULL, argc, argv);
+}
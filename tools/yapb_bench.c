@@ -0,0 +1,275 @@
+/*
+ * yapb-bench: measure page-fault and TLB effects of mapping options.
+ *
+ *   yapb-bench map [-c] [-w KiB] FILE     replay a packet log once per map flag set
+ *   yapb-bench pool [-m MiB] [-b BYTES]   fill a shared-buffer pool per memory flag set
+ *   yapb-bench replay [-d N] FILE         decode a packet log per prefetch distance
+ *
+ * Each line reports wall time, throughput, and minor/major page faults taken
+ * during the run, so settings can be compared on the target host.
+ */
+#define _GNU_SOURCE
+#include "yapb_batch.h"
+#include "yapb_log.h"
+#include "yapb_shared.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// Keeps the replay loop from being optimized away
+static volatile uint64_t sink;
+
+typedef struct {
+    struct timespec t;
+    struct rusage ru;
+} Mark;
+
+static void mark(Mark *m) {
+    getrusage(RUSAGE_SELF, &m->ru);
+    clock_gettime(CLOCK_MONOTONIC, &m->t);
+}
+
+static void report(const char *name, const Mark *a, const Mark *b, uint64_t bytes, uint64_t items,
+                   const char *note) {
+    double s = (double)(b->t.tv_sec - a->t.tv_sec) + (double)(b->t.tv_nsec - a->t.tv_nsec) / 1e9;
+    printf("%-28s %9.3f ms %9.1f MiB/s %11.0f items/s %9ld minflt %6ld majflt%s%s\n",
+           name, s * 1e3, (double)bytes / (1 << 20) / s, (double)items / s,
+           b->ru.ru_minflt - a->ru.ru_minflt, b->ru.ru_majflt - a->ru.ru_majflt,
+           note[0] ? "  " : "", note);
+}
+
+/* ======== Log replay ======== */
+
+// Drop the file's clean pages from the page cache so every run starts cold
+static void drop_cache(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static int bench_map(const char *prog, const char *path, bool cold, size_t window) {
+    static const struct { const char *name; unsigned flags; } runs[] = {
+        { "default",              0 },
+        { "sequential",           YAPB_MAP_SEQUENTIAL },
+        { "sequential+window",    YAPB_MAP_SEQUENTIAL },
+        { "willneed",             YAPB_MAP_WILLNEED },
+        { "populate",             YAPB_MAP_POPULATE },
+        { "populate+hugepage",    YAPB_MAP_POPULATE | YAPB_MAP_HUGEPAGE },
+    };
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        bool windowed = strstr(runs[i].name, "window") != NULL;
+        if (cold) {
+            drop_cache(path);
+        }
+        Mark a, b;
+        mark(&a);
+        YAPB_LogMap_t map;
+        YAPB_Result_t r = YAPB_log_map(&map, path, runs[i].flags);
+        if (r != YAPB_OK) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, YAPB_Result_str(r));
+            return 1;
+        }
+        size_t len, off = 0, next_window = 0;
+        const uint8_t *data = YAPB_log_get_data(&map, &len);
+        const uint8_t *pkt;
+        size_t pkt_len;
+        uint64_t packets = 0, sum = 0;
+        while (YAPB_log_next(data, len, &off, &pkt, &pkt_len) == YAPB_OK) {
+            if (windowed && off >= next_window) {
+                // Keep one window in flight ahead of the reader
+                YAPB_log_prefetch(&map, off + window, window);
+                next_window = off + window;
+            }
+            sum += pkt[pkt_len - 1];   // touch the whole packet span
+            packets++;
+        }
+        mark(&b);
+        YAPB_log_unmap(&map);
+        sink += sum;
+        report(runs[i].name, &a, &b, len, packets, "");
+    }
+    return 0;
+}
+
+/* ======== Pool fill ======== */
+
+static int bench_pool(const char *prog, size_t mem_size, size_t buf_size) {
+    static const uint8_t payload[1024];
+    uint16_t payload_len = (uint16_t)(buf_size - 32 < sizeof(payload) ? buf_size - 32 : sizeof(payload));
+    static const struct { const char *name; unsigned flags; } runs[] = {
+        { "default",              0 },
+        { "prefault",             YAPB_POOL_MEM_PREFAULT },
+        { "thp",                  YAPB_POOL_MEM_THP },
+        { "thp+prefault",         YAPB_POOL_MEM_THP | YAPB_POOL_MEM_PREFAULT },
+        { "hugetlb+prefault",     YAPB_POOL_MEM_HUGETLB | YAPB_POOL_MEM_PREFAULT },
+    };
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        Mark a, m, b;
+        mark(&a);
+        void *mem;
+        size_t size;
+        unsigned got;
+        YAPB_Result_t r = YAPB_pool_mem_alloc(mem_size, runs[i].flags, &mem, &size, &got);
+        if (r != YAPB_OK) {
+            fprintf(stderr, "%s: %s: %s\n", prog, runs[i].name, YAPB_Result_str(r));
+            return 1;
+        }
+        YAPB_Pool_t pool;
+        YAPB_pool_init(&pool, mem, size, buf_size);
+        mark(&m);
+
+        // Encode one packet into every buffer, then release them all
+        size_t total;
+        YAPB_pool_get_count(&pool, &total, NULL);
+        YAPB_Shared_t **held = malloc(total * sizeof(*held));
+        if (held == NULL) {
+            YAPB_pool_mem_free(mem, size);
+            return 1;
+        }
+        for (size_t k = 0; k < total; k++) {
+            YAPB_shared_alloc(&pool, &held[k]);
+            YAPB_Packet_t pkt;
+            YAPB_shared_initialize(&pkt, held[k]);
+            int64_t v = (int64_t)k;
+            YAPB_push_i64(&pkt, &v);
+            YAPB_push_blob(&pkt, payload, payload_len);
+            YAPB_finalize(&pkt, NULL);
+        }
+        for (size_t k = 0; k < total; k++) {
+            YAPB_shared_release(held[k]);
+        }
+        mark(&b);
+        free(held);
+        YAPB_pool_mem_free(mem, size);
+
+        char note[64];
+        snprintf(note, sizeof(note), "(setup %.3f ms%s)",
+                 (double)(m.t.tv_sec - a.t.tv_sec) * 1e3 + (double)(m.t.tv_nsec - a.t.tv_nsec) / 1e6,
+                 (runs[i].flags & YAPB_POOL_MEM_HUGETLB) && !(got & YAPB_POOL_MEM_HUGETLB)
+                     ? ", hugetlb fell back to thp" : "");
+        report(runs[i].name, &m, &b, (uint64_t)total * buf_size, total, note);
+    }
+    return 0;
+}
+
+/* ======== Prefetching replay ======== */
+
+// Decode every element, as a consumer of the log would
+static YAPB_Result_t decode_packet(void *ctx, YAPB_Packet_t *pkt) {
+    uint64_t *sum = ctx;
+    YAPB_Element_t el;
+    while (YAPB_pop_next(pkt, &el) >= 0) {
+        *sum += (uint64_t)el.type;
+    }
+    return YAPB_OK;
+}
+
+static int bench_replay(const char *prog, const char *path, unsigned distance) {
+    YAPB_LogMap_t map;
+    YAPB_Result_t r = YAPB_log_map(&map, path, YAPB_MAP_POPULATE);
+    if (r != YAPB_OK) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, YAPB_Result_str(r));
+        return 1;
+    }
+    size_t len;
+    const uint8_t *data = YAPB_log_get_data(&map, &len);
+    unsigned distances[] = { 0, 8, 32, 128, distance };
+    uint64_t sum = 0;
+
+    // Plain header walk as the baseline
+    Mark a, b;
+    mark(&a);
+    size_t off = 0, pkt_len;
+    const uint8_t *raw;
+    uint64_t packets = 0;
+    while (YAPB_log_next(data, len, &off, &raw, &pkt_len) == YAPB_OK) {
+        YAPB_Packet_t pkt;
+        YAPB_load(&pkt, raw, pkt_len);
+        decode_packet(&sum, &pkt);
+        packets++;
+    }
+    mark(&b);
+    report("log_next", &a, &b, len, packets, "");
+
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "reader d=%u", distances[i]);
+        YAPB_BatchReader_t rd;
+        YAPB_Packet_t pkt;
+        mark(&a);
+        YAPB_batch_reader_init(&rd, data, len, distances[i]);
+        while (YAPB_batch_reader_next(&rd, &pkt) == YAPB_OK) {
+            decode_packet(&sum, &pkt);
+        }
+        mark(&b);
+        report(name, &a, &b, len, packets, "");
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "for_each d=%u", distance);
+    mark(&a);
+    r = YAPB_batch_for_each(data, len, distance, decode_packet, &sum);
+    mark(&b);
+    report(name, &a, &b, len, packets, r == YAPB_OK ? "" : YAPB_Result_str(r));
+    sink += sum;
+    YAPB_log_unmap(&map);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s map [-c] [-w KiB] FILE\n"
+        "       %s pool [-m MiB] [-b BYTES]\n"
+        "       %s replay [-d N] FILE\n"
+        "  -c        drop FILE from the page cache before each run (cold replay)\n"
+        "  -w KiB    prefetch window for the windowed replay (default 4096)\n"
+        "  -m MiB    pool memory (default 256)\n"
+        "  -b BYTES  pool buffer size (default 2048)\n"
+        "  -d N      prefetch distance in cache lines for the replay (default 0)\n",
+        prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *mode = argv[1];
+    bool cold = false;
+    size_t window = 4096u << 10, mem_size = 256u << 20, buf_size = 2048;
+    unsigned distance = YAPB_BATCH_PREFETCH_DEFAULT;
+    int opt;
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, "cw:m:b:d:h")) != -1) {
+        switch (opt) {
+            case 'c': cold = true; break;
+            case 'w': window = (size_t)strtoull(optarg, NULL, 10) << 10; break;
+            case 'm': mem_size = (size_t)strtoull(optarg, NULL, 10) << 20; break;
+            case 'b': buf_size = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'd': distance = (unsigned)strtoul(optarg, NULL, 10); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (strcmp(mode, "map") == 0 && argc - optind == 1 && window > 0) {
+        return bench_map(argv[0], argv[optind], cold, window);
+    }
+    if (strcmp(mode, "replay") == 0 && argc - optind == 1) {
+        return bench_replay(argv[0], argv[optind], distance);
+    }
+    if (strcmp(mode, "pool") == 0 && argc == optind && mem_size > 0 && buf_size >= 64) {
+        return bench_pool(argv[0], mem_size, buf_size);
+    }
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,801 @@
+/*
+ * yapb-loadgen: drive a YAPB service at a target packet rate and measure
+ * echo latency.
+ *
+ *   yapb-loadgen run [-p PROFILE] [-r RATE] [-c CONNS] [-j THREADS] [-t SECONDS] [-s SEED] ADDR
+ *   yapb-loadgen echo ADDR
+ *
+ * ADDR is tcp:HOST:PORT, udp:HOST:PORT or unix:PATH. `echo` is a loopback
+ * stand-in for a service: it writes back every byte (or datagram) it gets.
+ *
+ * Load is open loop: packet k of a thread is due at start + k / rate whether
+ * or not earlier echoes have come back, and its latency counts from that due
+ * time. A service that stalls shows up as latency, not as a lower send rate.
+ * Each packet is { i64 due time (CLOCK_MONOTONIC ns), nested payload }, so
+ * the echo alone gives the latency. Payloads are drawn from a profile by a
+ * seeded generator, so two runs with the same seed send the same bytes.
+ */
+#define _GNU_SOURCE
+#include "yapb.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEMPLATES    256            // payloads generated per run
+#define PAYLOAD_MAX  8192           // largest payload packet
+#define PKT_MAX      (PAYLOAD_MAX + 32)
+#define OUT_CAP      (256u << 10)   // queued bytes per stream connection
+#define IN_CAP       (PKT_MAX * 8)  // receive buffer per stream connection
+#define ECHO_BUF     (64u << 10)
+
+static int64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* ======== Seeded payload profiles ======== */
+
+// splitmix64: small state, good enough spread for test data
+typedef struct {
+    uint64_t s;
+} Rng;
+
+static uint64_t rng_next(Rng *r) {
+    uint64_t z = (r->s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint32_t rng_below(Rng *r, uint32_t n) {
+    return (uint32_t)(rng_next(r) % n);
+}
+
+// The element mix of fuzzers/gen_corpus.c: 1-16 scalars, short blobs and
+// nested packets up to two levels deep
+static void gen_mixed(Rng *r, YAPB_Packet_t *pkt, int depth) {
+    int count = 1 + (int)rng_below(r, 16);
+    for (int i = 0; i < count; i++) {
+        uint32_t type = rng_below(r, 8);
+        if (type == 7 && depth >= 2) type = rng_below(r, 7);
+        uint64_t x = rng_next(r);
+
+        switch (type) {
+            case 0: { int8_t v = (int8_t)x; YAPB_push_i8(pkt, &v); break; }
+            case 1: { int16_t v = (int16_t)x; YAPB_push_i16(pkt, &v); break; }
+            case 2: { int32_t v = (int32_t)x; YAPB_push_i32(pkt, &v); break; }
+            case 3: { int64_t v = (int64_t)x; YAPB_push_i64(pkt, &v); break; }
+            case 4: { float v = (float)(x >> 40) / (float)(1 + (x & 0xFFFF)); YAPB_push_float(pkt, &v); break; }
+            case 5: { double v = (double)(x >> 11) / (double)(1 + (x & 0xFFFF)); YAPB_push_double(pkt, &v); break; }
+            case 6: {
+                uint8_t blob[64];
+                uint16_t len = (uint16_t)rng_below(r, sizeof(blob) + 1);
+                for (uint16_t j = 0; j < len; j++) blob[j] = (uint8_t)rng_next(r);
+                YAPB_push_blob(pkt, blob, len);
+                break;
+            }
+            case 7: {
+                uint8_t nbuf[PAYLOAD_MAX / 4];
+                YAPB_Packet_t nested;
+                YAPB_initialize(&nested, nbuf, sizeof(nbuf));
+                gen_mixed(r, &nested, depth + 1);
+                if (YAPB_finalize(&nested, NULL) == YAPB_OK) {
+                    YAPB_push_nested(pkt, &nested);
+                }
+                break;
+            }
+        }
+        if (YAPB_get_error(pkt) < 0) break;
+    }
+}
+
+// 1-4 integers: per-packet overhead dominates
+static void gen_small(Rng *r, YAPB_Packet_t *pkt, int depth) {
+    (void)depth;
+    int count = 1 + (int)rng_below(r, 4);
+    for (int i = 0; i < count; i++) {
+        int32_t v = (int32_t)rng_next(r);
+        YAPB_push_i32(pkt, &v);
+    }
+}
+
+// A sensor reading batch: start time, sensor id, then 8 timestamped values
+static void gen_telemetry(Rng *r, YAPB_Packet_t *pkt, int depth) {
+    (void)depth;
+    int64_t t = 1700000000000000000LL + (int64_t)(rng_next(r) >> 24);
+    int32_t id = (int32_t)rng_below(r, 10000);
+    YAPB_push_timestamp(pkt, &t);
+    YAPB_push_i32(pkt, &id);
+    for (int i = 0; i < 8; i++) {
+        t += 1000000 + rng_below(r, 1000);
+        double v = (double)rng_below(r, 100000) / 100.0;
+        YAPB_push_timestamp_delta(pkt, &t);
+        YAPB_push_double(pkt, &v);
+    }
+}
+
+// One blob of 256-4096 bytes: bandwidth rather than packet rate
+static void gen_bulk(Rng *r, YAPB_Packet_t *pkt, int depth) {
+    (void)depth;
+    static uint8_t blob[4096];
+    uint16_t len = (uint16_t)(256 + rng_below(r, sizeof(blob) - 256 + 1));
+    for (uint16_t j = 0; j < len; j++) blob[j] = (uint8_t)rng_next(r);
+    YAPB_push_blob(pkt, blob, len);
+}
+
+static const struct {
+    const char *name;
+    void (*gen)(Rng *r, YAPB_Packet_t *pkt, int depth);
+} profiles[] = {
+    { "mixed",     gen_mixed },
+    { "small",     gen_small },
+    { "telemetry", gen_telemetry },
+    { "bulk",      gen_bulk },
+};
+
+typedef struct {
+    uint8_t *mem;                   // TEMPLATES x PAYLOAD_MAX
+    YAPB_Packet_t pkt[TEMPLATES];   // finalized payloads
+    size_t min_len, max_len, total_len;
+} Templates;
+
+// A packet that overflows PAYLOAD_MAX is drawn again, which keeps the
+// sequence deterministic for a given seed
+static int templates_make(Templates *t, size_t profile, uint64_t seed) {
+    t->mem = malloc((size_t)TEMPLATES * PAYLOAD_MAX);
+    if (t->mem == NULL) {
+        return -1;
+    }
+    Rng r = { seed };
+    t->min_len = SIZE_MAX;
+    t->max_len = t->total_len = 0;
+    for (size_t i = 0; i < TEMPLATES; i++) {
+        size_t len;
+        do {
+            YAPB_initialize(&t->pkt[i], t->mem + i * PAYLOAD_MAX, PAYLOAD_MAX);
+            profiles[profile].gen(&r, &t->pkt[i], 0);
+        } while (YAPB_finalize(&t->pkt[i], &len) != YAPB_OK);
+        t->min_len = len < t->min_len ? len : t->min_len;
+        t->max_len = len > t->max_len ? len : t->max_len;
+        t->total_len += len;
+    }
+    return 0;
+}
+
+/* ======== Latency histogram ======== */
+
+// Log-linear buckets: 32 per power of two, so values within ~3%
+#define HIST_SUB     5
+#define HIST_BUCKETS ((64 - HIST_SUB + 1) << HIST_SUB)
+
+typedef struct {
+    uint64_t count[HIST_BUCKETS];
+    uint64_t n;
+    int64_t max;
+} Hist;
+
+static size_t hist_index(uint64_t v) {
+    if (v < (1u << HIST_SUB)) {
+        return (size_t)v;
+    }
+    unsigned e = 63 - (unsigned)__builtin_clzll(v);
+    return ((size_t)(e - HIST_SUB + 1) << HIST_SUB) | ((v >> (e - HIST_SUB)) & ((1u << HIST_SUB) - 1));
+}
+
+static uint64_t hist_value(size_t i) {
+    if (i < (1u << HIST_SUB)) {
+        return i;
+    }
+    unsigned e = (unsigned)(i >> HIST_SUB) + HIST_SUB - 1;
+    uint64_t sub = i & ((1u << HIST_SUB) - 1);
+    return ((1ULL << HIST_SUB) | sub) << (e - HIST_SUB);
+}
+
+static void hist_add(Hist *h, int64_t ns) {
+    if (ns < 0) ns = 0;
+    h->count[hist_index((uint64_t)ns)]++;
+    h->n++;
+    h->max = ns > h->max ? ns : h->max;
+}
+
+static void hist_merge(Hist *dst, const Hist *src) {
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        dst->count[i] += src->count[i];
+    }
+    dst->n += src->n;
+    dst->max = src->max > dst->max ? src->max : dst->max;
+}
+
+static uint64_t hist_percentile(const Hist *h, double p) {
+    uint64_t want = (uint64_t)(p / 100.0 * (double)h->n + 0.5), seen = 0;
+    if (want == 0) want = 1;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->count[i];
+        if (seen >= want) {
+            return hist_value(i);
+        }
+    }
+    return (uint64_t)h->max;
+}
+
+static const char *fmt_ns(char *buf, size_t size, double ns) {
+    if (ns < 1e3) snprintf(buf, size, "%.0f ns", ns);
+    else if (ns < 1e6) snprintf(buf, size, "%.1f us", ns / 1e3);
+    else if (ns < 1e9) snprintf(buf, size, "%.2f ms", ns / 1e6);
+    else snprintf(buf, size, "%.2f s", ns / 1e9);
+    return buf;
+}
+
+/* ======== Addresses ======== */
+
+typedef struct {
+    int family;
+    int socktype;
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+} Addr;
+
+static int addr_parse(const char *spec, Addr *out) {
+    memset(out, 0, sizeof(*out));
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un *un = (struct sockaddr_un *)&out->sa;
+        if (strlen(spec + 5) == 0 || strlen(spec + 5) >= sizeof(un->sun_path)) {
+            return -1;
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, spec + 5);
+        out->family = AF_UNIX;
+        out->socktype = SOCK_STREAM;
+        out->sa_len = sizeof(*un);
+        return 0;
+    }
+    if (strncmp(spec, "tcp:", 4) == 0) {
+        out->socktype = SOCK_STREAM;
+    } else if (strncmp(spec, "udp:", 4) == 0) {
+        out->socktype = SOCK_DGRAM;
+    } else {
+        return -1;
+    }
+
+    // HOST:PORT, with an IPv6 host in brackets
+    char host[256];
+    const char *port = strrchr(spec + 4, ':');
+    size_t host_len = port ? (size_t)(port - (spec + 4)) : 0;
+    if (port == NULL || host_len >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, spec + 4, host_len);
+    host[host_len] = '\0';
+    char *h = host;
+    if (host_len >= 2 && h[0] == '[' && h[host_len - 1] == ']') {
+        h[host_len - 1] = '\0';
+        h++;
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = out->socktype }, *res;
+    if (getaddrinfo(h, port + 1, &hints, &res) != 0) {
+        return -1;
+    }
+    memcpy(&out->sa, res->ai_addr, res->ai_addrlen);
+    out->sa_len = res->ai_addrlen;
+    out->family = res->ai_family;
+    freeaddrinfo(res);
+    return 0;
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Connected, non-blocking socket; -1 with errno set on failure
+static int addr_dial(const Addr *a) {
+    int fd = socket(a->family, a->socktype | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)&a->sa, a->sa_len) != 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    if (a->family != AF_UNIX && a->socktype == SOCK_STREAM) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+/* ======== Load generator ======== */
+
+typedef struct {
+    const Templates *tmpl;
+    double rate;        // packets per second over all threads
+    unsigned threads;
+    int64_t start;      // due time of the first packet
+    int64_t end;        // no packet is due at or after this
+    int64_t drain;      // how long to wait for echoes after the last send
+} RunConfig;
+
+typedef struct {
+    int fd;             // -1 once failed
+    bool stream;
+    size_t out_off, out_len;
+    size_t in_len;
+    uint8_t *out;       // OUT_CAP bytes queued for sending (streams)
+    uint8_t *in;        // IN_CAP bytes of partial packets (streams)
+} Conn;
+
+typedef struct {
+    const RunConfig *cfg;
+    unsigned id;
+    Conn *conns;
+    unsigned nconns;
+    uint64_t sent, echoed, dropped, errors;
+    uint64_t bytes_sent, bytes_echoed;
+    int64_t last_send, last_echo;
+    Hist hist;
+} Worker;
+
+static void conn_fail(Worker *w, Conn *c) {
+    close(c->fd);
+    c->fd = -1;
+    w->errors++;
+}
+
+static void on_echo(Worker *w, const uint8_t *p, size_t len, int64_t now) {
+    YAPB_Packet_t pkt;
+    int64_t due;
+    if (YAPB_load(&pkt, p, len) != YAPB_OK || YAPB_pop_i64(&pkt, &due) < 0) {
+        w->errors++;
+        return;
+    }
+    hist_add(&w->hist, now - due);
+    w->echoed++;
+    w->bytes_echoed += len;
+    w->last_echo = now;
+}
+
+static void conn_flush(Worker *w, Conn *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->out_off += (size_t)n;
+        } else if (errno != EINTR) {
+            if (errno != EAGAIN) conn_fail(w, c);
+            return;
+        }
+    }
+    c->out_off = c->out_len = 0;
+}
+
+// Datagram sockets take one packet per read; streams are split on headers
+static void conn_read(Worker *w, Conn *c) {
+    static _Thread_local uint8_t dgram[PKT_MAX];
+    while (c->fd >= 0) {
+        uint8_t *dst = c->stream ? c->in + c->in_len : dgram;
+        size_t room = c->stream ? IN_CAP - c->in_len : sizeof(dgram);
+        ssize_t n = recv(c->fd, dst, room, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            return;
+        }
+        if (!c->stream) {
+            // Errors here are ICMP reports for earlier datagrams
+            if (n >= 0) on_echo(w, dgram, (size_t)n, now_ns());
+            else w->errors++;
+            continue;
+        }
+        if (n <= 0) {
+            conn_fail(w, c);
+            return;
+        }
+        c->in_len += (size_t)n;
+
+        int64_t now = now_ns();
+        size_t off = 0;
+        while (c->in_len - off >= YAPB_HEADER_SIZE) {
+            uint32_t len;
+            memcpy(&len, c->in + off, 4);
+            len = ntohl(len);
+            if (len < YAPB_HEADER_SIZE || len > IN_CAP) {
+                conn_fail(w, c);
+                return;
+            }
+            if (c->in_len - off < len) {
+                break;
+            }
+            on_echo(w, c->in + off, len, now);
+            off += len;
+        }
+        memmove(c->in, c->in + off, c->in_len - off);
+        c->in_len -= off;
+    }
+}
+
+// Queue one packet; a packet that finds no room is dropped, never delayed,
+// so the schedule holds however far behind the service is
+static void send_one(Worker *w, Conn *c, int64_t due, const YAPB_Packet_t *payload) {
+    uint8_t dgram[PKT_MAX];
+    uint8_t *dst = dgram;
+    size_t room = sizeof(dgram), len;
+    if (c->fd < 0) {
+        w->dropped++;
+        return;
+    }
+    if (c->stream) {
+        if (c->out_off > 0 && OUT_CAP - c->out_len < PKT_MAX) {
+            memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+            c->out_len -= c->out_off;
+            c->out_off = 0;
+        }
+        dst = c->out + c->out_len;
+        room = OUT_CAP - c->out_len;
+    }
+
+    YAPB_Packet_t pkt;
+    YAPB_initialize(&pkt, dst, room);
+    YAPB_push_i64(&pkt, &due);
+    YAPB_push_nested(&pkt, payload);
+    if (YAPB_finalize(&pkt, &len) != YAPB_OK) {
+        w->dropped++;
+        return;
+    }
+    if (c->stream) {
+        c->out_len += len;
+        conn_flush(w, c);
+    } else if (send(c->fd, dgram, len, MSG_NOSIGNAL) != (ssize_t)len) {
+        w->dropped++;
+        return;
+    }
+    w->sent++;
+    w->bytes_sent += len;
+    w->last_send = due;
+}
+
+static void *run_worker(void *arg) {
+    Worker *w = arg;
+    const RunConfig *cfg = w->cfg;
+    struct epoll_event ev, evs[64];
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    for (unsigned i = 0; i < w->nconns; i++) {
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = &w->conns[i];
+        epoll_ctl(ep, EPOLL_CTL_ADD, w->conns[i].fd, &ev);
+    }
+
+    // Threads interleave: packet k of thread i is packet k * threads + i
+    // of the whole run
+    double interval = 1e9 * cfg->threads / cfg->rate;
+    int64_t offset = (int64_t)(1e9 / cfg->rate * w->id);
+    uint64_t k = 0;
+    int64_t due = cfg->start + offset, stop_at = cfg->end + cfg->drain;
+    for (;;) {
+        int64_t now = now_ns();
+        while (due < cfg->end && due <= now) {
+            size_t t = (size_t)((k * cfg->threads + w->id) % TEMPLATES);
+            send_one(w, &w->conns[k % w->nconns], due, &cfg->tmpl->pkt[t]);
+            k++;
+            due = cfg->start + offset + (int64_t)(interval * (double)k);
+        }
+        bool sending = due < cfg->end;
+        if (!sending && (w->echoed >= w->sent || now >= stop_at)) {
+            break;
+        }
+
+        // Millisecond timeouts: spin when the next packet is due sooner
+        int64_t wait = (sending ? due : stop_at) - now;
+        int n = epoll_wait(ep, evs, 64, wait > 0 ? (int)(wait / 1000000) : 0);
+        for (int i = 0; i < n; i++) {
+            Conn *c = evs[i].data.ptr;
+            if (c->fd >= 0 && (evs[i].events & EPOLLOUT)) conn_flush(w, c);
+            if (c->fd >= 0 && (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) conn_read(w, c);
+        }
+    }
+    close(ep);
+    return NULL;
+}
+
+static int run_load(const char *prog, const char *spec, size_t profile, double rate,
+                    unsigned nconns, unsigned threads, double seconds, uint64_t seed) {
+    Addr addr;
+    if (addr_parse(spec, &addr) != 0) {
+        fprintf(stderr, "%s: invalid address '%s'\n", prog, spec);
+        return 2;
+    }
+    static Templates tmpl;
+    if (templates_make(&tmpl, profile, seed) != 0) {
+        fprintf(stderr, "%s: out of memory\n", prog);
+        return 1;
+    }
+
+    bool stream = addr.socktype == SOCK_STREAM;
+    Conn *conns = calloc(nconns, sizeof(*conns));
+    Worker *workers = calloc(threads, sizeof(*workers));
+    pthread_t *tids = calloc(threads, sizeof(*tids));
+    if (conns == NULL || workers == NULL || tids == NULL) {
+        fprintf(stderr, "%s: out of memory\n", prog);
+        return 1;
+    }
+    for (unsigned i = 0; i < nconns; i++) {
+        conns[i].stream = stream;
+        conns[i].fd = addr_dial(&addr);
+        if (conns[i].fd < 0) {
+            fprintf(stderr, "%s: %s: %s\n", prog, spec, strerror(errno));
+            return 1;
+        }
+        if (stream) {
+            conns[i].out = malloc(OUT_CAP);
+            conns[i].in = malloc(IN_CAP);
+            if (conns[i].out == NULL || conns[i].in == NULL) {
+                fprintf(stderr, "%s: out of memory\n", prog);
+                return 1;
+            }
+        }
+    }
+
+    // Connections are split evenly, the first threads taking the remainder
+    RunConfig cfg = { .tmpl = &tmpl, .rate = rate, .threads = threads,
+                      .drain = 1000000000 };
+    cfg.start = now_ns() + 10000000;
+    cfg.end = cfg.start + (int64_t)(seconds * 1e9);
+    for (unsigned i = 0, first = 0; i < threads; i++) {
+        workers[i].cfg = &cfg;
+        workers[i].id = i;
+        workers[i].conns = conns + first;
+        workers[i].nconns = nconns / threads + (i < nconns % threads);
+        first += workers[i].nconns;
+        pthread_create(&tids[i], NULL, run_worker, &workers[i]);
+    }
+
+    static Hist hist;
+    uint64_t sent = 0, echoed = 0, dropped = 0, errors = 0, bytes_sent = 0, bytes_echoed = 0;
+    int64_t last_send = cfg.start, last_echo = cfg.start;
+    for (unsigned i = 0; i < threads; i++) {
+        Worker *w = &workers[i];
+        pthread_join(tids[i], NULL);
+        hist_merge(&hist, &w->hist);
+        sent += w->sent;
+        echoed += w->echoed;
+        dropped += w->dropped;
+        errors += w->errors;
+        bytes_sent += w->bytes_sent;
+        bytes_echoed += w->bytes_echoed;
+        last_send = w->last_send > last_send ? w->last_send : last_send;
+        last_echo = w->last_echo > last_echo ? w->last_echo : last_echo;
+    }
+
+    double send_s = (double)(last_send - cfg.start) / 1e9 + 1.0 / rate;
+    double echo_s = (double)(last_echo - cfg.start) / 1e9;
+    printf("profile   %s, seed %llu: %d payloads of %zu-%zu bytes (mean %.0f)\n",
+           profiles[profile].name, (unsigned long long)seed, TEMPLATES,
+           tmpl.min_len, tmpl.max_len, (double)tmpl.total_len / TEMPLATES);
+    printf("target    %.0f pkt/s for %.1f s over %u %s connections, %u sender threads\n",
+           rate, seconds, nconns, addr.family == AF_UNIX ? "unix" : stream ? "tcp" : "udp", threads);
+    printf("sent      %12llu packets %12.0f pkt/s %9.1f MiB/s   %llu dropped\n",
+           (unsigned long long)sent, (double)sent / send_s, (double)bytes_sent / (1 << 20) / send_s,
+           (unsigned long long)dropped);
+    printf("echoed    %12llu packets %12.0f pkt/s %9.1f MiB/s   %llu lost, %llu errors\n",
+           (unsigned long long)echoed, echo_s > 0 ? (double)echoed / echo_s : 0.0,
+           echo_s > 0 ? (double)bytes_echoed / (1 << 20) / echo_s : 0.0,
+           (unsigned long long)(sent - echoed), (unsigned long long)errors);
+    if (hist.n > 0) {
+        static const double pct[] = { 50, 90, 99, 99.9, 99.99 };
+        char b[32];
+        printf("latency  ");
+        for (size_t i = 0; i < sizeof(pct) / sizeof(pct[0]); i++) {
+            printf(" p%g %s ", pct[i], fmt_ns(b, sizeof(b), (double)hist_percentile(&hist, pct[i])));
+        }
+        printf(" max %s\n", fmt_ns(b, sizeof(b), (double)hist.max));
+    }
+
+    for (unsigned i = 0; i < nconns; i++) {
+        if (conns[i].fd >= 0) close(conns[i].fd);
+        free(conns[i].out);
+        free(conns[i].in);
+    }
+    free(conns);
+    free(workers);
+    free(tids);
+    free(tmpl.mem);
+    return 0;
+}
+
+/* ======== Echo server ======== */
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+typedef struct {
+    int fd;
+    size_t off, len;
+    uint8_t buf[ECHO_BUF];
+} EchoConn;
+
+// Write back what was read, reading more only once it has all gone out.
+// Returns false when the connection is done.
+static bool echo_pump(EchoConn *c) {
+    for (;;) {
+        while (c->off < c->len) {
+            ssize_t n = send(c->fd, c->buf + c->off, c->len - c->off, MSG_NOSIGNAL);
+            if (n > 0) {
+                c->off += (size_t)n;
+            } else if (errno != EINTR) {
+                return errno == EAGAIN;
+            }
+        }
+        ssize_t n = recv(c->fd, c->buf, sizeof(c->buf), 0);
+        if (n > 0) {
+            c->off = 0;
+            c->len = (size_t)n;
+        } else if (n == 0 || errno != EINTR) {
+            return n < 0 && errno == EAGAIN;
+        }
+    }
+}
+
+static void echo_datagrams(int fd) {
+    static uint8_t buf[65536];
+    for (;;) {
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return;
+        }
+        // A full socket buffer drops the echo, as the network would
+        sendto(fd, buf, (size_t)n, MSG_NOSIGNAL, (struct sockaddr *)&from, from_len);
+    }
+}
+
+static int run_echo(const char *prog, const char *spec) {
+    Addr addr;
+    if (addr_parse(spec, &addr) != 0) {
+        fprintf(stderr, "%s: invalid address '%s'\n", prog, spec);
+        return 2;
+    }
+    bool stream = addr.socktype == SOCK_STREAM;
+    const char *unix_path = addr.family == AF_UNIX ? ((struct sockaddr_un *)&addr.sa)->sun_path : NULL;
+    int lfd = socket(addr.family, addr.socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    int one = 1;
+    if (unix_path != NULL) {
+        unlink(unix_path);
+    } else if (lfd >= 0) {
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (lfd < 0 || bind(lfd, (const struct sockaddr *)&addr.sa, addr.sa_len) != 0 ||
+        (stream && listen(lfd, SOMAXCONN) != 0)) {
+        fprintf(stderr, "%s: %s: %s\n", prog, spec, strerror(errno));
+        return 1;
+    }
+
+    // No SA_RESTART, so a signal ends epoll_wait()
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }, evs[64];
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+    fprintf(stderr, "%s: echoing on %s\n", prog, spec);
+
+    while (!stopping) {
+        int n = epoll_wait(ep, evs, 64, -1);
+        for (int i = 0; i < n; i++) {
+            EchoConn *c = evs[i].data.ptr;
+            if (c != NULL) {
+                if (!echo_pump(c)) {
+                    close(c->fd);
+                    free(c);
+                }
+                continue;
+            }
+            if (!stream) {
+                echo_datagrams(lfd);
+                continue;
+            }
+            int fd;
+            while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                c = malloc(sizeof(*c));
+                if (c == NULL) {
+                    close(fd);
+                    continue;
+                }
+                c->fd = fd;
+                c->off = c->len = 0;
+                if (unix_path == NULL) {
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                ev.data.ptr = c;
+                epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+            }
+        }
+    }
+    close(ep);
+    close(lfd);
+    if (unix_path != NULL) {
+        unlink(unix_path);
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s run [-p PROFILE] [-r RATE] [-c CONNS] [-j THREADS] [-t SECONDS] [-s SEED] ADDR\n"
+        "       %s echo ADDR\n"
+        "  ADDR        tcp:HOST:PORT, udp:HOST:PORT or unix:PATH\n"
+        "  -p PROFILE  payload shape: mixed (default), small, telemetry, bulk\n"
+        "  -r RATE     target packets per second over all connections (default 10000)\n"
+        "  -c CONNS    connections (default 4)\n"
+        "  -j THREADS  sending threads, at most CONNS (default 1)\n"
+        "  -t SECONDS  run time (default 10)\n"
+        "  -s SEED     payload generator seed (default 1)\n",
+        prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *mode = argv[1];
+    const char *profile_name = "mixed";
+    double rate = 10000, seconds = 10;
+    unsigned nconns = 4, threads = 1;
+    uint64_t seed = 1;
+    int opt;
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, "p:r:c:j:t:s:h")) != -1) {
+        switch (opt) {
+            case 'p': profile_name = optarg; break;
+            case 'r': rate = strtod(optarg, NULL); break;
+            case 'c': nconns = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'j': threads = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 't': seconds = strtod(optarg, NULL); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    size_t profile = 0;
+    while (profile < sizeof(profiles) / sizeof(profiles[0]) && strcmp(profiles[profile].name, profile_name) != 0) {
+        profile++;
+    }
+    if (strcmp(mode, "run") == 0 && argc - optind == 1 && profile < sizeof(profiles) / sizeof(profiles[0]) &&
+        rate > 0 && seconds > 0 && threads > 0 && nconns >= threads) {
+        return run_load(argv[0], argv[optind], profile, rate, nconns, threads, seconds, seed);
+    }
+    if (strcmp(mode, "echo") == 0 && argc - optind == 1) {
+        return run_echo(argv[0], argv[optind]);
+    }
+    usage(argv[0]);
+    return 2;
+}